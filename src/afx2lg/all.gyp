@@ -11,6 +11,7 @@
         '../bcl/bcl.gyp:*',
         'axe_backup/axe_backup.gyp:*',
         'axe_http/axe_http.gyp:*',
+        'axe_import/axe_import.gyp:*',
         'axe_loader/axe_loader.gyp:*',
         'axys/axys.gyp:*',
         'main/afx2lg.gyp:*',
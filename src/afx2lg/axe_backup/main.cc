@@ -3,29 +3,49 @@
 
 #include "common/common_types.h"
 
+#include "axefx/axe_fx_sysex_parser.h"
 #include "axefx/preset.h"
+#include "axefx/preset_archive.h"
 #include "axefx/sysex_types.h"
 #include "common/file_utils.h"
-#include "json/writer.h"
+#include "common/json_writer.h"
+#include "common/thread_pool.h"
+#include "midi/message_pool.h"
+#include "midi/midi_capture.h"
 #include "midi/midi_in.h"
 #include "midi/midi_out.h"
+#include "midi/midi_stats.h"
+#include "midi/simulated_axefx.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <ctime>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 using axefx::BankDumpRequest;
 using base::FileExists;
+using base::MemoryMappedFile;
 using base::SharedThreadLoop;
 using std::placeholders::_1;
 using std::placeholders::_2;
 
+// Every bank dump, including the system bank, is 128 presets.
+const size_t kPresetsPerBank = 128u;
+
 void PrintUsage() {
   std::cerr <<
       "Usage:\n\n"
-      "  axebackup [-a] [-b] [-c] [-s] [-j]\n"
+      "  axebackup [-a] [-b] [-c] [-s] [-j | -jc] [-archive]"
+      " [-device=<name>]\n"
+      "            [-sim=<path>] [-simrate=<n>] [-record=<path>]\n"
+      "            [-replay=<path> | -replayfast=<path>] [-stats]\n"
       "\n"
       "    -a     Creates a backup of bank A (presets 0-127).\n"
       "           The file will be stored in the current directory with the\n"
@@ -37,14 +57,52 @@ void PrintUsage() {
       "\n"
       "    -j     Writes out a JSON file for each bank.\n"
       "\n"
-      "If no arguments are given, a backup will be created for all banks and\n"
+      "    -jc    Same as -j, but the JSON is written without whitespace.\n"
+      "\n"
+      "    -archive\n"
+      "           Also writes each bank as a preset archive (.axfp), which\n"
+      "           is smaller than the .syx file and can be restored with\n"
+      "           axeloader.\n"
+      "\n"
+      "    -device=<name>\n"
+      "           Backs up the MIDI device whose name contains <name>, or\n"
+      "           the device at that position if <name> is a number.\n"
+      "           Can be given more than once to back up several units at\n"
+      "           the same time.  The files for each unit are then prefixed\n"
+      "           with Unit<n>_.  By default, the first AxeFx is used.\n"
+      "\n"
+      "    -sim=<path>\n"
+      "           Backs up a simulated AxeFx instead of the unit, with the\n"
+      "           presets in the given .syx file.  For testing and timing.\n"
+      "           Like -device, can be given more than once.\n"
+      "\n"
+      "    -simrate=<n>\n"
+      "           Bytes per second for the simulated connection.  3125 is\n"
+      "           the speed of a MIDI cable and 0 means unlimited.\n"
+      "           The default is roughly USB speed.\n"
+      "\n"
+      "    -record=<path>\n"
+      "           Records all MIDI traffic, with timestamps, to a capture\n"
+      "           file.\n"
+      "\n"
+      "    -replay=<path>\n"
+      "           Runs against a recorded capture instead of the unit, at\n"
+      "           the pace it was recorded at.  -replayfast replays it as\n"
+      "           fast as possible.\n"
+      "\n"
+      "    -stats Prints MIDI timing and throughput statistics when done.\n"
+      "\n"
+      "If no banks are given, a backup will be created for all banks and\n"
       "system data.\n\n";
 }
 
 struct Options {
   // Constructor sets the program defaults.
   Options()
-      : bank_a(true), bank_b(true), bank_c(true), system(true), json(false) {}
+      : bank_a(true), bank_b(true), bank_c(true), system(true), json(false),
+        json_compact(false), archive(false),
+        simulate_rate(midi::SimulatedAxeFx::kUsbBytesPerSecond),
+        replay_fast(false), stats(false) {}
 
   bool bank_a;
   bool bank_b;
@@ -52,6 +110,21 @@ struct Options {
   bool system;
 
   bool json;
+  bool json_compact;
+  bool archive;
+
+  // Devices to back up.  If both are empty, the first AxeFx is used.
+  std::vector<std::string> devices;
+  // Paths to the presets of simulated units.
+  std::vector<std::string> simulate;
+  size_t simulate_rate;
+
+  // Capture files to write to or replay from.
+  std::string record;
+  std::string replay;
+  bool replay_fast;
+
+  bool stats;
 };
 
 bool ParseArgs(int argc, char* argv[], Options* options) {
@@ -63,6 +136,7 @@ bool ParseArgs(int argc, char* argv[], Options* options) {
   options->bank_c = false;
   options->system = false;
   options->json = false;
+  options->json_compact = false;
 
   struct {
     const char* name;
@@ -73,10 +147,39 @@ bool ParseArgs(int argc, char* argv[], Options* options) {
     { "-c", &options->bank_c },
     { "-s", &options->system },
     { "-j", &options->json },
+    { "-jc", &options->json_compact },
+    { "-archive", &options->archive },
+    { "-stats", &options->stats },
   };
 
   for (int i = 1; i < argc; ++i) {
     std::string arg(argv[i]);
+    if (arg.compare(0, 8, "-device=") == 0) {
+      options->devices.push_back(arg.substr(8));
+      continue;
+    }
+    if (arg.compare(0, 5, "-sim=") == 0) {
+      options->simulate.push_back(arg.substr(5));
+      continue;
+    }
+    if (arg.compare(0, 9, "-simrate=") == 0) {
+      options->simulate_rate = strtoul(arg.c_str() + 9, NULL, 10);
+      continue;
+    }
+    if (arg.compare(0, 8, "-record=") == 0) {
+      options->record = arg.substr(8);
+      continue;
+    }
+    if (arg.compare(0, 8, "-replay=") == 0) {
+      options->replay = arg.substr(8);
+      continue;
+    }
+    if (arg.compare(0, 12, "-replayfast=") == 0) {
+      options->replay = arg.substr(12);
+      options->replay_fast = true;
+      continue;
+    }
+
     bool option_known = false;
     for (size_t j = 0; !option_known && j < arraysize(flags); ++j) {
       if (arg.compare(flags[j].name) == 0) {
@@ -90,6 +193,22 @@ bool ParseArgs(int argc, char* argv[], Options* options) {
       return false;
     }
   }
+
+  if (options->json_compact)
+    options->json = true;
+
+  if ((!options->record.empty() || !options->replay.empty()) &&
+      options->devices.size() + options->simulate.size() > 1u) {
+    std::cerr << "Recording and replaying only work with a single unit.\n";
+    return false;
+  }
+
+  if (!options->bank_a && !options->bank_b && !options->bank_c &&
+      !options->system) {
+    options->bank_a = options->bank_b = options->bank_c = true;
+    options->system = true;
+  }
+
   return true;
 }
 
@@ -112,6 +231,16 @@ std::string GetDate() {
   return stream.str();
 }
 
+// Units are backed up concurrently, so output is written a whole line at a
+// time and prefixed with the unit it's about.
+std::mutex output_lock;
+
+void Print(std::ostream* stream, const std::string& label,
+           const std::string& text) {
+  std::lock_guard<std::mutex> lock(output_lock);
+  *stream << label << text << std::flush;
+}
+
 bool CreateOutputFile(std::string* name, std::ofstream* file) {
   if (FileExists(*name)) {
     size_t i = name->find_last_of('.');
@@ -128,22 +257,50 @@ bool CreateOutputFile(std::string* name, std::ofstream* file) {
   return file->good();
 }
 
+// Writes the received bank dump to |file| and, if |json| is non-null, each
+// preset to |json| as soon as it has been verified.  Presets are not kept
+// around after that, so memory use stays at one preset regardless of how
+// much data is received.
 class BackupWriter {
  public:
-  BackupWriter(std::ofstream* file, const SharedThreadLoop& loop)
-      : file_(file), loop_(loop), bytes_written_(0u), failed_(false) {
+  BackupWriter(std::ofstream* file, base::JsonWriter* json,
+               const SharedThreadLoop& loop, const std::string& label)
+      : file_(file), json_(json), loop_(loop), label_(label),
+        bytes_written_(0u), preset_count_(0u), failed_(false),
+        watchdog_(0u) {
+    if (json_) {
+      json_->BeginObject();
+      json_->Key("bank");
+      json_->BeginArray();
+    }
   }
 
   ~BackupWriter() {
+    if (watchdog_)
+      loop_->CancelTask(watchdog_);
+    if (json_) {
+      json_->EndArray();
+      json_->EndObject();
+      json_->Flush();
+    }
   }
 
   bool failed() const { return !bytes_written_ || failed_; }
-  size_t preset_count() const { return presets_.size(); }
+  size_t preset_count() const { return preset_count_; }
+
+  // Starts the inactivity watchdog.  Called right after the dump has been
+  // requested, on the worker thread.
+  void Start() {
+    last_activity_ = Clock::now();
+    StartWatchdog(kFirstDataTimeout);
+  }
 
   void OnSysEx(midi::Message* msg) {
     if (failed_)
       return;
 
+    last_activity_ = Clock::now();
+
     // Check if the message is recognized as a Fractal message.
     // We'll start by ignoring the message checksum.
     if (!msg->IsFractalMessageNoChecksum()) {
@@ -154,7 +311,7 @@ class BackupWriter {
         OnError(stream.str());
       } else {
 #ifndef NDEBUG
-        std::cout << "Ignoring unrecognized/partial message.\n";
+        Print(&std::cout, label_, "Ignoring unrecognized/partial message.\n");
 #endif
       }
       return;
@@ -164,12 +321,11 @@ class BackupWriter {
         reinterpret_cast<const axefx::FractalSysExHeader*>(&msg->at(0));
     if (header->function() == axefx::TEMPO_HEARTBEAT) {
       if (bytes_written_) {
-        file_->close();
-        loop_->Quit();
+        Done();
       } else {
 #ifndef NDEBUG
-        std::cerr
-            << "Received tempo message before starting to receive dump.\n";
+        Print(&std::cerr, label_,
+              "Received tempo message before starting to receive dump.\n");
 #endif
       }
       return;
@@ -188,8 +344,6 @@ class BackupWriter {
     switch (header->function()) {
       case axefx::PRESET_ID: {
         auto preset_hdr = static_cast<const axefx::PresetIdHeader*>(header);
-        std::cout << preset_hdr->id.As16bit() << ": ";
-
         current_preset_.reset(new axefx::Preset());
         if (!current_preset_->SetPresetId(*preset_hdr, msg->size())) {
           OnError("Failed to parse preset ID header");
@@ -224,8 +378,12 @@ class BackupWriter {
           OnError("Preset checksum verification failed.\n");
           return;
         }
-        std::cout << current_preset_->name() << " <verified>\n";
-        presets_.push_back(std::move(current_preset_));
+        Print(&std::cout, label_, std::to_string(current_preset_->id()) +
+              ": " + current_preset_->name() + " <verified>\n");
+        if (json_)
+          current_preset_->WriteJson(json_);
+        current_preset_.reset();
+        ++preset_count_;
         break;
       }
 
@@ -236,86 +394,215 @@ class BackupWriter {
 
     file_->write(reinterpret_cast<const char*>(&msg->at(0)), msg->size());
     bytes_written_ += msg->size();
+
+    // The checksum of the last preset is the last message of the dump.
+    if (preset_count_ == kPresetsPerBank)
+      Done();
   }
 
-  std::string ToJson() {
-    Json::Value presets;
-    for (auto& p : presets_) {
-      Json::Value preset;
-      p->ToJson(&preset);
-      presets.append(preset);
+ private:
+  typedef base::ThreadLoop::Clock Clock;
+
+  // How long the unit may be silent before and during the dump before the
+  // watchdog gives up.  The dump normally ends after the last preset or
+  // with a tempo message, so the watchdog is only a fallback.
+  static const std::chrono::milliseconds kFirstDataTimeout;
+  static const std::chrono::milliseconds kDataTimeout;
+
+  void StartWatchdog(std::chrono::microseconds delay) {
+    watchdog_ = loop_->QueueDelayedTask(delay,
+        std::bind(&BackupWriter::OnWatchdog, this));
+  }
+
+  void OnWatchdog() {
+    watchdog_ = 0u;
+    std::chrono::microseconds limit(bytes_written_ ? kDataTimeout :
+                                                     kFirstDataTimeout);
+    auto idle = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - last_activity_);
+    if (idle < limit) {
+      StartWatchdog(limit - idle);
+      return;
     }
-    Json::Value root;
-    root["bank"] = presets;
-    Json::StyledWriter writer;
-    return writer.write(root);
+    Print(&std::cerr, label_, bytes_written_ ?
+          "The data stopped coming.\n" : "No data received.\n");
+    Done();
+  }
+
+  void Done() {
+    if (watchdog_) {
+      loop_->CancelTask(watchdog_);
+      watchdog_ = 0u;
+    }
+    file_->close();
+    loop_->Quit();
   }
 
- private:
   void OnError(const std::string& err) {
     if (bytes_written_ == 0u) {
       // Treat errors as just warnings before we actually start to
       // receive data that we expect.  On Mac there can be 'leftovers' in
       // the midi driver that it will give us when we connect.
-      std::cerr << "Warning: " << err << std::endl;
+      Print(&std::cerr, label_, "Warning: " + err + "\n");
       return;
     }
     failed_ = true;
-    std::cerr << "Error: " << err << std::endl;
-    file_->close();
-    loop_->Quit();
+    Print(&std::cerr, label_, "Error: " + err + "\n");
+    Done();
   }
 
   std::ofstream* file_;
+  base::JsonWriter* json_;
   SharedThreadLoop loop_;
+  const std::string label_;
   size_t bytes_written_;
+  size_t preset_count_;
   bool failed_;
   unique_ptr<axefx::Preset> current_preset_;
-  std::vector<unique_ptr<axefx::Preset> > presets_;
+  Clock::time_point last_activity_;
+  base::ThreadLoop::TimerId watchdog_;
 };
 
-int main(int argc, char* argv[]) {
-  Options options;
-  if (!ParseArgs(argc, argv, &options)) {
-    PrintUsage();
-    return -1;
+const std::chrono::milliseconds BackupWriter::kFirstDataTimeout(3000);
+const std::chrono::milliseconds BackupWriter::kDataTimeout(1000);
+
+// Everything that's needed to back up one unit.  The members are declared
+// in the order that they need to be destroyed in reverse.
+struct Unit {
+  Unit() : loop(new base::ThreadLoop()), succeeded(false), elapsed(0) {}
+
+  std::string name;
+  // Prepended to file names and output respectively.  Empty when there's
+  // only one unit.
+  std::string file_prefix;
+  std::string label;
+  midi::MidiStats stats;
+  SharedThreadLoop loop;
+  midi::MidiCapture capture;
+  unique_ptr<midi::SimulatedAxeFx> simulator;
+  unique_ptr<midi::MidiReplayer> replayer;
+  shared_ptr<midi::MidiIn> midi_in;
+  unique_ptr<midi::MidiOut> midi_out;
+  bool succeeded;
+  std::chrono::milliseconds elapsed;
+};
+
+// Opens the devices for |unit|.  |device| is a device name or index, or
+// empty for the first AxeFx, unless |simulate| or |options.replay| is set.
+bool OpenUnit(const Options& options, const std::string& device,
+              const std::string& simulate, Unit* unit) {
+  if (!options.replay.empty()) {
+    midi::MidiCapture replay;
+    if (!replay.Load(options.replay))
+      return false;
+    unit->replayer.reset(new midi::MidiReplayer(replay,
+        options.replay_fast ? midi::MidiReplayer::FULL_SPEED :
+                              midi::MidiReplayer::ORIGINAL_PACE));
+    unit->midi_in = unit->replayer->OpenMidiIn(unit->loop);
+    unit->midi_out = unit->replayer->OpenMidiOut();
+  } else if (!simulate.empty()) {
+    midi::SimulatedAxeFx::Options sim_options;
+    sim_options.bytes_per_second = options.simulate_rate;
+    unit->simulator.reset(new midi::SimulatedAxeFx(sim_options));
+    if (!unit->simulator->LoadPresets(simulate)) {
+      std::cerr << "Failed to load presets from " << simulate << "\n";
+      return false;
+    }
+    unit->midi_in = unit->simulator->OpenMidiIn(unit->loop);
+    unit->midi_out = unit->simulator->OpenMidiOut();
+  } else if (!device.empty()) {
+    unit->midi_in = midi::MidiIn::Open(device, unit->loop);
+    unit->midi_out = midi::MidiOut::Open(device);
+  } else {
+    unit->midi_in = midi::MidiIn::OpenAxeFx(unit->loop);
+    unit->midi_out = midi::MidiOut::OpenAxeFx();
+  }
+  if (!unit->midi_in || !unit->midi_out) {
+    std::cerr << "Failed to open " << (device.empty() ? "AxeFx" : device)
+              << " midi devices\n";
+    return false;
   }
+  unit->name = unit->midi_in->device()->name();
 
-  std::cout << "Opening MIDI devices...\n";
+  if (!options.record.empty()) {
+    unit->capture.set_save_path(options.record);
+    unit->capture.RecordMidiIn(unit->midi_in.get());
+    unit->midi_out = unit->capture.RecordMidiOut(std::move(unit->midi_out));
+  }
 
-  SharedThreadLoop loop(new base::ThreadLoop());
-  shared_ptr<midi::MidiIn> midi_in(midi::MidiIn::OpenAxeFx(loop));
-  unique_ptr<midi::MidiOut> midi_out(midi::MidiOut::OpenAxeFx());
-  if (!midi_in || !midi_out) {
-    std::cerr << "Failed to open AxeFx midi devices\n";
-    return -1;
+  if (options.stats) {
+    unit->stats.RecordLoop(unit->loop.get());
+    unit->stats.RecordMidiIn(unit->midi_in.get());
+    unit->midi_out = unit->stats.RecordMidiOut(std::move(unit->midi_out));
   }
 
-  std::string date(GetDate());
+  return true;
+}
+
+// Parses the backup in |syx_path| and writes its presets as a preset
+// archive to |path|, which is changed if the file already exists.
+bool WriteArchive(const std::string& syx_path, std::string* path,
+                  const std::string& label) {
+  MemoryMappedFile syx;
+  axefx::SysExParser parser;
+  parser.set_executor(base::ThreadPool::Shared());
+  std::vector<uint8_t> archive;
+  if (!syx.Open(syx_path) ||
+      !parser.ParseSysExBuffer(syx.data(), syx.data() + syx.size(), true) ||
+      !axefx::WritePresetArchive(parser.presets(), &archive)) {
+    Print(&std::cerr, label, "Failed to create an archive of " + syx_path +
+          ".\n");
+    return false;
+  }
+
+  std::ofstream file;
+  if (!CreateOutputFile(path, &file) ||
+      !file.write(reinterpret_cast<const char*>(&archive[0]),
+                  archive.size())) {
+    Print(&std::cerr, label, "Failed to write " + *path + ".\n");
+    return false;
+  }
+
+  Print(&std::cout, label, "Archive " + *path + " ready.\n");
+  return true;
+}
+
+// Backs up the banks selected in |options| from |unit|.  Runs the unit's
+// loop on the calling thread.
+bool BackupUnit(const Options& options, const std::string& date,
+                Unit* unit) {
+  const std::string& prefix = unit->file_prefix;
+  const std::string& label = unit->label;
+  const SharedThreadLoop& loop = unit->loop;
   struct {
     std::string description;
     BankDumpRequest::BankId bank_id;
     std::string name;
     std::string json_name;
+    std::string archive_name;
     bool enabled;
     std::ofstream file;
     std::ofstream json;
   } files[] = {
     { "Bank A", BankDumpRequest::BANK_A,
-      "BankA_" + date + ".syx",
-      "BankA_" + date + ".json",
+      prefix + "BankA_" + date + ".syx",
+      prefix + "BankA_" + date + ".json",
+      prefix + "BankA_" + date + ".axfp",
       options.bank_a },
     { "Bank B", BankDumpRequest::BANK_B,
-      "BankB_" + date + ".syx",
-      "BankB_" + date + ".json",
+      prefix + "BankB_" + date + ".syx",
+      prefix + "BankB_" + date + ".json",
+      prefix + "BankB_" + date + ".axfp",
       options.bank_b },
     { "Bank C", BankDumpRequest::BANK_C,
-      "BankC_" + date + ".syx",
-      "BankC_" + date + ".json",
+      prefix + "BankC_" + date + ".syx",
+      prefix + "BankC_" + date + ".json",
+      prefix + "BankC_" + date + ".axfp",
       options.bank_c },
     { "System Bank", BankDumpRequest::SYSTEM_BANK,
-      "System_" + date + ".syx",
-      "System_" + date + ".json",
+      prefix + "System_" + date + ".syx",
+      prefix + "System_" + date + ".json",
+      prefix + "System_" + date + ".axfp",
       options.system },
   };
 
@@ -326,49 +613,137 @@ int main(int argc, char* argv[]) {
     if (files[i].enabled &&
         CreateOutputFile(&files[i].name, &f) &&
         (!options.json || CreateOutputFile(&files[i].json_name, &j))) {
-      std::cout << "\nWriting " << files[i].description << " to "
-                << files[i].name << ".\n";
-      BackupWriter writer(&f, loop);
-      midi::SysExDataBuffer sysex_buffer(
+      Print(&std::cout, label, "Writing " + files[i].description + " to " +
+            files[i].name + ".\n");
+      unique_ptr<base::JsonWriter> json;
+      if (options.json) {
+        json.reset(new base::JsonWriter(&j,
+            options.json_compact ? base::JsonWriter::COMPACT :
+                                   base::JsonWriter::STYLED));
+      }
+      BackupWriter writer(&f, json.get(), loop, label);
+      // Tempo messages mark the end of the dump.  Other data is only
+      // passed on for diagnostics.
+      midi::SysExDataBuffer sysex_buffer;
+      sysex_buffer.Subscribe(
+          midi::FunctionSet({ axefx::PRESET_ID, axefx::PRESET_PARAMETERS,
+                              axefx::PRESET_CHECKSUM, axefx::TEMPO_HEARTBEAT },
+                            true),
           std::bind(&BackupWriter::OnSysEx, &writer, _1));
-      sysex_buffer.Attach(midi_in);
+      midi::ScopedBufferAttach attach(unit->midi_in, &sysex_buffer);
       BankDumpRequest request(files[i].bank_id);
       unique_ptr<midi::Message> message(
-          new midi::Message(&request, sizeof(request)));
-      if (midi_out->Send(std::move(message), nullptr)) {
-        // Run until we get a timeout.  When we time out, we assume that the
-        // transmission is done.
-        loop->set_timeout(std::chrono::milliseconds(3 * 1000));
+          midi::MessagePool::Get()->New(&request, sizeof(request)));
+      auto start = std::chrono::steady_clock::now();
+      if (unit->midi_out->Send(std::move(message), nullptr)) {
+        // Runs until the last preset has arrived, or the watchdog gives up.
+        loop->QueueTask(std::bind(&BackupWriter::Start, &writer));
         loop->Run();
 
         if (writer.failed()) {
-          std::cerr <<
+          Print(&std::cerr, label,
             "\nErrors were detected in the backup data.\n\n"
             "It is possible that using other apps, typing or using"
             " the mouse (especially on Mac) can cause MIDI data from"
             " the AxeFx to be dropped and therefore damaging the backup.\n\n"
             "Please try again and make sure the AxeFx isn't busy before you do."
-            "\n\n";
-          return -1;
-        } else if (writer.preset_count() != 128) {
-          std::cerr << "Error: Received an unexpected number of presets: "
-                    << writer.preset_count() << ".\n";
-          return -1;
+            "\n\n");
+          return false;
+        } else if (writer.preset_count() != kPresetsPerBank) {
+          Print(&std::cerr, label,
+                "Error: Received an unexpected number of presets: " +
+                std::to_string(writer.preset_count()) + ".\n");
+          return false;
         }
 
-        if (options.json) {
-          j << writer.ToJson();
-          j.flush();
+        std::chrono::milliseconds elapsed(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start));
+        Print(&std::cout, label, "Backup " + files[i].name + " ready (" +
+              std::to_string(elapsed.count()) + "ms).\n");
+
+        // The archive is made from the file, which has been verified.
+        f.close();
+        if (options.archive &&
+            !WriteArchive(files[i].name, &files[i].archive_name, label)) {
+          return false;
         }
-        std::cout << "\n" << "Backup " << files[i].name << " ready.\n";
       } else {
-        std::cerr << "Failed to send bank request.\n";
-        return -1;
+        Print(&std::cerr, label, "Failed to send bank request.\n");
+        return false;
       }
     }
   }
 
-  std::cout << "All done\n";
+  return true;
+}
+
+void RunBackup(const Options& options, const std::string& date, Unit* unit) {
+  auto start = std::chrono::steady_clock::now();
+  unit->succeeded = BackupUnit(options, date, unit);
+  unit->elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseArgs(argc, argv, &options)) {
+    PrintUsage();
+    return -1;
+  }
+
+  std::cout << "Opening MIDI devices...\n";
+
+  // Devices are all opened up front on this thread, since not all MIDI
+  // APIs can be initialized from several threads at once.
+  std::vector<unique_ptr<Unit> > units;
+  size_t unit_count = options.devices.size() + options.simulate.size();
+  for (size_t i = 0; i < std::max<size_t>(unit_count, 1u); ++i) {
+    unique_ptr<Unit> unit(new Unit());
+    std::string device(i < options.devices.size() ? options.devices[i] : "");
+    std::string simulate(i >= options.devices.size() && i < unit_count ?
+        options.simulate[i - options.devices.size()] : "");
+    if (!OpenUnit(options, device, simulate, unit.get()))
+      return -1;
+    if (unit_count > 1u) {
+      std::string id("Unit" + std::to_string(i + 1));
+      unit->file_prefix = id + "_";
+      unit->label = id + ": ";
+      std::cout << unit->label << unit->name << "\n";
+    }
+    units.push_back(std::move(unit));
+  }
+
+  std::string date(GetDate());
+  auto start = std::chrono::steady_clock::now();
+  if (units.size() == 1u) {
+    RunBackup(options, date, units[0].get());
+  } else {
+    // Each unit has its own loop, so they're backed up side by side and
+    // the total time is that of the slowest one.
+    std::vector<std::thread> threads;
+    for (auto& unit : units)
+      threads.push_back(std::thread(&RunBackup, options, date, unit.get()));
+    for (auto& thread : threads)
+      thread.join();
+  }
+
+  bool succeeded = true;
+  for (const auto& unit : units) {
+    succeeded &= unit->succeeded;
+    if (options.stats) {
+      std::cout << "\n" << unit->label << "MIDI stats for " << unit->name
+                << ":\n";
+      unit->stats.Print(&std::cout);
+    }
+  }
+  if (!succeeded)
+    return -1;
+
+  std::chrono::milliseconds elapsed(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start));
+  std::cout << "All done (" << elapsed.count() << "ms)\n";
 
   return 0;
 }
@@ -0,0 +1,25 @@
+# Copyright (c) 2013 Tomas Gunnarsson. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+{
+  'targets': [
+    {
+      'target_name': 'axeimport',
+      'type': 'executable',
+      'defines': [
+      ],
+      'include_dirs': [
+        '..',
+      ],
+      'dependencies': [
+        '../axefx/axefx.gyp:*',
+        '../common/base.gyp:*',
+      ],
+      'sources': [
+        '../common/common_types.h',
+        'main.cc',
+      ],
+    },
+  ],
+}
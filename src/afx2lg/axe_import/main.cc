@@ -0,0 +1,121 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "common/common_types.h"
+
+#include "axefx/axe_edit_xml_reader.h"
+#include "axefx/preset.h"
+#include "common/file_utils.h"
+#include "common/thread_pool.h"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+using std::placeholders::_1;
+
+void PrintUsage() {
+  std::cerr <<
+      "Usage:\n\n"
+      "  axeimport <Axe-Edit .xml file or folder> <output folder>\n"
+      "\n"
+      "\n"
+      "Converts presets exported from Axe-Edit as XML into .syx files that\n"
+      "can be sent to the AxeFx with axeloader.  When a folder is given, all\n"
+      "the .xml files in it are converted.  Each output file gets the name of\n"
+      "the XML file it was converted from.\n"
+      "\n"
+      "The XML export doesn't contain the block layout or scenes, so those\n"
+      "need to be set up again after loading the preset.\n"
+      "\n";
+}
+
+bool ParseArgs(int argc, char* argv[], std::vector<std::string>* inputs,
+               std::string* output_dir) {
+  if (argc < 3) {
+    std::cerr << "Missing input or output path\n";
+    return false;
+  }
+
+  std::string input(argv[1]);
+  if (base::IsDirectory(input)) {
+    if (!base::ListFiles(input, ".xml", inputs)) {
+      std::cerr << "Failed to list files in '" << input << "'\n";
+      return false;
+    }
+  } else {
+    inputs->push_back(input);
+  }
+
+  *output_dir = argv[2];
+  if (!base::IsDirectory(*output_dir)) {
+    std::cerr << "'" << *output_dir << "' is not a folder\n";
+    return false;
+  }
+
+  return true;
+}
+
+std::string GetOutputPath(const std::string& input,
+                          const std::string& output_dir) {
+  size_t start = input.find_last_of("/\\");
+  start = start == std::string::npos ? 0 : start + 1;
+  size_t dot = input.find_last_of('.');
+  if (dot == std::string::npos || dot < start)
+    dot = input.length();
+  std::string path(output_dir);
+  if (path.back() != '/' && path.back() != '\\')
+    path += '/';
+  return path + input.substr(start, dot - start) + ".syx";
+}
+
+void WriteData(const std::vector<uint8_t>& data, std::ofstream* file) {
+  file->write(reinterpret_cast<const char*>(&data[0]), data.size());
+}
+
+bool ConvertFile(const std::string& input, const std::string& output) {
+  shared_ptr<axefx::Preset> preset;
+  if (!axefx::ReadAxeEditXmlFile(input, &preset))
+    return false;
+
+  std::ofstream file(output, std::ios::out | std::ios::binary);
+  if (!file.good())
+    return false;
+
+  if (!preset->Serialize(std::bind(&WriteData, _1, &file)))
+    return false;
+
+  return file.good();
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> inputs;
+  std::string output_dir;
+  if (!ParseArgs(argc, argv, &inputs, &output_dir)) {
+    PrintUsage();
+    return -1;
+  }
+
+  // Each file is independent, so they're converted in parallel on the
+  // shared pool.
+  std::atomic<size_t> failed(0u);
+  std::mutex output_lock;
+  base::ParallelFor(base::ThreadPool::Shared(), 0u, inputs.size(), 1u,
+                    [&](size_t i) {
+    std::string output(GetOutputPath(inputs[i], output_dir));
+    bool ok = ConvertFile(inputs[i], output);
+    std::lock_guard<std::mutex> lock(output_lock);
+    if (ok) {
+      std::cout << inputs[i] << " -> " << output << "\n";
+    } else {
+      std::cerr << "Failed to convert '" << inputs[i] << "'\n";
+      ++failed;
+    }
+  });
+
+  std::cout << "Converted " << (inputs.size() - failed) << " of "
+            << inputs.size() << " presets.\n";
+
+  return failed ? -1 : 0;
+}
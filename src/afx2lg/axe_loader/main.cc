@@ -5,30 +5,38 @@
 
 #include "axefx/axe_fx_sysex_parser.h"
 #include "axefx/preset.h"
+#include "axefx/preset_archive.h"
 #include "axefx/sysex_types.h"
 #include "common/file_utils.h"
+#include "common/thread_pool.h"
+#include "midi/message_pool.h"
+#include "midi/message_sender.h"
+#include "midi/midi_capture.h"
 #include "midi/midi_in.h"
 #include "midi/midi_out.h"
+#include "midi/midi_stats.h"
+#include "midi/simulated_axefx.h"
 
+#include <chrono>
 #include <climits>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <queue>
 
 using base::FileExists;
-using base::ReadFileIntoBuffer;
+using base::MemoryMappedFile;
 using base::SharedThreadLoop;
 
 using std::placeholders::_1;
 using std::placeholders::_2;
 
-typedef std::queue<unique_ptr<midi::Message> > MessageQueue;
-
 void PrintUsage() {
   std::cerr <<
       "Usage:\n\n"
-      "  axeloader <path to .syx file>\n"
+      "  axeloader [-window=<n>] [-sim=<path>] [-simrate=<n>]"
+      " [-record=<path>] [-stats]\n"
+      "            <path to .syx file or preset archive>\n"
       "\n"
       "\n"
       "For single presets, the utility will load the preset file into the\n"
@@ -45,53 +53,64 @@ void PrintUsage() {
       "\n"
       "Firmware files can be sent to the AxeFx but you'll be prompted before\n"
       "the data is sent\n"
+      "\n"
+      "Up to -window messages (default 4) are queued in the MIDI driver at\n"
+      "a time.  The transfer slows down automatically if the AxeFx reports\n"
+      "errors.  Use -window=1 to send one message at a time.\n"
+      "\n"
+      "For testing and timing, -sim sends the data to a simulated AxeFx that\n"
+      "holds the presets in the given .syx file, and -simrate sets the bytes\n"
+      "per second of its connection (3125 for a MIDI cable, 0 = unlimited).\n"
+      "\n"
+      "-record writes all MIDI traffic, with timestamps, to a capture file.\n"
+      "\n"
+      "-stats prints MIDI timing and throughput statistics when done.\n"
       "\n";
 }
 
-bool ParseArgs(int argc, char* argv[], std::string* path) {
-  if (argc < 2) {
+struct Options {
+  Options()
+      : simulate_rate(midi::SimulatedAxeFx::kUsbBytesPerSecond),
+        stats(false) {}
+
+  std::string path;
+  midi::MessageSender::Options sender;
+  // Path to the presets of a simulated unit.  Empty for the real thing.
+  std::string simulate;
+  size_t simulate_rate;
+  // Capture file to record the MIDI traffic to.
+  std::string record;
+  bool stats;
+};
+
+bool ParseArgs(int argc, char* argv[], Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 8, "-window=") == 0) {
+      options->sender.window = strtoul(arg.c_str() + 8, NULL, 10);
+    } else if (arg.compare(0, 5, "-sim=") == 0) {
+      options->simulate = arg.substr(5);
+    } else if (arg.compare(0, 9, "-simrate=") == 0) {
+      options->simulate_rate = strtoul(arg.c_str() + 9, NULL, 10);
+    } else if (arg.compare(0, 8, "-record=") == 0) {
+      options->record = arg.substr(8);
+    } else if (arg.compare("-stats") == 0) {
+      options->stats = true;
+    } else {
+      options->path = arg;
+    }
+  }
+
+  if (options->path.empty()) {
     std::cerr << "Missing path to preset file\n";
     return false;
   }
 
-  *path = argv[1];
-
   return true;
 }
 
-void SerializeCallback(const std::vector<uint8_t>& data, MessageQueue* out) {
-  unique_ptr<midi::Message> message(
-      new midi::Message(static_cast<const midi::Message&>(data)));
-  out->push(std::move(message));
-}
-
-unique_ptr<midi::Message> PopMessage(MessageQueue* q) {
-  unique_ptr<midi::Message> m(std::move(q->front()));
-  q->pop();
-  return m;
-}
-
-void SendMessage(const SharedThreadLoop& loop,
-                 midi::MidiOut* midi_out,
-                 MessageQueue* q,
-                 std::function<void()>& on_complete) {
-  if (q->empty()) {
-    loop->Quit();
-  } else {
-    midi_out->Send(PopMessage(q), on_complete);
-  }
-}
-
-void QueueNext(const SharedThreadLoop& loop,
-               midi::MidiOut* midi_out,
-               MessageQueue* q) {
-  if (q->empty()) {
-    loop->Quit();
-  } else {
-    std::function<void()> on_complete(std::bind(&QueueNext, loop, midi_out, q));
-    loop->QueueTask(std::bind(&SendMessage, loop, midi_out, q, on_complete));
-    std::cout << "#";
-  }
+void PrintProgress() {
+  std::cout << "#";
 }
 
 void Wait() {
@@ -100,12 +119,6 @@ void Wait() {
   std::cin.get();
 }
 
-// TODO: Move this function to a common utility file.
-bool IsTempoOrTuner(midi::Message* msg) {
-  return msg->IsFractalMessageType(axefx::TEMPO_HEARTBEAT) ||
-         msg->IsFractalMessageType(axefx::TUNER_DATA);
-}
-
 // TODO: Move this function to a common utility file.
 void AssignToBufferAndQuit(midi::Message* new_message,
                            const shared_ptr<base::ThreadLoop>& loop,
@@ -128,11 +141,12 @@ bool SwitchToFwUpdatePage(const shared_ptr<midi::MidiIn>& midi_in,
 
   axefx::GenericNoDataMessage request(axefx::FIRMWARE_UPDATE);
   unique_ptr<midi::Message> message(
-      new midi::Message(&request, sizeof(request)));
+      midi::MessagePool::Get()->New(&request, sizeof(request)));
 
   midi::Message data;
-  midi::SysExDataBuffer buffer(
-      std::bind(&AssignToBufferAndQuit, _1, loop, &data));
+  midi::SysExDataBuffer buffer;
+  buffer.Subscribe(midi::FunctionSet({ axefx::REPLY }, false),
+                   std::bind(&AssignToBufferAndQuit, _1, loop, &data));
   midi::ScopedBufferAttach scoped_attach(midi_in, &buffer);
   if (!midi_out->Send(std::move(message), nullptr)) {
     std::cerr << "Failed to send a midi message.\n";
@@ -141,10 +155,8 @@ bool SwitchToFwUpdatePage(const shared_ptr<midi::MidiIn>& midi_in,
 
   // Wait until we get a confirmation.
   while (loop->Run()) {
-    if (!IsTempoOrTuner(&data)) {
-      if (axefx::IsFractalSysEx(&data[0], data.size()))
-        break;
-    }
+    if (axefx::IsFractalSysEx(&data[0], data.size()))
+      break;
     data.clear();
   }
 
@@ -167,23 +179,28 @@ bool SwitchToFwUpdatePage(const shared_ptr<midi::MidiIn>& midi_in,
 }
 
 int main(int argc, char* argv[]) {
-  std::string path;
-  if (!ParseArgs(argc, argv, &path)) {
+  Options options;
+  if (!ParseArgs(argc, argv, &options)) {
     PrintUsage();
     Wait();
     return -1;
   }
 
-  unique_ptr<uint8_t[]> buffer;
-  size_t size = 0u;
-  if (!ReadFileIntoBuffer(path, &buffer, &size)) {
-    std::cerr << "Failed to open file '" << path << "'\n";
+  MemoryMappedFile file;
+  if (!file.Open(options.path)) {
+    std::cerr << "Failed to open file '" << options.path << "'\n";
     Wait();
     return -1;
   }
 
+  const uint8_t* begin = file.data();
+  const uint8_t* end = begin + file.size();
   axefx::SysExParser parser;
-  if (!parser.ParseSysExBuffer(buffer.get(), buffer.get() + size, false)) {
+  parser.set_executor(base::ThreadPool::Shared());
+  bool parsed = axefx::IsPresetArchive(begin, end) ?
+      parser.ParsePresetArchive(begin, end) :
+      parser.ParseSysExBuffer(begin, end, false);
+  if (!parsed) {
     std::cerr << "Failed to parse preset file.\n";
     Wait();
     return -1;
@@ -203,15 +220,44 @@ int main(int argc, char* argv[]) {
 
   std::cout << "Opening MIDI devices...\n";
 
+  midi::MidiStats stats;
   SharedThreadLoop loop(new base::ThreadLoop());
-  shared_ptr<midi::MidiIn> midi_in(midi::MidiIn::OpenAxeFx(loop));
-  unique_ptr<midi::MidiOut> midi_out(midi::MidiOut::OpenAxeFx());
+  midi::MidiCapture capture;
+  unique_ptr<midi::SimulatedAxeFx> simulator;
+  shared_ptr<midi::MidiIn> midi_in;
+  unique_ptr<midi::MidiOut> midi_out;
+  if (!options.simulate.empty()) {
+    midi::SimulatedAxeFx::Options sim_options;
+    sim_options.bytes_per_second = options.simulate_rate;
+    simulator.reset(new midi::SimulatedAxeFx(sim_options));
+    if (!simulator->LoadPresets(options.simulate)) {
+      std::cerr << "Failed to load presets from " << options.simulate << "\n";
+      return -1;
+    }
+    midi_in = simulator->OpenMidiIn(loop);
+    midi_out = simulator->OpenMidiOut();
+  } else {
+    midi_in = midi::MidiIn::OpenAxeFx(loop);
+    midi_out = midi::MidiOut::OpenAxeFx();
+  }
   if (!midi_in || !midi_out) {
     std::cerr << "Failed to open AxeFx midi devices\n";
     Wait();
     return -1;
   }
 
+  if (!options.record.empty()) {
+    capture.set_save_path(options.record);
+    capture.RecordMidiIn(midi_in.get());
+    midi_out = capture.RecordMidiOut(std::move(midi_out));
+  }
+
+  if (options.stats) {
+    stats.RecordLoop(loop.get());
+    stats.RecordMidiIn(midi_in.get());
+    midi_out = stats.RecordMidiOut(std::move(midi_out));
+  }
+
   if (parser.type() == axefx::SysExParser::FIRMWARE) {
     if (!SwitchToFwUpdatePage(midi_in, midi_out, loop)) {
       Wait();
@@ -221,17 +267,53 @@ int main(int argc, char* argv[]) {
 
   std::cout << "Sending data...\n";
 
-  MessageQueue messages;
-  if (!parser.Serialize(std::bind(&SerializeCallback, _1, &messages))) {
+  midi::MessageSender sender(midi_out.get(), midi_in, loop, options.sender);
+  if (!parser.Serialize(std::bind(&midi::MessageSender::Add, &sender, _1))) {
     std::cerr << "An error occurred while sending sysex data.\n";
     Wait();
     return -1;
   }
 
-  QueueNext(loop, midi_out.get(), &messages);
-  loop->Run();
+  auto start = std::chrono::steady_clock::now();
+  bool succeeded = false;
+  sender.Start(&PrintProgress, [&succeeded, &loop](bool result) {
+    succeeded = result;
+    loop->Quit();
+  });
+  // The sender has its own timeouts, this is for when the driver stops
+  // completing messages.
+  loop->set_timeout(std::chrono::seconds(10));
+  if (!loop->Run()) {
+    std::cerr << "\n\nTimed out while sending the data.\n";
+    Wait();
+    return -1;
+  }
+  std::chrono::milliseconds elapsed(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start));
+
+  if (options.stats) {
+    std::cout << "\n\nMIDI stats:\n";
+    stats.Print(&std::cout);
+  }
+
+  if (!succeeded) {
+    if (sender.error_replies()) {
+      std::cerr << "\n\nThe AxeFx reported " << sender.error_replies()
+                << " error(s) while receiving the data.\n";
+    } else {
+      std::cerr << "\n\nThe data couldn't be sent to the AxeFx.\n";
+    }
+    Wait();
+    return -1;
+  }
+
+  if (sender.retries()) {
+    std::cout << "\n\nThe AxeFx rejected data " << sender.retries()
+              << " time(s), which was sent again.";
+  }
 
-  std::cout << "\n\nAll done\n";
+  std::cout << "\n\nAll done (" << elapsed.count() << "ms)\n";
 
   return 0;
 }
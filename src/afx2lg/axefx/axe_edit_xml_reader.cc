@@ -0,0 +1,403 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "axefx/axe_edit_xml_reader.h"
+
+#include "axefx/blocks.h"
+#include "axefx/param_units.h"
+#include "axefx/preset.h"
+#include "common/file_utils.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace axefx {
+
+namespace {
+
+// Parameter version of presets saved by the firmware that the unit tables
+// were generated from.
+const uint16_t kProfilePresetVersion = 0x0202;
+
+struct XmlTag {
+  std::string name;
+  std::vector<std::pair<std::string, std::string> > attributes;
+
+  const std::string* Get(const char* attribute) const {
+    for (const auto& a : attributes) {
+      if (a.first == attribute)
+        return &a.second;
+    }
+    return NULL;
+  }
+};
+
+void AppendUtf8(unsigned long code, std::string* out) {
+  if (code < 0x80) {
+    out->push_back(static_cast<char>(code));
+  } else if (code < 0x800) {
+    out->push_back(static_cast<char>(0xC0 | (code >> 6)));
+    out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+  } else if (code < 0x10000) {
+    out->push_back(static_cast<char>(0xE0 | (code >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+  } else {
+    out->push_back(static_cast<char>(0xF0 | (code >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+  }
+}
+
+// Appends the attribute value [begin, end) to |out| and expands entities.
+bool AppendUnescaped(const char* begin, const char* end, std::string* out) {
+  static const struct {
+    const char* name;
+    size_t length;
+    char ch;
+  } kEntities[] = {
+    { "amp;", 4, '&' },
+    { "lt;", 3, '<' },
+    { "gt;", 3, '>' },
+    { "quot;", 5, '"' },
+    { "apos;", 5, '\'' },
+  };
+
+  const char* run = begin;
+  for (const char* p = begin; p < end; ++p) {
+    if (*p != '&')
+      continue;
+    out->append(run, p);
+    ++p;
+    bool found = false;
+    if (p < end && *p == '#') {
+      bool hex = p + 1 < end && p[1] == 'x';
+      char* digits_end = NULL;
+      unsigned long code =
+          strtoul(p + (hex ? 2 : 1), &digits_end, hex ? 16 : 10);
+      if (digits_end < end && *digits_end == ';' && code && code < 0x110000) {
+        AppendUtf8(code, out);
+        p = digits_end;
+        found = true;
+      }
+    } else {
+      for (size_t i = 0; i < arraysize(kEntities); ++i) {
+        size_t length = kEntities[i].length;
+        if (static_cast<size_t>(end - p) >= length &&
+            memcmp(p, kEntities[i].name, length) == 0) {
+          out->push_back(kEntities[i].ch);
+          p += length - 1;
+          found = true;
+          break;
+        }
+      }
+    }
+    if (!found)
+      return false;
+    run = p + 1;
+  }
+  out->append(run, end);
+  return true;
+}
+
+// Returns the start tags of a document one at a time.  End tags, text,
+// comments and processing instructions are skipped since the exports don't
+// carry any data in them.
+class XmlScanner {
+ public:
+  enum Result {
+    TAG,
+    END_OF_INPUT,
+    SYNTAX_ERROR,
+  };
+
+  XmlScanner(const char* begin, const char* end) : pos_(begin), end_(end) {}
+
+  Result Next(XmlTag* tag) {
+    while (true) {
+      pos_ = static_cast<const char*>(memchr(pos_, '<', end_ - pos_));
+      if (!pos_)
+        return END_OF_INPUT;
+      ++pos_;
+      if (pos_ == end_)
+        return SYNTAX_ERROR;
+
+      const char* close = NULL;
+      if (*pos_ == '?') {
+        close = Find("?>");
+      } else if (*pos_ == '!') {
+        close = StartsWith("!--") ? Find("-->") : Find(">");
+      } else if (*pos_ == '/') {
+        close = Find(">");
+      } else {
+        return ReadStartTag(tag) ? TAG : SYNTAX_ERROR;
+      }
+
+      if (!close)
+        return SYNTAX_ERROR;
+      pos_ = close;
+    }
+  }
+
+ private:
+  bool StartsWith(const char* str) const {
+    size_t length = strlen(str);
+    return static_cast<size_t>(end_ - pos_) >= length &&
+           memcmp(pos_, str, length) == 0;
+  }
+
+  // Returns the position right after the next occurrence of |str|.
+  const char* Find(const char* str) const {
+    size_t length = strlen(str);
+    for (const char* p = pos_; p + length <= end_; ++p) {
+      if (memcmp(p, str, length) == 0)
+        return p + length;
+    }
+    return NULL;
+  }
+
+  static bool IsSpace(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+  }
+
+  static bool IsNameChar(char ch) {
+    return !IsSpace(ch) && ch != '=' && ch != '>' && ch != '/' &&
+           ch != '"' && ch != '\'' && ch != '<';
+  }
+
+  void SkipSpace() {
+    while (pos_ < end_ && IsSpace(*pos_))
+      ++pos_;
+  }
+
+  const char* ReadName() {
+    const char* begin = pos_;
+    while (pos_ < end_ && IsNameChar(*pos_))
+      ++pos_;
+    return begin;
+  }
+
+  bool ReadStartTag(XmlTag* tag) {
+    const char* name = ReadName();
+    if (name == pos_)
+      return false;
+    tag->name.assign(name, pos_);
+    tag->attributes.clear();
+
+    while (true) {
+      SkipSpace();
+      if (pos_ == end_)
+        return false;
+      if (*pos_ == '>') {
+        ++pos_;
+        return true;
+      }
+      if (*pos_ == '/') {
+        ++pos_;
+        if (pos_ == end_ || *pos_ != '>')
+          return false;
+        ++pos_;
+        return true;
+      }
+
+      const char* attribute = ReadName();
+      if (attribute == pos_)
+        return false;
+      tag->attributes.push_back(
+          std::make_pair(std::string(attribute, pos_), std::string()));
+      SkipSpace();
+      if (pos_ == end_ || *pos_ != '=')
+        return false;
+      ++pos_;
+      SkipSpace();
+      if (pos_ == end_ || (*pos_ != '"' && *pos_ != '\''))
+        return false;
+      char quote = *pos_++;
+      const char* value_end =
+          static_cast<const char*>(memchr(pos_, quote, end_ - pos_));
+      if (!value_end ||
+          !AppendUnescaped(pos_, value_end, &tag->attributes.back().second)) {
+        return false;
+      }
+      pos_ = value_end + 1;
+    }
+  }
+
+  const char* pos_;
+  const char* end_;
+};
+
+bool ParseInt(const std::string* str, int min, int max, int* value) {
+  if (!str || str->empty())
+    return false;
+  char* end = NULL;
+  long l = strtol(str->c_str(), &end, 10);
+  if (*end != '\0' || l < min || l > max)
+    return false;
+  *value = static_cast<int>(l);
+  return true;
+}
+
+// Parameter id -> value as displayed.
+typedef std::vector<std::pair<int, std::string> > BlockValues;
+
+bool Error(const char* message, int block_id, int param_id) {
+  std::cerr << "Axe-Edit XML error: " << message;
+  if (block_id != -1)
+    std::cerr << " (block " << block_id;
+  if (param_id != -1)
+    std::cerr << ", parameter " << param_id;
+  if (block_id != -1)
+    std::cerr << ")";
+  std::cerr << std::endl;
+  return false;
+}
+
+bool BuildBlock(const TypeTables* tables, int block_id,
+                const BlockValues& values, unique_ptr<BlockParameters>* out) {
+  AxeFxBlockType type =
+      GetBlockType(tables, static_cast<AxeFxIIBlockID>(block_id));
+  if (type == BLOCK_TYPE_INVALID)
+    return Error("Unknown block", block_id, -1);
+
+  // The variant (e.g. amp model) decides how the other values are scaled.
+  int variant = 0;
+  int variant_param = GetVariantParamID(type);
+  const ParamScaleTable* table = GetParamScaleTable(type, 0);
+  if (!table)
+    return Error("No unit information for block", block_id, -1);
+  if (variant_param != -1) {
+    for (const auto& v : values) {
+      if (v.first != variant_param)
+        continue;
+      double value;
+      if (static_cast<size_t>(variant_param) >= table->count ||
+          !ParseDisplayValue(table->info[variant_param], v.second, &value)) {
+        return Error("Invalid value", block_id, variant_param);
+      }
+      variant = static_cast<int>(value);
+      break;
+    }
+    table = GetParamScaleTable(type, variant);
+    if (!table)
+      return Error("Unknown variant", block_id, variant_param);
+  }
+
+  size_t count = table->count;
+  for (const auto& v : values)
+    count = std::max(count, static_cast<size_t>(v.first) + 1u);
+
+  // Start off with all zeros for parameters that aren't in the export.
+  std::vector<uint16_t> raw(count, 0u);
+  std::vector<double> display(count);
+  RawToDisplay(*table, &raw[0], count, &display[0]);
+  for (const auto& v : values) {
+    size_t i = static_cast<size_t>(v.first);
+    // Parameters that don't apply to the current type are exported without a
+    // value.
+    if (v.second.find_first_not_of(' ') == std::string::npos)
+      continue;
+    bool ok;
+    if (i < table->count) {
+      ok = ParseDisplayValue(table->info[i], v.second, &display[i]);
+    } else {
+      // Not described by the profile, so the value is taken to be raw.
+      ParamInfo raw_info = { TAPER_LIST, 0.0f, 0.0f, 0, "", NULL, 0 };
+      ok = ParseDisplayValue(raw_info, v.second, &display[i]);
+    }
+    if (!ok)
+      return Error("Invalid value", block_id, v.first);
+  }
+  DisplayToRaw(*table, &display[0], count, &raw[0]);
+
+  bool supports_xy = BlockSupportsXY(type);
+  std::vector<uint16_t> data;
+  data.reserve(2 + count * 2);
+  data.push_back(static_cast<uint16_t>(block_id));
+  data.push_back(static_cast<uint16_t>(supports_xy ? count * 2 : count));
+  data.insert(data.end(), raw.begin(), raw.end());
+  if (supports_xy)
+    data.insert(data.end(), raw.begin(), raw.end());
+
+  out->reset(new BlockParameters(tables));
+  if (!(*out)->Initialize(&data[0], data.size()))
+    return Error("Invalid block", block_id, -1);
+
+  return true;
+}
+
+}  // namespace
+
+bool ParseAxeEditXml(const char* begin, const char* end,
+                     shared_ptr<Preset>* preset) {
+  XmlScanner scanner(begin, end);
+  XmlTag tag;
+  XmlScanner::Result result;
+  bool has_preset = false;
+  std::string name;
+  int number = -1;
+  // Keeps the blocks in the order of their ids.
+  std::map<int, BlockValues> blocks;
+
+  while ((result = scanner.Next(&tag)) == XmlScanner::TAG) {
+    if (tag.name == "Preset") {
+      if (has_preset)
+        return Error("More than one preset", -1, -1);
+      has_preset = true;
+      const std::string* n = tag.Get("Name");
+      if (n)
+        name = *n;
+      ParseInt(tag.Get("Number"), 0, (3 * 128) - 1, &number);
+    } else if (tag.name == "Effect") {
+      if (!has_preset)
+        return Error("Effect outside of a preset", -1, -1);
+      int block_id, param_id;
+      const std::string* value = tag.Get("VALUE");
+      if (!ParseInt(tag.Get("EFFECTID"), 1, 0xFF, &block_id))
+        return Error("Invalid EFFECTID", -1, -1);
+      if (!ParseInt(tag.Get("PARAMETERID"), 0, 0x7FFF, &param_id) || !value)
+        return Error("Invalid parameter", block_id, -1);
+      blocks[block_id].push_back(std::make_pair(param_id, *value));
+    }
+  }
+
+  if (result != XmlScanner::END_OF_INPUT)
+    return Error("Syntax error", -1, -1);
+
+  if (!has_preset)
+    return Error("Not a preset", -1, -1);
+
+  shared_ptr<Preset> p(new Preset());
+  p->set_id(number == -1 ? 0 : number);
+  if (number == -1)
+    p->SetAsEditBuffer();
+  p->set_name(name);
+  p->set_version(kProfilePresetVersion);
+  for (const auto& b : blocks) {
+    unique_ptr<BlockParameters> block;
+    if (!BuildBlock(p->type_tables(), b.first, b.second, &block))
+      return false;
+    p->AddBlockParameters(std::move(block));
+  }
+
+  preset->swap(p);
+  return true;
+}
+
+bool ReadAxeEditXmlFile(const std::string& path, shared_ptr<Preset>* preset) {
+  base::MemoryMappedFile file;
+  if (!file.Open(path)) {
+    std::cerr << "Failed to open " << path << std::endl;
+    return false;
+  }
+  const char* begin = reinterpret_cast<const char*>(file.data());
+  return ParseAxeEditXml(begin, begin + file.size(), preset);
+}
+
+}  // namespace axefx
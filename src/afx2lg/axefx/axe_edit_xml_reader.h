@@ -0,0 +1,40 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef AXEFX_AXE_EDIT_XML_READER_H_
+#define AXEFX_AXE_EDIT_XML_READER_H_
+
+#include "common/common_types.h"
+
+#include <string>
+
+namespace axefx {
+
+class Preset;
+
+// Reads the per parameter XML that Axe-Edit exports presets as:
+//
+//   <Preset Name="Dynamic JCM800" Number="0">
+//     <Effect EFFECTID="106" PARAMETERID="1" VALUE="    4.78" UNIT="" ...>
+//     </Effect>
+//     ...
+//   </Preset>
+//
+// Values are display values, so they're converted back to raw values with
+// the tables generated from AxeFxII_7_3.profile (see param_units.h).  The
+// preset is created with the matching (7.x) parameter version.
+// The export doesn't describe the block matrix or scenes, so the preset's
+// matrix is left empty and x/y blocks get the same values for x and y.
+//
+// The input is scanned once without building a DOM.  Returns false if the
+// document isn't a preset export or contains values that can't be converted.
+bool ParseAxeEditXml(const char* begin, const char* end,
+                     shared_ptr<Preset>* preset);
+
+// Convenience wrapper that reads |path|.
+bool ReadAxeEditXmlFile(const std::string& path, shared_ptr<Preset>* preset);
+
+}  // namespace axefx
+
+#endif  // AXEFX_AXE_EDIT_XML_READER_H_
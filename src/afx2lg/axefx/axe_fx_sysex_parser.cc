@@ -6,11 +6,71 @@
 #include "axefx/blocks.h"
 #include "axefx/ir_data.h"
 #include "axefx/preset.h"
+#include "axefx/preset_archive.h"
+#include "common/thread_pool.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace axefx {
 
+namespace {
+// Frames of a preset, from its PRESET_ID to its PRESET_CHECKSUM.
+struct PresetFrames {
+  const uint8_t* begin;
+  const uint8_t* end;
+};
+
+// Parses the frames that were found by ParseSysExBuffer.  If there's no
+// checksum frame, the checksum isn't verified.
+shared_ptr<Preset> ParsePresetFrames(const PresetFrames& frames,
+                                     bool parse_parameter_data) {
+  shared_ptr<Preset> preset(new Preset());
+  const uint8_t* frame = frames.begin;
+  while (frame < frames.end) {
+    const uint8_t* frame_end = std::find(frame, frames.end, kSysExEnd) + 1;
+    size_t size = frame_end - frame;
+    const FractalSysExHeader& header =
+        *reinterpret_cast<const FractalSysExHeader*>(frame);
+    switch (header.function()) {
+      case PRESET_ID:
+        if (!preset->SetPresetId(static_cast<const PresetIdHeader&>(header),
+                                 size)) {
+          return nullptr;
+        }
+        break;
+
+      case PRESET_PARAMETERS:
+        if (!preset->AddParameterData(
+                static_cast<const ParameterBlockHeader&>(header), size)) {
+          return nullptr;
+        }
+        break;
+
+      case PRESET_CHECKSUM: {
+        auto checksum = static_cast<const PresetChecksumHeader*>(&header);
+        if (!preset->Finalize(checksum, size, !parse_parameter_data))
+          return nullptr;
+        ASSERT(preset->valid());
+        return preset;
+      }
+
+      default:
+        ASSERT(false);
+        return nullptr;
+    }
+    frame = frame_end;
+  }
+
+  // This is a possible bug in the AxeFx (experienced with 9.02) where
+  // a parameter checksum won't be included with a preset dump.
+  if (!preset->Finalize(NULL, 0, !parse_parameter_data))
+    return nullptr;
+  ASSERT(preset->valid());
+  return preset;
+}
+}  // namespace
+
 FirmwareData::FirmwareData(const FirmwareBeginHeader& header)
     : expected_total_words_(header.count.Decode()) {
   data_.reserve(expected_total_words_);
@@ -110,7 +170,7 @@ bool FirmwareData::Serialize(const SysExCallback& callback) const {
   return true;
 }
 
-SysExParser::SysExParser() : type_(UNKNOWN) {
+SysExParser::SysExParser() : type_(UNKNOWN), executor_(NULL) {
 }
 
 SysExParser::~SysExParser() {
@@ -125,7 +185,10 @@ bool SysExParser::ParseSysExBuffer(const uint8_t* begin, const uint8_t* end,
   const uint8_t* sys_ex_begins = NULL;
   const uint8_t* pos = begin;
 
-  shared_ptr<Preset> preset;
+  // Presets are parsed once they've all been found, so that they can be
+  // parsed in parallel.
+  std::vector<PresetFrames> preset_frames;
+  const uint8_t* preset_begins = NULL;
   unique_ptr<IRData> ir_data;
   unique_ptr<FirmwareData> firmware;
 
@@ -153,35 +216,25 @@ bool SysExParser::ParseSysExBuffer(const uint8_t* begin, const uint8_t* end,
 
       switch (header.function()) {
         case PRESET_ID:
-          ASSERT(!preset.get());
-          preset.reset(new Preset());
-          if (!preset->SetPresetId(static_cast<const PresetIdHeader&>(header),
-                                   size)) {
-            return false;
-          }
+          ASSERT(!preset_begins);
+          preset_begins = sys_ex_begins;
           break;
 
-        case PRESET_PARAMETERS: {
-          ASSERT(preset);
-          const ParameterBlockHeader& param_header =
-              static_cast<const ParameterBlockHeader&>(header);
-          if (!preset.get() || !preset->AddParameterData(param_header, size))
+        case PRESET_PARAMETERS:
+          ASSERT(preset_begins);
+          if (!preset_begins)
             return false;
           break;
-        }
 
         case PRESET_CHECKSUM: {
-          ASSERT(preset);
-          auto checksum = static_cast<const PresetChecksumHeader*>(&header);
-          if (preset &&
-              preset->Finalize(checksum, size, !parse_parameter_data)) {
-            ASSERT(preset->valid());
-            presets_.insert(std::make_pair(preset->id(), preset));
-          } else {
+          ASSERT(preset_begins);
+          if (!preset_begins) {
             std::cerr << "Failed to parse preset data." << std::endl;
             return false;
           }
-          preset.reset();
+          PresetFrames frames = { preset_begins, pos + 1 };
+          preset_frames.push_back(frames);
+          preset_begins = NULL;
           break;
         }
 
@@ -256,20 +309,32 @@ bool SysExParser::ParseSysExBuffer(const uint8_t* begin, const uint8_t* end,
     ++pos;
   }
 
-  if (preset.get() && presets_.empty()) {
-    // This is a possible bug in the AxeFx (experienced with 9.02) where
-    // a parameter checksum won't be included with a preset dump.
-    // To work around this for now, we skip verifying the checksum.
-    // We don't do this for full banks though since we'd rather not save
-    // a bogus bank.
-    if (preset->Finalize(NULL, 0, !parse_parameter_data)) {
-      ASSERT(preset->valid());
+  std::vector<shared_ptr<Preset> > presets(preset_frames.size());
+  base::ParallelFor(executor_, 0u, preset_frames.size(), 1u, [&](size_t i) {
+    presets[i] = ParsePresetFrames(preset_frames[i], parse_parameter_data);
+  });
+  for (auto& preset : presets) {
+    if (!preset) {
+      std::cerr << "Failed to parse preset data." << std::endl;
+      return false;
+    }
+    presets_.insert(std::make_pair(preset->id(), preset));
+  }
+
+  if (preset_begins && presets_.empty()) {
+    // A preset without a checksum, see ParsePresetFrames().  We skip
+    // verifying the checksum for single presets, but not for full banks
+    // since we'd rather not save a bogus bank.
+    PresetFrames frames = { preset_begins, end };
+    shared_ptr<Preset> preset(
+        ParsePresetFrames(frames, parse_parameter_data));
+    if (preset) {
       presets_.insert(std::make_pair(preset->id(), preset));
-      preset.reset();
+      preset_begins = NULL;
     }
   }
 
-  ASSERT(!preset.get());  // Half way through parsing a preset?
+  ASSERT(!preset_begins);  // Half way through parsing a preset?
   ASSERT(!sys_ex_begins);
 
   // The expectation is that we were only parsing one type of syx data stream.
@@ -303,10 +368,63 @@ bool SysExParser::ParseSysExBuffer(const uint8_t* begin, const uint8_t* end,
   return true;
 }
 
-bool SysExParser::Serialize(const SysExCallback& callback) const {
-  for (auto& entry: presets_) {
-    if (!entry.second->Serialize(callback))
+bool SysExParser::ParsePresetArchive(const uint8_t* begin,
+                                     const uint8_t* end) {
+  ASSERT(!firmware_);
+  ASSERT(ir_array_.empty());
+  ASSERT(presets_.empty() || (type_ == PRESET || type_ == PRESET_ARCHIVE));
+
+  PresetArchiveReader reader;
+  if (!reader.Open(begin, end))
+    return false;
+
+  for (size_t i = 0; i < reader.preset_count(); ++i) {
+    shared_ptr<Preset> preset(reader.ReadPreset(i));
+    if (!preset) {
+      std::cerr << "Failed to read preset " << reader.preset_id(i)
+                << " from the archive." << std::endl;
       return false;
+    }
+    presets_.insert(std::make_pair(preset->id(), preset));
+  }
+
+  if (presets_.empty())
+    return false;
+
+  type_ = presets_.size() == 1 ? PRESET : PRESET_ARCHIVE;
+
+  return true;
+}
+
+bool SysExParser::Serialize(const SysExCallback& callback) const {
+  if (executor_ && presets_.size() > 1u) {
+    // Each preset is serialized into a list of its own and the messages
+    // are passed on in order.
+    std::vector<const Preset*> presets;
+    for (auto& entry: presets_)
+      presets.push_back(entry.second.get());
+    std::vector<std::vector<std::vector<uint8_t> > > messages(presets.size());
+    // Not vector<bool>, since the elements are written from several
+    // threads.
+    std::vector<char> serialized(presets.size());
+    base::ParallelFor(executor_, 0u, presets.size(), 1u, [&](size_t i) {
+      auto* preset_messages = &messages[i];
+      serialized[i] = presets[i]->Serialize(
+          [preset_messages](const std::vector<uint8_t>& message) {
+            preset_messages->push_back(message);
+          });
+    });
+    for (size_t i = 0; i < presets.size(); ++i) {
+      if (!serialized[i])
+        return false;
+      for (auto& message : messages[i])
+        callback(message);
+    }
+  } else {
+    for (auto& entry: presets_) {
+      if (!entry.second->Serialize(callback))
+        return false;
+    }
   }
 
   for (auto& entry: ir_array_) {
@@ -13,6 +13,10 @@
 
 #include <map>
 
+namespace base {
+class ThreadPool;
+}
+
 namespace axefx {
 
 class IRData;
@@ -49,9 +53,17 @@ class SysExParser {
     FIRMWARE,
   };
 
+  // Presets are parsed and serialized in parallel on |pool|.  NULL (the
+  // default) does everything on the calling thread.
+  void set_executor(base::ThreadPool* pool) { executor_ = pool; }
+
   bool ParseSysExBuffer(const uint8_t* begin, const uint8_t* end,
                         bool parse_parameter_data);
 
+  // Loads the presets from a preset archive (see preset_archive.h), after
+  // which they can be serialized to sysex like parsed presets.
+  bool ParsePresetArchive(const uint8_t* begin, const uint8_t* end);
+
   const PresetMap& presets() const { return presets_; }
   PresetMap& presets() { return presets_; }
   IRDataArray& ir_array() { return ir_array_; }
@@ -64,6 +76,7 @@ class SysExParser {
   IRDataArray ir_array_;
   unique_ptr<FirmwareData> firmware_;
   DataType type_;
+  base::ThreadPool* executor_;
 
   DISALLOW_COPY_AND_ASSIGN(SysExParser);
 };
@@ -12,22 +12,43 @@
       'target_name': 'axefx_types',
       'type': 'none',
       'sources': [
+        'AxeFxII_7.axeml',
+        'AxeFxII_7_3.profile',
         'AxeFxII_9_2.axeml',
         'type_gen.py',
+        'unit_gen.py',
       ],
       'actions': [
         {
           'action_name': 'generate_types',
           'msvs_cygwin_shell': 0,
           'inputs': [
+            'AxeFxII_7.axeml',
             'AxeFxII_9_2.axeml',
+            'type_gen.py',
           ],
           'outputs': [
             'axefx_ii_ids.cc',
             'axefx_ii_ids.h',
           ],
           'action': [
-            'python', 'type_gen.py', 'AxeFxII_9_2.axeml', './'
+            'python', 'type_gen.py', 'AxeFxII_9_2.axeml',
+            'AxeFxII_7.axeml=0x0202', './'
+          ],
+        },
+        {
+          'action_name': 'generate_units',
+          'msvs_cygwin_shell': 0,
+          'inputs': [
+            'AxeFxII_7_3.profile',
+            'unit_gen.py',
+          ],
+          'outputs': [
+            'axefx_ii_units.cc',
+            'axefx_ii_units.h',
+          ],
+          'action': [
+            'python', 'unit_gen.py', 'AxeFxII_7_3.profile', './'
           ],
         },
       ],
@@ -42,20 +63,31 @@
       ],
       'dependencies': [
         '../../bcl/bcl.gyp:bcl',
+        '../common/base.gyp:base',
         '../jsoncpp/jsoncpp.gyp:*',
         'axefx_types',
       ],
       'sources': [
+        'axe_edit_xml_reader.cc',
+        'axe_edit_xml_reader.h',
         'axe_fx_sysex_parser.cc',
         'axe_fx_sysex_parser.h',
         'axefx_ii_ids.cc',
         'axefx_ii_ids.h',
+        'axefx_ii_units.cc',
+        'axefx_ii_units.h',
         'blocks.cc',
         'blocks.h',
         'ir_data.cc',
         'ir_data.h',
+        'param_units.cc',
+        'param_units.h',
         'preset.cc',
         'preset.h',
+        'preset_archive.cc',
+        'preset_archive.h',
+        'preset_json_reader.cc',
+        'preset_json_reader.h',
         'preset_parameters.cc',
         'preset_parameters.h',
         'sysex_callback.h',
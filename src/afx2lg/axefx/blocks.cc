@@ -2,9 +2,7 @@
 // All rights reserved.
 
 #include "axefx/blocks.h"
-#include "json/value.h"
-
-#include <algorithm>
+#include "common/json_writer.h"
 
 namespace axefx {
 
@@ -80,20 +78,24 @@ bool BlockSceneState::IsEqual(const BlockSceneState& other) const {
   return other.bypass_ == bypass_ && other.xy_ == xy_;
 }
 
-void BlockSceneState::ToJson(bool supports_xy, Json::Value* out) const {
-  Json::Value& j = *out;
-  Json::Value enabled;
-  // A value of true means the block is active in that scene.
+void BlockSceneState::WriteJson(bool supports_xy,
+                                base::JsonWriter* writer) const {
+  base::JsonWriter& w = *writer;
+  w.BeginObject();
+  w.Key("enabled");
+  w.BeginArray();
   for (int i = 0; i < 8; ++i)
-    enabled.append(!IsBypassedInScene(i));
-  j["enabled"] = enabled;
+    w.Value(!IsBypassedInScene(i));
+  w.EndArray();
 
   if (supports_xy) {
-    Json::Value xy;
+    w.Key("xy");
+    w.BeginArray();
     for (int i = 0; i < 8; ++i)
-      xy.append(Json::Value(IsConfigYEnabledInScene(i) ? "y" : "x"));
-    j["xy"] = xy;
+      w.Value(IsConfigYEnabledInScene(i) ? "y" : "x");
+    w.EndArray();
   }
+  w.EndObject();
 }
 
 BlockInMatrix::BlockInMatrix() : block_(0), input_mask_(0) {}
@@ -107,24 +109,42 @@ bool BlockInMatrix::is_shunt() const {
   return block_ >= 200 && block_ < (200 + (12 * 4));
 }
 
-void BlockInMatrix::ToJson(Json::Value* out) const {
-  Json::Value& j = *out;
-  j["id"] = block_;
-  j["is_shunt"] = is_shunt();
-  Json::Value inputs;
-  // If the other bits are used, we don't know about it (yet).
+void BlockInMatrix::WriteJson(base::JsonWriter* writer) const {
+  base::JsonWriter& w = *writer;
+  w.BeginObject();
+  w.Key("id");
+  w.Value(static_cast<int>(block_));
+  w.Key("is_shunt");
+  w.Value(is_shunt());
+  w.Key("input_rows");
   ASSERT((input_mask_ >> 4) == 0);
-  for (size_t i = 1; i <= 4; ++i) {
-    if ((input_mask_ & (1 << i)) != 0)
-      inputs.append(static_cast<Json::Value::UInt>(i));
+  // A block without inputs gets null rather than an empty array.
+  if ((input_mask_ & 0x0F) == 0) {
+    w.Null();
+  } else {
+    w.BeginArray();
+    for (unsigned int i = 0; i < kMatrixRows; ++i) {
+      if ((input_mask_ & (1 << i)) != 0)
+        w.Value(i);
+    }
+    w.EndArray();
   }
-  j["input_rows"] = inputs;
+  w.EndObject();
 }
 
 BlockParameters::BlockParameters()
     : block_(BLOCK_INVALID),
       config_(CONFIG_X),
-      global_block_index_(0u) {
+      global_block_index_(0u),
+      tables_(GetLatestTypeTables()) {
+}
+
+BlockParameters::BlockParameters(const TypeTables* tables)
+    : block_(BLOCK_INVALID),
+      config_(CONFIG_X),
+      global_block_index_(0u),
+      tables_(tables) {
+  ASSERT(tables_);
 }
 
 BlockParameters::~BlockParameters() {}
@@ -175,7 +195,7 @@ size_t BlockParameters::Write(uint16_t* dest, size_t buffer_size) const {
 }
 
 AxeFxBlockType BlockParameters::type() const {
-  return GetBlockType(block_);
+  return GetBlockType(tables_, block_);
 }
 
 AxeFxIIBlockID BlockParameters::block() const {
@@ -212,84 +232,118 @@ void BlockParameters::SetParamValue(int index,
       params_[(params_.size() / 2) + index] = value;
 }
 
+int BlockParameters::GetBypassParamIndex() const {
+  int bypass_id = GetBlockBypassParamID(tables_, type());
+  // Blocks saved by older firmware versions can have fewer parameters than
+  // what the generated tables describe.
+  size_t values = supports_xy() ? params_.size() / 2u : params_.size();
+  if (bypass_id != -1 && static_cast<size_t>(bypass_id) >= values)
+    bypass_id = -1;
+  return bypass_id;
+}
+
 BlockSceneState BlockParameters::GetBypassState() const {
-  int bypass_id = GetBlockBypassParamID(type());
+  int bypass_id = GetBypassParamIndex();
   return bypass_id == -1 ? BlockSceneState(0) :
                            BlockSceneState(GetParamValue(bypass_id, true));
 }
 
 bool BlockParameters::SetBypassState(const BlockSceneState& state) {
-  int bypass_id = GetBlockBypassParamID(type());
+  int bypass_id = GetBypassParamIndex();
   if (bypass_id == -1)
     return false;
   SetParamValue(bypass_id, state.As16bit(), true);
   return true;
 }
 
-void BlockParameters::ToJson(Json::Value* out) const {
-  Json::Value& j = *out;
-  AxeFxBlockType block_type = GetBlockType(block_);
-  const char* type_name = GetBlockTypeName(block_type);
-  j["id"] = block_;
-  j["name"] = GetBlockName(block_);
-  j["type"] = type_name;
-  j["supports_xy"] = supports_xy();
-  if (global_block_index_)
-    j["global_block_id"] = static_cast<int>(global_block_index_);
-
-  // Used for x/y configs.
+void BlockParameters::WriteJson(base::JsonWriter* writer) const {
+  base::JsonWriter& w = *writer;
+  AxeFxBlockType block_type = GetBlockType(tables_, block_);
+  const char* type_name = GetBlockTypeName(tables_, block_type);
+
+  w.BeginObject();
+  w.Key("id");
+  w.Value(static_cast<int>(block_));
+  w.Key("name");
+  w.Value(GetBlockName(tables_, block_));
+  w.Key("type");
+  w.Value(type_name);
+  w.Key("supports_xy");
+  w.Value(supports_xy());
+  if (global_block_index_) {
+    w.Key("global_block_id");
+    w.Value(static_cast<int>(global_block_index_));
+  }
+  w.Key("active_config");
+  w.Value(config_ == CONFIG_Y ? "y" : "x");
+
   size_t y_offset = params_.size() / 2u;
 
   if (block_type == BLOCK_TYPE_AMP && !params_.empty()) {
-    j["amp_x"] = GetAmpName(params_[DISTORT_TYPE]);
-    j["amp_y"] = GetAmpName(params_[y_offset + DISTORT_TYPE]);
+    w.Key("amp_x");
+    w.Value(GetAmpName(tables_, params_[DISTORT_TYPE]));
+    w.Key("amp_y");
+    w.Value(GetAmpName(tables_, params_[y_offset + DISTORT_TYPE]));
   } else if (block_type == BLOCK_TYPE_CAB) {
-    j["cab_x_left"] = GetCabName(params_[CABINET_TYPEL]);
-    j["cab_x_right"] = GetCabName(params_[CABINET_TYPER]);
-    j["cab_y_left"] = GetCabName(params_[y_offset + CABINET_TYPEL]);
-    j["cab_y_right"] = GetCabName(params_[y_offset + CABINET_TYPER]);
+    w.Key("cab_x_left");
+    w.Value(GetCabName(tables_, params_[CABINET_TYPEL]));
+    w.Key("cab_x_right");
+    w.Value(GetCabName(tables_, params_[CABINET_TYPER]));
+    w.Key("cab_y_left");
+    w.Value(GetCabName(tables_, params_[y_offset + CABINET_TYPEL]));
+    w.Key("cab_y_right");
+    w.Value(GetCabName(tables_, params_[y_offset + CABINET_TYPER]));
   }
 
-  std::string default_param_prefix(type_name);
-  std::transform(default_param_prefix.begin(), default_param_prefix.end(),
-                 default_param_prefix.begin(), &tolower);
-  default_param_prefix += '_';
+  size_t prefix_length;
+  const char* prefix = GetParamPrefix(tables_, block_type, &prefix_length);
 
-  Json::Value scenes;
-  GetBypassState().ToJson(supports_xy(), &scenes);
-  j["scenes"] = scenes;
+  w.Key("scenes");
+  GetBypassState().WriteJson(supports_xy(), writer);
+
+  w.Key("values");
+  if (params_.empty()) {
+    w.Null();
+    w.EndObject();
+    return;
+  }
 
-  Json::Value values;
+  w.BeginObject();
   if (supports_xy()) {
-    Json::Value values_x, values_y;
-    Json::Value* x_and_y[] = { &values_x, &values_y };
-    int v = 0;
+    w.Key("x");
+    w.BeginObject();
     for (size_t i = 0; i < params_.size(); ++i) {
-      const char* param_name =
-          GetParamName(block_type, static_cast<int>(i % y_offset));
-      if (i == y_offset)
-        ++v;
-
-      Json::Value& dict = *x_and_y[v];
-      if (!param_name[0]) {
-        dict[default_param_prefix + std::to_string(i)] = params_[i];
+      if (i == y_offset) {
+        w.EndObject();
+        w.Key("y");
+        w.BeginObject();
+      }
+      size_t length;
+      const char* param_name = GetParamName(
+          tables_, block_type, static_cast<int>(i % y_offset), &length);
+      if (!length) {
+        w.Key(prefix, prefix_length, i);
       } else {
-        dict[param_name] = params_[i];
+        w.Key(param_name, length);
       }
+      w.Value(static_cast<int>(params_[i]));
     }
-    values["x"] = values_x;
-    values["y"] = values_y;
+    w.EndObject();
   } else {
     for (size_t i = 0; i < params_.size(); ++i) {
-      const char* param_name = GetParamName(block_type, static_cast<int>(i));
-      if (!param_name[0]) {
-        values[default_param_prefix + std::to_string(i)] = params_[i];
+      size_t length;
+      const char* param_name =
+          GetParamName(tables_, block_type, static_cast<int>(i), &length);
+      if (!length) {
+        w.Key(prefix, prefix_length, i);
       } else {
-        values[param_name] = params_[i];
+        w.Key(param_name, length);
       }
+      w.Value(static_cast<int>(params_[i]));
     }
   }
-  j["values"] = values;
+  w.EndObject();
+  w.EndObject();
 }
 
 }  // namespace axefx
@@ -10,8 +10,8 @@
 
 #include <vector>
 
-namespace Json {
-class Value;
+namespace base {
+class JsonWriter;
 }
 
 namespace axefx {
@@ -40,7 +40,7 @@ class BlockSceneState {
 
   bool IsEqual(const BlockSceneState& other) const;
 
-  void ToJson(bool supports_xy, Json::Value* out) const;
+  void WriteJson(bool supports_xy, base::JsonWriter* writer) const;
 
  private:
   uint8_t bypass_;
@@ -56,7 +56,7 @@ class BlockInMatrix {
   AxeFxIIBlockID block() const { return static_cast<AxeFxIIBlockID>(block_); }
   const uint16_t& input_mask() const { return input_mask_; }
 
-  void ToJson(Json::Value* out) const;
+  void WriteJson(base::JsonWriter* writer) const;
 
  private:
   uint16_t block_;
@@ -80,7 +80,11 @@ enum BlockConfig {
 
 class BlockParameters {
  public:
+  // Uses the type tables of the newest supported firmware.
   BlockParameters();
+  // |tables| are used for names and ids that differ between firmware
+  // versions.  See GetTypeTables().
+  explicit BlockParameters(const TypeTables* tables);
   ~BlockParameters();
 
   // Populates the block parameters from a 16bit value array.
@@ -92,6 +96,7 @@ class BlockParameters {
 
   AxeFxBlockType type() const;
   AxeFxIIBlockID block() const;
+  const TypeTables* type_tables() const { return tables_; }
 
   bool supports_xy() const;
   size_t param_count() const;
@@ -99,19 +104,29 @@ class BlockParameters {
   BlockConfig active_config() const { return config_; }
   uint8_t global_block_index() const { return global_block_index_; }
 
+  // All values as stored in the preset.  For x/y blocks, the first half are
+  // the x values and the second half the y values.
+  const std::vector<uint16_t>& raw_values() const { return params_; }
+  std::vector<uint16_t>* mutable_raw_values() { return &params_; }
+
   uint16_t GetParamValue(int index, bool get_x_value) const;
   void SetParamValue(int index, uint16_t value, bool set_x_value);
 
   BlockSceneState GetBypassState() const;
   bool SetBypassState(const BlockSceneState& state);
 
-  void ToJson(Json::Value* out) const;
+  void WriteJson(base::JsonWriter* writer) const;
 
  private:
+  // Returns the index of the bypass parameter or -1 if the block doesn't
+  // have one.
+  int GetBypassParamIndex() const;
+
   AxeFxIIBlockID block_;
   BlockConfig config_;
   uint8_t global_block_index_;
   std::vector<uint16_t> params_;
+  const TypeTables* tables_;
 };
 
 }  // namespace axefx
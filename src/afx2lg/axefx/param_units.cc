@@ -0,0 +1,208 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "axefx/param_units.h"
+
+#include "axefx/blocks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace axefx {
+
+namespace {
+
+// Returns the offset of the x or y values within a block's raw values and
+// the number of values per config.
+void GetConfigRange(const BlockParameters& block, bool x_config,
+                    size_t* offset, size_t* count) {
+  size_t size = block.raw_values().size();
+  if (!block.supports_xy()) {
+    *offset = 0u;
+    *count = size;
+  } else {
+    *count = size / 2u;
+    *offset = x_config ? 0u : *count;
+  }
+}
+
+uint16_t ToRaw(double linear, double offset, double scale,
+               unsigned short min_raw, unsigned short max_raw) {
+  double raw = scale != 0.0 ? (linear - offset) / scale : 0.0;
+  // Also catches NaN.
+  if (!(raw > min_raw))
+    return min_raw;
+  if (raw >= max_raw)
+    return max_raw;
+  return static_cast<uint16_t>(raw + 0.5);
+}
+
+}  // namespace
+
+const ParamScaleTable* GetParamScaleTable(const BlockParameters& block,
+                                          bool x_config) {
+  if (block.is_modifier())
+    return NULL;
+
+  AxeFxBlockType type = block.type();
+  int variant = 0;
+  int variant_param = GetVariantParamID(type);
+  if (variant_param != -1) {
+    size_t offset, count;
+    GetConfigRange(block, x_config, &offset, &count);
+    if (static_cast<size_t>(variant_param) >= count)
+      return NULL;
+    variant = block.raw_values()[offset + variant_param];
+  }
+
+  return GetParamScaleTable(type, variant);
+}
+
+void RawToDisplay(const ParamScaleTable& table, const uint16_t* raw,
+                  size_t count, double* out) {
+  size_t scaled = std::min(count, table.count);
+  const double* offsets = table.offsets;
+  const double* scales = table.scales;
+  // Written as a plain multiply-add so the compiler can vectorize it.
+  for (size_t i = 0; i < scaled; ++i)
+    out[i] = offsets[i] + scales[i] * raw[i];
+  for (size_t i = 0; i < table.log_count; ++i) {
+    size_t index = table.log_params[i];
+    if (index < scaled)
+      out[index] = exp(out[index]);
+  }
+  for (size_t i = scaled; i < count; ++i)
+    out[i] = raw[i];
+}
+
+void DisplayToRaw(const ParamScaleTable& table, const double* values,
+                  size_t count, uint16_t* out) {
+  size_t scaled = std::min(count, table.count);
+  for (size_t i = 0; i < scaled; ++i) {
+    out[i] = ToRaw(values[i], table.offsets[i], table.scales[i],
+                   table.min_raw[i], table.max_raw[i]);
+  }
+  for (size_t i = 0; i < table.log_count; ++i) {
+    size_t index = table.log_params[i];
+    if (index < scaled) {
+      double value = values[index];
+      out[index] = value > 0.0 ?
+          ToRaw(log(value), table.offsets[index], table.scales[index],
+                table.min_raw[index], table.max_raw[index]) :
+          table.min_raw[index];
+    }
+  }
+  for (size_t i = scaled; i < count; ++i)
+    out[i] = ToRaw(values[i], 0.0, 1.0, 0u, 0xFFFF);
+}
+
+bool GetDisplayValues(const BlockParameters& block, std::vector<double>* out) {
+  const std::vector<uint16_t>& raw = block.raw_values();
+  out->resize(raw.size());
+  if (raw.empty())
+    return true;
+
+  for (int config = 0; config < (block.supports_xy() ? 2 : 1); ++config) {
+    bool x_config = config == 0;
+    const ParamScaleTable* table = GetParamScaleTable(block, x_config);
+    if (!table)
+      return false;
+    size_t offset, count;
+    GetConfigRange(block, x_config, &offset, &count);
+    RawToDisplay(*table, &raw[offset], count, &(*out)[offset]);
+  }
+
+  return true;
+}
+
+bool SetDisplayValues(const std::vector<double>& values,
+                      BlockParameters* block) {
+  std::vector<uint16_t>& raw = *block->mutable_raw_values();
+  if (values.size() != raw.size() || block->is_modifier())
+    return false;
+  if (raw.empty())
+    return true;
+
+  AxeFxBlockType type = block->type();
+  int variant_param = GetVariantParamID(type);
+  for (int config = 0; config < (block->supports_xy() ? 2 : 1); ++config) {
+    size_t offset, count;
+    GetConfigRange(*block, config == 0, &offset, &count);
+    int variant = 0;
+    if (variant_param != -1) {
+      // The variant parameter is described the same way in all variants.
+      const ParamScaleTable* first = GetParamScaleTable(type, 0);
+      if (!first || static_cast<size_t>(variant_param) >= count ||
+          static_cast<size_t>(variant_param) >= first->count) {
+        return false;
+      }
+      variant = ToRaw(values[offset + variant_param],
+                      first->offsets[variant_param],
+                      first->scales[variant_param],
+                      first->min_raw[variant_param],
+                      first->max_raw[variant_param]);
+    }
+
+    const ParamScaleTable* table = GetParamScaleTable(type, variant);
+    if (!table)
+      return false;
+    DisplayToRaw(*table, &values[offset], count, &raw[offset]);
+  }
+
+  return true;
+}
+
+std::string FormatDisplayValue(const ParamInfo& info, double value) {
+  if (info.taper == TAPER_LIST && info.item_count) {
+    double index = floor(value - info.minimum + 0.5);
+    if (index >= 0.0 && index < info.item_count)
+      return info.items[static_cast<int>(index)];
+  }
+
+  std::ostringstream stream;
+  stream << std::fixed
+         << std::setprecision(info.taper == TAPER_LIST ? 0 : info.precision)
+         << value;
+  if (info.unit[0])
+    stream << ' ' << info.unit;
+  return stream.str();
+}
+
+bool ParseDisplayValue(const ParamInfo& info, const std::string& text,
+                       double* value) {
+  size_t begin = text.find_first_not_of(' ');
+  size_t end = text.find_last_not_of(' ');
+  if (begin == std::string::npos)
+    return false;
+  std::string trimmed(text, begin, end - begin + 1);
+
+  for (int i = 0; i < info.item_count; ++i) {
+    // Some of the labels in the profile have trailing spaces.
+    const char* label = info.items[i];
+    size_t length = strlen(label);
+    while (length && label[length - 1] == ' ')
+      --length;
+    if (trimmed.compare(0, std::string::npos, label, length) == 0) {
+      *value = info.minimum + i;
+      return true;
+    }
+  }
+
+  // Drop the thousands separators.
+  std::string number;
+  number.reserve(trimmed.length());
+  for (char ch : trimmed) {
+    if (ch != ',')
+      number.push_back(ch);
+  }
+
+  char* number_end = NULL;
+  *value = strtod(number.c_str(), &number_end);
+  return number_end != number.c_str() && *number_end == '\0';
+}
+
+}  // namespace axefx
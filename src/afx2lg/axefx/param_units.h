@@ -0,0 +1,57 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef AXEFX_PARAM_UNITS_H_
+#define AXEFX_PARAM_UNITS_H_
+
+#include "common/common_types.h"
+#include "axefx/axefx_ii_units.h"
+
+#include <string>
+#include <vector>
+
+namespace axefx {
+
+class BlockParameters;
+
+// Conversion between raw parameter values (0-65534 for knobs) and the values
+// shown on the unit, e.g. dB, Hz or ms.  The scaling comes from the tables
+// generated from AxeFxII_7_3.profile, see unit_gen.py.
+// Parameters that the tables don't describe (e.g. ones added in later
+// firmware versions) are passed through unchanged.
+
+// Returns the table for the variant (e.g. amp model) that |block| is
+// currently set to in the x or y config, or NULL if there isn't one.
+const ParamScaleTable* GetParamScaleTable(const BlockParameters& block,
+                                          bool x_config);
+
+// Converts |count| values in one pass.
+void RawToDisplay(const ParamScaleTable& table, const uint16_t* raw,
+                  size_t count, double* out);
+// Values outside of a parameter's range are clamped.
+void DisplayToRaw(const ParamScaleTable& table, const double* values,
+                  size_t count, uint16_t* out);
+
+// Converts all of a block's values.  The layout of |out| is the same as the
+// raw values, i.e. for x/y blocks the x values come first.
+bool GetDisplayValues(const BlockParameters& block, std::vector<double>* out);
+// Counterpart of GetDisplayValues.  |values| must have one value per
+// parameter.  The variant parameter itself is taken from |values| first, so
+// the rest are converted with the matching table.
+bool SetDisplayValues(const std::vector<double>& values,
+                      BlockParameters* block);
+
+// Formats |value| with the parameter's precision and unit, e.g. "-12.5 dB".
+// List parameters are formatted as the item label, e.g. "BRIT 800".
+std::string FormatDisplayValue(const ParamInfo& info, double value);
+
+// Parses a value as shown by the unit or Axe-Edit, e.g. "  1,800.0" or
+// "SOFT".  The unit must not be included.  Returns false if |text| is neither
+// a number nor one of the parameter's item labels.
+bool ParseDisplayValue(const ParamInfo& info, const std::string& text,
+                       double* value);
+
+}  // namespace axefx
+
+#endif  // AXEFX_PARAM_UNITS_H_
@@ -5,15 +5,25 @@
 
 #include "axefx/sysex_types.h"
 #include "bcl/overrides/src/huffman.h"
+#include "common/json_writer.h"
+#include "json/reader.h"
 #include "json/value.h"
 
 #include <algorithm>
 #include <iostream>
+#include <sstream>
 
 namespace axefx {
 
 const int kInvalidPresetId = -1;
 const uint16_t kCurrentParameterVersion = 0x0206;
+// Number of 16 bit values in a preset's parameter data.
+const size_t kParameterCount = 2048u;
+// Size of the tone match IR data, in 16 bit values.
+const size_t kIRDataSize = 1024u;
+// Version, compressed size, name and the name's zero terminator come before
+// the matrix.
+const size_t kMatrixOffset = 2u + 31u + 1u;
 
 namespace {
 
@@ -26,7 +36,12 @@ bool IsVersionSupported(uint16_t version) {
 
 }  // namespace
 
-Preset::Preset() : version_(kCurrentParameterVersion), id_(kInvalidPresetId) {}
+Preset::Preset()
+    : version_(kCurrentParameterVersion),
+      type_tables_(GetTypeTables(kCurrentParameterVersion)),
+      id_(kInvalidPresetId) {
+}
+
 Preset::~Preset() {}
 
 void Preset::set_id(int id) {
@@ -36,7 +51,23 @@ void Preset::set_id(int id) {
 
 void Preset::set_name(const std::string& name) {
   ASSERT(params_.empty());
-  name.length() >= 31 ? name_ = name.substr(0, 30) : name_ = name;
+  name.length() > 31 ? name_ = name.substr(0, 31) : name_ = name;
+}
+
+void Preset::set_version(uint16_t version) {
+  ASSERT(params_.empty());
+  version_ = version;
+  type_tables_ = GetTypeTables(version);
+}
+
+void Preset::set_matrix(const Matrix& matrix) {
+  ASSERT(params_.empty());
+  memcpy(&matrix_[0][0], &matrix[0][0], sizeof(matrix_));
+}
+
+void Preset::AddBlockParameters(unique_ptr<BlockParameters> block) {
+  ASSERT(params_.empty());
+  block_parameters_.push_back(std::move(block));
 }
 
 bool Preset::valid() const {
@@ -117,6 +148,7 @@ bool Preset::Finalize(const PresetChecksumHeader* header, size_t size,
   }
 
   version_ = *p;
+  type_tables_ = GetTypeTables(version_);
   if (!IsVersionSupported(version_)) {
     std::cerr << "Unsupported syx version - " << version_ << std::endl;
     return false;
@@ -175,7 +207,8 @@ bool Preset::Finalize(const PresetChecksumHeader* header, size_t size,
 
   // Parse per block parameters (including modifiers).
   while (p < params_.end() && *p) {
-    unique_ptr<BlockParameters> block_params(new BlockParameters());
+    unique_ptr<BlockParameters> block_params(
+        new BlockParameters(type_tables_));
     size_t values_eaten = block_params->Initialize(&(*p), params_.end() - p);
     if (!values_eaten)
       return false;
@@ -190,41 +223,60 @@ bool Preset::Finalize(const PresetChecksumHeader* header, size_t size,
 }
 
 void Preset::ToJson(Json::Value* out) const {
-  Json::Value& j = *out;
+  std::ostringstream stream;
+  {
+    base::JsonWriter writer(&stream, base::JsonWriter::COMPACT);
+    WriteJson(&writer);
+  }
+  Json::Reader reader;
+  if (!reader.parse(stream.str(), *out))
+    ASSERT(false);
+}
+
+void Preset::WriteJson(base::JsonWriter* writer) const {
+  base::JsonWriter& w = *writer;
+  w.BeginObject();
+  w.Key("id");
   if (from_edit_buffer()) {
-    j["id"] = Json::Value();
+    w.Null();
   } else {
-    j["id"] = id_;
+    w.Value(id_);
+  }
+  w.Key("name");
+  w.Value(name_);
+
+  if (!is_global_setting()) {
+    w.Key("version");
+    w.Value(static_cast<int>(version_));
   }
-  j["name"] = name_;
 
   if (is_global_setting() || !params_.empty()) {
-    // TODO: Support at least user cabs and the 0x1234 "preset".
+    w.EndObject();
     return;
   }
 
-  Json::Value matrix;
+  w.Key("matrix");
+  w.BeginObject();
   for (size_t y = 0; y < kMatrixRows; ++y) {
-    Json::Value row;
-    for (size_t x = 0; x < kMatrixColumns; ++x) {
-      const BlockInMatrix& b = matrix_[x][y];
-      Json::Value block;
-      b.ToJson(&block);
-      row.append(block);
-    }
-    matrix["row" + std::to_string(y)] = row;
+    w.Key("row", 3, y);
+    w.BeginArray();
+    for (size_t x = 0; x < kMatrixColumns; ++x)
+      matrix_[x][y].WriteJson(writer);
+    w.EndArray();
   }
+  w.EndObject();
 
-  j["matrix"] = matrix;
-
-  Json::Value block_params;
-  for (const auto& p: block_parameters_) {
-    Json::Value params;
-    p->ToJson(&params);
-    block_params.append(params);
+  w.Key("block_params");
+  if (block_parameters_.empty()) {
+    w.Null();
+  } else {
+    w.BeginArray();
+    for (const auto& p: block_parameters_)
+      p->WriteJson(writer);
+    w.EndArray();
   }
 
-  j["block_params"] = block_params;
+  w.EndObject();
 }
 
 bool Preset::Serialize(const SysExCallback& callback) const {
@@ -249,6 +301,42 @@ void Preset::WriteHeader(const SysExCallback& callback) const {
   callback(data);
 }
 
+void Preset::GetUncompressedParameters(std::vector<uint16_t>* params) const {
+  if (is_global_setting() || !params_.empty()) {
+    params->assign(params_.begin(), params_.end());
+    return;
+  }
+
+  params->assign(kParameterCount, 0);
+  params->resize(WriteUncompressed(&(*params)[0], params->size()));
+}
+
+bool Preset::SetUncompressedParameters(int id,
+                                       const uint16_t* params,
+                                       size_t count,
+                                       const uint16_t* ir_data,
+                                       size_t ir_count) {
+  ASSERT(params_.empty() && block_parameters_.empty());
+  if (count > kParameterCount || (ir_count != 0 && ir_count != kIRDataSize))
+    return false;
+
+  if (ir_count && (count < 2 || params[1] != 0))
+    return false;  // Compressed data must come with the IR data included.
+
+  id_ = id;
+  params_.assign(params, params + count);
+  params_.resize(kParameterCount, 0);
+  if (!Finalize(NULL, 0, false)) {
+    id_ = kInvalidPresetId;
+    params_.clear();
+    return false;
+  }
+
+  ir_data_.assign(ir_data, ir_data + ir_count);
+
+  return true;
+}
+
 void Preset::FillParameters(PresetParameters* params) const {
   // TODO: Configure a struct for the version, compressed_size and name values.
   PresetParameters& p = *params;
@@ -261,25 +349,10 @@ void Preset::FillParameters(PresetParameters* params) const {
   }
 
   // Param block size is fixed at 2048.
-  p.assign(2048, 0);
-
-  size_t pos = 0;
-  p[pos++] = version_;
-  uint16_t& compressed_size = p[pos++];
-
-  for (size_t i = 0; i < 31; ++i)
-    p[pos++] = (i < name_.length()) ? name_[i] : ' ';
-  ++pos;  // zero terminator.
-
-  // Copy the matrix.
-  size_t matrix_begins = pos;
-  memcpy(&p[pos], &matrix_[0][0], sizeof(matrix_));
-  pos += sizeof(matrix_) / sizeof(p[0]);
-
-  for (const auto& b: block_parameters_) {
-    size_t values = b->Write(&p[pos], p.size() - pos);
-    pos += values;
-  }
+  p.assign(kParameterCount, 0);
+  size_t pos = WriteUncompressed(&p[0], p.size());
+  uint16_t& compressed_size = p[1];
+  const size_t matrix_begins = kMatrixOffset;
 
   if (!ir_data_.empty()) {
     // Compress the parameters.
@@ -306,6 +379,29 @@ void Preset::FillParameters(PresetParameters* params) const {
   }
 }
 
+size_t Preset::WriteUncompressed(uint16_t* dest, size_t size) const {
+  ASSERT(size >= kMatrixOffset + (sizeof(matrix_) / sizeof(dest[0])));
+  size_t pos = 0;
+  dest[pos++] = version_;
+  dest[pos++] = 0;  // Compressed size.
+
+  for (size_t i = 0; i < 31; ++i)
+    dest[pos++] = (i < name_.length()) ? name_[i] : ' ';
+  dest[pos++] = 0;  // zero terminator.
+
+  // Copy the matrix.
+  ASSERT(pos == kMatrixOffset);
+  memcpy(&dest[pos], &matrix_[0][0], sizeof(matrix_));
+  pos += sizeof(matrix_) / sizeof(dest[0]);
+
+  for (const auto& b: block_parameters_) {
+    size_t values = b->Write(&dest[pos], size - pos);
+    pos += values;
+  }
+
+  return pos;
+}
+
 void Preset::WriteChecksum(uint16_t checksum,
                            const SysExCallback& callback) const {
   std::vector<uint8_t> data;
@@ -15,6 +15,10 @@
 #include <string>
 #include <vector>
 
+namespace base {
+class JsonWriter;
+}
+
 namespace Json {
 class Value;
 }
@@ -30,7 +34,13 @@ class Preset {
   void set_id(int id);
   const std::string& name() const { return name_; }
   void set_name(const std::string& name);
+  uint16_t version() const { return version_; }
+  void set_version(uint16_t version);
+  // The name and id tables that match the firmware the preset was saved
+  // with.  Blocks added via AddBlockParameters should use the same tables.
+  const TypeTables* type_tables() const { return type_tables_; }
   const Matrix& matrix() const { return matrix_; }
+  void set_matrix(const Matrix& matrix);
   const PresetParameters& params() const { return params_; }
 
   // Returns the embedded IR data if any.  Used in presets that use the tone
@@ -48,6 +58,10 @@ class Preset {
 
   BlockParameters* LookupBlock(AxeFxIIBlockID block);
 
+  // Appends a block to the preset.  Used when building a preset from other
+  // sources than sysex, e.g. JSON.
+  void AddBlockParameters(unique_ptr<BlockParameters> block);
+
   // Parse methods.
   bool SetPresetId(const PresetIdHeader& header, size_t size);
   bool AddParameterData(const ParameterBlockHeader& header, size_t size);
@@ -59,13 +73,32 @@ class Preset {
   bool Finalize(const PresetChecksumHeader* header, size_t size,
                 bool verify_only);
 
+  // The preset data in its native form, i.e. neither compressed nor sysex
+  // encoded: version, name, matrix and block parameters.  Tone match IR data
+  // is not included, see ir_data().  For presets that haven't been parsed
+  // (e.g. global system data), the raw parameter data is returned.
+  void GetUncompressedParameters(std::vector<uint16_t>* params) const;
+  // Counterpart of GetUncompressedParameters.  |ir_data| is optional.
+  // Returns false if the data can't be parsed.
+  bool SetUncompressedParameters(int id,
+                                 const uint16_t* params,
+                                 size_t count,
+                                 const uint16_t* ir_data,
+                                 size_t ir_count);
+
+  // Builds a DOM from what WriteJson writes.  WriteJson defines the schema.
   void ToJson(Json::Value* out) const;
+  // The preset is written as a single JSON object.
+  void WriteJson(base::JsonWriter* writer) const;
 
   bool Serialize(const SysExCallback& callback) const;
 
  private:
   void WriteHeader(const SysExCallback& callback) const;
   void FillParameters(PresetParameters* params) const;
+  // Writes the parameter data, without compression, to |dest| and returns
+  // the number of values written.
+  size_t WriteUncompressed(uint16_t* dest, size_t size) const;
   void WriteChecksum(uint16_t checksum, const SysExCallback& callback) const;
 
   // Valid while parsing, then discarded.
@@ -75,6 +108,7 @@ class Preset {
 
   // Valid after parsing only.
   uint16_t version_;
+  const TypeTables* type_tables_;
   int id_;
   std::string name_;
   Matrix matrix_;
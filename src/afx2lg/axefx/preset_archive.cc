@@ -0,0 +1,181 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "axefx/preset_archive.h"
+
+#include "axefx/preset.h"
+
+#include <iostream>
+
+namespace axefx {
+
+namespace {
+
+const char kArchiveMagic[4] = { 'A', 'X', 'F', 'P' };
+
+// The archive is written and read in the host's byte order.  All of the
+// platforms we build for are little endian.
+bool IsLittleEndian() {
+  const uint16_t value = 1;
+  return *reinterpret_cast<const uint8_t*>(&value) == 1;
+}
+
+size_t AlignTo4(size_t offset) {
+  return (offset + 3) & ~static_cast<size_t>(3);
+}
+
+}  // namespace
+
+bool IsPresetArchive(const uint8_t* begin, const uint8_t* end) {
+  return static_cast<size_t>(end - begin) >= sizeof(ArchiveHeader) &&
+         memcmp(begin, kArchiveMagic, sizeof(kArchiveMagic)) == 0;
+}
+
+bool WritePresetArchive(const PresetMap& presets, std::vector<uint8_t>* out) {
+  ASSERT(IsLittleEndian());
+
+  size_t offset = sizeof(ArchiveHeader) + presets.size() * sizeof(ArchiveEntry);
+  out->assign(offset, 0);
+
+  ArchiveHeader header = {};
+  memcpy(header.magic, kArchiveMagic, sizeof(kArchiveMagic));
+  header.format_version = kArchiveFormatVersion;
+  header.entry_size = sizeof(ArchiveEntry);
+  header.preset_count = static_cast<uint32_t>(presets.size());
+  memcpy(&(*out)[0], &header, sizeof(header));
+
+  std::vector<uint16_t> params;
+  size_t index = 0;
+  for (const auto& entry : presets) {
+    const Preset& preset = *entry.second.get();
+    if (!preset.valid())
+      return false;
+
+    preset.GetUncompressedParameters(&params);
+    // The parameter data is padded with zeros, which don't need storing.
+    while (!params.empty() && params.back() == 0)
+      params.pop_back();
+
+    const std::vector<uint16_t>& ir_data = preset.ir_data();
+
+    offset = AlignTo4(out->size());
+    ArchiveEntry e = {};
+    e.offset = static_cast<uint32_t>(offset);
+    e.id = static_cast<uint16_t>(preset.id());
+    e.param_count = static_cast<uint16_t>(params.size());
+    e.ir_count = static_cast<uint16_t>(ir_data.size());
+    memcpy(&(*out)[sizeof(ArchiveHeader) + index * sizeof(ArchiveEntry)], &e,
+           sizeof(e));
+    ++index;
+
+    size_t param_bytes = params.size() * sizeof(params[0]);
+    size_t ir_bytes = ir_data.size() * sizeof(ir_data[0]);
+    out->resize(offset + param_bytes + ir_bytes, 0);
+    if (param_bytes)
+      memcpy(&(*out)[offset], &params[0], param_bytes);
+    if (ir_bytes)
+      memcpy(&(*out)[offset + param_bytes], &ir_data[0], ir_bytes);
+  }
+
+  return true;
+}
+
+PresetArchiveReader::PresetArchiveReader()
+    : begin_(NULL), entries_(NULL), count_(0u) {
+}
+
+PresetArchiveReader::~PresetArchiveReader() {}
+
+bool PresetArchiveReader::Open(const uint8_t* begin, const uint8_t* end) {
+  ASSERT(IsLittleEndian());
+  begin_ = NULL;
+  entries_ = NULL;
+  count_ = 0u;
+
+  if (!IsPresetArchive(begin, end)) {
+    std::cerr << "Not a preset archive\n";
+    return false;
+  }
+
+  if ((reinterpret_cast<uintptr_t>(begin) & 3) != 0) {
+    ASSERT(false);
+    return false;
+  }
+
+  const ArchiveHeader& header = *reinterpret_cast<const ArchiveHeader*>(begin);
+  if (header.format_version != kArchiveFormatVersion ||
+      header.entry_size != sizeof(ArchiveEntry)) {
+    std::cerr << "Unsupported preset archive version: "
+              << header.format_version << std::endl;
+    return false;
+  }
+
+  size_t size = end - begin;
+  size_t toc_end = sizeof(ArchiveHeader) +
+      static_cast<size_t>(header.preset_count) * sizeof(ArchiveEntry);
+  if (header.preset_count > size / sizeof(ArchiveEntry) || toc_end > size) {
+    std::cerr << "Preset archive is truncated\n";
+    return false;
+  }
+
+  const ArchiveEntry* entries =
+      reinterpret_cast<const ArchiveEntry*>(begin + sizeof(ArchiveHeader));
+  for (uint32_t i = 0; i < header.preset_count; ++i) {
+    const ArchiveEntry& e = entries[i];
+    size_t data_size = (e.param_count + e.ir_count) * sizeof(uint16_t);
+    if ((e.offset & 3) != 0 || e.offset < toc_end || e.offset > size ||
+        data_size > size - e.offset) {
+      std::cerr << "Preset archive entry " << i << " is corrupt\n";
+      return false;
+    }
+  }
+
+  begin_ = begin;
+  entries_ = entries;
+  count_ = header.preset_count;
+
+  return true;
+}
+
+int PresetArchiveReader::preset_id(size_t index) const {
+  ASSERT(index < count_);
+  return entries_[index].id;
+}
+
+std::string PresetArchiveReader::preset_name(size_t index) const {
+  ASSERT(index < count_);
+  const ArchiveEntry& e = entries_[index];
+  if (e.id >= (3 * 128) && e.id < (4 * 128)) {
+    // Global system data doesn't have a name in the parameters.
+    shared_ptr<Preset> preset(ReadPreset(index));
+    return preset ? preset->name() : std::string();
+  }
+
+  // Same layout as in Preset::Finalize: version, compressed size, then the
+  // name as 31 values padded with spaces.
+  const uint16_t* params =
+      reinterpret_cast<const uint16_t*>(begin_ + e.offset);
+  std::string name;
+  for (size_t i = 2; i < 2 + 31 && i < e.param_count; ++i)
+    name.push_back(static_cast<char>(params[i]));
+  std::string::size_type length = name.length();
+  while (length > 0 && (name[length - 1] == ' ' || name[length - 1] == '\0'))
+    --length;
+  name.resize(length);
+  return name;
+}
+
+shared_ptr<Preset> PresetArchiveReader::ReadPreset(size_t index) const {
+  ASSERT(index < count_);
+  const ArchiveEntry& e = entries_[index];
+  const uint16_t* params =
+      reinterpret_cast<const uint16_t*>(begin_ + e.offset);
+  shared_ptr<Preset> preset(new Preset());
+  if (!preset->SetUncompressedParameters(e.id, params, e.param_count,
+                                         params + e.param_count, e.ir_count)) {
+    preset.reset();
+  }
+  return preset;
+}
+
+}  // namespace axefx
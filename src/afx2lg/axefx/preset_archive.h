@@ -0,0 +1,88 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef AXEFX_PRESET_ARCHIVE_H_
+#define AXEFX_PRESET_ARCHIVE_H_
+
+#include "common/common_types.h"
+
+#include "axefx/axe_fx_sysex_parser.h"
+
+#include <string>
+#include <vector>
+
+namespace axefx {
+
+class Preset;
+
+// A compact binary container for presets.  Where a .syx file spends 3 bytes
+// on every 16 bit value and adds framing and checksums, the archive stores
+// each preset's uncompressed parameters (see
+// Preset::GetUncompressedParameters) and tone match IR data as plain 16 bit
+// values.  A table of contents follows the header, so an archive can be
+// memory mapped and any preset reached without decoding the others.
+//
+// Layout (all values little endian):
+//   ArchiveHeader
+//   ArchiveEntry[preset_count]
+//   Preset data, each starting at a 4 byte aligned offset:
+//     uint16_t params[param_count]
+//     uint16_t ir_data[ir_count]
+struct ArchiveHeader {
+  char magic[4];  // "AXFP"
+  uint16_t format_version;
+  uint16_t entry_size;  // sizeof(ArchiveEntry).
+  uint32_t preset_count;
+  uint32_t reserved;
+};
+
+struct ArchiveEntry {
+  uint32_t offset;  // Offset of the preset data from the start of the archive.
+  uint16_t id;
+  uint16_t param_count;
+  uint16_t ir_count;
+  uint16_t reserved;
+};
+
+static_assert(sizeof(ArchiveHeader) == 16, "ArchiveHeader size mismatch");
+static_assert(sizeof(ArchiveEntry) == 12, "ArchiveEntry size mismatch");
+
+const uint16_t kArchiveFormatVersion = 1u;
+
+// Returns true if the buffer starts with an archive header.
+bool IsPresetArchive(const uint8_t* begin, const uint8_t* end);
+
+// Writes |presets| as an archive to |out|.
+bool WritePresetArchive(const PresetMap& presets, std::vector<uint8_t>* out);
+
+// Gives access to the presets in an archive.  The archive data is not copied.
+class PresetArchiveReader {
+ public:
+  PresetArchiveReader();
+  ~PresetArchiveReader();
+
+  // Verifies the header and table of contents.  The buffer must be 4 byte
+  // aligned (e.g. memory mapped or heap allocated) and outlive the reader.
+  bool Open(const uint8_t* begin, const uint8_t* end);
+
+  size_t preset_count() const { return count_; }
+  int preset_id(size_t index) const;
+  // Reads the name directly from the archive without creating a Preset.
+  std::string preset_name(size_t index) const;
+
+  // Creates a Preset for the entry at |index|.  Returns null if the preset
+  // data isn't valid.
+  shared_ptr<Preset> ReadPreset(size_t index) const;
+
+ private:
+  const uint8_t* begin_;
+  const ArchiveEntry* entries_;
+  size_t count_;
+
+  DISALLOW_COPY_AND_ASSIGN(PresetArchiveReader);
+};
+
+}  // namespace axefx
+
+#endif  // AXEFX_PRESET_ARCHIVE_H_
@@ -0,0 +1,482 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "axefx/preset_json_reader.h"
+
+#include "axefx/preset.h"
+#include "axefx/sysex_types.h"
+
+#include <cstdlib>
+#include <iostream>
+
+namespace axefx {
+
+using base::JsonReader;
+
+namespace {
+const int kScenes = 8;
+}  // namespace
+
+PresetJsonReader::PresetJsonReader(const PresetCallback& callback)
+    : callback_(callback) {
+}
+
+PresetJsonReader::~PresetJsonReader() {}
+
+bool PresetJsonReader::Parse(const char* begin, const char* end) {
+  JsonReader reader(begin, end);
+  JsonReader::Token token = reader.Next();
+  if (token == JsonReader::BEGIN_ARRAY) {
+    if (!ParsePresetArray(&reader))
+      return false;
+  } else if (token == JsonReader::BEGIN_OBJECT) {
+    token = reader.Next();
+    if (token == JsonReader::KEY && reader.string() == "bank") {
+      if (reader.Next() != JsonReader::BEGIN_ARRAY)
+        return Error(reader, "'bank' must be an array");
+      if (!ParsePresetArray(&reader))
+        return false;
+      while ((token = reader.Next()) == JsonReader::KEY) {
+        if (!reader.Skip(reader.Next()))
+          return Error(reader, "Syntax error");
+      }
+      if (token != JsonReader::END_OBJECT)
+        return Error(reader, "Syntax error");
+    } else if (!ParsePreset(&reader, token)) {
+      return false;
+    }
+  } else {
+    return Error(reader, "Expected a preset or an array of presets");
+  }
+
+  if (reader.Next() != JsonReader::END_OF_INPUT)
+    return Error(reader, "Unexpected data after the presets");
+
+  return true;
+}
+
+bool PresetJsonReader::ParsePresetArray(JsonReader* reader) {
+  JsonReader::Token token;
+  while ((token = reader->Next()) == JsonReader::BEGIN_OBJECT) {
+    if (!ParsePreset(reader, reader->Next()))
+      return false;
+  }
+  return token == JsonReader::END_ARRAY ||
+         Error(*reader, "Expected a preset object");
+}
+
+bool PresetJsonReader::ParsePreset(JsonReader* reader,
+                                   JsonReader::Token first_token) {
+  bool has_id = false;
+  bool edit_buffer = false;
+  int id = 0;
+  uint16_t version = 0;
+  bool has_version = false;
+  std::string name;
+  bool has_matrix = false;
+  Matrix matrix;
+  std::vector<PendingBlock> blocks;
+
+  JsonReader::Token token = first_token;
+  for (; token == JsonReader::KEY; token = reader->Next()) {
+    std::string key(reader->string());
+    token = reader->Next();
+    if (key == "id") {
+      has_id = true;
+      if (token == JsonReader::NULL_VALUE) {
+        edit_buffer = true;
+      } else if (token == JsonReader::NUMBER && reader->IsInteger(0, 511)) {
+        id = static_cast<int>(reader->number());
+      } else {
+        return Error(*reader, "Invalid preset id");
+      }
+    } else if (key == "version") {
+      if (token != JsonReader::NUMBER || !reader->IsInteger(0, 0xFFFF))
+        return Error(*reader, "Invalid preset version");
+      version = static_cast<uint16_t>(reader->number());
+      has_version = true;
+    } else if (key == "name") {
+      if (token != JsonReader::STRING)
+        return Error(*reader, "Invalid preset name");
+      name = reader->string();
+    } else if (key == "matrix") {
+      if (token != JsonReader::BEGIN_OBJECT || !ParseMatrix(reader, &matrix))
+        return Error(*reader, "Invalid matrix");
+      has_matrix = true;
+    } else if (key == "block_params") {
+      if (token == JsonReader::BEGIN_ARRAY) {
+        while ((token = reader->Next()) == JsonReader::BEGIN_OBJECT) {
+          blocks.push_back(PendingBlock());
+          if (!ParseBlock(reader, &blocks.back()))
+            return false;
+        }
+        if (token != JsonReader::END_ARRAY)
+          return Error(*reader, "Invalid block parameters");
+      } else if (token != JsonReader::NULL_VALUE) {
+        return Error(*reader, "Invalid block parameters");
+      }
+    } else if (!reader->Skip(token)) {
+      return Error(*reader, "Syntax error");
+    }
+  }
+
+  if (token != JsonReader::END_OBJECT)
+    return Error(*reader, "Syntax error");
+
+  if (!has_id)
+    return Error(*reader, "Preset has no id");
+
+  if (!edit_buffer && id >= (3 * 128) && id < (4 * 128))
+    return Error(*reader, "Global system data can't be imported");
+
+  if (!has_matrix)
+    return Error(*reader, "Preset has no matrix");
+
+  shared_ptr<Preset> preset(new Preset());
+  preset->set_id(id);
+  if (edit_buffer)
+    preset->SetAsEditBuffer();
+  preset->set_name(name);
+  if (has_version)
+    preset->set_version(version);
+  preset->set_matrix(matrix);
+  for (const auto& b : blocks) {
+    unique_ptr<BlockParameters> block;
+    if (!BuildBlock(preset->type_tables(), b, &block))
+      return false;
+    preset->AddBlockParameters(std::move(block));
+  }
+
+  callback_(preset);
+
+  return true;
+}
+
+bool PresetJsonReader::ParseMatrix(JsonReader* reader, Matrix* matrix) {
+  JsonReader::Token token;
+  while ((token = reader->Next()) == JsonReader::KEY) {
+    const std::string& key = reader->string();
+    if (key.length() == 4 && key.compare(0, 3, "row") == 0 &&
+        key[3] >= '0' && key[3] < static_cast<char>('0' + kMatrixRows)) {
+      size_t row = key[3] - '0';
+      if (reader->Next() != JsonReader::BEGIN_ARRAY ||
+          !ParseMatrixRow(reader, row, matrix)) {
+        return false;
+      }
+    } else if (!reader->Skip(reader->Next())) {
+      return false;
+    }
+  }
+  return token == JsonReader::END_OBJECT;
+}
+
+bool PresetJsonReader::ParseMatrixRow(JsonReader* reader,
+                                      size_t row,
+                                      Matrix* matrix) {
+  JsonReader::Token token;
+  size_t column = 0;
+  while ((token = reader->Next()) == JsonReader::BEGIN_OBJECT) {
+    if (column == kMatrixColumns)
+      return false;
+
+    uint16_t block = 0;
+    uint16_t mask = 0;
+    while ((token = reader->Next()) == JsonReader::KEY) {
+      if (reader->string() == "id") {
+        if (reader->Next() != JsonReader::NUMBER ||
+            !reader->IsInteger(0, 0xFFFF)) {
+          return false;
+        }
+        block = static_cast<uint16_t>(reader->number());
+      } else if (reader->string() == "input_rows") {
+        token = reader->Next();
+        if (token == JsonReader::BEGIN_ARRAY) {
+          while ((token = reader->Next()) == JsonReader::NUMBER) {
+            if (!reader->IsInteger(0, kMatrixRows - 1))
+              return false;
+            mask |= 1 << static_cast<int>(reader->number());
+          }
+          if (token != JsonReader::END_ARRAY)
+            return false;
+        } else if (token != JsonReader::NULL_VALUE) {
+          return false;
+        }
+      } else if (!reader->Skip(reader->Next())) {
+        return false;
+      }
+    }
+
+    if (token != JsonReader::END_OBJECT)
+      return false;
+
+    (*matrix)[column++][row] = BlockInMatrix(block, mask);
+  }
+
+  return token == JsonReader::END_ARRAY;
+}
+
+bool PresetJsonReader::ParseBlock(JsonReader* reader, PendingBlock* block) {
+  int id = -1;
+  int global_block_index = 0;
+  bool config_y = false;
+  block->has_enabled = false;
+  block->has_xy = false;
+  block->is_xy = false;
+
+  JsonReader::Token token;
+  while ((token = reader->Next()) == JsonReader::KEY) {
+    std::string key(reader->string());
+    token = reader->Next();
+    if (key == "id") {
+      if (token != JsonReader::NUMBER || !reader->IsInteger(1, 0xFF))
+        return Error(*reader, "Invalid block id");
+      id = static_cast<int>(reader->number());
+    } else if (key == "global_block_id") {
+      if (token != JsonReader::NUMBER || !reader->IsInteger(0, 0x0F))
+        return Error(*reader, "Invalid global block id");
+      global_block_index = static_cast<int>(reader->number());
+    } else if (key == "active_config") {
+      if (token != JsonReader::STRING ||
+          (reader->string() != "x" && reader->string() != "y")) {
+        return Error(*reader, "Invalid active config");
+      }
+      config_y = reader->string() == "y";
+    } else if (key == "scenes") {
+      if (token != JsonReader::BEGIN_OBJECT ||
+          !ParseScenes(reader, &block->enabled[0], &block->y_enabled[0],
+                       &block->has_enabled, &block->has_xy)) {
+        return Error(*reader, "Invalid scene state");
+      }
+    } else if (key == "values") {
+      if (token == JsonReader::BEGIN_OBJECT) {
+        if (!ParseValues(reader, &block->is_xy, &block->values_x,
+                         &block->values_y)) {
+          return Error(*reader, "Invalid block values");
+        }
+      } else if (token != JsonReader::NULL_VALUE) {
+        return Error(*reader, "Invalid block values");
+      }
+    } else if (!reader->Skip(token)) {
+      return Error(*reader, "Syntax error");
+    }
+  }
+
+  if (token != JsonReader::END_OBJECT)
+    return Error(*reader, "Syntax error");
+
+  if (id == -1)
+    return Error(*reader, "Block has no id");
+
+  block->id = id;
+  block->state = static_cast<uint8_t>(global_block_index);
+  if (config_y)
+    block->state |= 0x80;
+  block->offset = reader->offset();
+
+  return true;
+}
+
+bool PresetJsonReader::BuildBlock(const TypeTables* tables,
+                                  const PendingBlock& block,
+                                  unique_ptr<BlockParameters>* out) {
+  AxeFxIIBlockID block_id = static_cast<AxeFxIIBlockID>(block.id);
+  AxeFxBlockType type = GetBlockType(tables, block_id);
+  bool supports_xy = block.id >= kFirstBlockId && BlockSupportsXY(type);
+  if (block.is_xy != supports_xy &&
+      !(block.values_x.empty() && block.values_y.empty())) {
+    return Error(block.offset, "X/Y values don't match the block type");
+  }
+
+  if (block.values_x.size() != block.values_y.size() && block.is_xy)
+    return Error(block.offset, "Different number of X and Y values");
+
+  // Build the same layout as is stored in the preset and let BlockParameters
+  // take it from there.
+  std::vector<uint16_t> data(2);
+  data[0] = static_cast<uint16_t>(block.id | (block.state << 8));
+  if (!ResolveValues(tables, type, block.values_x, 0, &data) ||
+      !ResolveValues(tables, type, block.values_y, block.values_x.size(),
+                     &data)) {
+    return Error(block.offset, "Unknown or duplicate parameter name");
+  }
+  if (data.size() - 2 > 0xFFFF)
+    return Error(block.offset, "Too many parameters");
+  data[1] = static_cast<uint16_t>(data.size() - 2);
+
+  out->reset(new BlockParameters(tables));
+  if (!(*out)->Initialize(&data[0], data.size()))
+    return Error(block.offset, "Invalid block");
+
+  if (block.has_enabled || block.has_xy) {
+    BlockSceneState scenes((*out)->GetBypassState());
+    for (int i = 0; i < kScenes; ++i) {
+      if (block.has_enabled)
+        scenes.SetBypassedInScene(i, !block.enabled[i]);
+      if (block.has_xy)
+        scenes.SetConfigYEnabledInScene(i, block.y_enabled[i]);
+    }
+    // Not all blocks have a bypass parameter, so this is allowed to fail.
+    (*out)->SetBypassState(scenes);
+  }
+
+  return true;
+}
+
+bool PresetJsonReader::ParseScenes(JsonReader* reader,
+                                   bool* enabled,
+                                   bool* y_enabled,
+                                   bool* has_enabled,
+                                   bool* has_xy) {
+  JsonReader::Token token;
+  while ((token = reader->Next()) == JsonReader::KEY) {
+    bool is_xy = reader->string() == "xy";
+    if (!is_xy && reader->string() != "enabled") {
+      if (!reader->Skip(reader->Next()))
+        return false;
+      continue;
+    }
+
+    if (reader->Next() != JsonReader::BEGIN_ARRAY)
+      return false;
+
+    int scene = 0;
+    while ((token = reader->Next()) != JsonReader::END_ARRAY) {
+      if (scene == kScenes)
+        return false;
+      if (is_xy) {
+        if (token != JsonReader::STRING ||
+            (reader->string() != "x" && reader->string() != "y")) {
+          return false;
+        }
+        y_enabled[scene] = reader->string() == "y";
+      } else {
+        if (token != JsonReader::BOOLEAN)
+          return false;
+        enabled[scene] = reader->boolean();
+      }
+      ++scene;
+    }
+
+    // All scenes must be listed.
+    if (scene != kScenes)
+      return false;
+
+    is_xy ? *has_xy = true : *has_enabled = true;
+  }
+
+  return token == JsonReader::END_OBJECT;
+}
+
+bool PresetJsonReader::ParseValues(JsonReader* reader,
+                                   bool* is_xy,
+                                   NamedValues* x,
+                                   NamedValues* y) {
+  // Values are either a flat name -> value object or, for blocks that
+  // support x/y, an object with "x" and "y" objects.
+  JsonReader::Token token;
+  while ((token = reader->Next()) == JsonReader::KEY) {
+    std::string key(reader->string());
+    token = reader->Next();
+    if (token == JsonReader::BEGIN_OBJECT && (key == "x" || key == "y")) {
+      if (!*is_xy && !x->empty())
+        return false;
+      *is_xy = true;
+      if (!ParseNamedValues(reader, key == "x" ? x : y))
+        return false;
+    } else if (token == JsonReader::NUMBER && reader->IsInteger(0, 0xFFFF)) {
+      if (*is_xy)
+        return false;
+      x->push_back(std::make_pair(key, static_cast<uint16_t>(
+          reader->number())));
+    } else {
+      return false;
+    }
+  }
+  return token == JsonReader::END_OBJECT;
+}
+
+bool PresetJsonReader::ParseNamedValues(JsonReader* reader,
+                                        NamedValues* values) {
+  JsonReader::Token token;
+  while ((token = reader->Next()) == JsonReader::KEY) {
+    values->push_back(std::make_pair(reader->string(), 0));
+    if (reader->Next() != JsonReader::NUMBER || !reader->IsInteger(0, 0xFFFF))
+      return false;
+    values->back().second = static_cast<uint16_t>(reader->number());
+  }
+  return token == JsonReader::END_OBJECT;
+}
+
+bool PresetJsonReader::ResolveValues(const TypeTables* tables,
+                                     AxeFxBlockType type,
+                                     const NamedValues& values,
+                                     size_t key_offset,
+                                     std::vector<uint16_t>* out) {
+  if (values.empty())
+    return true;
+
+  const ParamNameMap& names = GetParamNames(tables, type);
+
+  // Parameters without a name are written as the lower case type name,
+  // followed by an underscore and the index.
+  size_t prefix_length;
+  const std::string prefix(GetParamPrefix(tables, type, &prefix_length));
+
+  size_t first = out->size();
+  out->resize(first + values.size(), 0);
+  std::vector<bool> assigned(values.size(), false);
+  for (const auto& v : values) {
+    size_t index = values.size();
+    ParamNameMap::const_iterator found = names.find(v.first);
+    if (found != names.end()) {
+      for (int i : found->second) {
+        if (static_cast<size_t>(i) < values.size() && !assigned[i]) {
+          index = i;
+          break;
+        }
+      }
+    } else if (v.first.length() > prefix.length() &&
+               v.first.compare(0, prefix.length(), prefix) == 0) {
+      const char* digits = v.first.c_str() + prefix.length();
+      char* digits_end = NULL;
+      unsigned long i = strtoul(digits, &digits_end, 10);
+      if (*digits_end == '\0' && i >= key_offset)
+        index = i - key_offset;
+    }
+
+    if (index >= values.size() || assigned[index])
+      return false;
+
+    assigned[index] = true;
+    (*out)[first + index] = v.second;
+  }
+
+  return true;
+}
+
+const PresetJsonReader::ParamNameMap& PresetJsonReader::GetParamNames(
+    const TypeTables* tables,
+    AxeFxBlockType type) {
+  ParamNameMap& names = param_names_[std::make_pair(tables, type)];
+  if (names.empty()) {
+    int count = GetParamCount(tables, type);
+    for (int i = 0; i < count; ++i) {
+      const char* name = GetParamName(tables, type, i, NULL);
+      if (name[0])
+        names[name].push_back(i);
+    }
+  }
+  return names;
+}
+
+bool PresetJsonReader::Error(const JsonReader& reader, const char* message) {
+  return Error(reader.offset(), message);
+}
+
+bool PresetJsonReader::Error(size_t offset, const char* message) {
+  std::cerr << "Preset JSON error @ offset " << offset << ": " << message
+            << std::endl;
+  return false;
+}
+
+}  // namespace axefx
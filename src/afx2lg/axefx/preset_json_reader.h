@@ -0,0 +1,102 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef AXEFX_PRESET_JSON_READER_H_
+#define AXEFX_PRESET_JSON_READER_H_
+
+#include "common/common_types.h"
+#include "axefx/axefx_ii_ids.h"
+#include "axefx/blocks.h"
+#include "common/json_reader.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace axefx {
+
+class Preset;
+
+// Rebuilds Preset objects from the JSON written by Preset::WriteJson.  The
+// input is walked token by token, so no DOM is built and presets are handed
+// to the callback as soon as each one has been read.
+//
+// Accepted documents are a single preset object, an array of presets or an
+// object with a "bank" array as written by axe_backup.
+// The JSON doesn't carry tone match IR data or global system data, so presets
+// that rely on those can't be imported.
+class PresetJsonReader {
+ public:
+  typedef std::function<void(const shared_ptr<Preset>& preset)> PresetCallback;
+
+  explicit PresetJsonReader(const PresetCallback& callback);
+  ~PresetJsonReader();
+
+  // Returns false if the document is malformed or doesn't describe a preset.
+  // Presets that were successfully read before the error was found, will
+  // already have been delivered to the callback.
+  bool Parse(const char* begin, const char* end);
+
+ private:
+  typedef std::vector<std::pair<std::string, uint16_t> > NamedValues;
+  // Parameter name -> indices.  Some block types reuse a name for more than
+  // one parameter, in which case the indices are used in order.
+  typedef std::unordered_map<std::string, std::vector<int> > ParamNameMap;
+
+  // A block as read from the JSON.  Parameter names can't be resolved until
+  // the whole preset has been read, since they depend on the preset version.
+  struct PendingBlock {
+    int id;
+    uint8_t state;  // Global block index and active config.
+    bool has_enabled;
+    bool enabled[8];
+    bool has_xy;
+    bool y_enabled[8];
+    bool is_xy;
+    NamedValues values_x;
+    NamedValues values_y;
+    // Where the block ends in the input.  For error messages.
+    size_t offset;
+  };
+
+  bool ParsePresetArray(base::JsonReader* reader);
+  // Called after the opening brace and first token of a preset object.
+  bool ParsePreset(base::JsonReader* reader,
+                   base::JsonReader::Token first_token);
+  bool ParseMatrix(base::JsonReader* reader, Matrix* matrix);
+  bool ParseMatrixRow(base::JsonReader* reader, size_t row, Matrix* matrix);
+  bool ParseBlock(base::JsonReader* reader, PendingBlock* block);
+  bool BuildBlock(const TypeTables* tables, const PendingBlock& block,
+                  unique_ptr<BlockParameters>* out);
+  bool ParseScenes(base::JsonReader* reader, bool* enabled, bool* y_enabled,
+                   bool* has_enabled, bool* has_xy);
+  bool ParseValues(base::JsonReader* reader, bool* is_xy, NamedValues* x,
+                   NamedValues* y);
+  bool ParseNamedValues(base::JsonReader* reader, NamedValues* values);
+
+  // Maps each name in |values| to a parameter index and writes the values
+  // in index order to |out|.  |key_offset| is subtracted from the index
+  // embedded in default names (e.g. "amp_212" for y values).
+  bool ResolveValues(const TypeTables* tables, AxeFxBlockType type,
+                     const NamedValues& values, size_t key_offset,
+                     std::vector<uint16_t>* out);
+  const ParamNameMap& GetParamNames(const TypeTables* tables,
+                                    AxeFxBlockType type);
+
+  bool Error(const base::JsonReader& reader, const char* message);
+  bool Error(size_t offset, const char* message);
+
+  PresetCallback callback_;
+  std::map<std::pair<const TypeTables*, AxeFxBlockType>, ParamNameMap>
+      param_names_;
+
+  DISALLOW_COPY_AND_ASSIGN(PresetJsonReader);
+};
+
+}  // namespace axefx
+
+#endif  // AXEFX_PRESET_JSON_READER_H_
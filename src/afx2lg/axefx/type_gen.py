@@ -17,6 +17,8 @@ HEADER_FILE_TEMPLATE = """// Copyright (c) 2012, Tomas Gunnarsson
 #ifndef __AXEFX_II_GENERATED_TYPE_IDS__
 #define __AXEFX_II_GENERATED_TYPE_IDS__
 
+#include <cstddef>
+
 namespace axefx {
 
 %s
@@ -26,9 +28,41 @@ const char* GetBlockTypeName(AxeFxBlockType type);
 const char* GetBlockName(AxeFxIIBlockID id);
 int GetBlockBypassParamID(AxeFxBlockType type);
 const char* GetParamName(AxeFxBlockType type, int param_id);
+// Same as above, but also returns the length of the name via |length|.
+const char* GetParamName(AxeFxBlockType type, int param_id, size_t* length);
+// Returns the number of parameter ids there are names for.
+int GetParamCount(AxeFxBlockType type);
+// Returns the lower case type name followed by an underscore, e.g. "amp_".
+// Parameters that don't have a name are referred to by this prefix and the
+// parameter index.
+const char* GetParamPrefix(AxeFxBlockType type, size_t* length);
 const char* GetAmpName(int index);
 const char* GetCabName(int index);
 
+// Lookup tables generated from one firmware profile (.axeml file).
+// The functions above use the tables of the newest profile, the overloads
+// below look names up in a specific set of tables.
+struct TypeTables;
+
+// Returns the tables to use for presets saved with the given preset
+// parameter |version|.
+const TypeTables* GetTypeTables(unsigned int preset_version);
+const TypeTables* GetLatestTypeTables();
+// Returns the firmware version the tables were generated from, e.g. "9.2".
+const char* GetFirmwareVersion(const TypeTables* tables);
+
+AxeFxBlockType GetBlockType(const TypeTables* tables, AxeFxIIBlockID id);
+const char* GetBlockTypeName(const TypeTables* tables, AxeFxBlockType type);
+const char* GetBlockName(const TypeTables* tables, AxeFxIIBlockID id);
+int GetBlockBypassParamID(const TypeTables* tables, AxeFxBlockType type);
+const char* GetParamName(const TypeTables* tables, AxeFxBlockType type,
+                         int param_id, size_t* length);
+int GetParamCount(const TypeTables* tables, AxeFxBlockType type);
+const char* GetParamPrefix(const TypeTables* tables, AxeFxBlockType type,
+                           size_t* length);
+const char* GetAmpName(const TypeTables* tables, int index);
+const char* GetCabName(const TypeTables* tables, int index);
+
 // Forward declarations for block parameter lookups.
 %s
 
@@ -46,60 +80,198 @@ SOURCE_FILE_TEMPLATE = """// Copyright (c) 2012, Tomas Gunnarsson
 
 namespace axefx {
 
+namespace {
+
+struct Name {
+  const char* str;
+  size_t length;
+};
+
+template <size_t N>
+const char* LookupName(const Name (&table)[N], int index, size_t* length) {
+  if (index < 0 || static_cast<size_t>(index) >= N) {
+    if (length)
+      *length = 0u;
+    return "";
+  }
+  if (length)
+    *length = table[index].length;
+  return table[index].str;
+}
+
+struct BlockInfo {
+  AxeFxBlockType type;
+  const char* name;
+};
+
+struct BlockTypeInfo {
+  const char* name;
+  // Lower case name followed by an underscore.
+  const char* param_prefix;
+  size_t param_prefix_length;
+  int bypass_param;
+  const Name* params;
+  int param_count;
+};
+
+%s
+
+}  // namespace
+
+struct TypeTables {
+  const char* firmware;
+  // The newest preset parameter version the tables apply to.
+  unsigned int max_preset_version;
+  // |blocks| is indexed by block id - |first_block_id|.
+  int first_block_id;
+  const BlockInfo* blocks;
+  size_t block_count;
+  // Indexed by block type.
+  const BlockTypeInfo* types;
+  size_t type_count;
+  const Name* amps;
+  size_t amp_count;
+  const Name* cabs;
+  size_t cab_count;
+};
+
+#define TABLE_SIZE(table) (sizeof(table) / sizeof(table[0]))
+
+namespace {
+
+// Ordered by |max_preset_version|.
+const TypeTables kTypeTables[] = {
+%s};
+
+const BlockTypeInfo* GetBlockTypeInfo(const TypeTables* tables,
+                                      AxeFxBlockType type) {
+  if (type < 0 || static_cast<size_t>(type) >= tables->type_count)
+    return NULL;
+  return &tables->types[type];
+}
+
+const BlockInfo* GetBlockInfo(const TypeTables* tables, AxeFxIIBlockID id) {
+  int index = static_cast<int>(id) - tables->first_block_id;
+  if (index < 0 || static_cast<size_t>(index) >= tables->block_count)
+    return NULL;
+  return &tables->blocks[index];
+}
+
+const char* LookupName(const Name* table, size_t count, int index) {
+  if (index < 0 || static_cast<size_t>(index) >= count)
+    return "";
+  return table[index].str;
+}
+
+}  // namespace
+
+const TypeTables* GetTypeTables(unsigned int preset_version) {
+  for (size_t i = 0; i < TABLE_SIZE(kTypeTables); ++i) {
+    if (preset_version <= kTypeTables[i].max_preset_version)
+      return &kTypeTables[i];
+  }
+  return GetLatestTypeTables();
+}
+
+const TypeTables* GetLatestTypeTables() {
+  return &kTypeTables[TABLE_SIZE(kTypeTables) - 1];
+}
+
+const char* GetFirmwareVersion(const TypeTables* tables) {
+  return tables->firmware;
+}
+
+AxeFxBlockType GetBlockType(const TypeTables* tables, AxeFxIIBlockID id) {
+  const BlockInfo* info = GetBlockInfo(tables, id);
+  return info ? info->type : BLOCK_TYPE_INVALID;
+}
+
+const char* GetBlockTypeName(const TypeTables* tables, AxeFxBlockType type) {
+  const BlockTypeInfo* info = GetBlockTypeInfo(tables, type);
+  return info ? info->name : "";
+}
+
+const char* GetBlockName(const TypeTables* tables, AxeFxIIBlockID id) {
+  const BlockInfo* info = GetBlockInfo(tables, id);
+  return info ? info->name : "";
+}
+
+int GetBlockBypassParamID(const TypeTables* tables, AxeFxBlockType type) {
+  const BlockTypeInfo* info = GetBlockTypeInfo(tables, type);
+  return info ? info->bypass_param : -1;
+}
+
+const char* GetParamName(const TypeTables* tables, AxeFxBlockType type,
+                         int param_id, size_t* length) {
+  const BlockTypeInfo* info = GetBlockTypeInfo(tables, type);
+  if (!info || param_id < 0 || param_id >= info->param_count) {
+    if (length)
+      *length = 0u;
+    return "";
+  }
+  if (length)
+    *length = info->params[param_id].length;
+  return info->params[param_id].str;
+}
+
+int GetParamCount(const TypeTables* tables, AxeFxBlockType type) {
+  const BlockTypeInfo* info = GetBlockTypeInfo(tables, type);
+  return info ? info->param_count : 0;
+}
+
+const char* GetParamPrefix(const TypeTables* tables, AxeFxBlockType type,
+                           size_t* length) {
+  const BlockTypeInfo* info = GetBlockTypeInfo(tables, type);
+  *length = info ? info->param_prefix_length : 0u;
+  return info ? info->param_prefix : "";
+}
+
+const char* GetAmpName(const TypeTables* tables, int index) {
+  return LookupName(tables->amps, tables->amp_count, index);
+}
+
+const char* GetCabName(const TypeTables* tables, int index) {
+  return LookupName(tables->cabs, tables->cab_count, index);
+}
+
 AxeFxBlockType GetBlockType(AxeFxIIBlockID id) {
-  switch (id) {
-    default:
-      break;
-%s  }
-  return BLOCK_TYPE_INVALID;
+  return GetBlockType(GetLatestTypeTables(), id);
 }
 
 const char* GetBlockTypeName(AxeFxBlockType type) {
-  switch (type) {
-    default:
-      break;
-%s  }
-  return "";
+  return GetBlockTypeName(GetLatestTypeTables(), type);
 }
 
 const char* GetBlockName(AxeFxIIBlockID id) {
-  switch (id) {
-    default:
-      break;
-%s  }
-  return "";
+  return GetBlockName(GetLatestTypeTables(), id);
 }
 
 int GetBlockBypassParamID(AxeFxBlockType type) {
-  switch (type) {
-    default:
-      break;
-%s  }
-  return -1;
+  return GetBlockBypassParamID(GetLatestTypeTables(), type);
 }
 
 const char* GetParamName(AxeFxBlockType type, int param_id) {
-  switch (type) {
-    default:
-      break;
-%s  }
-  return "";
+  return GetParamName(GetLatestTypeTables(), type, param_id, NULL);
+}
+
+const char* GetParamName(AxeFxBlockType type, int param_id, size_t* length) {
+  return GetParamName(GetLatestTypeTables(), type, param_id, length);
+}
+
+int GetParamCount(AxeFxBlockType type) {
+  return GetParamCount(GetLatestTypeTables(), type);
+}
+
+const char* GetParamPrefix(AxeFxBlockType type, size_t* length) {
+  return GetParamPrefix(GetLatestTypeTables(), type, length);
 }
 
 const char* GetAmpName(int index) {
-  switch (index) {
-    default:
-      break;
-%s  }
-  return "";
+  return GetAmpName(GetLatestTypeTables(), index);
 }
 
 const char* GetCabName(int index) {
-  switch (index) {
-    default:
-      break;
-%s  }
-  return "";
+  return GetCabName(GetLatestTypeTables(), index);
 }
 
 // Implementations of block parameter lookup functions.
@@ -109,6 +281,40 @@ const char* GetCabName(int index) {
 }  // namespace axefx
 """
 
+PROFILE_TABLES_TEMPLATE = """// Generated from %s.
+namespace %s {
+
+const BlockInfo kBlockInfo[] = {
+%s};
+
+%s
+
+const BlockTypeInfo kBlockTypeInfo[] = {
+%s};
+
+const Name kAmpNames[] = {
+%s};
+
+const Name kCabNames[] = {
+%s};
+
+}  // namespace %s"""
+
+TYPE_TABLES_ENTRY_TEMPLATE = """  {
+    "%(firmware)s",
+    %(max_version)s,
+    %(first_block_id)d,
+    %(ns)s::kBlockInfo,
+    TABLE_SIZE(%(ns)s::kBlockInfo),
+    %(ns)s::kBlockTypeInfo,
+    TABLE_SIZE(%(ns)s::kBlockTypeInfo),
+    %(amp_ns)s::kAmpNames,
+    TABLE_SIZE(%(amp_ns)s::kAmpNames),
+    %(ns)s::kCabNames,
+    TABLE_SIZE(%(ns)s::kCabNames),
+  },
+"""
+
 BLOCK_TYPE_TEMPLATE = """enum AxeFxBlockType {
   BLOCK_TYPE_INVALID = -1,
   %s
@@ -128,35 +334,34 @@ PARAM_ID_LOOKUP_FUNCTION_FWD_TEMPLATE = \
   "const char* Get%sParamName(%sParamID id);"
 
 PARAM_ID_LOOKUP_FUNCTION_TEMPLATE = \
-"""
-const char* Get%sParamName(%sParamID id) {
-  switch (id) {
-    default:
-      break;
-%s  }
-  return "";
+"""const char* Get%sParamName(%sParamID id) {
+  return LookupName(%s::k%sParamNames, id, NULL);
 }"""
 
-class AxeMlParser:
-  amp_names = {}
-  block_ids = []
-  block_to_type_id = {}
-  block_type_bypass_ids = {}
-  block_types = []
-  cab_names = {}
-  current_block = None
-  current_bypass_id = None
-  current_type_name = None
-  effect_parameter_names = []
-  effect_parameters = []
-  param_ids = []
-  param_lookup_fn_fwd = []
-  param_lookup_fn_impl = []
-  parser = None
-  type_id_name = {}
-  type_id_to_name = {}
+PARAM_NAME_TABLE_TEMPLATE = """const Name k%sParamNames[] = {
+%s};"""
 
+class AxeMlParser:
   def __init__(self):
+    self.amp_names = {}
+    self.block_ids = []
+    self.block_id_values = {}
+    self.block_to_type_id = {}
+    self.block_type_bypass_ids = {}
+    self.block_types = []
+    self.cab_names = {}
+    self.current_block = None
+    self.current_bypass_id = None
+    self.current_type_name = None
+    self.effect_parameter_names = {}
+    self.effect_parameters = []
+    self.param_ids = []
+    self.param_lookup_fn_fwd = []
+    self.param_lookup_fn_impl = []
+    self.param_name_tables = {}
+    self.type_id_name = {}
+    self.type_id_to_name = {}
+    self.type_name_to_id = {}
     self.parser = xml.parsers.expat.ParserCreate()
     self.parser.CharacterDataHandler = self.onCharData
     self.parser.StartElementHandler = self.onStartElement
@@ -174,6 +379,7 @@ class AxeMlParser:
         block_name = "BLOCK_%s" % (attrs["name"].replace(' ', '_')\
             .replace('/','_').upper())
         self.block_ids += ["%s = %s" % (block_name, attrs["id"])]
+        self.block_id_values[block_name] = int(attrs["id"])
         self.block_to_type_id[block_name] = [attrs["typeID"], attrs["name"]]
     elif name == "EffectParameters":
       if "typeID" in attrs:
@@ -182,14 +388,16 @@ class AxeMlParser:
             (self.current_type_name, attrs["typeID"])]
         self.current_block = attrs["name"]
         self.type_id_to_name[attrs["typeID"]] = self.current_type_name
+        self.type_name_to_id[self.current_type_name] = int(attrs["typeID"])
         self.type_id_name[self.current_type_name] = self.current_block
         if "bypassParam" in attrs:
           self.current_bypass_id = attrs["bypassParam"]
     elif name == "EffectParameter":
       self.effect_parameters += ["%s = %s" % (attrs["name"], attrs["id"])]
-      self.effect_parameter_names += [attrs["name"]]
+      self.effect_parameter_names[int(attrs["id"])] = attrs["name"]
       if attrs["id"] == self.current_bypass_id:
-        self.block_type_bypass_ids[self.current_type_name] = attrs["name"]
+        self.block_type_bypass_ids[self.current_type_name] = \
+            [int(attrs["id"]), attrs["name"]]
     elif name == "Amp":
       self.amp_names[int(attrs["id"])] = attrs["name"]
     elif name == "Cab":
@@ -204,67 +412,89 @@ class AxeMlParser:
         self.param_lookup_fn_fwd += \
           [PARAM_ID_LOOKUP_FUNCTION_FWD_TEMPLATE %
            (self.current_block, self.current_block)]
-        self.param_lookup_fn_impl += \
-          [PARAM_ID_LOOKUP_FUNCTION_TEMPLATE %
-           (self.current_block, self.current_block,
-            self.GenerateCaseLabelsWithReturn(self.effect_parameter_names))]
+        self.param_name_tables[self.current_type_name] = \
+          dict((i, n.lower()) for i, n in self.effect_parameter_names.items())
       self.current_block = None
       self.current_type_name = None
       self.effect_parameters = []
-      self.effect_parameter_names = []
+      self.effect_parameter_names = {}
       self.current_bypass_id = None
 
-  def GenerateCaseLabelsWithReturn(self, entries):
-    ret = ""
-    for e in entries:
-      ret += '    case %s:\n      return "%s";\n' % (e, e.lower())
-    return ret
-
-  def GenerateBlockTypeFromID(self):
+  # Returns table rows for a dense, zero based table of names.
+  def GenerateNameRows(self, names):
+    if not names:
+      return '  { "", 0 },\n'
     ret = ""
-    for b, t in self.block_to_type_id.items():
-      ret += "    case %s:\n      return %s;\n" % (b, self.type_id_to_name[t[0]])
+    for i in range(max(names.keys()) + 1):
+      n = names.get(i, "")
+      ret += '  { "%s", %d },\n' % (n, len(n))
     return ret
 
-  def GenerateBlockTypeName(self):
-    ret = ""
-    for t in self.type_id_name.items():
-      ret += "    case %s:\n      return \"%s\";\n" % (t[0], t[1])
-    return ret
-
-  def GenerateBlockNameFromID(self):
-    ret = ""
+  # |primary| is the parser of the profile the enums were generated from.
+  # Type names that don't exist there are written as plain numbers.
+  def TypeEnum(self, type_name, primary):
+    if type_name in primary.type_name_to_id:
+      return type_name
+    return "static_cast<AxeFxBlockType>(%d)" % \
+        self.type_name_to_id[type_name]
+
+  def GenerateBlockInfo(self, primary):
+    first = min(self.block_id_values.values())
+    last = max(self.block_id_values.values())
+    rows = {}
     for b, t in self.block_to_type_id.items():
-      ret += '    case %s:\n      return "%s";\n' % (b, t[1])
-    return ret
-
-  def GenerateBlockBypassParamID(self):
+      rows[self.block_id_values[b]] = '  { %s, "%s" },  // %s\n' % \
+          (self.TypeEnum(self.type_id_to_name[t[0]], primary), t[1], b)
     ret = ""
-    for n in self.type_id_to_name.values():
-      if n in self.block_type_bypass_ids:
-        ret += "    case %s:\n      return %s;\n" % \
-               (n, self.block_type_bypass_ids[n])
-    return ret
-
-  def GenerateParamNamesForBlocks(self):
-    ret = ""
-    for t in self.type_id_to_name.values():
+    for i in range(first, last + 1):
+      ret += rows.get(i, '  { BLOCK_TYPE_INVALID, "" },\n')
+    return first, ret
+
+  def GenerateParamNameTables(self):
+    tables = []
+    for t in sorted(self.param_name_tables.keys(),
+                    key=lambda t: self.type_name_to_id[t]):
+      tables += [PARAM_NAME_TABLE_TEMPLATE %
+                 (self.type_id_name[t],
+                  self.GenerateNameRows(self.param_name_tables[t]))]
+    return "\n\n".join(tables)
+
+  def GenerateBlockTypeInfo(self):
+    rows = {}
+    for t, type_id in self.type_name_to_id.items():
       block_name = self.type_id_name[t]
-      ret += "    case %s:\n      return Get%sParamName(static_cast<%sParamID>(param_id));\n" % \
-        (t, block_name, block_name)
+      prefix = block_name.lower() + "_"
+      params = self.param_name_tables.get(t, {})
+      param_count = (max(params.keys()) + 1) if params else 0
+      bypass = self.block_type_bypass_ids.get(t, [-1, "none"])
+      rows[type_id] = \
+          '  { "%s", "%s", %d, %d, k%sParamNames, %d },  // %s, bypass: %s\n' % \
+          (block_name, prefix, len(prefix), bypass[0], block_name,
+           param_count, t, bypass[1])
+    ret = ""
+    for i in range(max(rows.keys()) + 1):
+      ret += rows.get(i, '  { "", "", 0, -1, NULL, 0 },\n')
     return ret
 
   def GenerateAmpNames(self):
-    ret = ""
-    for i, n in sorted(self.amp_names.items()):
-      ret += '    case %s:\n      return "%s";\n' %  (i, n)
-    return ret
+    return self.GenerateNameRows(self.amp_names)
 
   def GenerateCabNames(self):
-    ret = ""
-    for i, n in sorted(self.cab_names.items()):
-      ret += '    case %s:\n      return "%s";\n' %  (i, n)
-    return ret
+    return self.GenerateNameRows(self.cab_names)
+
+# A firmware profile given on the command line, e.g. "AxeFxII_7.axeml=0x0202".
+# The optional version is the newest preset parameter version the profile is
+# used for.  A profile without a version is used for all newer presets.
+class Profile:
+  def __init__(self, arg):
+    parts = arg.split('=')
+    self.path = os.path.normcase(parts[0])
+    self.max_version = int(parts[1], 0) if len(parts) > 1 else None
+    # "AxeFxII_9_2.axeml" -> "9.2"
+    base = os.path.splitext(os.path.basename(parts[0]))[0]
+    self.firmware = base[base.find('_') + 1:].replace('_', '.')
+    self.namespace = "fw_%s" % self.firmware.replace('.', '_')
+    self.parser = AxeMlParser()
 
 def WriteIfChanged(path, contents):
   if os.path.exists(path):
@@ -278,14 +508,17 @@ def WriteIfChanged(path, contents):
 
 def main(args):
   # args[0]: this script.
-  # args[1]: '--clean' or input file.
-  # args[2]: output folder
-  if len(args) != 3:
+  # args[1]: '--clean' or the primary input file.  The enums and the
+  #          functions that don't take a TypeTables argument are generated
+  #          from this one.
+  # args[2..n-1]: Optional older profiles in the form file=max_preset_version.
+  # args[n]: output folder
+  if len(args) < 3:
     print >> sys.stderr, "Missing argument"
     print args
     sys.exit(-1)
 
-  output_folder = os.path.normcase(args[2])
+  output_folder = os.path.normcase(args[-1])
   cc_file = os.path.join(output_folder, OUTPUT_CC)
   h_file = os.path.join(output_folder, OUTPUT_H)
   if args[1].lower() == "--clean":
@@ -300,13 +533,19 @@ def main(args):
       print >> os.stderr, "%s doesn't exist" % h_file
     sys.exit(0)
 
-  input_file = os.path.normcase(args[1])
-  if not os.path.exists(input_file):
-    print >> os.stderr, "%s doesn't exist" % input_file
+  profiles = [Profile(a) for a in args[1:-1]]
+  for p in profiles:
+    if not os.path.exists(p.path):
+      print >> sys.stderr, "%s doesn't exist" % p.path
+      sys.exit(-1)
+    p.parser.parse(p.path)
+
+  primary = profiles[0]
+  if primary.max_version != None:
+    print >> sys.stderr, "The first profile must not have a version limit"
     sys.exit(-1)
 
-  x = AxeMlParser()
-  x.parse(input_file)
+  x = primary.parser
   header = BLOCK_TYPE_TEMPLATE % (",\n  ".join(x.block_types)) + \
            "\n\n" + (BLOCK_ID_TEMPLATE % (",\n  ".join(x.block_ids)))
   header += "\n\n"
@@ -314,14 +553,38 @@ def main(args):
 
   header = HEADER_FILE_TEMPLATE % (header, "\n".join(x.param_lookup_fn_fwd))
 
-  source = SOURCE_FILE_TEMPLATE % (x.GenerateBlockTypeFromID(),
-                                   x.GenerateBlockTypeName(),
-                                   x.GenerateBlockNameFromID(),
-                                   x.GenerateBlockBypassParamID(),
-                                   x.GenerateParamNamesForBlocks(),
-                                   x.GenerateAmpNames(),
-                                   x.GenerateCabNames(),
-                                   "\n".join(x.param_lookup_fn_impl))
+  # Oldest first, so that GetTypeTables() can pick the first match.
+  ordered = sorted(profiles[1:], key=lambda p: p.max_version) + [primary]
+  profile_tables = []
+  type_tables = ""
+  for p in ordered:
+    first_block_id, block_info = p.parser.GenerateBlockInfo(x)
+    profile_tables += [PROFILE_TABLES_TEMPLATE % (
+        os.path.basename(p.path), p.namespace, block_info,
+        p.parser.GenerateParamNameTables(),
+        p.parser.GenerateBlockTypeInfo(),
+        p.parser.GenerateAmpNames(),
+        p.parser.GenerateCabNames(),
+        p.namespace)]
+    type_tables += TYPE_TABLES_ENTRY_TEMPLATE % {
+        "firmware": p.firmware,
+        "max_version": "0x%04x" % p.max_version
+                       if p.max_version != None else "0xffff",
+        "first_block_id": first_block_id,
+        "ns": p.namespace,
+        # Some profiles don't list the amp models.  Fall back on the newest.
+        "amp_ns": p.namespace if p.parser.amp_names else primary.namespace,
+    }
+
+  param_lookup_fn_impl = [
+      PARAM_ID_LOOKUP_FUNCTION_TEMPLATE % (b, b, primary.namespace, b)
+      for b in [x.type_id_name[t] for t in
+                sorted(x.param_name_tables.keys(),
+                       key=lambda t: x.type_name_to_id[t])]]
+
+  source = SOURCE_FILE_TEMPLATE % ("\n\n".join(profile_tables),
+                                   type_tables,
+                                   "\n\n".join(param_lookup_fn_impl))
   WriteIfChanged(h_file, header)
   WriteIfChanged(cc_file, source)
 
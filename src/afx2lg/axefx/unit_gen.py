@@ -0,0 +1,355 @@
+#!/usr/bin/python
+# Copyright (c) 2013 Tomas Gunnarsson. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+# Generates parameter scaling tables from an Axe-Edit .profile file.
+# The profile describes the range and taper of every parameter, per block
+# type and variant (e.g. per amp model).  Those descriptions are turned into
+# offset/scale coefficients here, so that converting a raw value is a single
+# multiply-add (followed by exp() for logarithmic parameters) at runtime.
+
+import math, os, sys
+import xml.parsers.expat
+
+OUTPUT_H = "axefx_ii_units.h"
+OUTPUT_CC = "axefx_ii_units.cc"
+
+# Full scale raw value for continuous parameters.
+MAX_RAW_VALUE = 65534
+
+HEADER_FILE_TEMPLATE = """// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+// WARNING: Do not edit, this file is generated!
+#pragma once
+#ifndef __AXEFX_II_GENERATED_UNITS__
+#define __AXEFX_II_GENERATED_UNITS__
+
+#include "axefx/axefx_ii_ids.h"
+
+#include <cstddef>
+
+namespace axefx {
+
+enum ParamTaper {
+  TAPER_LINEAR,
+  TAPER_LOG,
+  TAPER_LIST,  // One of a list of items, e.g. amp models.
+};
+
+struct ParamInfo {
+  ParamTaper taper;
+  float minimum;
+  float maximum;
+  // Number of decimals the value is displayed with.
+  int precision;
+  const char* unit;
+  // Labels of list parameters.  Item |i| has the value |minimum| + i.
+  const char* const* items;
+  int item_count;
+};
+
+// Coefficients for all parameters of one block variant.
+// For each parameter |i|:
+//   linear = offsets[i] + scales[i] * raw
+//   display = linear, or exp(linear) for the parameters in |log_params|.
+struct ParamScaleTable {
+  size_t count;
+  const double* offsets;
+  const double* scales;
+  // Raw values are clamped to this range.  See |info| for the range of
+  // list parameters.
+  const unsigned short* min_raw;
+  const unsigned short* max_raw;
+  const ParamInfo* info;
+  const unsigned char* log_params;
+  size_t log_count;
+};
+
+// Returns the id of the parameter that selects the variant of a block, e.g.
+// the amp model, or -1 if the block type only has one variant.
+int GetVariantParamID(AxeFxBlockType type);
+int GetVariantCount(AxeFxBlockType type);
+// Returns NULL if there's no table for the type or variant.
+const ParamScaleTable* GetParamScaleTable(AxeFxBlockType type, int variant);
+
+// Firmware version of the profile the tables were generated from.
+const char* GetParamScaleFirmwareVersion();
+
+}  // namespace axefx
+
+#endif  // __AXEFX_II_GENERATED_UNITS__
+"""
+
+SOURCE_FILE_TEMPLATE = """// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "axefx_ii_units.h"
+
+// WARNING: Do not edit, this file is generated!
+
+namespace axefx {
+
+namespace {
+
+#define TABLE_SIZE(table) (sizeof(table) / sizeof(table[0]))
+
+%s
+
+struct BlockScaleInfo {
+  int variant_param;
+  const ParamScaleTable* const* variants;
+  int variant_count;
+};
+
+// Indexed by block type.
+const BlockScaleInfo kBlockScaleInfo[] = {
+%s};
+
+}  // namespace
+
+int GetVariantParamID(AxeFxBlockType type) {
+  if (type < 0 || static_cast<size_t>(type) >= TABLE_SIZE(kBlockScaleInfo))
+    return -1;
+  return kBlockScaleInfo[type].variant_param;
+}
+
+int GetVariantCount(AxeFxBlockType type) {
+  if (type < 0 || static_cast<size_t>(type) >= TABLE_SIZE(kBlockScaleInfo))
+    return 0;
+  return kBlockScaleInfo[type].variant_count;
+}
+
+const ParamScaleTable* GetParamScaleTable(AxeFxBlockType type, int variant) {
+  if (variant < 0 || variant >= GetVariantCount(type))
+    return NULL;
+  return kBlockScaleInfo[type].variants[variant];
+}
+
+const char* GetParamScaleFirmwareVersion() {
+  return "%s";
+}
+
+}  // namespace axefx
+"""
+
+SCALE_TABLE_TEMPLATE = """const double kOffsets%(n)d[] = {
+%(offsets)s};
+
+const double kScales%(n)d[] = {
+%(scales)s};
+
+const unsigned short kMinRaw%(n)d[] = {
+%(min_raw)s};
+
+const unsigned short kMaxRaw%(n)d[] = {
+%(max_raw)s};
+
+const ParamInfo kInfo%(n)d[] = {
+%(info)s};
+
+%(log_params)s
+
+const ParamScaleTable kScaleTable%(n)d = {
+  TABLE_SIZE(kOffsets%(n)d), kOffsets%(n)d, kScales%(n)d, kMinRaw%(n)d,
+  kMaxRaw%(n)d, kInfo%(n)d, %(log_table)s, %(log_count)d
+};"""
+
+VARIANT_LIST_TEMPLATE = """// %s
+const ParamScaleTable* const k%sVariants[] = {
+%s};"""
+
+class Param:
+  def __init__(self, attrs):
+    self.id = int(attrs["paramID"])
+    self.type = attrs["paramType"]
+    self.minimum = float(attrs["minimum"])
+    self.maximum = float(attrs["maximum"])
+    self.precision = int(attrs["precision"])
+    self.unit = attrs["unit"]
+    self.num_vals = int(attrs["numVals"])
+    self.items = []
+    while ("item%d" % len(self.items)) in attrs:
+      self.items += [attrs["item%d" % len(self.items)]]
+
+  # Returns (taper, offset, scale, min_raw, max_raw).
+  def Coefficients(self):
+    if self.type == "INT":
+      # List parameters store the value itself, e.g. 103-151 for a pitch
+      # shift of -24 to +24 semitones.  Presets do contain values outside
+      # of the listed range, so those are let through as-is.
+      return ("TAPER_LIST", 0.0, 1.0, 0, 0xFFFF)
+    if self.type == "LOG" and self.minimum > 0 and self.maximum > 0:
+      return ("TAPER_LOG", math.log(self.minimum),
+              math.log(self.maximum / self.minimum) / MAX_RAW_VALUE,
+              0, MAX_RAW_VALUE)
+    # Some LOG parameters start at zero (e.g. 0-10 knobs).  Their exact
+    # curve isn't described by the profile, so they're treated as linear.
+    return ("TAPER_LINEAR", self.minimum,
+            (self.maximum - self.minimum) / MAX_RAW_VALUE, 0, MAX_RAW_VALUE)
+
+class ProfileParser:
+  def __init__(self):
+    self.firmware = ""
+    # type id -> [name, variant param id, {variant id: {param id: Param}}]
+    self.effects = {}
+    self.current_effect = None
+    self.current_variant = None
+    self.parser = xml.parsers.expat.ParserCreate()
+    self.parser.StartElementHandler = self.onStartElement
+    self.parser.EndElementHandler = self.onEndElement
+
+  def parse(self, profile):
+    self.parser.ParseFile(open(profile, "rb"))
+
+  def onStartElement(self, name, attrs):
+    if name == "PROFILE":
+      self.firmware = "%s.%s" % (attrs["majorVersion"], attrs["minorVersion"])
+    elif name == "Effect":
+      self.current_effect = [attrs["effectType"],
+                             int(attrs["variantParamID"]), {}]
+      self.effects[int(attrs["typeID"])] = self.current_effect
+    elif name == "Variant":
+      self.current_variant = {}
+      self.current_effect[2][int(attrs["effectVariantID"])] = \
+          self.current_variant
+    elif name == "Parameter":
+      p = Param(attrs)
+      self.current_variant[p.id] = p
+
+  def onEndElement(self, name):
+    if name == "Effect":
+      self.current_effect = None
+    elif name == "Variant":
+      self.current_variant = None
+
+def FormatDouble(value):
+  return repr(value)
+
+def CString(value):
+  return '"%s"' % value.replace('\\', '\\\\').replace('"', '\\"')
+
+# Generates the coefficient tables.  Variants with identical parameter
+# descriptions (e.g. most amp models) share one table.
+def GenerateTables(parser):
+  tables = []
+  table_index = {}
+  # Item lists are shared too, e.g. the amp names of all amp variants.
+  item_lists = []
+  item_index = {}
+  variant_lists = []
+  block_rows = {}
+  for type_id in sorted(parser.effects.keys()):
+    name, variant_param, variants = parser.effects[type_id]
+    # Only the first variant describes the variant parameter itself, the
+    # others list it with an empty range.
+    if variant_param != -1 and 0 in variants:
+      for params in variants.values():
+        params[variant_param] = variants[0][variant_param]
+    refs = []
+    for variant_id in range(max(variants.keys()) + 1):
+      params = variants.get(variant_id)
+      if not params:
+        refs += ["  NULL,\n"]
+        continue
+      coefficients = []
+      for i in range(max(params.keys()) + 1):
+        p = params.get(i)
+        if p:
+          items = tuple(p.items)
+          if items and items not in item_index:
+            item_index[items] = len(item_lists)
+            item_lists += ["const char* const kItems%d[] = {\n%s};" %
+                           (len(item_lists),
+                            "".join("  %s,\n" % CString(i) for i in items))]
+          coefficients += [p.Coefficients() +
+                           (p.minimum, p.maximum, p.precision, p.unit,
+                            items)]
+        else:
+          coefficients += [("TAPER_LIST", 0.0, 1.0, 0, 0xFFFF,
+                            0.0, 0.0, 0, "", ())]
+      key = tuple(coefficients)
+      if key not in table_index:
+        n = len(tables)
+        table_index[key] = n
+        log_params = [i for i, c in enumerate(coefficients)
+                      if c[0] == "TAPER_LOG"]
+        tables += [SCALE_TABLE_TEMPLATE % {
+            "n": n,
+            "offsets": "".join("  %s,\n" % FormatDouble(c[1])
+                               for c in coefficients),
+            "scales": "".join("  %s,\n" % FormatDouble(c[2])
+                              for c in coefficients),
+            "min_raw": "".join("  %d,\n" % c[3] for c in coefficients),
+            "max_raw": "".join("  %d,\n" % c[4] for c in coefficients),
+            "info": "".join('  { %s, %sf, %sf, %d, %s, %s, %d },\n' %
+                            (c[0], FormatDouble(c[5]), FormatDouble(c[6]),
+                             c[7], CString(c[8]),
+                             ("kItems%d" % item_index[c[9]]) if c[9]
+                                 else "NULL",
+                             len(c[9]))
+                            for c in coefficients),
+            "log_params": ("const unsigned char kLogParams%d[] = {\n%s};" %
+                           (n, "".join("  %d,\n" % i for i in log_params)))
+                          if log_params else "",
+            "log_table": ("kLogParams%d" % n) if log_params else "NULL",
+            "log_count": len(log_params),
+        }]
+      refs += ["  &kScaleTable%d,\n" % table_index[key]]
+    variant_lists += [VARIANT_LIST_TEMPLATE % (name, name, "".join(refs))]
+    block_rows[type_id] = "  { %d, k%sVariants, %d },  // %s\n" % \
+        (variant_param, name, len(refs), name)
+
+  rows = ""
+  for i in range(max(block_rows.keys()) + 1):
+    rows += block_rows.get(i, "  { -1, NULL, 0 },\n")
+  return "\n\n".join(item_lists + tables + variant_lists), rows
+
+def WriteIfChanged(path, contents):
+  if os.path.exists(path):
+    if open(path, 'r').read() == contents:
+      print "%s is up to date." % path
+      return True
+  print "Generating %s" % path
+  f = open(path, 'w')
+  f.write(contents)
+  f.close()
+
+def main(args):
+  # args[0]: this script.
+  # args[1]: '--clean' or input file.
+  # args[2]: output folder
+  if len(args) != 3:
+    print >> sys.stderr, "Missing argument"
+    print args
+    sys.exit(-1)
+
+  output_folder = os.path.normcase(args[2])
+  cc_file = os.path.join(output_folder, OUTPUT_CC)
+  h_file = os.path.join(output_folder, OUTPUT_H)
+  if args[1].lower() == "--clean":
+    print "Deleting source files."
+    for f in [cc_file, h_file]:
+      try:
+        os.unlink(f)
+      except:
+        print >> sys.stderr, "%s doesn't exist" % f
+    sys.exit(0)
+
+  input_file = os.path.normcase(args[1])
+  if not os.path.exists(input_file):
+    print >> sys.stderr, "%s doesn't exist" % input_file
+    sys.exit(-1)
+
+  x = ProfileParser()
+  x.parse(input_file)
+  tables, rows = GenerateTables(x)
+  source = SOURCE_FILE_TEMPLATE % (tables, rows, x.firmware)
+  WriteIfChanged(h_file, HEADER_FILE_TEMPLATE)
+  WriteIfChanged(cc_file, source)
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main(sys.argv))
@@ -15,11 +15,22 @@
         '..',
       ],
       'sources': [
+        'byte_ring.cc',
+        'byte_ring.h',
         'common_types.h',
         'file_utils.cc',
         'file_utils.h',
+        'histogram.cc',
+        'histogram.h',
+        'json_reader.cc',
+        'json_reader.h',
+        'json_writer.cc',
+        'json_writer.h',
+        'small_task.h',
         'thread_loop.cc',
         'thread_loop.h',
+        'thread_pool.cc',
+        'thread_pool.h',
       ],
     },
   ],
@@ -0,0 +1,67 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "common/byte_ring.h"
+
+#include <algorithm>
+
+namespace base {
+
+namespace {
+size_t RoundUpToPowerOfTwo(size_t size) {
+  size_t ret = 1u;
+  while (ret < size)
+    ret <<= 1;
+  return ret;
+}
+}  // namespace
+
+ByteRing::ByteRing(size_t capacity)
+    : buffer_(new uint8_t[RoundUpToPowerOfTwo(capacity)]),
+      mask_(RoundUpToPowerOfTwo(capacity) - 1u),
+      write_pos_(0u),
+      read_pos_(0u) {
+}
+
+ByteRing::~ByteRing() {}
+
+size_t ByteRing::Write(const uint8_t* data, size_t size) {
+  size_t write_pos = write_pos_.load(std::memory_order_relaxed);
+  size_t read_pos = read_pos_.load(std::memory_order_acquire);
+  size = std::min(size, capacity() - (write_pos - read_pos));
+  if (!size)
+    return 0u;
+
+  size_t offset = write_pos & mask_;
+  size_t first = std::min(size, capacity() - offset);
+  memcpy(&buffer_[offset], data, first);
+  memcpy(&buffer_[0], data + first, size - first);
+  write_pos_.store(write_pos + size, std::memory_order_release);
+  return size;
+}
+
+size_t ByteRing::space() const {
+  size_t write_pos = write_pos_.load(std::memory_order_relaxed);
+  return capacity() - (write_pos - read_pos_.load(std::memory_order_acquire));
+}
+
+size_t ByteRing::Peek(const uint8_t** data) const {
+  size_t read_pos = read_pos_.load(std::memory_order_relaxed);
+  size_t write_pos = write_pos_.load(std::memory_order_acquire);
+  size_t offset = read_pos & mask_;
+  *data = &buffer_[offset];
+  return std::min(write_pos - read_pos, capacity() - offset);
+}
+
+void ByteRing::Consume(size_t size) {
+  size_t read_pos = read_pos_.load(std::memory_order_relaxed);
+  ASSERT(size <= write_pos_.load(std::memory_order_acquire) - read_pos);
+  read_pos_.store(read_pos + size, std::memory_order_release);
+}
+
+size_t ByteRing::size() const {
+  size_t read_pos = read_pos_.load(std::memory_order_acquire);
+  return write_pos_.load(std::memory_order_acquire) - read_pos;
+}
+
+}  // namespace base
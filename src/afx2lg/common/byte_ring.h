@@ -0,0 +1,57 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef COMMON_BYTE_RING_H_
+#define COMMON_BYTE_RING_H_
+
+#include "common/common_types.h"
+
+#include <atomic>
+
+namespace base {
+
+// A fixed size ring buffer of bytes for exactly one producer thread and one
+// consumer thread.  Neither side takes a lock or allocates memory, so the
+// producer can be e.g. a midi driver callback.
+class ByteRing {
+ public:
+  // |capacity| is rounded up to a power of two.
+  explicit ByteRing(size_t capacity);
+  ~ByteRing();
+
+  size_t capacity() const { return mask_ + 1u; }
+
+  // Producer side.  Copies as much of |data| as there's room for and
+  // returns the number of bytes copied.
+  size_t Write(const uint8_t* data, size_t size);
+  // Number of bytes that can be written.  Only exact on the producer
+  // thread, where it can only be too low.
+  size_t space() const;
+
+  // Consumer side.  Points |data| at the oldest bytes in the ring and
+  // returns how many bytes can be read from there.  Since the ring wraps
+  // around, this can be fewer than what's available.  The bytes stay valid
+  // until they're released via Consume().
+  size_t Peek(const uint8_t** data) const;
+  void Consume(size_t size);
+
+  // Number of bytes that can be read.  Only exact on the consumer thread.
+  size_t size() const;
+  bool empty() const { return size() == 0u; }
+
+ private:
+  unique_ptr<uint8_t[]> buffer_;
+  const size_t mask_;
+  // The positions only grow and are masked when the buffer is accessed, so
+  // that a full ring can be told apart from an empty one.  Each side owns
+  // one of them.
+  std::atomic<size_t> write_pos_;
+  std::atomic<size_t> read_pos_;
+
+  DISALLOW_COPY_AND_ASSIGN(ByteRing);
+};
+
+}  // namespace base
+
+#endif  // COMMON_BYTE_RING_H_
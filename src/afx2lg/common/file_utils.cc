@@ -3,8 +3,21 @@
 
 #include "common/file_utils.h"
 
+#include <algorithm>
+#include <cctype>
+#include <climits>
 #include <fstream>
 
+#if defined(OS_WIN)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace base {
 
 bool FileExists(const std::string& path) {
@@ -12,6 +25,82 @@ bool FileExists(const std::string& path) {
   return file.good();
 }
 
+namespace {
+
+bool EndsWithNoCase(const std::string& str, const std::string& suffix) {
+  if (str.length() < suffix.length())
+    return false;
+  size_t offset = str.length() - suffix.length();
+  for (size_t i = 0; i < suffix.length(); ++i) {
+    if (tolower(static_cast<unsigned char>(str[offset + i])) !=
+        tolower(static_cast<unsigned char>(suffix[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string AppendSeparator(const std::string& directory) {
+  if (directory.empty())
+    return directory;
+  char last = directory[directory.length() - 1];
+#if defined(OS_WIN)
+  if (last == '\\' || last == '/')
+    return directory;
+  return directory + '\\';
+#else
+  if (last == '/')
+    return directory;
+  return directory + '/';
+#endif
+}
+
+}  // namespace
+
+bool IsDirectory(const std::string& path) {
+#if defined(OS_WIN)
+  DWORD attributes = ::GetFileAttributesA(path.c_str());
+  return attributes != INVALID_FILE_ATTRIBUTES &&
+         (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+bool ListFiles(const std::string& directory, const std::string& extension,
+               std::vector<std::string>* files) {
+  std::string prefix(AppendSeparator(directory));
+#if defined(OS_WIN)
+  WIN32_FIND_DATAA data;
+  HANDLE find = ::FindFirstFileA((prefix + '*').c_str(), &data);
+  if (find == INVALID_HANDLE_VALUE)
+    return false;
+  do {
+    if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 &&
+        EndsWithNoCase(data.cFileName, extension)) {
+      files->push_back(prefix + data.cFileName);
+    }
+  } while (::FindNextFileA(find, &data));
+  ::FindClose(find);
+#else
+  DIR* dir = opendir(directory.c_str());
+  if (!dir)
+    return false;
+  while (struct dirent* entry = readdir(dir)) {
+    std::string path(prefix + entry->d_name);
+    struct stat info;
+    if (EndsWithNoCase(entry->d_name, extension) &&
+        stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+      files->push_back(path);
+    }
+  }
+  closedir(dir);
+#endif
+  std::sort(files->begin(), files->end());
+  return true;
+}
+
 bool ReadFileIntoBuffer(const std::string& path, unique_ptr<uint8_t[]>* buffer,
                         size_t* file_size) {
   std::ifstream f;
@@ -33,4 +122,106 @@ bool ReadFileIntoBuffer(const std::string& path, unique_ptr<uint8_t[]>* buffer,
   return true;
 }
 
+#if defined(OS_WIN)
+
+MemoryMappedFile::MemoryMappedFile()
+    : file_(INVALID_HANDLE_VALUE), mapping_(NULL), data_(NULL), size_(0u) {
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+  Close();
+}
+
+bool MemoryMappedFile::Open(const std::string& path) {
+  Close();
+
+  file_ = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file_ == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!::GetFileSizeEx(file_, &size) || size.QuadPart >= INT_MAX) {
+    Close();
+    return false;
+  }
+
+  size_ = static_cast<size_t>(size.QuadPart);
+  if (!size_)
+    return true;  // Empty files can't be mapped.
+
+  mapping_ = ::CreateFileMapping(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping_)
+    data_ = static_cast<const uint8_t*>(
+        ::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+
+  if (!data_) {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void MemoryMappedFile::Close() {
+  if (data_)
+    ::UnmapViewOfFile(data_);
+  if (mapping_)
+    ::CloseHandle(mapping_);
+  if (file_ != INVALID_HANDLE_VALUE)
+    ::CloseHandle(file_);
+  file_ = INVALID_HANDLE_VALUE;
+  mapping_ = NULL;
+  data_ = NULL;
+  size_ = 0u;
+}
+
+#else  // !OS_WIN
+
+MemoryMappedFile::MemoryMappedFile() : fd_(-1), data_(NULL), size_(0u) {}
+
+MemoryMappedFile::~MemoryMappedFile() {
+  Close();
+}
+
+bool MemoryMappedFile::Open(const std::string& path) {
+  Close();
+
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ == -1)
+    return false;
+
+  struct stat info;
+  if (fstat(fd_, &info) != 0 || info.st_size >= INT_MAX) {
+    Close();
+    return false;
+  }
+
+  size_ = static_cast<size_t>(info.st_size);
+  if (!size_)
+    return true;  // Empty files can't be mapped.
+
+  void* data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (data == MAP_FAILED) {
+    Close();
+    return false;
+  }
+
+  data_ = static_cast<const uint8_t*>(data);
+
+  return true;
+}
+
+void MemoryMappedFile::Close() {
+  if (data_)
+    munmap(const_cast<uint8_t*>(data_), size_);
+  if (fd_ != -1)
+    close(fd_);
+  fd_ = -1;
+  data_ = NULL;
+  size_ = 0u;
+}
+
+#endif  // OS_WIN
+
 }  // namespace common
@@ -6,6 +6,7 @@
 #define COMMON_FILE_UTILS_H_
 
 #include <string>
+#include <vector>
 
 #include "common_types.h"
 
@@ -13,9 +14,43 @@ namespace base {
 
 bool FileExists(const std::string& path);
 
+bool IsDirectory(const std::string& path);
+
+// Lists the regular files in |directory| whose names end with |extension|
+// (case insensitive, e.g. ".xml").  Subdirectories aren't searched.  The
+// returned paths include |directory| and are sorted.
+bool ListFiles(const std::string& directory, const std::string& extension,
+               std::vector<std::string>* files);
+
 bool ReadFileIntoBuffer(const std::string& path, unique_ptr<uint8_t[]>* buffer,
                         size_t* file_size);
 
+// Maps a file read-only into memory.  The mapping is released when the
+// object is destroyed.
+class MemoryMappedFile {
+ public:
+  MemoryMappedFile();
+  ~MemoryMappedFile();
+
+  bool Open(const std::string& path);
+  void Close();
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+#if defined(OS_WIN)
+  void* file_;
+  void* mapping_;
+#else
+  int fd_;
+#endif
+  const uint8_t* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryMappedFile);
+};
+
 }  // namespace base
 
 #endif  // COMMON_FILE_UTILS_H_
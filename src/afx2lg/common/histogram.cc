@@ -0,0 +1,93 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "common/histogram.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace base {
+
+namespace {
+void PrintDuration(std::ostream* out, std::chrono::microseconds duration) {
+  int64_t us = duration.count();
+  if (us < 10 * 1000) {
+    *out << us << "us";
+  } else {
+    *out << us / 1000 << "ms";
+  }
+}
+}  // namespace
+
+Histogram::Histogram()
+    : count_(0u),
+      sum_(0),
+      min_(std::numeric_limits<int64_t>::max()),
+      max_(0) {
+  for (size_t i = 0; i < kBuckets; ++i)
+    buckets_[i] = 0u;
+}
+
+Histogram::~Histogram() {}
+
+void Histogram::Add(std::chrono::microseconds sample) {
+  int64_t us = std::max<int64_t>(sample.count(), 0);
+  size_t bucket = 0u;
+  while (bucket < kBuckets - 1 && us >= (1ll << bucket))
+    ++bucket;
+  ++buckets_[bucket];
+  sum_ += us;
+
+  int64_t current = min_;
+  while (us < current && !min_.compare_exchange_weak(current, us)) {}
+  current = max_;
+  while (us > current && !max_.compare_exchange_weak(current, us)) {}
+
+  // Last, so that readers that see the count also see the sample.
+  ++count_;
+}
+
+std::chrono::microseconds Histogram::min() const {
+  return std::chrono::microseconds(count_ ? min_.load() : 0);
+}
+
+std::chrono::microseconds Histogram::max() const {
+  return std::chrono::microseconds(max_.load());
+}
+
+std::chrono::microseconds Histogram::mean() const {
+  size_t count = count_;
+  return std::chrono::microseconds(count ? sum_ / count : 0);
+}
+
+std::chrono::microseconds Histogram::Percentile(double percent) const {
+  size_t count = count_;
+  if (!count)
+    return std::chrono::microseconds(0);
+
+  double target = count * percent / 100.0;
+  size_t seen = 0u;
+  for (size_t i = 0; i < kBuckets; ++i) {
+    seen += buckets_[i];
+    if (seen && seen >= target) {
+      // The bucket's upper bound, but never more than the largest sample.
+      return std::min(std::chrono::microseconds(1ll << i), max());
+    }
+  }
+  return max();
+}
+
+void Histogram::Print(std::ostream* out) const {
+  *out << count() << " samples, min ";
+  PrintDuration(out, min());
+  *out << ", median ";
+  PrintDuration(out, Percentile(50));
+  *out << ", 99% ";
+  PrintDuration(out, Percentile(99));
+  *out << ", max ";
+  PrintDuration(out, max());
+  *out << ", mean ";
+  PrintDuration(out, mean());
+}
+
+}  // namespace base
@@ -0,0 +1,54 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef COMMON_HISTOGRAM_H_
+#define COMMON_HISTOGRAM_H_
+
+#include "common/common_types.h"
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+namespace base {
+
+// A histogram of durations with power of two buckets, from under a
+// microsecond up to over half an hour.  Samples can be added from any
+// thread without locking.  Percentiles are accurate to within the bucket
+// they fall in, i.e. a factor of two.
+class Histogram {
+ public:
+  Histogram();
+  ~Histogram();
+
+  void Add(std::chrono::microseconds sample);
+
+  size_t count() const { return count_; }
+  std::chrono::microseconds min() const;
+  std::chrono::microseconds max() const;
+  std::chrono::microseconds mean() const;
+  // Returns the upper bound of the bucket that |percent| of the samples
+  // fall under, e.g. 50 for the median.
+  std::chrono::microseconds Percentile(double percent) const;
+
+  // Prints count, min, median, 99th percentile, max and mean on one line.
+  void Print(std::ostream* out) const;
+
+ private:
+  static const size_t kBuckets = 32;
+
+  // Bucket i holds samples under 2^i microseconds, that aren't in a
+  // smaller bucket.  The last one also holds everything larger.
+  std::atomic<uint32_t> buckets_[kBuckets];
+  std::atomic<size_t> count_;
+  std::atomic<int64_t> sum_;
+  std::atomic<int64_t> min_;
+  std::atomic<int64_t> max_;
+
+  DISALLOW_COPY_AND_ASSIGN(Histogram);
+};
+
+}  // namespace base
+
+#endif  // COMMON_HISTOGRAM_H_
@@ -0,0 +1,296 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "common/json_reader.h"
+
+#include <cmath>
+#include <cstdlib>
+
+namespace base {
+
+namespace {
+
+int HexValue(char ch) {
+  if (ch >= '0' && ch <= '9')
+    return ch - '0';
+  if (ch >= 'a' && ch <= 'f')
+    return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F')
+    return ch - 'A' + 10;
+  return -1;
+}
+
+bool ReadHex4(const char* pos, const char* end, unsigned int* value) {
+  if (end - pos < 4)
+    return false;
+  *value = 0;
+  for (int i = 0; i < 4; ++i) {
+    int v = HexValue(pos[i]);
+    if (v < 0)
+      return false;
+    *value = (*value << 4) | v;
+  }
+  return true;
+}
+
+void AppendUtf8(unsigned int code_point, std::string* out) {
+  if (code_point < 0x80) {
+    out->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+}  // namespace
+
+JsonReader::JsonReader(const char* begin, const char* end)
+    : begin_(begin),
+      end_(end),
+      pos_(begin),
+      expect_(EXPECT_VALUE),
+      number_(0.0),
+      boolean_(false) {
+}
+
+JsonReader::~JsonReader() {}
+
+JsonReader::Token JsonReader::Next() {
+  if (expect_ == FAILED)
+    return INVALID;
+
+  SkipWhitespace();
+  if (pos_ == end_)
+    return expect_ == EXPECT_NOTHING ? END_OF_INPUT : Fail();
+
+  char ch = *pos_;
+  if (ch == '}' || ch == ']') {
+    bool is_object = ch == '}';
+    if (stack_.empty() || stack_.back() != (is_object ? '{' : '['))
+      return Fail();
+    if (expect_ != EXPECT_SEPARATOR_OR_END &&
+        expect_ != (is_object ? EXPECT_KEY_OR_END : EXPECT_VALUE_OR_END)) {
+      return Fail();
+    }
+    ++pos_;
+    stack_.pop_back();
+    return EndValue(is_object ? END_OBJECT : END_ARRAY);
+  }
+
+  if (expect_ == EXPECT_SEPARATOR_OR_END) {
+    if (ch != ',')
+      return Fail();
+    ++pos_;
+    expect_ = stack_.back() == '{' ? EXPECT_KEY : EXPECT_VALUE;
+    SkipWhitespace();
+    if (pos_ == end_)
+      return Fail();
+    ch = *pos_;
+  }
+
+  if (expect_ == EXPECT_NOTHING)
+    return Fail();
+
+  if (expect_ == EXPECT_KEY || expect_ == EXPECT_KEY_OR_END) {
+    if (ch != '"' || !ReadString())
+      return Fail();
+    SkipWhitespace();
+    if (pos_ == end_ || *pos_ != ':')
+      return Fail();
+    ++pos_;
+    expect_ = EXPECT_VALUE;
+    return KEY;
+  }
+
+  switch (ch) {
+    case '{':
+      ++pos_;
+      stack_.push_back('{');
+      expect_ = EXPECT_KEY_OR_END;
+      return BEGIN_OBJECT;
+
+    case '[':
+      ++pos_;
+      stack_.push_back('[');
+      expect_ = EXPECT_VALUE_OR_END;
+      return BEGIN_ARRAY;
+
+    case '"':
+      if (!ReadString())
+        return Fail();
+      return EndValue(STRING);
+
+    case 't':
+      if (!ReadLiteral("true", 4))
+        return Fail();
+      boolean_ = true;
+      return EndValue(BOOLEAN);
+
+    case 'f':
+      if (!ReadLiteral("false", 5))
+        return Fail();
+      boolean_ = false;
+      return EndValue(BOOLEAN);
+
+    case 'n':
+      if (!ReadLiteral("null", 4))
+        return Fail();
+      return EndValue(NULL_VALUE);
+
+    default:
+      if (!ReadNumber())
+        return Fail();
+      return EndValue(NUMBER);
+  }
+}
+
+bool JsonReader::Skip(Token first) {
+  if (first == INVALID || first == END_OF_INPUT || first == KEY)
+    return false;
+
+  if (first != BEGIN_OBJECT && first != BEGIN_ARRAY)
+    return true;
+
+  int depth = 1;
+  while (depth) {
+    switch (Next()) {
+      case BEGIN_OBJECT:
+      case BEGIN_ARRAY:
+        ++depth;
+        break;
+      case END_OBJECT:
+      case END_ARRAY:
+        --depth;
+        break;
+      case INVALID:
+      case END_OF_INPUT:
+        return false;
+      default:
+        break;
+    }
+  }
+  return true;
+}
+
+bool JsonReader::IsInteger(int min, int max) const {
+  return number_ >= min && number_ <= max && std::floor(number_) == number_;
+}
+
+JsonReader::Token JsonReader::Fail() {
+  expect_ = FAILED;
+  return INVALID;
+}
+
+JsonReader::Token JsonReader::EndValue(Token token) {
+  expect_ = stack_.empty() ? EXPECT_NOTHING : EXPECT_SEPARATOR_OR_END;
+  return token;
+}
+
+void JsonReader::SkipWhitespace() {
+  while (pos_ < end_ &&
+         (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t')) {
+    ++pos_;
+  }
+}
+
+bool JsonReader::ReadString() {
+  ASSERT(*pos_ == '"');
+  ++pos_;
+  string_.clear();
+  while (pos_ < end_) {
+    const char* run = pos_;
+    while (pos_ < end_ && *pos_ != '"' && *pos_ != '\\' &&
+           static_cast<unsigned char>(*pos_) >= 0x20) {
+      ++pos_;
+    }
+    string_.append(run, pos_);
+    if (pos_ == end_)
+      return false;
+
+    char ch = *pos_++;
+    if (ch == '"')
+      return true;
+
+    if (ch != '\\' || pos_ == end_)
+      return false;  // Unescaped control character or truncated escape.
+
+    ch = *pos_++;
+    switch (ch) {
+      case '"': string_.push_back('"'); break;
+      case '\\': string_.push_back('\\'); break;
+      case '/': string_.push_back('/'); break;
+      case 'b': string_.push_back('\b'); break;
+      case 'f': string_.push_back('\f'); break;
+      case 'n': string_.push_back('\n'); break;
+      case 'r': string_.push_back('\r'); break;
+      case 't': string_.push_back('\t'); break;
+      case 'u': {
+        unsigned int code_point;
+        if (!ReadHex4(pos_, end_, &code_point))
+          return false;
+        pos_ += 4;
+        if (code_point >= 0xD800 && code_point < 0xDC00) {
+          // High surrogate, expect a low surrogate to follow.
+          unsigned int low;
+          if (end_ - pos_ < 6 || pos_[0] != '\\' || pos_[1] != 'u' ||
+              !ReadHex4(pos_ + 2, end_, &low) || low < 0xDC00 ||
+              low >= 0xE000) {
+            return false;
+          }
+          pos_ += 6;
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) +
+                       (low - 0xDC00);
+        }
+        AppendUtf8(code_point, &string_);
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return false;
+}
+
+bool JsonReader::ReadNumber() {
+  const char* start = pos_;
+  if (pos_ < end_ && *pos_ == '-')
+    ++pos_;
+  if (pos_ == end_ || *pos_ < '0' || *pos_ > '9')
+    return false;
+  while (pos_ < end_ &&
+         ((*pos_ >= '0' && *pos_ <= '9') || *pos_ == '.' || *pos_ == 'e' ||
+          *pos_ == 'E' || *pos_ == '+' || *pos_ == '-')) {
+    ++pos_;
+  }
+
+  // strtod needs a zero terminated string.
+  char buffer[64];
+  size_t length = pos_ - start;
+  if (length >= sizeof(buffer))
+    return false;
+  memcpy(buffer, start, length);
+  buffer[length] = '\0';
+  char* parsed_end = NULL;
+  number_ = strtod(buffer, &parsed_end);
+  return parsed_end == buffer + length;
+}
+
+bool JsonReader::ReadLiteral(const char* literal, size_t length) {
+  if (static_cast<size_t>(end_ - pos_) < length ||
+      memcmp(pos_, literal, length) != 0) {
+    return false;
+  }
+  pos_ += length;
+  return true;
+}
+
+}  // namespace base
@@ -0,0 +1,88 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef COMMON_JSON_READER_H_
+#define COMMON_JSON_READER_H_
+
+#include "common/common_types.h"
+
+#include <string>
+#include <vector>
+
+namespace base {
+
+// A pull parser for JSON text.  Each call to Next() returns the next token
+// in the buffer, so a document can be walked without building a DOM.
+// The reader does not copy the input buffer, which must stay valid for the
+// lifetime of the reader.
+class JsonReader {
+ public:
+  enum Token {
+    BEGIN_OBJECT,
+    END_OBJECT,
+    BEGIN_ARRAY,
+    END_ARRAY,
+    KEY,  // An object member name.  Use string().
+    STRING,  // Use string().
+    NUMBER,  // Use number().
+    BOOLEAN,  // Use boolean().
+    NULL_VALUE,
+    END_OF_INPUT,
+    INVALID,  // Syntax error.  All subsequent calls return INVALID.
+  };
+
+  JsonReader(const char* begin, const char* end);
+  ~JsonReader();
+
+  Token Next();
+
+  // Consumes the rest of a value whose first token is |first|.  For scalars
+  // this is a no-op, for objects and arrays it reads up to and including the
+  // matching end token.  Returns false on a syntax error.
+  bool Skip(Token first);
+
+  const std::string& string() const { return string_; }
+  double number() const { return number_; }
+  bool boolean() const { return boolean_; }
+
+  // Returns true if number() holds an integer in the range [min, max].
+  bool IsInteger(int min, int max) const;
+
+  // Offset of the current read position.  Useful for error messages.
+  size_t offset() const { return pos_ - begin_; }
+
+ private:
+  enum Expect {
+    EXPECT_VALUE,
+    EXPECT_KEY_OR_END,  // Right after '{'.
+    EXPECT_KEY,  // After ',' in an object.
+    EXPECT_VALUE_OR_END,  // Right after '['.
+    EXPECT_SEPARATOR_OR_END,  // After a value in a container.
+    EXPECT_NOTHING,  // After the root value.
+    FAILED,  // A syntax error has been found.
+  };
+
+  Token Fail();
+  Token EndValue(Token token);
+  void SkipWhitespace();
+  bool ReadString();
+  bool ReadNumber();
+  bool ReadLiteral(const char* literal, size_t length);
+
+  const char* begin_;
+  const char* end_;
+  const char* pos_;
+  Expect expect_;
+  // '{' or '[' per open container.
+  std::vector<char> stack_;
+  std::string string_;
+  double number_;
+  bool boolean_;
+
+  DISALLOW_COPY_AND_ASSIGN(JsonReader);
+};
+
+}  // namespace base
+
+#endif  // COMMON_JSON_READER_H_
@@ -0,0 +1,250 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "common/json_writer.h"
+
+#include <algorithm>
+#include <ostream>
+
+namespace base {
+
+namespace {
+const char kIndent[] = "   ";
+
+void WriteToStream(std::ostream* stream, const char* data, size_t size) {
+  stream->write(data, static_cast<std::streamsize>(size));
+}
+}  // namespace
+
+JsonWriter::JsonWriter(const Output& output, Style style)
+    : output_(output),
+      style_(style),
+      buffer_(new char[kBufferSize]),
+      used_(0u),
+      after_key_(false) {
+}
+
+JsonWriter::JsonWriter(std::ostream* stream, Style style)
+    : output_(std::bind(&WriteToStream, stream, std::placeholders::_1,
+                        std::placeholders::_2)),
+      style_(style),
+      buffer_(new char[kBufferSize]),
+      used_(0u),
+      after_key_(false) {
+}
+
+JsonWriter::~JsonWriter() {
+  ASSERT(scopes_.empty());
+  Flush();
+}
+
+void JsonWriter::BeginObject() {
+  BeginScope(false, '{');
+}
+
+void JsonWriter::EndObject() {
+  EndScope(false, '}');
+}
+
+void JsonWriter::BeginArray() {
+  BeginScope(true, '[');
+}
+
+void JsonWriter::EndArray() {
+  EndScope(true, ']');
+}
+
+void JsonWriter::Key(const char* key) {
+  Key(key, strlen(key));
+}
+
+void JsonWriter::Key(const char* key, size_t length) {
+  ASSERT(!scopes_.empty() && !scopes_.back().is_array);
+  ASSERT(!after_key_);
+  Scope& scope = scopes_.back();
+  if (scope.count)
+    Put(',');
+  ++scope.count;
+  if (style_ == STYLED)
+    NewLine(scopes_.size());
+  Put('"');
+  Put(key, length);
+  Put('"');
+  if (style_ == STYLED) {
+    Put(" : ", 3);
+  } else {
+    Put(':');
+  }
+  after_key_ = true;
+}
+
+void JsonWriter::Key(const char* prefix, size_t prefix_length, size_t index) {
+  char buffer[64];
+  ASSERT(prefix_length < sizeof(buffer) - 20);
+  memcpy(buffer, prefix, prefix_length);
+  size_t length = prefix_length;
+  char digits[20];
+  size_t digit_count = 0;
+  do {
+    digits[digit_count++] = '0' + static_cast<char>(index % 10);
+    index /= 10;
+  } while (index);
+  while (digit_count)
+    buffer[length++] = digits[--digit_count];
+  Key(buffer, length);
+}
+
+void JsonWriter::Value(int value) {
+  BeginValue(false);
+  if (value < 0) {
+    Put('-');
+    WriteUnsigned(0u - static_cast<unsigned int>(value));
+  } else {
+    WriteUnsigned(static_cast<unsigned int>(value));
+  }
+}
+
+void JsonWriter::Value(unsigned int value) {
+  BeginValue(false);
+  WriteUnsigned(value);
+}
+
+void JsonWriter::Value(bool value) {
+  BeginValue(false);
+  value ? Put("true", 4) : Put("false", 5);
+}
+
+void JsonWriter::Value(const char* value) {
+  BeginValue(false);
+  WriteString(value, strlen(value));
+}
+
+void JsonWriter::Value(const std::string& value) {
+  BeginValue(false);
+  WriteString(value.c_str(), value.length());
+}
+
+void JsonWriter::Null() {
+  BeginValue(false);
+  Put("null", 4);
+}
+
+void JsonWriter::Flush() {
+  if (used_) {
+    output_(buffer_.get(), used_);
+    used_ = 0u;
+  }
+}
+
+void JsonWriter::BeginValue(bool is_container) {
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+
+  if (scopes_.empty())
+    return;
+
+  Scope& scope = scopes_.back();
+  ASSERT(scope.is_array);
+  if (scope.count)
+    Put(',');
+  ++scope.count;
+
+  if (style_ == STYLED) {
+    // Scalars are kept on the same line, containers get a line of their own.
+    if (is_container) {
+      scope.multi_line = true;
+      NewLine(scopes_.size());
+    } else {
+      Put(' ');
+    }
+  }
+}
+
+void JsonWriter::BeginScope(bool is_array, char ch) {
+  BeginValue(true);
+  Put(ch);
+  Scope scope = { is_array, false, 0u };
+  scopes_.push_back(scope);
+}
+
+void JsonWriter::EndScope(bool is_array, char ch) {
+  ASSERT(!scopes_.empty() && scopes_.back().is_array == is_array);
+  ASSERT(!after_key_);
+  Scope scope = scopes_.back();
+  scopes_.pop_back();
+  if (style_ == STYLED) {
+    if (is_array ? scope.multi_line : scope.count != 0u) {
+      NewLine(scopes_.size());
+    } else if (scope.count) {
+      Put(' ');
+    }
+  }
+  Put(ch);
+  if (style_ == STYLED && scopes_.empty())
+    Put('\n');
+}
+
+void JsonWriter::NewLine(size_t depth) {
+  Put('\n');
+  while (depth--)
+    Put(kIndent, arraysize(kIndent) - 1);
+}
+
+void JsonWriter::WriteString(const char* str, size_t length) {
+  static const char kHex[] = "0123456789abcdef";
+  Put('"');
+  const char* end = str + length;
+  const char* run = str;
+  for (const char* p = str; p < end; ++p) {
+    unsigned char ch = static_cast<unsigned char>(*p);
+    if (ch >= 0x20 && ch != '"' && ch != '\\')
+      continue;
+
+    Put(run, p - run);
+    run = p + 1;
+    Put('\\');
+    switch (ch) {
+      case '"': Put('"'); break;
+      case '\\': Put('\\'); break;
+      case '\b': Put('b'); break;
+      case '\f': Put('f'); break;
+      case '\n': Put('n'); break;
+      case '\r': Put('r'); break;
+      case '\t': Put('t'); break;
+      default:
+        Put("u00", 3);
+        Put(kHex[ch >> 4]);
+        Put(kHex[ch & 0xF]);
+        break;
+    }
+  }
+  Put(run, end - run);
+  Put('"');
+}
+
+void JsonWriter::WriteUnsigned(unsigned int value) {
+  char digits[16];
+  size_t count = 0u;
+  do {
+    digits[count++] = '0' + static_cast<char>(value % 10);
+    value /= 10;
+  } while (value);
+  while (count)
+    Put(digits[--count]);
+}
+
+void JsonWriter::Put(const char* data, size_t size) {
+  while (size) {
+    if (used_ == kBufferSize)
+      Flush();
+    size_t chunk = std::min(size, kBufferSize - used_);
+    memcpy(&buffer_[used_], data, chunk);
+    used_ += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+}
+
+}  // namespace base
@@ -0,0 +1,101 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef COMMON_JSON_WRITER_H_
+#define COMMON_JSON_WRITER_H_
+
+#include "common/common_types.h"
+
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace base {
+
+// A forward-only JSON emitter that writes straight into a fixed size buffer
+// and hands full buffers over to an output callback.  Unlike Json::Value,
+// nothing is kept around once written, so memory use doesn't grow with the
+// size of the document.
+//
+// Keys are expected to be plain identifiers (e.g. the generated parameter
+// names) and are written as-is without escaping or copying.  String values
+// are escaped.
+class JsonWriter {
+ public:
+  typedef std::function<void(const char* data, size_t size)> Output;
+
+  enum Style {
+    STYLED,  // Indented, one member per line.
+    COMPACT,  // No whitespace at all.
+  };
+
+  JsonWriter(const Output& output, Style style);
+  // Convenience constructor for writing to a stream.  The stream must
+  // outlive the writer.
+  JsonWriter(std::ostream* stream, Style style);
+  // Writes whatever is left in the buffer to the output.
+  ~JsonWriter();
+
+  void BeginObject();
+  void EndObject();
+  void BeginArray();
+  void EndArray();
+
+  void Key(const char* key);
+  void Key(const char* key, size_t length);
+  // Writes a key made of |prefix| followed by |index|, e.g. "amp_12",
+  // without building a temporary string.
+  void Key(const char* prefix, size_t prefix_length, size_t index);
+
+  void Value(int value);
+  void Value(unsigned int value);
+  void Value(bool value);
+  void Value(const char* value);
+  void Value(const std::string& value);
+  void Null();
+
+  // Writes the buffered data to the output.
+  void Flush();
+
+ private:
+  struct Scope {
+    bool is_array;
+    // Set when a container has been written into an array, in which case
+    // the closing bracket goes on its own line.
+    bool multi_line;
+    size_t count;
+  };
+
+  void BeginValue(bool is_container);
+  void BeginScope(bool is_array, char ch);
+  void EndScope(bool is_array, char ch);
+  void NewLine(size_t depth);
+  void WriteString(const char* str, size_t length);
+  void WriteUnsigned(unsigned int value);
+
+  void Put(char ch) {
+    if (used_ == kBufferSize)
+      Flush();
+    buffer_[used_++] = ch;
+  }
+
+  void Put(const char* data, size_t size);
+
+  static const size_t kBufferSize = 64 * 1024;
+
+  Output output_;
+  Style style_;
+  unique_ptr<char[]> buffer_;
+  size_t used_;
+  std::vector<Scope> scopes_;
+  // True when a key has been written and its value is expected next.
+  bool after_key_;
+
+  DISALLOW_COPY_AND_ASSIGN(JsonWriter);
+};
+
+}  // namespace base
+
+#endif  // COMMON_JSON_WRITER_H_
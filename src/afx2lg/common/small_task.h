@@ -0,0 +1,158 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef COMMON_SMALL_TASK_H_
+#define COMMON_SMALL_TASK_H_
+
+#include "common/common_types.h"
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace base {
+
+// A move-only void() callable, like std::function, that stores closures of
+// up to kInlineSize bytes inside the object instead of allocating memory.
+// That covers lambdas and binds with a few pointers, shared_ptrs or
+// weak_ptrs and even a std::function.  Larger closures, and ones that need
+// a stricter alignment than kInlineAlignment, are kept on the heap.
+class SmallTask {
+ public:
+  static const size_t kInlineSize = 48;
+  static const size_t kInlineAlignment = 8;
+
+  SmallTask() : ops_(nullptr) {}
+
+  // The second argument keeps this from being used instead of the move
+  // constructor for non-const SmallTask lvalues.
+  template<typename F>
+  SmallTask(F&& f,
+            typename std::enable_if<!std::is_same<
+                typename std::decay<F>::type, SmallTask>::value>::type* = 0)
+      : ops_(nullptr) {
+    Emplace(std::forward<F>(f));
+  }
+
+  SmallTask(SmallTask&& other) : ops_(nullptr) {
+    *this = std::move(other);
+  }
+
+  ~SmallTask() { Reset(); }
+
+  SmallTask& operator=(SmallTask&& other) {
+    if (this != &other) {
+      Reset();
+      if (other.ops_) {
+        other.ops_->move(&other.storage_, &storage_);
+        ops_ = other.ops_;
+        other.ops_ = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  // Replaces the current closure with |f|.
+  template<typename F>
+  void Emplace(F&& f) {
+    typedef typename std::decay<F>::type Functor;
+    Reset();
+    Construct<Functor>(std::forward<F>(f),
+        std::integral_constant<bool, IsInline<Functor>::value>());
+  }
+
+  void Reset() {
+    if (ops_) {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+  bool empty() const { return ops_ == nullptr; }
+
+  void operator()() {
+    ASSERT(ops_);
+    ops_->invoke(&storage_);
+  }
+
+ private:
+  struct Ops {
+    void (*invoke)(void* storage);
+    // Move constructs into |to| and destroys |from|.
+    void (*move)(void* from, void* to);
+    void (*destroy)(void* storage);
+  };
+
+  template<typename Functor>
+  struct IsInline {
+    enum {
+      value = sizeof(Functor) <= kInlineSize &&
+              std::alignment_of<Functor>::value <= kInlineAlignment
+    };
+  };
+
+  template<typename Functor>
+  struct InlineOps {
+    static void Invoke(void* storage) {
+      (*static_cast<Functor*>(storage))();
+    }
+    static void Move(void* from, void* to) {
+      Functor* f = static_cast<Functor*>(from);
+      new (to) Functor(std::move(*f));
+      f->~Functor();
+    }
+    static void Destroy(void* storage) {
+      static_cast<Functor*>(storage)->~Functor();
+    }
+    static const Ops ops;
+  };
+
+  template<typename Functor>
+  struct HeapOps {
+    static Functor*& Get(void* storage) {
+      return *static_cast<Functor**>(storage);
+    }
+    static void Invoke(void* storage) { (*Get(storage))(); }
+    static void Move(void* from, void* to) {
+      new (to) Functor*(Get(from));
+    }
+    static void Destroy(void* storage) { delete Get(storage); }
+    static const Ops ops;
+  };
+
+  template<typename Functor, typename F>
+  void Construct(F&& f, std::true_type /* inline */) {
+    new (&storage_) Functor(std::forward<F>(f));
+    ops_ = &InlineOps<Functor>::ops;
+  }
+
+  template<typename Functor, typename F>
+  void Construct(F&& f, std::false_type /* inline */) {
+    new (&storage_) Functor*(new Functor(std::forward<F>(f)));
+    ops_ = &HeapOps<Functor>::ops;
+  }
+
+  std::aligned_storage<kInlineSize, kInlineAlignment>::type storage_;
+  const Ops* ops_;
+
+  DISALLOW_COPY_AND_ASSIGN(SmallTask);
+};
+
+template<typename Functor>
+const SmallTask::Ops SmallTask::InlineOps<Functor>::ops = {
+  &InlineOps<Functor>::Invoke,
+  &InlineOps<Functor>::Move,
+  &InlineOps<Functor>::Destroy,
+};
+
+template<typename Functor>
+const SmallTask::Ops SmallTask::HeapOps<Functor>::ops = {
+  &HeapOps<Functor>::Invoke,
+  &HeapOps<Functor>::Move,
+  &HeapOps<Functor>::Destroy,
+};
+
+}  // namespace base
+
+#endif  // COMMON_SMALL_TASK_H_
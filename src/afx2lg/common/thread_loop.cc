@@ -3,29 +3,42 @@
 
 #include "common/thread_loop.h"
 
+#include "common/histogram.h"
+
+#include <algorithm>
+
 namespace base {
 
-#if defined(OS_WIN)
-using std::cv_status::cv_status;
-#else
-using std::cv_status;
-#endif
+namespace {
+// While tasks keep coming, due timers are run after this many tasks.
+const size_t kTasksPerTimerCheck = 16;
+}  // namespace
 
 ThreadLoop::ThreadLoop()
-    : timeout_(std::chrono::milliseconds(1000 * 60 * 10)),
-      is_running_(false) {
+    : ring_(new Slot[kRingSize]),
+      push_pos_(0u),
+      pop_pos_(0u),
+      overflow_pending_(false),
+      waiting_(false),
+      is_running_(false),
+      queue_delay_(nullptr),
+      last_timer_id_(0u),
+      timeout_(std::chrono::milliseconds(1000 * 60 * 10)),
+      next_due_(Clock::time_point::max().time_since_epoch().count()) {
+  static_assert((kRingSize & (kRingSize - 1)) == 0,
+                "kRingSize must be a power of two");
+  for (size_t i = 0; i < kRingSize; ++i)
+    ring_[i].sequence.store(i, std::memory_order_relaxed);
 }
 
 ThreadLoop::~ThreadLoop() {}
 
 bool ThreadLoop::is_running() const {
-  std::lock_guard<std::mutex> lock(lock_);
   return is_running_;
 }
 
 bool ThreadLoop::empty() const {
-  std::lock_guard<std::mutex> lock(lock_);
-  return queue_.empty();
+  return push_pos_.load() == pop_pos_.load() && !overflow_pending_.load();
 }
 
 void ThreadLoop::set_timeout(const std::chrono::milliseconds& timeout) {
@@ -34,17 +47,33 @@ void ThreadLoop::set_timeout(const std::chrono::milliseconds& timeout) {
 }
 
 bool ThreadLoop::Run() {
-  {
-    std::lock_guard<std::mutex> lock(lock_);
-    ASSERT(!is_running_);
-    is_running_ = true;
-  }
-
-  Task task;
-  while (PopTask(&task)) {
-    task();
-    if (!is_running())
+  ASSERT(!is_running_);
+  is_running_ = true;
+
+  Entry entry;
+  for (;;) {
+    // Run everything that's queued before checking for more.
+    size_t count = 0u;
+    while (PopTask(&entry)) {
+      Histogram* queue_delay = queue_delay_.load(std::memory_order_relaxed);
+      if (queue_delay &&
+          entry.queued != std::chrono::steady_clock::time_point()) {
+        queue_delay->Add(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - entry.queued));
+      }
+      entry.task();
+      entry.task.Reset();
+      if (!is_running_.load(std::memory_order_relaxed))
+        return true;
+      if (++count % kTasksPerTimerCheck == 0u && !RunDueTimers())
+        return true;
+    }
+
+    if (!RunDueTimers())
       return true;
+    if (!WaitForTask())
+      break;
   }
 
   SetQuit();
@@ -53,35 +82,140 @@ bool ThreadLoop::Run() {
 }
 
 void ThreadLoop::Quit() {
-  QueueTask(std::bind(&ThreadLoop::SetQuit, this));
+  QueueTask([this]() { SetQuit(); });
 }
 
-void ThreadLoop::QueueTask(const Task& task) {
-  {
-    std::lock_guard<std::mutex> lock(lock_);
-    queue_.push(std::move(task));
-  }
+bool ThreadLoop::CancelTask(TimerId id) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto found = std::find_if(timers_.begin(), timers_.end(),
+      [id](const Timer& timer) { return timer.id == id; });
+  if (found == timers_.end())
+    return false;
+  timers_.erase(found);
+  std::make_heap(timers_.begin(), timers_.end(), LaterTimer());
+  next_due_ = (timers_.empty() ? Clock::time_point::max() :
+                                 timers_.front().due).time_since_epoch()
+                                                     .count();
+  return true;
+}
+
+void ThreadLoop::set_queue_delay(Histogram* histogram) {
+  queue_delay_ = histogram;
+}
+
+void ThreadLoop::Signal() {
+  // Pairs with the fence in WaitForTask(): either the worker sees the new
+  // task before it waits, or we see that it's waiting.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!waiting_.load(std::memory_order_relaxed))
+    return;
+
+  // Taking the lock makes sure that the worker is either still checking
+  // for tasks or already waiting for the signal.
+  { std::lock_guard<std::mutex> lock(lock_); }
   signal_.notify_one();
 }
 
+std::chrono::steady_clock::time_point ThreadLoop::QueueTime() const {
+  if (!queue_delay_.load(std::memory_order_relaxed))
+    return std::chrono::steady_clock::time_point();
+  return std::chrono::steady_clock::now();
+}
+
 void ThreadLoop::SetQuit() {
-  std::lock_guard<std::mutex> lock(lock_);
   is_running_ = false;
 }
 
-bool ThreadLoop::PopTask(ThreadLoop::Task* task) {
-  std::unique_lock<std::mutex> lock(lock_);
-  while (queue_.empty()) {
-    cv_status status = signal_.wait_for(lock, timeout_);
-    if (status == cv_status::timeout)
-      return false;
+bool ThreadLoop::PopTask(Entry* entry) {
+  size_t pos = pop_pos_.load(std::memory_order_relaxed);
+  if (pos != push_pos_.load(std::memory_order_acquire)) {
+    Slot* slot = &ring_[pos & (kRingSize - 1)];
+    // The slot has been claimed, but the producer might not have written
+    // the task yet.  Skipping ahead would run tasks out of order.
+    while (slot->sequence.load(std::memory_order_acquire) != pos + 1)
+      std::this_thread::yield();
+    entry->task = std::move(slot->entry.task);
+    entry->queued = slot->entry.queued;
+    slot->sequence.store(pos + kRingSize, std::memory_order_release);
+    pop_pos_.store(pos + 1, std::memory_order_release);
+    return true;
   }
 
-  ASSERT(lock.owns_lock());
-  *task = std::move(queue_.front());
-  queue_.pop();
+  // The overflow list is only used once the ring is empty, since the
+  // tasks in it were queued after the ones in the ring.
+  if (!overflow_pending_.load())
+    return false;
 
+  std::lock_guard<std::mutex> lock(lock_);
+  if (overflow_.empty())
+    return false;
+  *entry = std::move(overflow_.front());
+  overflow_.pop_front();
+  if (overflow_.empty())
+    overflow_pending_ = false;
   return true;
 }
 
+bool ThreadLoop::WaitForTask() {
+  std::unique_lock<std::mutex> lock(lock_);
+  Clock::time_point idle = Clock::now() + timeout_;
+  waiting_.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool ready = true;
+  for (;;) {
+    if (!empty())
+      break;
+    Clock::time_point now = Clock::now();
+    if (!timers_.empty() && timers_.front().due <= now)
+      break;
+    if (now >= idle) {
+      ready = false;
+      break;
+    }
+    Clock::time_point wake = idle;
+    if (!timers_.empty())
+      wake = std::min(wake, timers_.front().due);
+    signal_.wait_until(lock, wake);
+  }
+  waiting_.store(false, std::memory_order_relaxed);
+  return ready;
+}
+
+void ThreadLoop::AddTimer(Clock::time_point due, TimerId id,
+                          SmallTask task) {
+  timers_.push_back(Timer(due, id, std::move(task)));
+  std::push_heap(timers_.begin(), timers_.end(), LaterTimer());
+  next_due_ = timers_.front().due.time_since_epoch().count();
+  // The worker only needs to know if it should wake up earlier.
+  if (timers_.front().id == id && waiting_.load())
+    signal_.notify_one();
+}
+
+bool ThreadLoop::RunDueTimers() {
+  for (;;) {
+    Clock::time_point now = Clock::now();
+    if (next_due_.load(std::memory_order_relaxed) >
+        now.time_since_epoch().count()) {
+      return true;
+    }
+
+    SmallTask task;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      if (timers_.empty() || timers_.front().due > now)
+        return true;
+      std::pop_heap(timers_.begin(), timers_.end(), LaterTimer());
+      task = std::move(timers_.back().task);
+      timers_.pop_back();
+      next_due_ = (timers_.empty() ? Clock::time_point::max() :
+                                     timers_.front().due).time_since_epoch()
+                                                         .count();
+    }
+
+    task();
+    if (!is_running_.load(std::memory_order_relaxed))
+      return false;
+  }
+}
+
 }  // namespace base
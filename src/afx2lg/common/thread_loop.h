@@ -6,18 +6,38 @@
 #define COMMON_THREAD_LOOP_H_
 
 #include "common_types.h"
+#include "common/small_task.h"
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <vector>
 
 namespace base {
 
+class Histogram;
+
+// Runs tasks, in the order they were queued, on the thread that calls
+// Run().  Tasks can be queued from any thread.  They're kept in a fixed
+// size ring that producers claim slots in without locking, and closures of
+// up to SmallTask::kInlineSize bytes are stored in the ring itself, so
+// queueing a task normally neither locks nor allocates.  If the ring is
+// full, tasks go to an overflow list under a lock until it's been drained.
+// The worker runs whatever is queued in one go and producers only wake it
+// up when it's waiting.
+//
+// Delayed tasks are kept in a heap, ordered by when they're due, and run
+// between the queued tasks.
 class ThreadLoop {
  public:
   typedef std::function<void()> Task;
+  typedef std::chrono::steady_clock Clock;
+  // Identifies a delayed task.  Never 0.
+  typedef uint64_t TimerId;
 
   ThreadLoop();
   ~ThreadLoop();
@@ -32,21 +52,187 @@ class ThreadLoop {
 
   void Quit();
 
-  void QueueTask(const Task& task);
+  // Accepts any void() callable, e.g. a Task, lambda or bind.
+  template<typename F>
+  void QueueTask(F&& task);
+
+  // Runs |task| on the loop once |delay| has passed.  Tasks that are due
+  // at the same time run in the order they were queued.  Running delayed
+  // tasks counts as activity, so the loop doesn't time out while they're
+  // due more often than the timeout.  Can be called from any thread.
+  template<typename F>
+  TimerId QueueDelayedTask(std::chrono::microseconds delay, F&& task);
+
+  // Cancels a delayed task that hasn't started running.  Returns false if
+  // it has already run, or is running.  Can be called from any thread.
+  bool CancelTask(TimerId id);
+
+  // Records how long each task waits in the queue before it runs.  NULL
+  // stops recording.  |histogram| must outlive the loop or be unset.
+  void set_queue_delay(Histogram* histogram);
 
  private:
+  // Number of slots in the ring.  A power of two.
+  static const size_t kRingSize = 1024;
+
+  // The move operations are spelled out since VS2012 doesn't generate them.
+  struct Entry {
+    Entry() {}
+    Entry(Entry&& other)
+        : task(std::move(other.task)), queued(other.queued) {}
+    Entry& operator=(Entry&& other) {
+      task = std::move(other.task);
+      queued = other.queued;
+      return *this;
+    }
+
+    SmallTask task;
+    // Only set while the queue delay is recorded.
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  struct Timer {
+    Timer(Clock::time_point due, TimerId id, SmallTask task)
+        : due(due), id(id), task(std::move(task)) {}
+    Timer(Timer&& other)
+        : due(other.due), id(other.id), task(std::move(other.task)) {}
+    Timer& operator=(Timer&& other) {
+      due = other.due;
+      id = other.id;
+      task = std::move(other.task);
+      return *this;
+    }
+
+    Clock::time_point due;
+    TimerId id;
+    SmallTask task;
+  };
+
+  // Orders |timers_| as a min-heap by due time and then id.
+  struct LaterTimer {
+    bool operator()(const Timer& a, const Timer& b) const {
+      return a.due > b.due || (a.due == b.due && a.id > b.id);
+    }
+  };
+
+  struct Slot {
+    // The position that the slot is ready to be written at, plus one once
+    // it's been written.  See TryPush().
+    std::atomic<size_t> sequence;
+    Entry entry;
+  };
+
+  // Lock-free push to the ring.  Returns false if it's full, in which case
+  // |task| is left alone.
+  template<typename F>
+  bool TryPush(F&& task, std::chrono::steady_clock::time_point queued);
+  template<typename F>
+  void PushOverflow(F&& task, std::chrono::steady_clock::time_point queued);
+  // Wakes up the worker if it's waiting for tasks.
+  void Signal();
+  std::chrono::steady_clock::time_point QueueTime() const;
+
   void SetQuit();
-  bool PopTask(Task* task);
+  // Only called on the worker thread.  Pops the next task without waiting
+  // for one to be queued.
+  bool PopTask(Entry* entry);
+  // Waits up to the timeout for a task to be queued or a delayed task to
+  // become due.
+  bool WaitForTask();
+  // Called with |lock_| held.
+  void AddTimer(Clock::time_point due, TimerId id, SmallTask task);
+  // Runs the delayed tasks that are due.  Returns false if one of them
+  // quit the loop.
+  bool RunDueTimers();
+
+  // The ring.  Producers claim positions by incrementing |push_pos_| and
+  // only the worker writes |pop_pos_|.
+  unique_ptr<Slot[]> ring_;
+  std::atomic<size_t> push_pos_;
+  std::atomic<size_t> pop_pos_;
+
+  // True while there are tasks in |overflow_|.  Producers then add to the
+  // overflow list too, so that tasks from one thread stay in order.
+  std::atomic<bool> overflow_pending_;
+  std::atomic<bool> waiting_;
+  std::atomic<bool> is_running_;
+  std::atomic<Histogram*> queue_delay_;
 
+  // Guards |overflow_|, the timers and |timeout_| and is used with
+  // |signal_| when the worker waits.
+  mutable std::mutex lock_;
   std::condition_variable signal_;
+  std::deque<Entry> overflow_;
+  std::vector<Timer> timers_;
+  TimerId last_timer_id_;
   std::chrono::milliseconds timeout_;
-  mutable std::mutex lock_;
-  std::queue<Task> queue_;
-  bool is_running_;
+  // When the first timer is due, so that the worker can check without
+  // locking.  Clock::time_point::max() if there are no timers.
+  std::atomic<Clock::rep> next_due_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadLoop);
 };
 
 typedef std::shared_ptr<ThreadLoop> SharedThreadLoop;
 
+template<typename F>
+void ThreadLoop::QueueTask(F&& task) {
+  std::chrono::steady_clock::time_point queued = QueueTime();
+  if (overflow_pending_.load() || !TryPush(std::forward<F>(task), queued))
+    PushOverflow(std::forward<F>(task), queued);
+  Signal();
+}
+
+template<typename F>
+ThreadLoop::TimerId ThreadLoop::QueueDelayedTask(
+    std::chrono::microseconds delay, F&& task) {
+  SmallTask small_task(std::forward<F>(task));
+  Clock::time_point due = Clock::now() + delay;
+  std::lock_guard<std::mutex> lock(lock_);
+  TimerId id = ++last_timer_id_;
+  AddTimer(due, id, std::move(small_task));
+  return id;
+}
+
+template<typename F>
+bool ThreadLoop::TryPush(F&& task,
+                         std::chrono::steady_clock::time_point queued) {
+  // Bounded MPMC queue as described by Dmitry Vyukov, with one consumer.
+  size_t pos = push_pos_.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &ring_[pos & (kRingSize - 1)];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    intptr_t diff = static_cast<intptr_t>(sequence) -
+                    static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (push_pos_.compare_exchange_weak(pos, pos + 1,
+                                          std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;  // Full.
+    } else {
+      pos = push_pos_.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->entry.task.Emplace(std::forward<F>(task));
+  slot->entry.queued = queued;
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+template<typename F>
+void ThreadLoop::PushOverflow(F&& task,
+                              std::chrono::steady_clock::time_point queued) {
+  std::lock_guard<std::mutex> lock(lock_);
+  overflow_.push_back(Entry());
+  overflow_.back().task.Emplace(std::forward<F>(task));
+  overflow_.back().queued = queued;
+  overflow_pending_ = true;
+}
+
 }  // namespace base
 
 #endif  // COMMON_THREAD_LOOP_H_
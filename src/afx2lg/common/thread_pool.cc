@@ -0,0 +1,302 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "common/thread_pool.h"
+
+#include <algorithm>
+
+namespace base {
+
+namespace {
+// How long a waiting thread sleeps before it looks for tasks to run again.
+// Tasks are normally run by the workers, this only matters when all of
+// them are waiting too.
+const std::chrono::milliseconds kHelpInterval(1);
+
+// Splits the range of ParallelFor into this many chunks per worker.
+const size_t kChunksPerWorker = 4u;
+
+// Statics aren't initialized thread safely (-fno-threadsafe-statics).
+std::once_flag shared_pool_once;
+ThreadPool* shared_pool = NULL;
+
+size_t DefaultThreadCount() {
+  unsigned int cores = std::thread::hardware_concurrency();
+  return cores ? cores : 2u;
+}
+
+// Waits until |pending| is 0, running tasks from |pool| in the meantime.
+// |done| is signaled with |lock| held when |pending| reaches 0.
+void WaitAndHelp(ThreadPool* pool, const std::atomic<size_t>& pending,
+                 std::mutex* lock, std::condition_variable* done) {
+  while (pending.load() != 0u) {
+    if (pool && pool->RunPendingTask())
+      continue;
+    std::unique_lock<std::mutex> l(*lock);
+    done->wait_for(l, kHelpInterval, [&]() { return pending == 0u; });
+  }
+  // The last task might still be signaling |done|.
+  std::lock_guard<std::mutex> l(*lock);
+}
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threads)
+    : next_worker_(0u), queued_(0u), idle_(0u), quit_(false) {
+  if (!threads)
+    threads = DefaultThreadCount();
+  for (size_t i = 0; i < threads; ++i)
+    workers_.push_back(unique_ptr<Worker>(new Worker()));
+  // Workers look at each other's threads, so they wait for |lock_| before
+  // they start.
+  std::lock_guard<std::mutex> lock(lock_);
+  for (size_t i = 0; i < threads; ++i)
+    workers_[i]->thread = std::thread(&ThreadPool::WorkerMain, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    quit_ = true;
+  }
+  signal_.notify_all();
+  for (auto& worker : workers_)
+    worker->thread.join();
+}
+
+// static
+ThreadPool* ThreadPool::Shared() {
+  // Never deleted, since tasks may still be running while the process is
+  // shutting down.
+  std::call_once(shared_pool_once, []() { shared_pool = new ThreadPool(); });
+  return shared_pool;
+}
+
+void ThreadPool::PostTaskAndReply(const Task& task,
+                                  const SharedThreadLoop& loop,
+                                  const Task& reply) {
+  PostTask([task, loop, reply]() {
+    task();
+    loop->QueueTask(reply);
+  });
+}
+
+bool ThreadPool::RunPendingTask() {
+  SmallTask task;
+  if (!PopTask(CurrentWorker(), &task))
+    return false;
+  task();
+  return true;
+}
+
+void ThreadPool::Push(SmallTask task) {
+  // Workers keep their own tasks, so that what they split up stays on one
+  // core unless another worker has nothing to do.
+  size_t index = CurrentWorker();
+  if (index == workers_.size())
+    index = next_worker_++ % workers_.size();
+
+  Worker* worker = workers_[index].get();
+  {
+    std::lock_guard<std::mutex> lock(worker->lock);
+    worker->tasks.push_back(std::move(task));
+    ++queued_;
+  }
+
+  // Pairs with the check in WorkerMain(), see ThreadLoop::Signal().
+  if (idle_.load()) {
+    std::lock_guard<std::mutex> lock(lock_);
+    signal_.notify_one();
+  }
+}
+
+size_t ThreadPool::CurrentWorker() const {
+  std::thread::id id = std::this_thread::get_id();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (workers_[i]->thread.get_id() == id)
+      return i;
+  }
+  return workers_.size();
+}
+
+bool ThreadPool::PopTask(size_t index, SmallTask* task) {
+  if (!queued_.load(std::memory_order_relaxed))
+    return false;
+
+  size_t count = workers_.size();
+  if (index < count) {
+    Worker* own = workers_[index].get();
+    std::lock_guard<std::mutex> lock(own->lock);
+    if (!own->tasks.empty()) {
+      *task = std::move(own->tasks.back());
+      own->tasks.pop_back();
+      --queued_;
+      return true;
+    }
+  }
+
+  // Start with the next worker, so that thieves don't all go for the same
+  // one.
+  for (size_t i = 1; i <= count; ++i) {
+    Worker* victim = workers_[(index + i) % count].get();
+    std::lock_guard<std::mutex> lock(victim->lock);
+    if (!victim->tasks.empty()) {
+      *task = std::move(victim->tasks.front());
+      victim->tasks.pop_front();
+      --queued_;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::WorkerMain(size_t index) {
+  // Wait for the constructor to finish starting the workers.
+  { std::lock_guard<std::mutex> lock(lock_); }
+
+  SmallTask task;
+  for (;;) {
+    if (PopTask(index, &task)) {
+      task();
+      task.Reset();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(lock_);
+    ++idle_;
+    while (!queued_.load() && !quit_)
+      signal_.wait(lock);
+    --idle_;
+    // Tasks that are still queued are run before quitting.
+    if (quit_ && !queued_.load())
+      return;
+  }
+}
+
+TaskGroup::TaskGroup(ThreadPool* pool) : pool_(pool), pending_(0u) {}
+
+TaskGroup::~TaskGroup() {
+  Wait();
+}
+
+void TaskGroup::Wait() {
+  WaitAndHelp(pool_, pending_, &lock_, &done_);
+}
+
+void TaskGroup::OnTaskDone() {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (--pending_ == 0u)
+    done_.notify_all();
+}
+
+void ParallelFor(ThreadPool* pool, size_t begin, size_t end, size_t grain,
+                 const std::function<void(size_t)>& body) {
+  if (begin >= end)
+    return;
+
+  grain = std::max<size_t>(grain, 1u);
+  size_t count = end - begin;
+  if (!pool || count <= grain) {
+    for (size_t i = begin; i < end; ++i)
+      body(i);
+    return;
+  }
+
+  size_t chunks = std::min(count / grain, pool->size() * kChunksPerWorker);
+  size_t chunk_size = (count + chunks - 1) / chunks;
+
+  TaskGroup group(pool);
+  for (size_t chunk = begin + chunk_size; chunk < end; chunk += chunk_size) {
+    size_t chunk_end = std::min(end, chunk + chunk_size);
+    group.Run([&body, chunk, chunk_end]() {
+      for (size_t i = chunk; i < chunk_end; ++i)
+        body(i);
+    });
+  }
+
+  // The calling thread takes the first chunk.
+  for (size_t i = begin; i < begin + chunk_size; ++i)
+    body(i);
+
+  group.Wait();
+}
+
+TaskGraph::TaskGraph(ThreadPool* pool) : pool_(pool), pending_(0u) {}
+
+TaskGraph::~TaskGraph() {}
+
+TaskGraph::Node TaskGraph::Add(const Task& task,
+                               std::initializer_list<Node> dependencies) {
+  Node node = nodes_.size();
+  unique_ptr<NodeData> data(new NodeData());
+  data->task = task;
+  data->dependencies = dependencies.size();
+  data->waiting_for = 0u;
+  for (Node dependency : dependencies) {
+    ASSERT(dependency < node);
+    nodes_[dependency]->dependents.push_back(node);
+  }
+  nodes_.push_back(std::move(data));
+  return node;
+}
+
+void TaskGraph::Run() {
+  Start();
+  WaitAndHelp(pool_, pending_, &lock_, &done_);
+}
+
+void TaskGraph::Run(const SharedThreadLoop& loop, const Task& on_done) {
+  ASSERT(loop);
+  if (nodes_.empty()) {
+    loop->QueueTask(on_done);
+    return;
+  }
+  loop_ = loop;
+  on_done_ = on_done;
+  Start();
+}
+
+void TaskGraph::Start() {
+  ASSERT(!pending_);
+  pending_ = nodes_.size();
+  for (auto& node : nodes_)
+    node->waiting_for = node->dependencies;
+  for (Node node = 0; node < nodes_.size(); ++node) {
+    if (!nodes_[node]->dependencies)
+      Post(node);
+  }
+}
+
+void TaskGraph::Post(Node node) {
+  if (pool_) {
+    pool_->PostTask([this, node]() { RunNode(node); });
+  } else {
+    RunNode(node);
+  }
+}
+
+void TaskGraph::RunNode(Node node) {
+  NodeData* data = nodes_[node].get();
+  data->task();
+  for (Node dependent : data->dependents) {
+    if (--nodes_[dependent]->waiting_for == 0u)
+      Post(dependent);
+  }
+
+  SharedThreadLoop loop;
+  Task on_done;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (--pending_ != 0u)
+      return;
+    done_.notify_all();
+    loop.swap(loop_);
+    on_done.swap(on_done_);
+  }
+
+  // The graph can be deleted as soon as |on_done| has been queued.
+  if (loop)
+    loop->QueueTask(on_done);
+}
+
+}  // namespace base
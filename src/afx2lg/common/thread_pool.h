@@ -0,0 +1,203 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef COMMON_THREAD_POOL_H_
+#define COMMON_THREAD_POOL_H_
+
+#include "common/common_types.h"
+#include "common/small_task.h"
+#include "common/thread_loop.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace base {
+
+// A pool of worker threads for CPU bound work such as parsing and
+// serializing presets.  Each worker has its own deque of tasks.  A worker
+// runs the newest task in its own deque and when that's empty, steals the
+// oldest task from another worker, so that work that's split up on one
+// worker spreads out to the idle ones.  Tasks that are posted from threads
+// outside of the pool are spread evenly over the workers.
+//
+// Threads that wait for tasks in the pool (TaskGroup::Wait(), ParallelFor()
+// and TaskGraph::Run()) run queued tasks while they wait, so waits can be
+// nested inside of tasks.
+//
+// Results that a single threaded consumer, e.g. the MIDI code or the GUI,
+// needs to handle are posted back to its ThreadLoop with
+// PostTaskAndReply().
+//
+// The helpers below accept a NULL pool and then run everything on the
+// calling thread, so code can take a ThreadPool* and let the caller decide
+// whether it's run in parallel.
+class ThreadPool {
+ public:
+  typedef std::function<void()> Task;
+
+  // 0 creates a worker per core.
+  explicit ThreadPool(size_t threads = 0u);
+  // Runs the tasks that are still queued and joins the workers.
+  ~ThreadPool();
+
+  // The pool that the tools share.  Never deleted.
+  static ThreadPool* Shared();
+
+  size_t size() const { return workers_.size(); }
+
+  // Can be called from any thread.
+  template<typename F>
+  void PostTask(F&& task);
+
+  // Runs |task| on the pool and then |reply| on |loop|.
+  void PostTaskAndReply(const Task& task, const SharedThreadLoop& loop,
+                        const Task& reply);
+
+  // Runs one queued task on the calling thread, if there is one.  Used by
+  // threads that wait for tasks in the pool.
+  bool RunPendingTask();
+
+ private:
+  struct Worker {
+    Worker() {}
+
+    std::thread thread;
+    std::mutex lock;
+    // Owner pushes and pops at the back, thieves take from the front.
+    std::deque<SmallTask> tasks;
+
+    DISALLOW_COPY_AND_ASSIGN(Worker);
+  };
+
+  void Push(SmallTask task);
+  // Returns the index of the worker that's running on the calling thread,
+  // or size() if it's not one of ours.
+  size_t CurrentWorker() const;
+  // Pops the newest task of |index| or steals the oldest one of another
+  // worker.  |index| can be size() to only steal.
+  bool PopTask(size_t index, SmallTask* task);
+  void WorkerMain(size_t index);
+
+  std::vector<unique_ptr<Worker> > workers_;
+  // Where the next task from outside of the pool goes.
+  std::atomic<size_t> next_worker_;
+  // Number of tasks in all of the deques.
+  std::atomic<size_t> queued_;
+  // Number of workers that are waiting for |signal_|.
+  std::atomic<size_t> idle_;
+
+  // Used with |signal_| when workers wait for tasks.  Guards |quit_|.
+  std::mutex lock_;
+  std::condition_variable signal_;
+  bool quit_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+// Runs tasks on a pool and waits for all of them.  The destructor waits
+// too.
+class TaskGroup {
+ public:
+  // |pool| can be NULL to run the tasks right away on the calling thread.
+  explicit TaskGroup(ThreadPool* pool);
+  ~TaskGroup();
+
+  template<typename F>
+  void Run(F&& task);
+
+  // Returns once all tasks that have been run have finished, running tasks
+  // from the pool in the meantime.
+  void Wait();
+
+ private:
+  void OnTaskDone();
+
+  ThreadPool* pool_;
+  std::atomic<size_t> pending_;
+  std::mutex lock_;
+  std::condition_variable done_;
+
+  DISALLOW_COPY_AND_ASSIGN(TaskGroup);
+};
+
+// Calls |body(i)| for each i in [begin, end) and returns when all calls have
+// returned.  The range is split into chunks of at least |grain| iterations,
+// a few per worker, so that workers that finish early can steal the rest.
+void ParallelFor(ThreadPool* pool, size_t begin, size_t end, size_t grain,
+                 const std::function<void(size_t)>& body);
+
+// Tasks with dependencies.  A task is posted to the pool once all the tasks
+// that it depends on have finished.  Since a task can only depend on tasks
+// that were added before it, the graph can't have cycles.  The graph can
+// only be run once.
+class TaskGraph {
+ public:
+  typedef size_t Node;
+  typedef std::function<void()> Task;
+
+  // |pool| can be NULL to run the tasks on the calling thread, in order.
+  explicit TaskGraph(ThreadPool* pool);
+  ~TaskGraph();
+
+  Node Add(const Task& task, std::initializer_list<Node> dependencies = {});
+
+  // Runs the graph and waits for it, running tasks from the pool in the
+  // meantime.
+  void Run();
+
+  // Starts running the graph and returns.  |on_done| is run on |loop| once
+  // all tasks have finished.  The graph must outlive that.
+  void Run(const SharedThreadLoop& loop, const Task& on_done);
+
+ private:
+  struct NodeData {
+    Task task;
+    std::vector<Node> dependents;
+    size_t dependencies;
+    // Dependencies that haven't finished.
+    std::atomic<size_t> waiting_for;
+  };
+
+  void Start();
+  void Post(Node node);
+  void RunNode(Node node);
+
+  ThreadPool* pool_;
+  std::vector<unique_ptr<NodeData> > nodes_;
+  std::atomic<size_t> pending_;
+  SharedThreadLoop loop_;
+  Task on_done_;
+  std::mutex lock_;
+  std::condition_variable done_;
+
+  DISALLOW_COPY_AND_ASSIGN(TaskGraph);
+};
+
+template<typename F>
+void ThreadPool::PostTask(F&& task) {
+  Push(SmallTask(std::forward<F>(task)));
+}
+
+template<typename F>
+void TaskGroup::Run(F&& task) {
+  if (!pool_) {
+    task();
+    return;
+  }
+  ++pending_;
+  pool_->PostTask([this, task]() mutable {
+    task();
+    OnTaskDone();
+  });
+}
+
+}  // namespace base
+
+#endif  // COMMON_THREAD_POOL_H_
@@ -16,6 +16,7 @@
       ],
       'dependencies': [
         '../axefx/axefx.gyp:axefx_types',
+        '../common/base.gyp:base',
       ],
       'sources': [
         'lg_entry.cc',
@@ -24,6 +25,12 @@
         'lg_parser.h',
         'lg_utils.cc',
         'lg_utils.h',
+        'line_arena.cc',
+        'line_arena.h',
+        'output_buffer.cc',
+        'output_buffer.h',
+        'setup_state.cc',
+        'setup_state.h',
       ],
     },
   ],
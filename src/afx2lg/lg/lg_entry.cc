@@ -6,40 +6,35 @@
 #include "lg/lg_entry.h"
 #include "lg/lg_parser.h"
 #include "lg/lg_utils.h"
+#include "lg/output_buffer.h"
 
 #include <iomanip>
-#include <regex>
 #include <sstream>
 
 namespace lg {
 
-using std::match_results;
-using std::regex;
-using std::regex_match;
-
 void LgEntry::AppendLine(const char* line, const char* eol) {
-  lines_.push_back(std::string(line, eol + 1));  // \n inclusive.
+  Line s(line, eol + 1 - line);  // \n inclusive.
   // LG export files can have superfluous whitespace at the end of names.
-  // Let's trim that now.
-  std::string& s= lines_.back();
+  // Let's trim that now.  Only trimmed lines need to be copied.
   size_t chars = 0, i = s.length() > 2 ? s.length() - 2 : 0;
   while (i > 0 && isspace(s[i])) {
     --i;
     ++chars;
   }
-  if (chars)
-    s.erase(i + 1, chars);
+  lines_.push_back(chars ? arena_->CopyWithNewline(s, i + 1) : s);
 }
 
-void LgEntry::WriteLines(LgParserCallback* callback) {
-  std::vector<std::string>::const_iterator it = lines_.begin();
+void LgEntry::WriteLines(OutputBuffer* output) {
+  Lines::const_iterator it = lines_.begin();
   for (; it != lines_.end(); ++it)
-    callback->WriteLine(*it);
+    output->Append(it->data(), it->length());
 }
 
 void NamedEntry::SetName(const std::string& name) {
-  if (!lines_.empty())
-    ReplaceEntryName(&lines_[0], name);
+  size_t offset, length;
+  if (!lines_.empty() && FindEntryName(lines_[0], &offset, &length))
+    lines_[0] = arena_->Replace(lines_[0], offset, length, name);
   name_ = name;
 }
 
@@ -52,28 +47,36 @@ void NamedEntry::AppendLine(const char* line, const char* eol) {
 void BankList::AppendLine(const char* line, const char* eol) {
   NamedEntry::AppendLine(line, eol);
   if (lines_.size() > 1) {
-    std::string& str = lines_.back();
-    // Remove the trailing '\n' temporarily.  We'll put it back in WriteLines.
-    str.erase(str.end() - 1);
-    if (str.empty() || IsComment(str.c_str())) {
+    // Only keep the bank names.  Separators are written in WriteLines.
+    const Line& str = lines_.back();
+    if (str.length() == 1u || IsComment(str.data()))
       lines_.pop_back();
-    }
   }
 }
 
-void BankList::WriteLines(LgParserCallback* callback) {
+void BankList::WriteLines(OutputBuffer* output) {
+  NamedEntry::WriteLines(output);
   if (!lines_.empty()) {
-    std::vector<std::string>::iterator it = lines_.begin();
-    ++it;
-    for (; it != lines_.end(); ++it)
-      (*it) += '\n';
-    lines_.push_back(";-----------------------------------------\n");
+    const char separator[] = ";-----------------------------------------\n";
+    output->Append(separator, arraysize(separator) - 1);
   }
-  NamedEntry::WriteLines(callback);
 }
 
 void BankList::AppendBank(const std::string& bank_name) {
-  lines_.push_back(bank_name);
+  lines_.push_back(arena_->CopyWithNewline(bank_name, bank_name.length()));
+}
+
+std::vector<std::string> BankList::GetBankNames() const {
+  std::vector<std::string> ret;
+  if (lines_.empty())
+    return ret;
+
+  ret.reserve(lines_.size() - 1);
+  Lines::const_iterator it = lines_.begin() + 1;
+  for (; it != lines_.end(); ++it)
+    ret.push_back(std::string(it->data(), it->length() - 1));
+
+  return ret;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -87,35 +90,35 @@ void Bank::AppendLine(const char* line, const char* eol) {
   }
 }
 
-void Bank::WriteLines(LgParserCallback* callback) {
+void Bank::WriteLines(OutputBuffer* output) {
   if (lines_.empty())
     return;
 
-  std::vector<std::string>::const_iterator it = lines_.begin();
-  callback->WriteLine(*it);
+  Lines::const_iterator it = lines_.begin();
+  output->Append(it->data(), it->length());
   ++it;
 
   if (!inherited_from_name_.empty()) {
     std::string line("DERIVED FROM ");
     line += inherited_from_name_;
     line += '\n';
-    callback->WriteLine(line);
+    output->Append(line);
   }
 
   if (!default_preset_.empty()) {
     std::string line("DEFAULTPRESET ");
     line += default_preset_;
     line += '\n';
-    callback->WriteLine(line);
+    output->Append(line);
   }
 
   for (; it != lines_.end(); ++it)
-    callback->WriteLine(*it);
+    output->Append(it->data(), it->length());
 
-  if (!IsComment(lines_.back().c_str())) {
+  if (!IsComment(lines_.back().data())) {
     const char separator[] =
         ";---------------------------------------------------------------\n";
-    callback->WriteLine(separator, arraysize(separator) - 1);
+    output->Append(separator, arraysize(separator) - 1);
   }
 }
 
@@ -133,9 +136,14 @@ void Bank::OnPatchNameChange(const std::string& old_name,
     default_preset_ = new_name;
 
   Lines::iterator it = lines_.begin() + 1;
-  const char* reg_exp = "switch \\d+\\s+\\:\\s+PA\\s+([\\w ]+)\n";
-  for (; it != lines_.end(); ++it)
-    ReplaceIfMatch(&(*it), reg_exp, old_name.c_str(), new_name.c_str());
+  for (; it != lines_.end(); ++it) {
+    size_t offset, length;
+    if (FindLinePattern(*it, PATCH_SWITCH, &offset, &length) &&
+        old_name.compare(0, std::string::npos, it->data() + offset,
+                         length) == 0) {
+      *it = arena_->Replace(*it, offset, length, new_name);
+    }
+  }
 }
 
 std::vector<std::string> Bank::GetPatchNames() const {
@@ -144,10 +152,9 @@ std::vector<std::string> Bank::GetPatchNames() const {
     return ret;
 
   Lines::const_iterator it = lines_.begin() + 1;
-  const char* reg_exp = "switch \\d+\\s+\\:\\s+PA\\s+([\\w ]+)\n";
   std::string str;
   for (; it != lines_.end(); ++it) {
-    if (ExtractSubstring(*it, reg_exp, &str))
+    if (ExtractSubstring(*it, PATCH_SWITCH, &str))
       ret.push_back(str);
   }
 
@@ -163,10 +170,9 @@ void Bank::RemoveNonPatchEntries() {
     return;
 
   Lines::iterator it = lines_.begin() + 1;
-  regex rx("switch \\d+\\s+\\:\\s+PA\\s+([\\w ]+)\n");
   for (; it != lines_.end(); ++it) {
-    match_results<std::string::const_iterator> match;
-    if (!regex_match(*it, match, rx))
+    size_t offset, length;
+    if (!FindLinePattern(*it, PATCH_SWITCH, &offset, &length))
       it = lines_.erase(it) - 1;
   }
 }
@@ -180,7 +186,7 @@ int Patch::preset() const {
 
 void Patch::AppendLine(const char* line, const char* eol) {
   NamedEntry::AppendLine(line, eol);
-  const std::string& str = lines_.back();
+  const Line& str = lines_.back();
 
   if (lines_.size() > 1) {
     // TODO(tommi): Right now we are not _really_ aware of different midi
@@ -204,7 +210,7 @@ void Patch::SetName(const std::string& name) {
   if (lines_.empty()) {
     std::string str(kPatchStart);
     str += ": " + name + "\n";
-    lines_.push_back(str);
+    lines_.push_back(arena_->Copy(str));
     name_ = name;
   } else {
     NamedEntry::SetName(name);
@@ -222,7 +228,7 @@ void Patch::Update(const axefx::Preset& p) {
   if (lines_.empty()) {
     std::string str(kPatchStart);
     str += ": " + name + "\n";
-    lines_.push_back(str);
+    lines_.push_back(arena_->Copy(str));
     name_ = name;
     SetPreset(p.id());
   } else {
@@ -245,12 +251,12 @@ void Patch::SetPreset(int preset_number) {
   if (cc_index_ == -1) {
     cc_index_ = static_cast<int>(lines_.size());
     if (pc_index_ == -1) {
-      lines_.push_back(stream.str());
+      lines_.push_back(arena_->Copy(stream.str()));
     } else {
-      lines_.insert(lines_.begin() + pc_index_, stream.str());
+      lines_.insert(lines_.begin() + pc_index_, arena_->Copy(stream.str()));
     }
   } else {
-    lines_[cc_index_] = stream.str();
+    lines_[cc_index_] = arena_->Copy(stream.str());
   }
 
   stream.clear();
@@ -260,9 +266,9 @@ void Patch::SetPreset(int preset_number) {
 
   if (pc_index_ == -1) {
     pc_index_ = static_cast<int>(lines_.size());
-    lines_.push_back(stream.str());
+    lines_.push_back(arena_->Copy(stream.str()));
   } else {
-    lines_[pc_index_] = stream.str();
+    lines_[pc_index_] = arena_->Copy(stream.str());
   }
 }
 
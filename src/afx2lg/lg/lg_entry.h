@@ -8,32 +8,37 @@
 
 #include "common/common_types.h"
 #include "axefx/preset.h"
+#include "lg/line_arena.h"
 
 #include <vector>
 
 namespace lg {
 
-class LgParserCallback;
+class OutputBuffer;
 
+// Entries keep Lines that point into the buffer being parsed, which must
+// stay valid while the entries are used.  Lines that are added or changed
+// are allocated from |arena|, which must outlive the entry and its copies.
 class LgEntry {
  public:
-  typedef std::vector<std::string> Lines;
+  typedef std::vector<Line> Lines;
 
-  LgEntry() {}
+  explicit LgEntry(LineArena* arena) : arena_(arena) {}
   virtual ~LgEntry() {}
 
   virtual void AppendLine(const char* line, const char* eol);
-  virtual void WriteLines(LgParserCallback* callback);
+  virtual void WriteLines(OutputBuffer* output);
 
   const Lines& lines() const { return lines_; }
 
  protected:
+  LineArena* arena_;
   Lines lines_;
 };
 
 class NamedEntry : public LgEntry {
  public:
-  NamedEntry() {}
+  explicit NamedEntry(LineArena* arena) : LgEntry(arena) {}
   ~NamedEntry() {}
 
   const std::string& name() const { return name_; }
@@ -47,24 +52,26 @@ class NamedEntry : public LgEntry {
 
 class BankList : public NamedEntry {
  public:
-  BankList() {}
+  explicit BankList(LineArena* arena) : NamedEntry(arena) {}
   virtual ~BankList() {}
 
   virtual void AppendLine(const char* line, const char* eol);
-  virtual void WriteLines(LgParserCallback* callback);
+  virtual void WriteLines(OutputBuffer* output);
 
   void AppendBank(const std::string& bank_name);
+  // The bank names, i.e. all lines but the first, without the '\n'.
+  std::vector<std::string> GetBankNames() const;
 
  private:
 };
 
 class Bank : public NamedEntry {
  public:
-  Bank() {}
+  explicit Bank(LineArena* arena) : NamedEntry(arena) {}
   virtual ~Bank() {}
 
   virtual void AppendLine(const char* line, const char* eol);
-  virtual void WriteLines(LgParserCallback* callback);
+  virtual void WriteLines(OutputBuffer* output);
   void SetBankList(const shared_ptr<BankList>& bank_list);
   void OnPatchNameChange(const std::string& old_name,
                          const std::string& new_name);
@@ -82,8 +89,9 @@ class Bank : public NamedEntry {
 
 class Patch : public NamedEntry {
  public:
-  Patch()
-     : channel_(1), preset_(0), bank_id_(0), cc_index_(-1), pc_index_(-1) {}
+  explicit Patch(LineArena* arena)
+     : NamedEntry(arena), channel_(1), preset_(0), bank_id_(0), cc_index_(-1),
+       pc_index_(-1) {}
   virtual ~Patch() {}
   virtual void AppendLine(const char* line, const char* eol);
   virtual void SetName(const std::string& name);
@@ -5,8 +5,10 @@
 
 #include "lg/lg_parser.h"
 #include "lg/lg_utils.h"
+#include "lg/output_buffer.h"
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <string>
 
@@ -18,6 +20,16 @@
 
 namespace lg {
 
+void LgParserCallback::Write(const char* data, size_t length) {
+  const char* end = data + length;
+  while (data < end) {
+    const char* eol = static_cast<const char*>(memchr(data, '\n', end - data));
+    const char* next = eol ? eol + 1 : end;
+    WriteLine(data, next - data);
+    data = next;
+  }
+}
+
 LgParser::LgParser() {
 }
 
@@ -44,8 +56,9 @@ bool LgParser::ParseBuffer(LgParserCallback* callback,
     return false;
   }
 
-  // Begin quick-n-dirty O(n^2) algos. :-|
-
+  // Entries are looked up by name and id from here on, so index them once
+  // rather than scanning the lists for every lookup.
+  BuildIndices();
   ConnectBanksToBankLists();
   ConnectPatchesToBanks();
 
@@ -71,12 +84,20 @@ bool LgParser::ParseBuffer(LgParserCallback* callback,
   size_t bank_id = bank_size;
 
   ReservedNames taken_names;
+  // Last suffix used for each name, so that generating many unique names
+  // from the same base name doesn't retry all the previously used suffixes.
+  std::unordered_map<std::string, size_t> name_counters;
   const axefx::PresetMap& presets = callback->GetPresetMap();
   axefx::PresetMap::const_iterator it = presets.begin();
   for (; it != presets.end(); ++it) {
     Patches::value_type p = LookupPatch(it->second->id());
     if (p.get()) {
+      if (!callback->ShouldUpdatePatch(*it->second.get()))
+        continue;
+      std::string old_name(p->name());
       p->Update(*it->second.get());
+      if (p->name() != old_name)
+        OnPatchRenamed(p, old_name);
     } else {
       // Use a template to add a patch.
       p.reset(new Patch(*patches_[0].get()));
@@ -101,12 +122,15 @@ bool LgParser::ParseBuffer(LgParserCallback* callback,
         new_bank.reset();
       }
 
-      if (taken_names.find(p->name()) != taken_names.end())
-        p->SetName(GenerateUniqueName(taken_names, p->name()));
+      if (taken_names.find(p->name()) != taken_names.end()) {
+        p->SetName(GenerateUniqueName(taken_names, p->name(),
+                                      &name_counters[p->name()]));
+      }
       taken_names.insert(p->name());
 
       patches_.push_back(p);
-      patch_insert_point = entries_.insert(patch_insert_point, p) + 1;
+      AddToIndex(p);
+      entries_.insert(patch_insert_point, p);
     }
   }
 
@@ -117,26 +141,59 @@ bool LgParser::ParseBuffer(LgParserCallback* callback,
     entries_.insert(pos, banks_.begin() + bank_size, banks_.end());
   }
 
+  OutputBuffer output(callback);
   for (Entries::const_iterator it = entries_.begin();
        it != entries_.end(); ++it) {
-    (*it)->WriteLines(callback);
+    (*it)->WriteLines(&output);
   }
+  output.Flush();
 
   return true;
 }
 
+void LgParser::BuildIndices() {
+  patch_names_.clear();
+  patch_ids_.clear();
+  bank_names_.clear();
+
+  patch_names_.reserve(patches_.size());
+  patch_ids_.reserve(patches_.size());
+  for (Patches::const_iterator it = patches_.begin(); it != patches_.end();
+       ++it) {
+    AddToIndex(*it);
+  }
+
+  bank_names_.reserve(banks_.size());
+  for (Banks::const_iterator it = banks_.begin(); it != banks_.end(); ++it)
+    bank_names_.insert(BankIndex::value_type((*it)->name(), *it));
+}
+
+void LgParser::AddToIndex(const shared_ptr<Patch>& patch) {
+  // insert() doesn't replace existing entries, so the first patch wins.
+  patch_names_.insert(PatchNameIndex::value_type(patch->name(), patch));
+  patch_ids_.insert(PatchIdIndex::value_type(patch->preset(), patch));
+}
+
+void LgParser::OnPatchRenamed(const shared_ptr<Patch>& patch,
+                              const std::string& old_name) {
+  // Patch names are unique in valid setups, so there's no other patch with
+  // |old_name| to index instead.
+  PatchNameIndex::iterator it = patch_names_.find(old_name);
+  if (it != patch_names_.end() && it->second == patch)
+    patch_names_.erase(it);
+  patch_names_.insert(PatchNameIndex::value_type(patch->name(), patch));
+}
+
 void LgParser::ConnectBanksToBankLists() {
   BankLists::const_iterator bl = bank_lists_.begin();
   for (; bl!= bank_lists_.end(); ++bl) {
-    const LgEntry::Lines& lines = (*bl)->lines();
-    if (lines.size() > 1) {
-      LgEntry::Lines::const_iterator l = lines.begin() + 1;
-      for (; l != lines.end(); ++l) {
-        for (Banks::iterator b = banks_.begin(); b != banks_.end(); ++b) {
-          if ((*b)->name() == *l)
-            (*b)->SetBankList(*bl);
-        }
-      }
+    std::vector<std::string> bank_names((*bl)->GetBankNames());
+    std::vector<std::string>::const_iterator l = bank_names.begin();
+    for (; l != bank_names.end(); ++l) {
+      std::pair<BankIndex::iterator, BankIndex::iterator> range =
+          bank_names_.equal_range(*l);
+      for (BankIndex::iterator b = range.first; b != range.second; ++b)
+        b->second->SetBankList(*bl);
     }
   }
 }
@@ -155,27 +212,13 @@ void LgParser::ConnectPatchesToBanks() {
 
 LgParser::Patches::value_type LgParser::LookupPatch(
     const std::string& name) {
-  // If this turns out to be a perf problem we could build hash maps of
-  // name->patch.
-  Patches::const_iterator it = patches_.begin();
-  for (; it != patches_.end(); ++it) {
-    if ((*it)->name() == name)
-      return *it;
-  }
-
-  return LgParser::Patches::value_type();
+  PatchNameIndex::const_iterator it = patch_names_.find(name);
+  return it == patch_names_.end() ? Patches::value_type() : it->second;
 }
 
 LgParser::Patches::value_type LgParser::LookupPatch(int preset_id) {
-  // If this turns out to be a perf problem we could build hash maps of
-  // id->patch.
-  Patches::const_iterator it = patches_.begin();
-  for (; it != patches_.end(); ++it) {
-    if ((*it)->preset() == preset_id)
-      return *it;
-  }
-
-  return LgParser::Patches::value_type();
+  PatchIdIndex::const_iterator it = patch_ids_.find(preset_id);
+  return it == patch_ids_.end() ? Patches::value_type() : it->second;
 }
 
 LgParser::Entries::iterator LgParser::GetPatchInsertPoint() {
@@ -192,19 +235,19 @@ shared_ptr<LgEntry> LgParser::CreateEntry(const char* line) {
   shared_ptr<LgEntry> ret;
   if (line && IsEntryStart(line)) {
     if (IsPatchStart(line)) {
-      patches_.push_back(Patches::value_type(new Patch()));
+      patches_.push_back(Patches::value_type(new Patch(&arena_)));
       ret = patches_.back();
     } else if (IsBankStart(line)) {
-      banks_.push_back(Banks::value_type(new Bank()));
+      banks_.push_back(Banks::value_type(new Bank(&arena_)));
       ret = banks_.back();
     } else if (IsBankListStart(line)) {
-      bank_lists_.push_back(BankLists::value_type(new BankList()));
+      bank_lists_.push_back(BankLists::value_type(new BankList(&arena_)));
       ret = bank_lists_.back();
     }
   }
 
   if (!ret.get())
-    ret.reset(new LgEntry());
+    ret.reset(new LgEntry(&arena_));
 
   entries_.push_back(ret);
 
@@ -9,6 +9,10 @@
 #include "axefx/axe_fx_sysex_parser.h"
 #include "axefx/preset.h"
 #include "lg/lg_entry.h"
+#include "lg/line_arena.h"
+
+#include <list>
+#include <unordered_map>
 
 namespace lg {
 
@@ -16,10 +20,22 @@ class LgParserCallback {
  public:
   virtual const axefx::PresetMap& GetPresetMap() = 0;
   virtual void WriteLine(const char* line, size_t length) = 0;
+  // Receives the output in large chunks of complete lines (see
+  // OutputBuffer).  The default implementation passes each line on to
+  // WriteLine(), so callbacks that write to a file or memory should override
+  // this instead.
+  virtual void Write(const char* data, size_t length);
+  // Called for presets that already have a patch in the setup.  Returning
+  // false leaves the patch and its bank slots exactly as they are in the
+  // setup, which is how unchanged presets are skipped in incremental mode.
+  virtual bool ShouldUpdatePatch(const axefx::Preset& preset) { return true; }
 
   void WriteLine(const std::string& line) {
     WriteLine(line.c_str(), line.length());
   }
+
+ protected:
+  virtual ~LgParserCallback() {}
 };
 
 class LgParser {
@@ -27,17 +43,31 @@ class LgParser {
   LgParser();
   ~LgParser();
 
+  // Lines are not copied out of the buffer, so it must stay valid for as
+  // long as the parser is used.
   bool ParseBuffer(LgParserCallback* callback, const char* begin,
       const char* end);
 
  protected:
-  typedef std::vector<shared_ptr<LgEntry> > Entries;
+  // A list, since new patches and banks are inserted in the middle.
+  typedef std::list<shared_ptr<LgEntry> > Entries;
   typedef std::vector<shared_ptr<Patch> > Patches;
   typedef std::vector<shared_ptr<Bank> > Banks;
   typedef std::vector<shared_ptr<BankList> > BankLists;
+  // Only the first patch with a given name or id is indexed, which is the
+  // one a linear search would find.
+  typedef std::unordered_map<std::string, shared_ptr<Patch> > PatchNameIndex;
+  typedef std::unordered_map<int, shared_ptr<Patch> > PatchIdIndex;
+  // Bank names aren't guaranteed to be unique.
+  typedef std::unordered_multimap<std::string, shared_ptr<Bank> > BankIndex;
 
   void ProcessLine(const char* line, const char* end);
   shared_ptr<LgEntry> CreateEntry(const char* line);
+  void BuildIndices();
+  void AddToIndex(const shared_ptr<Patch>& patch);
+  // Call after a patch has been renamed.
+  void OnPatchRenamed(const shared_ptr<Patch>& patch,
+                      const std::string& old_name);
   void ConnectBanksToBankLists();
   void ConnectPatchesToBanks();
   Patches::value_type LookupPatch(const std::string& name);
@@ -45,12 +75,18 @@ class LgParser {
   Entries::iterator GetPatchInsertPoint();
 
  private:
+  // Declared first, since the entries point into it.
+  LineArena arena_;
   Entries entries_;
   shared_ptr<LgEntry> current_entry_;
 
   Patches patches_;
   Banks banks_;
   BankLists bank_lists_;
+
+  PatchNameIndex patch_names_;
+  PatchIdIndex patch_ids_;
+  BankIndex bank_names_;
 };
 
 }  // namespace lg
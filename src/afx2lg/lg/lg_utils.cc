@@ -5,11 +5,6 @@
 #include "lg/lg_utils.h"
 
 #include <locale>
-#include <regex>
-
-using std::match_results;
-using std::regex;
-using std::regex_match;
 
 namespace lg {
 
@@ -23,13 +18,19 @@ static const char kBankListStart[] = "* BANKLIST ";
 
 std::string GenerateUniqueName(const ReservedNames& taken_names,
                                const std::string& original_name) {
+  size_t counter = 0u;
+  return GenerateUniqueName(taken_names, original_name, &counter);
+}
+
+std::string GenerateUniqueName(const ReservedNames& taken_names,
+                               const std::string& original_name,
+                               size_t* counter) {
   ASSERT(taken_names.find(original_name) != taken_names.end());
   std::string new_name;
-  size_t counter = 0u;
   do {
-    new_name = original_name + std::to_string(++counter);
+    new_name = original_name + std::to_string(++(*counter));
     if (new_name.length() > kMaxNameLength) {
-      size_t chars = 0, temp_count = counter;
+      size_t chars = 0, temp_count = *counter;
       while (temp_count) {
         ++chars;
         temp_count /= 10;
@@ -92,82 +93,225 @@ bool IsBankListStart(const char* line) {
 bool FindEol(const char** ptr, const char* end) {
   while (*ptr < end && *ptr[0] != '\n')
     ++(*ptr);
-  return *ptr[0] == '\n';
+  // Don't read past |end|, the buffer may be a mapped file.
+  return *ptr < end;
 }
 
-bool ParseInts(const std::string& str, const char* reg_exp, int* ints[],
-               int size) {
-  if (str[0] != '+')
-    return false;
+namespace {
+
+// The character classes below match what std::regex uses for \s, \d and
+// \w with the classic locale, which is what these parsers used to use.
+bool IsSpace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+bool IsWordChar(char c) {
+  return IsDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         c == '_';
+}
+
+// Scans a single line (including the '\n') from left to right.  Each method
+// consumes what it matches and returns false if there's no match, in which
+// case the scanner shouldn't be used further.
+class LineScanner {
+ public:
+  explicit LineScanner(const Line& line)
+      : begin_(line.data()), pos_(begin_), end_(begin_ + line.length()) {}
+
+  // Matches |text| literally.
+  bool Literal(const char* text) {
+    for (; *text; ++text, ++pos_) {
+      if (pos_ == end_ || *pos_ != *text)
+        return false;
+    }
+    return true;
+  }
+
+  // \s+
+  bool Spaces() {
+    const char* start = pos_;
+    while (pos_ < end_ && IsSpace(*pos_))
+      ++pos_;
+    return pos_ != start;
+  }
+
+  // \w+
+  bool Word() {
+    const char* start = pos_;
+    while (pos_ < end_ && IsWordChar(*pos_))
+      ++pos_;
+    return pos_ != start;
+  }
+
+  // (\d+), converted the same way as atoi().
+  bool Number(int* value) {
+    const char* start = pos_;
+    unsigned int result = 0u;
+    while (pos_ < end_ && IsDigit(*pos_))
+      result = result * 10u + (*pos_++ - '0');
+    *value = static_cast<int>(result);
+    return pos_ != start;
+  }
 
-  regex rx(reg_exp);
-  match_results<std::string::const_iterator> match;
-  bool ret = regex_match(str, match, rx);
-  if (ret) {
-    for (int i = 0; i < size; ++i) {
-      if (ints[i])
-        *ints[i] = atoi(match.str(i + 1).c_str());
+  // .*\n up to the end of the line.  '.' doesn't match '\r' or '\n'.
+  bool RestOfLine() {
+    if (pos_ == end_ || end_[-1] != '\n')
+      return false;
+    for (; pos_ < end_ - 1; ++pos_) {
+      if (*pos_ == '\n' || *pos_ == '\r')
+        return false;
     }
+    pos_ = end_;
+    return true;
   }
 
-  return ret;
+  // \s+([\w ]+)\n up to the end of the line.  |offset| and |length|
+  // receive the position of the group within the line.
+  bool SpacesAndName(size_t* offset, size_t* length) {
+    if (pos_ == end_ || end_[-1] != '\n')
+      return false;
+    const char* last = end_ - 1;  // The '\n'.
+    const char* name = pos_;
+    while (name < last && IsSpace(*name))
+      ++name;
+    if (name == pos_)
+      return false;
+
+    if (name == last) {
+      // All white space.  \s+ backs off just enough for the name to be a
+      // single trailing space.
+      if (last - pos_ < 2 || last[-1] != ' ')
+        return false;
+      name = last - 1;
+    } else {
+      for (const char* c = name; c < last; ++c) {
+        if (!IsWordChar(*c) && *c != ' ')
+          return false;
+      }
+    }
+
+    *offset = name - begin_;
+    *length = last - name;
+    pos_ = end_;
+    return true;
+  }
+
+ private:
+  const char* const begin_;
+  const char* pos_;
+  const char* const end_;
+};
+
+}  // namespace
+
+// \*\s+\w+\s+:\s+([\w ]+)\n
+bool FindEntryName(const Line& line, size_t* offset, size_t* length) {
+  LineScanner scanner(line);
+  return scanner.Literal("*") && scanner.Spaces() && scanner.Word() &&
+         scanner.Spaces() && scanner.Literal(":") &&
+         scanner.SpacesAndName(offset, length);
+}
+
+bool FindLinePattern(const Line& line, LinePattern pattern, size_t* offset,
+                     size_t* length) {
+  LineScanner scanner(line);
+  int number;
+  switch (pattern) {
+    case PATCH_SWITCH:
+      // switch \d+\s+\:\s+PA\s+([\w ]+)\n
+      return scanner.Literal("switch ") && scanner.Number(&number) &&
+             scanner.Spaces() && scanner.Literal(":") && scanner.Spaces() &&
+             scanner.Literal("PA") && scanner.SpacesAndName(offset, length);
+    case DEFAULT_PRESET:
+      // DEFAULTPRESET\s+([\w ]+)\n
+      return scanner.Literal("DEFAULTPRESET") &&
+             scanner.SpacesAndName(offset, length);
+  }
+  ASSERT(false);
+  return false;
 }
 
-bool ParseCC(const std::string& str, int* channel, int* cc, int* value) {
-  int* ints[] = { channel, cc, value };
-  return ParseInts(str, "\\+\\s+(\\d+)\\s+CC\\s+(\\d+)\\s+(\\d+).*\n", ints,
-                   arraysize(ints));
+bool ParseCC(const Line& str, int* channel, int* cc, int* value) {
+  // \+\s+(\d+)\s+CC\s+(\d+)\s+(\d+).*\n
+  LineScanner scanner(str);
+  int ints[3];
+  if (!scanner.Literal("+") || !scanner.Spaces() ||
+      !scanner.Number(&ints[0]) || !scanner.Spaces() ||
+      !scanner.Literal("CC") || !scanner.Spaces() ||
+      !scanner.Number(&ints[1]) || !scanner.Spaces() ||
+      !scanner.Number(&ints[2]) || !scanner.RestOfLine()) {
+    return false;
+  }
+
+  if (channel)
+    *channel = ints[0];
+  if (cc)
+    *cc = ints[1];
+  if (value)
+    *value = ints[2];
+  return true;
 }
 
-bool ParseProgramChange(const std::string& str, int* channel, int* preset) {
-  int* ints[] = { channel, preset };
-  return ParseInts(str, "\\+\\s+(\\d+)\\s+PC\\s+(\\d+).*\n", ints,
-                   arraysize(ints));
+bool ParseProgramChange(const Line& str, int* channel, int* preset) {
+  // \+\s+(\d+)\s+PC\s+(\d+).*\n
+  LineScanner scanner(str);
+  int ints[2];
+  if (!scanner.Literal("+") || !scanner.Spaces() ||
+      !scanner.Number(&ints[0]) || !scanner.Spaces() ||
+      !scanner.Literal("PC") || !scanner.Spaces() ||
+      !scanner.Number(&ints[1]) || !scanner.RestOfLine()) {
+    return false;
+  }
+
+  if (channel)
+    *channel = ints[0];
+  if (preset)
+    *preset = ints[1];
+  return true;
 }
 
-bool ParseEntryName(const std::string& str, std::string* name) {
-  regex rx("\\*\\s+(\\w+)\\s+:\\s+([\\w ]+)\n");
-  match_results<std::string::const_iterator> match;
-  bool ret = regex_match(str, match, rx);
-  if (ret)
-    *name = match.str(2);
-  return ret;
+bool ParseEntryName(const Line& str, std::string* name) {
+  size_t offset, length;
+  if (!FindEntryName(str, &offset, &length))
+    return false;
+  name->assign(str.data() + offset, length);
+  return true;
 }
 
 bool ReplaceEntryName(std::string* str, const std::string& name) {
-  regex rx("\\*\\s+\\w+\\s+:\\s+([\\w ]+)\n");
-  match_results<std::string::const_iterator> match;
-  bool ret = regex_match(*str, match, rx);
-  if (ret)
-    str->replace(match.position(1), match.length(1), name);
-  return ret;
+  size_t offset, length;
+  if (!FindEntryName(*str, &offset, &length))
+    return false;
+  str->replace(offset, length, name);
+  return true;
 }
 
-bool ReplaceIfMatch(std::string* str, const char* reg_exp, const char* find,
+bool ReplaceIfMatch(std::string* str, LinePattern pattern, const char* find,
                     const char* replace) {
-  regex rx(reg_exp);
-  match_results<std::string::const_iterator> match;
-  bool ret = regex_match(*str, match, rx);
-  if (ret) {
-    ret = (match.str(1).compare(find) == 0);
-    if (ret)
-      str->replace(match.position(1), match.length(1), replace);
+  size_t offset, length;
+  if (!FindLinePattern(*str, pattern, &offset, &length) ||
+      str->compare(offset, length, find) != 0) {
+    return false;
   }
-  return ret;
+  str->replace(offset, length, replace);
+  return true;
 }
 
-bool ExtractSubstring(const std::string& search, const char* reg_exp,
+bool ExtractSubstring(const Line& search, LinePattern pattern,
                       std::string* found) {
-  regex rx(reg_exp);
-  match_results<std::string::const_iterator> match;
-  bool ret = regex_match(search, match, rx);
-  if (ret)
-    *found = match.str(1);
-  return ret;
+  size_t offset, length;
+  if (!FindLinePattern(search, pattern, &offset, &length))
+    return false;
+  found->assign(search.data() + offset, length);
+  return true;
 }
 
-bool IsDefaultPreset(const std::string& str, std::string* name) {
-  const char regex[] = "DEFAULTPRESET\\s+([\\w ]+)\n";
-  return ExtractSubstring(str, regex, name);
+bool IsDefaultPreset(const Line& str, std::string* name) {
+  return ExtractSubstring(str, DEFAULT_PRESET, name);
 }
+
 }  // namespace lg
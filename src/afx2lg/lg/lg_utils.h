@@ -6,6 +6,8 @@
 #ifndef LG_UTILS_H_
 #define LG_UTILS_H_
 
+#include "lg/line_arena.h"
+
 #include <string>
 #include <unordered_set>
 
@@ -18,6 +20,12 @@ extern const size_t kMaxNameLength;
 
 std::string GenerateUniqueName(const ReservedNames& taken_names,
                                const std::string& original_name);
+// Same as above but continues from the suffix stored in |counter| and stores
+// the one used.  Pass the same counter for all names generated from
+// |original_name| to avoid retrying suffixes that are known to be taken.
+std::string GenerateUniqueName(const ReservedNames& taken_names,
+                               const std::string& original_name,
+                               size_t* counter);
 void CheckNameSizeLimit(std::string* name);
 bool IsSectionSeparator(const char* line);
 bool IsComment(const char* line);
@@ -26,15 +34,28 @@ bool IsPatchStart(const char* line);
 bool IsBankStart(const char* line);
 bool IsBankListStart(const char* line);
 bool FindEol(const char** ptr, const char* end);
-bool ParseCC(const std::string& str, int* channel, int* cc, int* value);
-bool ParseProgramChange(const std::string& str, int* channel, int* preset);
-bool ParseEntryName(const std::string& str, std::string* name);
+// Lines that ExtractSubstring() and ReplaceIfMatch() look for.  The
+// extracted or replaced part is the name at the end of the line.
+enum LinePattern {
+  PATCH_SWITCH,    // "switch 01 : PA <patch name>"
+  DEFAULT_PRESET,  // "DEFAULTPRESET <patch name>"
+};
+
+// The parsers below expect a single line, including the trailing '\n'.
+bool ParseCC(const Line& str, int* channel, int* cc, int* value);
+bool ParseProgramChange(const Line& str, int* channel, int* preset);
+bool ParseEntryName(const Line& str, std::string* name);
 bool ReplaceEntryName(std::string* str, const std::string& name);
-bool ReplaceIfMatch(std::string* str, const char* reg_exp, const char* find,
+bool ReplaceIfMatch(std::string* str, LinePattern pattern, const char* find,
                     const char* replace);
-bool ExtractSubstring(const std::string& search, const char* reg_exp,
+bool ExtractSubstring(const Line& search, LinePattern pattern,
                       std::string* found);
-bool IsDefaultPreset(const std::string& str, std::string* name);
+bool IsDefaultPreset(const Line& str, std::string* name);
+// Find the name in an entry's first line or in a line of the given type
+// without copying it.
+bool FindEntryName(const Line& line, size_t* offset, size_t* length);
+bool FindLinePattern(const Line& line, LinePattern pattern, size_t* offset,
+                     size_t* length);
 
 }  // namespace lg
 
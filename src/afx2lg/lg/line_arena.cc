@@ -0,0 +1,64 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "lg/line_arena.h"
+
+#include <algorithm>
+
+namespace lg {
+
+namespace {
+// Lines are short, so this fits a few hundred of them.
+const size_t kBlockSize = 16 * 1024;
+}
+
+LineArena::LineArena() : free_(NULL), available_(0u) {}
+
+LineArena::~LineArena() {}
+
+Line LineArena::Copy(const char* data, size_t length) {
+  char* copy = Allocate(length);
+  if (length)
+    memcpy(copy, data, length);
+  return Line(copy, length);
+}
+
+Line LineArena::Replace(const Line& line, size_t offset, size_t length,
+                        const std::string& text) {
+  ASSERT(offset + length <= line.length());
+  size_t tail = line.length() - offset - length;
+  char* copy = Allocate(offset + text.length() + tail);
+  memcpy(copy, line.data(), offset);
+  memcpy(copy + offset, text.data(), text.length());
+  memcpy(copy + offset + text.length(), line.data() + offset + length, tail);
+  return Line(copy, offset + text.length() + tail);
+}
+
+Line LineArena::CopyWithNewline(const Line& line, size_t length) {
+  ASSERT(length <= line.length());
+  char* copy = Allocate(length + 1);
+  if (length)
+    memcpy(copy, line.data(), length);
+  copy[length] = '\n';
+  return Line(copy, length + 1);
+}
+
+char* LineArena::Allocate(size_t length) {
+  if (length > available_) {
+    // Unusually long lines get a block of their own so that the current
+    // block can still be used for the lines that follow.
+    size_t size = std::max(length, kBlockSize);
+    blocks_.push_back(unique_ptr<char[]>(new char[size]));
+    if (size != kBlockSize)
+      return blocks_.back().get();
+    free_ = blocks_.back().get();
+    available_ = size;
+  }
+
+  char* ret = free_;
+  free_ += length;
+  available_ -= length;
+  return ret;
+}
+
+}  // namespace lg
@@ -0,0 +1,77 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+
+#ifndef LG_LINE_ARENA_H_
+#define LG_LINE_ARENA_H_
+
+#include "common/common_types.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace lg {
+
+// A line in an LG setup file, usually including the trailing '\n'.  Lines
+// don't own their characters.  Lines that are read from a setup file point
+// into the buffer that was parsed and lines that are created or modified
+// point into a LineArena.
+class Line {
+ public:
+  Line() : data_(NULL), length_(0u) {}
+  Line(const char* data, size_t length) : data_(data), length_(length) {}
+  // Not explicit, so that strings can be passed where a Line is expected.
+  // |str| must outlive the Line.
+  Line(const std::string& str) : data_(str.data()), length_(str.length()) {}
+
+  const char* data() const { return data_; }
+  size_t length() const { return length_; }
+  bool empty() const { return length_ == 0u; }
+  char operator[](size_t i) const { return data_[i]; }
+
+  std::string str() const { return std::string(data_, length_); }
+
+  bool operator==(const Line& other) const {
+    return length_ == other.length_ &&
+           (!length_ || memcmp(data_, other.data_, length_) == 0);
+  }
+  bool operator!=(const Line& other) const { return !(*this == other); }
+
+ private:
+  const char* data_;
+  size_t length_;
+};
+
+// Storage for lines that are created or modified while processing a setup.
+// Memory is handed out from large blocks and is only freed when the arena
+// is destroyed, so Lines from the arena stay valid until then.
+class LineArena {
+ public:
+  LineArena();
+  ~LineArena();
+
+  Line Copy(const char* data, size_t length);
+  Line Copy(const std::string& str) { return Copy(str.data(), str.length()); }
+  // Returns a copy of |line| with |length| characters at |offset| replaced
+  // with |text|.
+  Line Replace(const Line& line, size_t offset, size_t length,
+               const std::string& text);
+  // Returns a copy of the first |length| characters of |line| followed by
+  // '\n'.
+  Line CopyWithNewline(const Line& line, size_t length);
+
+ private:
+  char* Allocate(size_t length);
+
+  std::vector<unique_ptr<char[]> > blocks_;
+  char* free_;
+  size_t available_;
+
+  DISALLOW_COPY_AND_ASSIGN(LineArena);
+};
+
+}  // namespace lg
+
+#endif  // LG_LINE_ARENA_H_
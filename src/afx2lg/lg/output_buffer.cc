@@ -0,0 +1,36 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "lg/output_buffer.h"
+
+#include "lg/lg_parser.h"
+
+namespace lg {
+
+OutputBuffer::OutputBuffer(LgParserCallback* callback, size_t capacity)
+    : callback_(callback), buffer_(capacity), size_(0u) {
+  ASSERT(capacity);
+}
+
+OutputBuffer::~OutputBuffer() {
+  Flush();
+}
+
+void OutputBuffer::Flush() {
+  if (size_) {
+    callback_->Write(&buffer_[0], size_);
+    size_ = 0u;
+  }
+}
+
+void OutputBuffer::FlushAndAppend(const char* line, size_t length) {
+  Flush();
+  if (length > buffer_.size()) {
+    // Doesn't fit even in an empty buffer, so pass it on as is.
+    callback_->Write(line, length);
+  } else {
+    AppendUnchecked(line, length);
+  }
+}
+
+}  // namespace lg
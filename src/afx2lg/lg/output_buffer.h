@@ -0,0 +1,60 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+
+#ifndef LG_OUTPUT_BUFFER_H_
+#define LG_OUTPUT_BUFFER_H_
+
+#include "common/common_types.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace lg {
+
+class LgParserCallback;
+
+// Collects the lines that entries write and passes them on to
+// LgParserCallback::Write() in large chunks, so that there's one virtual call
+// and one write per chunk instead of per line.  Chunks always end with a
+// complete line.
+class OutputBuffer {
+ public:
+  static const size_t kDefaultCapacity = 64 * 1024;
+
+  explicit OutputBuffer(LgParserCallback* callback,
+                        size_t capacity = kDefaultCapacity);
+  // Flushes whatever is left.
+  ~OutputBuffer();
+
+  // |line| should include the '\n'.
+  void Append(const char* line, size_t length) {
+    if (length > buffer_.size() - size_)
+      FlushAndAppend(line, length);
+    else
+      AppendUnchecked(line, length);
+  }
+
+  void Append(const std::string& line) { Append(line.data(), line.length()); }
+
+  void Flush();
+
+ private:
+  void AppendUnchecked(const char* line, size_t length) {
+    memcpy(&buffer_[size_], line, length);
+    size_ += length;
+  }
+  void FlushAndAppend(const char* line, size_t length);
+
+  LgParserCallback* const callback_;
+  std::vector<char> buffer_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(OutputBuffer);
+};
+
+}  // namespace lg
+
+#endif  // LG_OUTPUT_BUFFER_H_
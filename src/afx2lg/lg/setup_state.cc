@@ -0,0 +1,112 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "lg/setup_state.h"
+
+#include "axefx/preset.h"
+#include "common/file_utils.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace lg {
+
+namespace {
+
+// FNV-1a.
+const uint32_t kHashOffset = 2166136261u;
+const uint32_t kHashPrime = 16777619u;
+
+uint32_t Hash(uint32_t hash, const std::vector<uint16_t>& values) {
+  for (auto v : values) {
+    hash = (hash ^ (v & 0xFF)) * kHashPrime;
+    hash = (hash ^ (v >> 8)) * kHashPrime;
+  }
+  return hash;
+}
+
+uint32_t Hash(uint32_t hash, const std::string& str) {
+  for (auto c : str)
+    hash = (hash ^ static_cast<uint8_t>(c)) * kHashPrime;
+  return hash;
+}
+
+}  // namespace
+
+SetupState::SetupState() {}
+
+SetupState::~SetupState() {}
+
+bool SetupState::Load(const std::string& path) {
+  presets_.clear();
+  if (!base::FileExists(path))
+    return true;
+
+  std::ifstream file(path);
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    ++line_number;
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty())
+      continue;
+
+    std::istringstream stream(line);
+    int id;
+    Entry entry;
+    stream >> id >> std::hex >> entry.checksum;
+    if (stream.fail() || stream.get() != ' ') {
+      std::cerr << path << "(" << line_number << "): Invalid preset state\n";
+      presets_.clear();
+      return false;
+    }
+    std::getline(stream, entry.name);
+    presets_[id] = entry;
+  }
+
+  return true;
+}
+
+bool SetupState::Save(const std::string& path) const {
+  std::ofstream file(path, std::ios::out | std::ios::trunc);
+  if (!file.good()) {
+    std::cerr << "Failed to open " << path << "\n";
+    return false;
+  }
+
+  file << std::hex << std::setfill('0');
+  for (const auto& p : presets_) {
+    file << std::dec << p.first << ' ' << std::hex << std::setw(8)
+         << p.second.checksum << ' ' << p.second.name << '\n';
+  }
+
+  return file.good();
+}
+
+bool SetupState::HasChanged(const axefx::Preset& preset) const {
+  auto it = presets_.find(preset.id());
+  return it == presets_.end() ||
+         it->second.checksum != PresetChecksum(preset);
+}
+
+void SetupState::Update(const axefx::Preset& preset) {
+  Entry& entry = presets_[preset.id()];
+  entry.name = preset.name();
+  entry.checksum = PresetChecksum(preset);
+}
+
+// static
+uint32_t SetupState::PresetChecksum(const axefx::Preset& preset) {
+  std::vector<uint16_t> params;
+  preset.GetUncompressedParameters(&params);
+  // The parameters hold the name padded with spaces, which doesn't tell
+  // names with trailing spaces apart.  The setup shows the name as is.
+  uint32_t hash = Hash(kHashOffset, preset.name());
+  return Hash(Hash(hash, params), preset.ir_data());
+}
+
+}  // namespace lg
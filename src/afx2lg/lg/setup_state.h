@@ -0,0 +1,61 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+
+#ifndef LG_SETUP_STATE_H_
+#define LG_SETUP_STATE_H_
+
+#include "common/common_types.h"
+
+#include <map>
+#include <string>
+
+namespace axefx {
+class Preset;
+}
+
+namespace lg {
+
+// Remembers the presets that a setup was last generated from, so that the
+// next run only needs to touch the patches whose presets have changed.
+// The state is stored as text with one preset per line:
+//   <id> <checksum> <name>
+// The name is only there to make the file readable, changes are detected by
+// the checksum alone.
+class SetupState {
+ public:
+  SetupState();
+  ~SetupState();
+
+  // A missing file is not an error and leaves the state empty, which means
+  // that all presets are considered changed.
+  bool Load(const std::string& path);
+  bool Save(const std::string& path) const;
+
+  // Returns true if |preset| isn't in the state or if its checksum is
+  // different from when it was recorded.
+  bool HasChanged(const axefx::Preset& preset) const;
+  void Update(const axefx::Preset& preset);
+
+  size_t size() const { return presets_.size(); }
+
+  // A checksum of the name and of everything that's sent to the AxeFx for
+  // the preset.
+  static uint32_t PresetChecksum(const axefx::Preset& preset);
+
+ private:
+  struct Entry {
+    Entry() : checksum(0u) {}
+    std::string name;
+    uint32_t checksum;
+  };
+
+  std::map<int, Entry> presets_;
+
+  DISALLOW_COPY_AND_ASSIGN(SetupState);
+};
+
+}  // namespace lg
+
+#endif  // LG_SETUP_STATE_H_
@@ -3,38 +3,56 @@
 
 #include "axefx/axe_fx_sysex_parser.h"
 #include "common/file_utils.h"
+#include "common/thread_pool.h"
 #include "lg/lg_parser.h"
+#include "lg/setup_state.h"
 
 #include <climits>
 #include <fstream>
 #include <iostream>
 
 using base::FileExists;
+using base::MemoryMappedFile;
 using base::ReadFileIntoBuffer;
 
 class LgSetupFileWriter : public lg::LgParserCallback {
  public:
-  explicit LgSetupFileWriter(const axefx::PresetMap& presets)
-      : presets_(presets) {}
+  // |state| is optional.  If set, only patches for presets that have changed
+  // since the state was saved are updated.
+  LgSetupFileWriter(const axefx::PresetMap& presets, std::ostream* out,
+                    const lg::SetupState* state)
+      : presets_(presets), out_(out), state_(state) {}
   ~LgSetupFileWriter() {}
 
   virtual void WriteLine(const char* line, size_t length) {
-    std::cout << std::string(line, length);
+    Write(line, length);
+  }
+
+  // The parser buffers the output, so this gets large chunks that are
+  // written straight through.
+  virtual void Write(const char* data, size_t length) {
+    out_->write(data, length);
   }
 
   virtual const axefx::PresetMap& GetPresetMap() {
     return presets_;
   }
 
+  virtual bool ShouldUpdatePatch(const axefx::Preset& preset) {
+    return !state_ || state_->HasChanged(preset);
+  }
+
  private:
   const axefx::PresetMap& presets_;
+  std::ostream* out_;
+  const lg::SetupState* state_;
   DISALLOW_COPY_AND_ASSIGN(LgSetupFileWriter);
 };
 
 void PrintUsage() {
   std::cerr <<
     "Usage:\n\n"
-    "  afx2lg -s=f1.syx [-r=<range>] -t=t.txt\n"
+    "  afx2lg -s=f1.syx [-r=<range>] -t=t.txt [-i=state.txt]\n"
     "\n"
     "    -s     A .syx SysEx patch or bank file for AxeFx II.\n"
     "           You can specify multiple such files in one go.\n"
@@ -49,6 +67,12 @@ void PrintUsage() {
     "           your setup file from LG Control Center as a via the\n"
     "           'File->Export to...->Text...' command.\n"
     "\n"
+    "    -i     Incremental mode.  Specifies a state file where the\n"
+    "           names and checksums of the presets are kept between\n"
+    "           runs.  Patches for presets that haven't changed since\n"
+    "           the last run are left untouched.  Use this when the\n"
+    "           template is the setup that was generated last time.\n"
+    "\n"
     "The generated output will be written to stdout, so just pipe it\n"
     "to a file of your choosing.\n\n"
     "Example:\n\n"
@@ -157,6 +181,7 @@ bool ParseArgs(int argc,
                char* argv[],
                std::vector<SysExFileParam>* syx_files,
                std::string* input_template,
+               std::string* state_file,
                bool* did_prompt) {
   *did_prompt = false;
   SysExFileParam* prev_sysex = NULL;
@@ -184,6 +209,8 @@ bool ParseArgs(int argc,
         return false;
       }
       *input_template = &arg[3];
+    } else if (arg[1] == 'i') {
+      *state_file = &arg[3];
     }
   }
 
@@ -212,8 +239,10 @@ bool ParseArgs(int argc,
 int main(int argc, char* argv[]) {
   std::vector<SysExFileParam> syx_files;
   std::string input_template;
+  std::string state_file;
   bool did_prompt = false;
-  if (!ParseArgs(argc, argv, &syx_files, &input_template, &did_prompt)) {
+  if (!ParseArgs(argc, argv, &syx_files, &input_template, &state_file,
+                 &did_prompt)) {
     PrintUsage();
     return -1;
   }
@@ -237,6 +266,7 @@ int main(int argc, char* argv[]) {
 
   axefx::PresetMap presets;
   axefx::SysExParser parser;
+  parser.set_executor(base::ThreadPool::Shared());
   for (size_t i = 0; i < syx_files.size(); ++i) {
     std::unique_ptr<uint8_t[]> buffer;
     size_t size = 0;
@@ -257,16 +287,29 @@ int main(int argc, char* argv[]) {
     }
   }
 
+  lg::SetupState state;
+  if (!state_file.empty() && !state.Load(state_file))
+    return -1;
+
+  // The parser refers to the lines in the file, so the file needs to stay
+  // mapped while the parser is around.
+  MemoryMappedFile setup;
   lg::LgParser lg_parser;
-  std::unique_ptr<uint8_t[]> buffer;
-  size_t size = 0;
-  if (ReadFileIntoBuffer(input_template, &buffer, &size)) {
-    LgSetupFileWriter callback(presets);
-    if (!lg_parser.ParseBuffer(&callback, reinterpret_cast<char*>(buffer.get()),
-            reinterpret_cast<char*>(buffer.get()) + size)) {
+  if (setup.Open(input_template)) {
+    LgSetupFileWriter callback(presets, &std::cout,
+                               state_file.empty() ? NULL : &state);
+    const char* begin = reinterpret_cast<const char*>(setup.data());
+    if (!lg_parser.ParseBuffer(&callback, begin, begin + setup.size())) {
       std::cerr << "No patches found in " << input_template << std::endl;
       return -1;
     }
+
+    if (!state_file.empty()) {
+      for (const auto& p : presets)
+        state.Update(*p.second.get());
+      if (!state.Save(state_file))
+        return -1;
+    }
   } else {
     std::cerr << "Failed to open " << input_template << std::endl;
   }
@@ -35,6 +35,10 @@ class SetupFileWriter : public lg::LgParserCallback {
     file_->write(line, length);
   }
 
+  virtual void Write(const char* data, size_t length) {
+    file_->write(data, length);
+  }
+
   virtual const axefx::PresetMap& GetPresetMap() {
     return presets_;
   }
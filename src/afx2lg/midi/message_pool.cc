@@ -0,0 +1,82 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "midi/message_pool.h"
+
+namespace midi {
+
+namespace {
+// The first call to Get() can come from a driver thread, and statics aren't
+// initialized thread safely (-fno-threadsafe-statics).
+std::once_flag pool_once;
+MessagePool* pool = NULL;
+}  // namespace
+
+// static
+MessagePool* MessagePool::Get() {
+  // Never deleted, since messages can be recycled at any time, including
+  // while the process is shutting down.
+  std::call_once(pool_once, []() { pool = new MessagePool(); });
+  return pool;
+}
+
+MessagePool::MessagePool() : allocations_(0u) {
+  small_.reserve(kMaxFree);
+  frames_.reserve(kMaxFree);
+}
+
+MessagePool::~MessagePool() {}
+
+unique_ptr<Message> MessagePool::New(size_t size) {
+  if (size > kMaxFrameSize)
+    return unique_ptr<Message>(new Message());
+
+  std::vector<Message*>& list = size > kSmallMessageSize ? frames_ : small_;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!list.empty()) {
+      Message* message = list.back();
+      list.pop_back();
+      return unique_ptr<Message>(message);
+    }
+    ++allocations_;
+  }
+
+  unique_ptr<Message> message(new Message());
+  message->reserve(size > kSmallMessageSize ? kMaxFrameSize
+                                            : kSmallMessageSize);
+  message->pooled_ = true;
+  return message;
+}
+
+unique_ptr<Message> MessagePool::New(const uint8_t* data, size_t size) {
+  unique_ptr<Message> message(New(size));
+  message->assign(data, data + size);
+  return message;
+}
+
+unique_ptr<Message> MessagePool::New(const axefx::FractalSysExHeader* header,
+                                     size_t size) {
+  return New(reinterpret_cast<const uint8_t*>(header), size);
+}
+
+void MessagePool::Recycle(unique_ptr<Message> message) {
+  // A message that has grown beyond its class has reallocated its buffer,
+  // so there's no point in keeping it around.
+  if (!message || !message->pooled_ || message->capacity() > kMaxFrameSize)
+    return;
+
+  message->clear();
+  std::vector<Message*>& list =
+      message->capacity() == kMaxFrameSize ? frames_ : small_;
+  std::lock_guard<std::mutex> lock(lock_);
+  if (list.size() < kMaxFree)
+    list.push_back(message.release());
+}
+
+size_t MessagePool::allocations() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return allocations_;
+}
+
+}  // namespace midi
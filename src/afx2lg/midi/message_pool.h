@@ -0,0 +1,62 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef MIDI_MESSAGE_POOL_H_
+#define MIDI_MESSAGE_POOL_H_
+
+#include "common/common_types.h"
+#include "midi/midi_out.h"
+
+#include <mutex>
+#include <vector>
+
+namespace midi {
+
+// Fractal's largest frames are firmware data messages with 32 words each.
+const size_t kMaxFrameSize = sizeof(axefx::FirmwareDataHeader) +
+                             (sizeof(axefx::Fractal32bit) * 31) +
+                             sizeof(axefx::FractalSysExEnd);
+// Requests, program changes and other short messages.
+const size_t kSmallMessageSize = 16;
+
+// A process wide pool of Message objects with preallocated buffers, so that
+// sending a stream of frames doesn't allocate memory for each one.  There
+// are two sizes, one for small messages and one for full frames.  Messages
+// from the pool are returned to it when the MessageBufferOwner that sends
+// them goes away, i.e. when the send has completed, or via Recycle.
+// Larger messages are allocated as usual.  The pool is thread safe.
+class MessagePool {
+ public:
+  static MessagePool* Get();
+
+  // Returns an empty message that |size| bytes fit in without reallocating.
+  unique_ptr<Message> New(size_t size);
+  unique_ptr<Message> New(const uint8_t* data, size_t size);
+  unique_ptr<Message> New(const axefx::FractalSysExHeader* header,
+                          size_t size);
+
+  // Takes back a message from New().  Other messages are deleted.
+  void Recycle(unique_ptr<Message> message);
+
+  // The number of messages that the pool has had to allocate.
+  size_t allocations() const;
+
+ private:
+  MessagePool();
+  ~MessagePool();
+
+  // Upper bound of messages kept around in each list.
+  static const size_t kMaxFree = 64;
+
+  mutable std::mutex lock_;
+  std::vector<Message*> small_;
+  std::vector<Message*> frames_;
+  size_t allocations_;
+
+  DISALLOW_COPY_AND_ASSIGN(MessagePool);
+};
+
+}  // namespace midi
+
+#endif  // MIDI_MESSAGE_POOL_H_
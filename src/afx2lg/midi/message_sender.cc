@@ -0,0 +1,280 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "midi/message_sender.h"
+
+#include "midi/message_pool.h"
+
+#include <algorithm>
+#include <iostream>
+
+using std::placeholders::_1;
+
+namespace midi {
+
+MessageSender::Options::Options()
+    : window(4u),
+      min_interval(0),
+      max_interval(std::chrono::milliseconds(100)),
+      wait_for_reply(1, axefx::PRESET_CHECKSUM),
+      reply_timeout(1000),
+      max_retries(3u) {
+}
+
+MessageSender::MessageSender(MidiOut* midi_out,
+                             const shared_ptr<MidiIn>& midi_in,
+                             const shared_ptr<base::ThreadLoop>& loop,
+                             const Options& options)
+    : midi_out_(midi_out),
+      midi_in_(midi_in),
+      loop_(loop),
+      options_(options),
+      next_frame_(0u),
+      unit_begin_(0u),
+      reply_unit_begin_(0u),
+      in_flight_(0u),
+      window_(std::max<size_t>(options.window, 1u)),
+      messages_sent_(0u),
+      error_replies_(0u),
+      retries_(0u),
+      unit_retries_(0u),
+      failed_(false),
+      interval_(options.min_interval),
+      last_send_(Clock::now()),
+      waiting_for_reply_(false),
+      expects_replies_(!options.wait_for_reply.empty()),
+      send_timer_(0u),
+      reply_timer_(0u),
+      done_(false),
+      self_(new MessageSender*(this)) {
+  ASSERT(options_.min_interval <= options_.max_interval);
+  // Tempo and tuner data are dropped by the driver, which also means that
+  // they don't keep the worker loop from timing out.
+  sysex_buffer_.Subscribe(FunctionSet({ axefx::REPLY }, false),
+                          std::bind(&MessageSender::OnSysEx, this, _1));
+}
+
+MessageSender::~MessageSender() {
+  if (send_timer_)
+    loop_->CancelTask(send_timer_);
+  if (reply_timer_)
+    loop_->CancelTask(reply_timer_);
+  midi_in_->set_ondataavailable(nullptr);
+  midi_in_->set_input_filter(FunctionSet::All());
+}
+
+void MessageSender::Add(const std::vector<uint8_t>& message) {
+  ASSERT(!message.empty());
+  data_.insert(data_.end(), message.begin(), message.end());
+  frame_ends_.push_back(data_.size());
+}
+
+void MessageSender::Start(const Callback& on_progress,
+                          const DoneCallback& on_done) {
+  on_progress_ = on_progress;
+  on_done_ = on_done;
+  sysex_buffer_.Attach(midi_in_);
+  SendNext();
+}
+
+void MessageSender::OnReplyTimeout() {
+  reply_timer_ = 0u;
+  // OnComplete() restarts the timer.
+  if (!waiting_for_reply_ || in_flight_)
+    return;
+
+  std::cerr << "\nNo reply from the AxeFx.  Continuing without waiting for "
+               "replies.\n";
+  expects_replies_ = false;
+  waiting_for_reply_ = false;
+  SendNext();
+}
+
+void MessageSender::StartReplyTimer() {
+  if (reply_timer_)
+    loop_->CancelTask(reply_timer_);
+  reply_timer_ = loop_->QueueDelayedTask(options_.reply_timeout,
+                                         [this]() { OnReplyTimeout(); });
+}
+
+void MessageSender::SendNext() {
+  if (send_timer_)
+    return;
+
+  while (!waiting_for_reply_ && in_flight_ < window_ && !empty()) {
+    if (interval_.count()) {
+      auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+          last_send_ + interval_ - Clock::now());
+      if (wait.count() > 0) {
+        send_timer_ = loop_->QueueDelayedTask(wait, [this]() {
+          send_timer_ = 0u;
+          SendNext();
+        });
+        return;
+      }
+    }
+
+    size_t begin = next_frame_ ? frame_ends_[next_frame_ - 1] : 0u;
+    size_t end = frame_ends_[next_frame_++];
+    unique_ptr<Message> message(
+        MessagePool::Get()->New(&data_[begin], end - begin));
+
+    bool reply = expects_replies_ && ExpectsReply(*message);
+    ++in_flight_;
+    last_send_ = Clock::now();
+    // The completion callback comes on the driver's thread, possibly after
+    // the sender has been deleted.
+    std::function<void()> on_complete(std::bind(&MessageSender::OnSendComplete,
+        loop_, std::weak_ptr<MessageSender*>(self_)));
+    if (!midi_out_->Send(std::move(message), on_complete)) {
+      std::cerr << "\nFailed to send a midi message.\n";
+      --in_flight_;
+      failed_ = true;
+      next_frame_ = frame_ends_.size();
+      // The messages in flight might never complete if the device is gone.
+      Finish();
+      return;
+    }
+
+    if (reply) {
+      waiting_for_reply_ = true;
+      reply_unit_begin_ = unit_begin_;
+      unit_begin_ = next_frame_;
+      StartReplyTimer();
+    }
+  }
+
+  CheckDone();
+}
+
+// static
+void MessageSender::OnSendComplete(
+    const shared_ptr<base::ThreadLoop>& loop,
+    const std::weak_ptr<MessageSender*>& sender) {
+  loop->QueueTask([sender]() {
+    shared_ptr<MessageSender*> self(sender.lock());
+    if (self)
+      (*self)->OnComplete();
+  });
+}
+
+void MessageSender::OnComplete() {
+  ASSERT(in_flight_ > 0u);
+  --in_flight_;
+  ++messages_sent_;
+  if (on_progress_)
+    on_progress_();
+
+  // The reply can't be expected before the message has been sent.
+  if (waiting_for_reply_)
+    StartReplyTimer();
+
+  SpeedUp();
+  SendNext();
+}
+
+void MessageSender::OnSysEx(Message* message) {
+  if (!message->IsFractalMessageWithChecksum() ||
+      message->size() < sizeof(axefx::ReplyMessage) +
+                            sizeof(axefx::FractalSysExEnd)) {
+    return;
+  }
+
+  auto reply = reinterpret_cast<const axefx::ReplyMessage*>(&message->at(0));
+  bool error = reply->error_id != 0;
+  if (error) {
+    ++error_replies_;
+    SlowDown();
+  }
+
+  auto& types = options_.wait_for_reply;
+  if (!waiting_for_reply_ ||
+      std::find(types.begin(), types.end(), reply->reply_to()) ==
+          types.end()) {
+    // Without a reply to wait for, there's no telling which messages the
+    // error refers to.
+    if (error)
+      failed_ = true;
+    return;
+  }
+
+  waiting_for_reply_ = false;
+  if (reply_timer_) {
+    loop_->CancelTask(reply_timer_);
+    reply_timer_ = 0u;
+  }
+
+  if (error) {
+    OnErrorReply();
+  } else {
+    unit_retries_ = 0u;
+  }
+  SendNext();
+}
+
+void MessageSender::OnErrorReply() {
+  if (unit_retries_ == options_.max_retries) {
+    std::cerr << "\nThe AxeFx rejected the same data "
+              << options_.max_retries + 1 << " times.  Giving up.\n";
+    failed_ = true;
+    // Nothing more is sent and the sender is done once the messages in
+    // flight have completed.
+    next_frame_ = frame_ends_.size();
+    return;
+  }
+
+  // Nothing has been sent since the message that the unit replied to, so
+  // everything from the previous reply on is sent again.
+  ++unit_retries_;
+  ++retries_;
+  next_frame_ = reply_unit_begin_;
+  unit_begin_ = reply_unit_begin_;
+}
+
+void MessageSender::SlowDown() {
+  // Back off quickly...
+  window_ = std::max<size_t>(window_ / 2u, 1u);
+  interval_ = std::max(interval_ * 2,
+      std::chrono::microseconds(std::chrono::milliseconds(1)));
+  interval_ = std::min(interval_, options_.max_interval);
+}
+
+void MessageSender::SpeedUp() {
+  // ...and recover slowly.
+  if (interval_ > options_.min_interval) {
+    interval_ -= std::max(interval_ / 16, std::chrono::microseconds(1));
+    interval_ = std::max(interval_, options_.min_interval);
+  } else if (window_ < options_.window) {
+    ++window_;
+  }
+}
+
+bool MessageSender::ExpectsReply(const Message& message) const {
+  if (!message.IsFractalMessageNoChecksum())
+    return false;
+  auto header =
+      reinterpret_cast<const axefx::FractalSysExHeader*>(&message[0]);
+  auto& types = options_.wait_for_reply;
+  return std::find(types.begin(), types.end(), header->function()) !=
+         types.end();
+}
+
+void MessageSender::CheckDone() {
+  if (!empty() || in_flight_ || waiting_for_reply_)
+    return;
+  Finish();
+}
+
+void MessageSender::Finish() {
+  if (done_)
+    return;
+  done_ = true;
+  if (reply_timer_) {
+    loop_->CancelTask(reply_timer_);
+    reply_timer_ = 0u;
+  }
+  if (on_done_)
+    on_done_(!failed_);
+}
+
+}  // namespace midi
@@ -0,0 +1,151 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef MIDI_MESSAGE_SENDER_H_
+#define MIDI_MESSAGE_SENDER_H_
+
+#include "common/common_types.h"
+#include "common/thread_loop.h"
+#include "midi/midi_in.h"
+#include "midi/midi_out.h"
+
+#include <chrono>
+#include <vector>
+
+namespace midi {
+
+// Sends a sequence of messages to the AxeFx as fast as the unit can take
+// them.  Up to |window| messages are handed to the MidiOut at a time, so that
+// the driver always has the next message ready, and the time between
+// messages adapts to REPLY messages from the unit: an error reply (e.g. the
+// unit was busy) slows the transfer down, successful messages speed it up
+// again.  After messages of the types in |wait_for_reply|, e.g. the end of a
+// preset, nothing more is sent until the unit has replied, so that it has
+// time to store the data.  If the reply is an error, the messages since the
+// previous reply, i.e. the whole preset, are sent again, up to
+// |max_retries| times before the transfer fails.  If the unit doesn't reply
+// in time, the sender stops waiting for replies and relies on pacing alone.
+// The pacing and the reply timeout are delayed tasks on the worker loop.
+// If the MidiOut fails to send a message, nothing more is sent and the
+// transfer fails right away.
+//
+// All methods must be called on the worker thread of the MidiIn, which is
+// also where callbacks are made.  Run the worker loop until the |on_done|
+// callback has been called.
+class MessageSender {
+ public:
+  struct Options {
+    // Constructor sets the defaults.
+    Options();
+
+    // Max number of messages that have been sent but not completed.
+    size_t window;
+    // Bounds for the adaptive time between messages.
+    std::chrono::microseconds min_interval;
+    std::chrono::microseconds max_interval;
+    // Message types that the unit is expected to reply to.
+    std::vector<axefx::FunctionId> wait_for_reply;
+    std::chrono::milliseconds reply_timeout;
+    // How many times the messages that an error reply refers to are sent
+    // again.
+    size_t max_retries;
+  };
+
+  typedef std::function<void()> Callback;
+  // Gets false if the transfer failed, see failed().
+  typedef std::function<void(bool succeeded)> DoneCallback;
+
+  MessageSender(MidiOut* midi_out,
+                const shared_ptr<MidiIn>& midi_in,
+                const shared_ptr<base::ThreadLoop>& loop,
+                const Options& options);
+  ~MessageSender();
+
+  // Appends a message to send.  Messages are stored back to back in one
+  // buffer and copied into pooled messages as they're sent.
+  void Add(const std::vector<uint8_t>& message);
+  bool empty() const { return next_frame_ == frame_ends_.size(); }
+
+  // |on_progress| is called for each message that's been sent and |on_done|
+  // once all messages have been sent and replied to, or when the transfer
+  // has failed.
+  void Start(const Callback& on_progress, const DoneCallback& on_done);
+
+  size_t messages_sent() const { return messages_sent_; }
+  size_t error_replies() const { return error_replies_; }
+  // Number of times that messages have been sent again after an error.
+  size_t retries() const { return retries_; }
+  // True if a message couldn't be sent or if the unit reported an error
+  // that couldn't be recovered from, either because the retries ran out or
+  // because the sender wasn't waiting for replies and can't tell which
+  // message the error refers to.
+  bool failed() const { return failed_; }
+  std::chrono::microseconds interval() const { return interval_; }
+  bool waiting_for_reply() const { return waiting_for_reply_; }
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  // Called on the driver's thread when a message has been sent.  Passes the
+  // completion on to the sender on |loop|, unless it's been deleted.
+  static void OnSendComplete(const shared_ptr<base::ThreadLoop>& loop,
+                             const std::weak_ptr<MessageSender*>& sender);
+
+  void SendNext();
+  void OnComplete();
+  void OnErrorReply();
+  // Stops waiting for replies.
+  void OnReplyTimeout();
+  // (Re)starts the reply timeout.
+  void StartReplyTimer();
+  void OnSysEx(Message* message);
+  void SlowDown();
+  void SpeedUp();
+  bool ExpectsReply(const Message& message) const;
+  void CheckDone();
+  // Calls |on_done_|, once.
+  void Finish();
+
+  MidiOut* midi_out_;
+  shared_ptr<MidiIn> midi_in_;
+  shared_ptr<base::ThreadLoop> loop_;
+  Options options_;
+  SysExDataBuffer sysex_buffer_;
+  std::vector<uint8_t> data_;
+  std::vector<size_t> frame_ends_;
+  size_t next_frame_;
+  // First frame after the last message that expects a reply, and the first
+  // frame of the messages that the reply we're waiting for refers to.
+  size_t unit_begin_;
+  size_t reply_unit_begin_;
+  Callback on_progress_;
+  DoneCallback on_done_;
+  size_t in_flight_;
+  // The current window, which shrinks when the unit reports errors.
+  size_t window_;
+  size_t messages_sent_;
+  size_t error_replies_;
+  size_t retries_;
+  // Retries of the messages that we're waiting for a reply to.
+  size_t unit_retries_;
+  bool failed_;
+  std::chrono::microseconds interval_;
+  Clock::time_point last_send_;
+  bool waiting_for_reply_;
+  bool expects_replies_;
+  // Delayed tasks on |loop_|, 0 when not pending.
+  base::ThreadLoop::TimerId send_timer_;
+  base::ThreadLoop::TimerId reply_timer_;
+  bool done_;
+  // Completions of sent messages can come after the sender has been
+  // deleted, so they get a weak reference.  Only dereferenced on the worker
+  // thread, which is also where the sender is deleted.
+  shared_ptr<MessageSender*> self_;
+
+  DISALLOW_COPY_AND_ASSIGN(MessageSender);
+};
+
+}  // namespace midi
+
+#endif  // MIDI_MESSAGE_SENDER_H_
@@ -13,10 +13,22 @@
         '..',
       ],
       'sources': [
+        'message_pool.cc',
+        'message_pool.h',
+        'message_sender.cc',
+        'message_sender.h',
+        'midi_capture.cc',
+        'midi_capture.h',
         'midi_in.cc',
         'midi_in.h',
         'midi_out.cc',
         'midi_out.h',
+        'midi_stats.cc',
+        'midi_stats.h',
+        'simulated_axefx.cc',
+        'simulated_axefx.h',
+        'sysex_filter.cc',
+        'sysex_filter.h',
       ],
       'conditions': [
         ['OS=="win"', {
@@ -44,6 +56,19 @@
             ],
           },
         }],
+        ['OS=="linux"', {
+          'sources': [
+            'midi_in_linux.cc',
+            'midi_linux.cc',
+            'midi_linux.h',
+            'midi_out_linux.cc',
+          ],
+          'link_settings': {
+            'libraries': [
+              '-lpthread',
+            ],
+          },
+        }],
       ],
     },
   ],
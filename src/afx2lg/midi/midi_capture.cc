@@ -0,0 +1,303 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "midi/midi_capture.h"
+
+#include "common/file_utils.h"
+#include "midi/message_pool.h"
+
+#include <fstream>
+#include <iostream>
+
+namespace midi {
+
+namespace {
+const char kSignature[8] = { 'a', 'f', 'x', '2', 'l', 'g', 'M', 'C' };
+const uint32_t kVersion = 1u;
+const char kDeviceName[] = "MIDI Capture";
+
+void AppendLittleEndian(uint64_t value, size_t bytes, std::string* out) {
+  for (size_t i = 0; i < bytes; ++i)
+    out->push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+}
+
+bool ReadLittleEndian(const uint8_t** pos, const uint8_t* end, size_t bytes,
+                      uint64_t* value) {
+  if (static_cast<size_t>(end - *pos) < bytes)
+    return false;
+  *value = 0u;
+  for (size_t i = 0; i < bytes; ++i)
+    *value |= static_cast<uint64_t>((*pos)[i]) << (i * 8);
+  *pos += bytes;
+  return true;
+}
+}  // namespace
+
+class MidiCapture::Out : public MidiOut {
+ public:
+  Out(unique_ptr<MidiOut> midi_out, MidiCapture* capture)
+      : MidiOut(midi_out->device()),
+        midi_out_(std::move(midi_out)),
+        capture_(capture) {}
+  virtual ~Out() {}
+
+  virtual bool Send(unique_ptr<Message> message,
+                    const std::function<void()>& on_complete) {
+    capture_->Record(TO_UNIT, &message->at(0), message->size());
+    return midi_out_->Send(std::move(message), on_complete);
+  }
+
+ private:
+  unique_ptr<MidiOut> midi_out_;
+  MidiCapture* capture_;
+};
+
+MidiCapture::MidiCapture() : start_(std::chrono::steady_clock::now()) {}
+
+MidiCapture::~MidiCapture() {
+  if (!save_path_.empty())
+    Save(save_path_);
+}
+
+void MidiCapture::RecordMidiIn(MidiIn* midi_in) {
+  midi_in->set_capture(this);
+}
+
+unique_ptr<MidiOut> MidiCapture::RecordMidiOut(unique_ptr<MidiOut> midi_out) {
+  return unique_ptr<MidiOut>(new Out(std::move(midi_out), this));
+}
+
+void MidiCapture::Record(Direction direction, const uint8_t* data,
+                         size_t size) {
+  Chunk chunk;
+  chunk.direction = direction;
+  chunk.time = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start_);
+  chunk.data.assign(data, data + size);
+  std::lock_guard<std::mutex> lock(lock_);
+  chunks_.push_back(std::move(chunk));
+}
+
+bool MidiCapture::Save(const std::string& path) const {
+  std::string data(kSignature, sizeof(kSignature));
+  AppendLittleEndian(kVersion, 4, &data);
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (const auto& chunk : chunks_) {
+      data.push_back(static_cast<char>(chunk.direction));
+      AppendLittleEndian(chunk.time.count(), 8, &data);
+      AppendLittleEndian(chunk.data.size(), 4, &data);
+      data.append(chunk.data.begin(), chunk.data.end());
+    }
+  }
+
+  std::ofstream file(path.c_str(), std::ios::out | std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open " << path << " for writing\n";
+    return false;
+  }
+  file.write(data.c_str(), data.size());
+  return file.good();
+}
+
+bool MidiCapture::Load(const std::string& path) {
+  base::MemoryMappedFile file;
+  if (!file.Open(path)) {
+    std::cerr << "Failed to open " << path << "\n";
+    return false;
+  }
+  return Load(file.data(), file.data() + file.size());
+}
+
+bool MidiCapture::Load(const uint8_t* begin, const uint8_t* end) {
+  bool signature = static_cast<size_t>(end - begin) > sizeof(kSignature) &&
+                   memcmp(begin, kSignature, sizeof(kSignature)) == 0;
+  const uint8_t* pos = signature ? begin + sizeof(kSignature) : end;
+  uint64_t version;
+  if (!ReadLittleEndian(&pos, end, 4, &version) || version != kVersion) {
+    std::cerr << "Not a MIDI capture file\n";
+    return false;
+  }
+
+  std::vector<Chunk> chunks;
+  while (pos < end) {
+    uint64_t time, size;
+    Chunk chunk;
+    chunk.direction = static_cast<Direction>(*pos++);
+    if ((chunk.direction != FROM_UNIT && chunk.direction != TO_UNIT) ||
+        !ReadLittleEndian(&pos, end, 8, &time) ||
+        !ReadLittleEndian(&pos, end, 4, &size) ||
+        static_cast<uint64_t>(end - pos) < size) {
+      std::cerr << "Corrupt MIDI capture file\n";
+      return false;
+    }
+    chunk.time = std::chrono::microseconds(time);
+    chunk.data.assign(pos, pos + size);
+    pos += size;
+    chunks.push_back(std::move(chunk));
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  chunks_.swap(chunks);
+  return true;
+}
+
+class MidiReplayer::In : public MidiIn {
+ public:
+  In(const shared_ptr<MidiDeviceInfo>& device,
+     const shared_ptr<base::ThreadLoop>& worker_thread)
+      : MidiIn(device, worker_thread) {}
+  virtual ~In() {}
+
+  void set_weak_this(const std::weak_ptr<In>& me) { weak_this_ = me; }
+
+  // Called on the replay thread.  Returns the number of bytes that fit in
+  // the input ring.
+  size_t Deliver(const uint8_t* data, size_t size) {
+    return QueueData(weak_this_, data, size);
+  }
+
+ private:
+  std::weak_ptr<In> weak_this_;
+};
+
+class MidiReplayer::Out : public MidiOut {
+ public:
+  Out(const shared_ptr<MidiDeviceInfo>& device, MidiReplayer* replayer)
+      : MidiOut(device), replayer_(replayer) {}
+  virtual ~Out() {}
+
+  virtual bool Send(unique_ptr<Message> message,
+                    const std::function<void()>& on_complete) {
+    ASSERT(!message->empty());
+    replayer_->OnSend(*message);
+    MessagePool::Get()->Recycle(std::move(message));
+    if (on_complete)
+      on_complete();
+    return true;
+  }
+
+ private:
+  MidiReplayer* replayer_;
+};
+
+MidiReplayer::MidiReplayer(const MidiCapture& capture, Pace pace)
+    : chunks_(capture.chunks()),
+      pace_(pace),
+      quit_(false),
+      chunks_played_(0u),
+      mismatches_(0u),
+      done_(false) {
+  for (size_t i = 0; i < chunks_.size(); ++i) {
+    if (chunks_[i].direction == MidiCapture::TO_UNIT)
+      sent_chunks_.push_back(i);
+  }
+}
+
+MidiReplayer::~MidiReplayer() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    quit_ = true;
+  }
+  signal_.notify_one();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+shared_ptr<MidiIn> MidiReplayer::OpenMidiIn(
+    const shared_ptr<base::ThreadLoop>& worker_thread) {
+  ASSERT(!thread_.joinable());
+  shared_ptr<MidiDeviceInfo> device(new MidiDeviceInfo(-1, kDeviceName));
+  shared_ptr<In> in(new In(device, worker_thread));
+  in->set_weak_this(in);
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    in_ = in;
+  }
+  thread_ = std::thread(&MidiReplayer::Run, this);
+  return in;
+}
+
+unique_ptr<MidiOut> MidiReplayer::OpenMidiOut() {
+  shared_ptr<MidiDeviceInfo> device(new MidiDeviceInfo(-1, kDeviceName));
+  return unique_ptr<MidiOut>(new Out(device, this));
+}
+
+bool MidiReplayer::done() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return done_;
+}
+
+size_t MidiReplayer::chunks_played() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return chunks_played_;
+}
+
+size_t MidiReplayer::mismatches() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return mismatches_;
+}
+
+void MidiReplayer::OnSend(const Message& message) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    size_t index = send_times_.size();
+    if (index >= sent_chunks_.size() ||
+        chunks_[sent_chunks_[index]].data != message) {
+      ++mismatches_;
+    }
+    send_times_.push_back(Clock::now());
+  }
+  signal_.notify_one();
+}
+
+void MidiReplayer::Run() {
+  // Replies are timed relative to when the host sent the message that
+  // they follow, or to the start of playback for data that came first.
+  Clock::time_point segment_start = Clock::now();
+  std::chrono::microseconds segment_time(0);
+  size_t sent = 0u;
+
+  std::unique_lock<std::mutex> lock(lock_);
+  for (const auto& chunk : chunks_) {
+    if (chunk.direction == MidiCapture::TO_UNIT) {
+      while (!quit_ && send_times_.size() <= sent)
+        signal_.wait(lock);
+      if (quit_)
+        return;
+      segment_start = send_times_[sent++];
+      segment_time = chunk.time;
+      continue;
+    }
+
+    if (pace_ == ORIGINAL_PACE) {
+      Clock::time_point time = segment_start + (chunk.time - segment_time);
+      while (!quit_ && Clock::now() < time)
+        signal_.wait_until(lock, time);
+    }
+    if (quit_)
+      return;
+
+    shared_ptr<In> in(in_.lock());
+    if (in) {
+      size_t queued = 0u;
+      while (queued < chunk.data.size()) {
+        lock.unlock();
+        queued += in->Deliver(&chunk.data[queued],
+                              chunk.data.size() - queued);
+        lock.lock();
+        // Wait for the host if it isn't keeping up.
+        if (queued < chunk.data.size() &&
+            signal_.wait_for(lock, std::chrono::milliseconds(1),
+                             [this]() { return quit_; })) {
+          return;
+        }
+      }
+    }
+    ++chunks_played_;
+  }
+
+  done_ = true;
+}
+
+}  // namespace midi
@@ -0,0 +1,150 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef MIDI_MIDI_CAPTURE_H_
+#define MIDI_MIDI_CAPTURE_H_
+
+#include "common/common_types.h"
+#include "common/thread_loop.h"
+#include "midi/midi_in.h"
+#include "midi/midi_out.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace midi {
+
+// A recording of the MIDI traffic between the host and a unit.  Data from
+// the unit is recorded in the chunks that the driver delivered it in, so
+// that the fragmentation of the stream is preserved, and messages to the
+// unit are recorded as they were sent.  Every chunk has a timestamp
+// relative to when the capture was created.
+//
+// Capture files start with the 8 byte signature "afx2lgMC" and a 32 bit
+// version, followed by one record per chunk:
+//   uint8_t   direction (0 = from the unit, 1 = to the unit)
+//   uint64_t  microseconds since the capture started
+//   uint32_t  size
+//   uint8_t   data[size]
+// All integers are little endian.
+class MidiCapture {
+ public:
+  enum Direction {
+    FROM_UNIT = 0,
+    TO_UNIT = 1,
+  };
+
+  struct Chunk {
+    Direction direction;
+    std::chrono::microseconds time;
+    std::vector<uint8_t> data;
+  };
+
+  MidiCapture();
+  ~MidiCapture();
+
+  // When set, the capture is saved to |path| when it's destroyed, so that
+  // runs that end early are recorded too.
+  void set_save_path(const std::string& path) { save_path_ = path; }
+
+  // Records everything that |midi_in| receives from now on.  The capture
+  // must outlive |midi_in|.
+  void RecordMidiIn(MidiIn* midi_in);
+
+  // Returns a MidiOut that records messages and passes them on to
+  // |midi_out|.  The capture must outlive the returned object.
+  unique_ptr<MidiOut> RecordMidiOut(unique_ptr<MidiOut> midi_out);
+
+  // Thread safe.  Called from the driver's thread for incoming data.
+  void Record(Direction direction, const uint8_t* data, size_t size);
+
+  bool Save(const std::string& path) const;
+  // Replaces the current chunks with the ones in the file.
+  bool Load(const std::string& path);
+  bool Load(const uint8_t* begin, const uint8_t* end);
+
+  // Not thread safe.  Only use while nothing is being recorded.
+  const std::vector<Chunk>& chunks() const { return chunks_; }
+
+ private:
+  class Out;
+
+  const std::chrono::steady_clock::time_point start_;
+  std::string save_path_;
+  mutable std::mutex lock_;
+  std::vector<Chunk> chunks_;
+
+  DISALLOW_COPY_AND_ASSIGN(MidiCapture);
+};
+
+// Plays back the unit's side of a capture through a MidiIn.  Replies are
+// held back until the host has sent the message that they followed in the
+// capture, so a tool that's run against the replayer goes through the
+// same sequence as it did against the unit and receives the data in the
+// same chunks.  The timing within each reply is either kept as it was or
+// dropped entirely to run at full speed.
+//
+// Sent messages are compared to the capture and complete right away.  The
+// replayer runs on its own thread, which is also where data for the MidiIn
+// worker comes from.  The replayer must outlive the MidiIn and MidiOut
+// objects it opens.
+class MidiReplayer {
+ public:
+  enum Pace {
+    ORIGINAL_PACE,
+    FULL_SPEED,
+  };
+
+  MidiReplayer(const MidiCapture& capture, Pace pace);
+  ~MidiReplayer();
+
+  // Playback starts when the MidiIn is opened.  Only one can be opened.
+  shared_ptr<MidiIn> OpenMidiIn(
+      const shared_ptr<base::ThreadLoop>& worker_thread);
+  unique_ptr<MidiOut> OpenMidiOut();
+
+  // True once all chunks have been played back.
+  bool done() const;
+  size_t chunks_played() const;
+  // Number of sent messages that differ from the capture, or that were
+  // sent after the capture ended.
+  size_t mismatches() const;
+
+ private:
+  class In;
+  class Out;
+
+  typedef std::chrono::steady_clock Clock;
+
+  // Called by Out on the host's thread.
+  void OnSend(const Message& message);
+  void Run();
+
+  const std::vector<MidiCapture::Chunk> chunks_;
+  const Pace pace_;
+  // Indices of the TO_UNIT chunks.
+  std::vector<size_t> sent_chunks_;
+
+  mutable std::mutex lock_;
+  std::condition_variable signal_;
+  bool quit_;
+  std::thread thread_;
+
+  // Guarded by |lock_|.
+  std::weak_ptr<In> in_;
+  std::vector<Clock::time_point> send_times_;
+  size_t chunks_played_;
+  size_t mismatches_;
+  bool done_;
+
+  DISALLOW_COPY_AND_ASSIGN(MidiReplayer);
+};
+
+}  // namespace midi
+
+#endif  // MIDI_MIDI_CAPTURE_H_
@@ -3,10 +3,15 @@
 
 #include "midi/midi_in.h"
 
+#include "midi/midi_capture.h"
+#include "midi/midi_stats.h"
+
 // todo: remove
 #include "axefx/sysex_types.h"
 
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 using std::placeholders::_1;
 using std::placeholders::_2;
@@ -16,7 +21,7 @@ static const uint8_t kSysExStart = 0xF0;
 
 namespace midi {
 
-#if !defined(OS_WIN) && !defined(OS_MACOSX)
+#if !defined(OS_WIN) && !defined(OS_MACOSX) && !defined(OS_LINUX)
 // static
 shared_ptr<MidiIn> MidiIn::Create(
     const shared_ptr<MidiDeviceInfo>& device,
@@ -32,7 +37,152 @@ bool MidiIn::EnumerateDevices(DeviceInfos* devices) {
 
 MidiIn::MidiIn(const shared_ptr<MidiDeviceInfo>& device,
                 const shared_ptr<base::ThreadLoop>& worker_thread)
-    : device_(device), worker_(worker_thread) {
+    : device_(device),
+      worker_(worker_thread),
+      input_(kInputRingSize),
+      drain_pending_(false),
+      filter_sequence_(0u),
+      filter_other_(true),
+      filtered_size_(0u),
+      capture_(nullptr),
+      stats_(nullptr),
+      arrivals_(kMaxArrivals * sizeof(Arrival)),
+      bytes_queued_(0u),
+      bytes_drained_(0u) {
+  filter_bits_[0] = filter_bits_[1] = ~0ull;
+  filter_output_ = [this](const uint8_t* data, size_t size) {
+    size_t written = input_.Write(data, size);
+    ASSERT(written == size);
+    filtered_size_ += written;
+  };
+}
+
+void MidiIn::set_input_filter(const FunctionSet& functions) {
+  std::lock_guard<std::mutex> lock(filter_lock_);
+  ++filter_sequence_;
+  filter_bits_[0] = functions.bits_[0];
+  filter_bits_[1] = functions.bits_[1];
+  filter_other_ = functions.other_;
+  ++filter_sequence_;
+}
+
+FunctionSet MidiIn::LoadInputFilter() const {
+  FunctionSet functions;
+  uint32_t sequence;
+  do {
+    // Wait for a change that's in progress to finish.
+    while ((sequence = filter_sequence_.load()) & 1u)
+      std::this_thread::yield();
+    functions.bits_[0] = filter_bits_[0];
+    functions.bits_[1] = filter_bits_[1];
+    functions.other_ = filter_other_;
+  } while (filter_sequence_.load() != sequence);
+  return functions;
+}
+
+size_t MidiIn::QueueData(const std::weak_ptr<MidiIn>& me,
+                         const uint8_t* data,
+                         size_t size) {
+  shared_ptr<base::ThreadLoop> worker(worker_.lock());
+  if (!worker)
+    return size;  // Nobody to deliver to.
+
+  FunctionSet functions(LoadInputFilter());
+
+  size_t written, queued;
+  if (functions.all()) {
+    written = queued = input_.Write(data, size);
+  } else {
+    // The filter can output the bytes it held back from the previous call
+    // along with this data.  Since it can't undo what it's seen, only
+    // filter when all of the output fits.
+    if (input_.space() < size + SysExFilter::kMaxHeldBytes)
+      return 0u;
+    filtered_size_ = 0u;
+    filter_.Filter(data, size, functions, filter_output_);
+    written = size;
+    queued = filtered_size_;
+  }
+
+  MidiCapture* capture = capture_.load();
+  if (capture && written)
+    capture->Record(MidiCapture::FROM_UNIT, data, written);
+
+  bytes_queued_ += queued;
+  MidiStats* stats = stats_.load();
+  if (stats && written) {
+    stats->OnDataReceived(written);
+    // If there's no room for the record, the data is counted as arriving
+    // with the next one.
+    Arrival arrival = { bytes_queued_,
+                        std::chrono::steady_clock::now().time_since_epoch()
+                            .count() };
+    if (queued && arrivals_.space() >= sizeof(arrival)) {
+      arrivals_.Write(reinterpret_cast<const uint8_t*>(&arrival),
+                      sizeof(arrival));
+    }
+  }
+
+  // Only one drain task is queued at a time, no matter how many packets
+  // arrive before the worker gets to it.
+  if (queued && !drain_pending_.exchange(true))
+    worker->QueueTask(std::bind(&MidiIn::DrainInput, me));
+  return written;
+}
+
+// static
+void MidiIn::DrainInput(const std::weak_ptr<MidiIn>& me) {
+  shared_ptr<MidiIn> locked(me.lock());
+  if (!locked)
+    return;
+
+  // Clear the flag first, so that data that arrives while we're draining
+  // gets a new task if we miss it.
+  locked->drain_pending_.store(false);
+
+  // Deliver what's there, but don't keep the worker busy forever if the
+  // driver keeps up with us.
+  size_t budget = locked->input_.capacity();
+  const uint8_t* data;
+  size_t size;
+  while (budget && (size = locked->input_.Peek(&data)) != 0u) {
+    size = std::min(size, budget);
+    // With stats, data is delivered in the chunks that the driver queued.
+    if (locked->stats_.load())
+      size = locked->UpdateArrivalTime(size);
+    if (locked->data_available_ != nullptr)
+      locked->data_available_(data, size);
+    locked->input_.Consume(size);
+    locked->bytes_drained_ += size;
+    budget -= size;
+  }
+
+  if (!locked->input_.empty() && !locked->drain_pending_.exchange(true)) {
+    shared_ptr<base::ThreadLoop> worker(locked->worker_.lock());
+    if (worker)
+      worker->QueueTask(std::bind(&MidiIn::DrainInput, me));
+  }
+}
+
+size_t MidiIn::UpdateArrivalTime(size_t size) {
+  const uint8_t* data;
+  while (arrivals_.Peek(&data) != 0u) {
+    // Records are written whole and the ring is a multiple of their size,
+    // so they're never split.
+    Arrival arrival;
+    memcpy(&arrival, data, sizeof(arrival));
+    if (arrival.end > bytes_drained_) {
+      arrival_time_ = std::chrono::steady_clock::time_point(
+          std::chrono::steady_clock::duration(arrival.time));
+      return static_cast<size_t>(
+          std::min<uint64_t>(size, arrival.end - bytes_drained_));
+    }
+    arrivals_.Consume(sizeof(arrival));
+  }
+
+  // The record hasn't been written yet.
+  arrival_time_ = std::chrono::steady_clock::now();
+  return size;
 }
 
 // static
@@ -46,23 +196,70 @@ shared_ptr<MidiIn> MidiIn::OpenAxeFx(
   return MidiIn::Create(*found, worker_thread);
 }
 
+// static
+shared_ptr<MidiIn> MidiIn::Open(
+    const std::string& device,
+    const shared_ptr<base::ThreadLoop>& worker_thread) {
+  DeviceInfos devices;
+  EnumerateDevices(&devices);
+  DeviceInfos::const_iterator found = devices.Find(device);
+  if (found == devices.end())
+    return nullptr;
+  return MidiIn::Create(*found, worker_thread);
+}
+
+SysExDataBuffer::SysExDataBuffer()
+    : midi_in_(nullptr),
+      filter_output_(std::bind(&SysExDataBuffer::OnFilteredData, this, _1,
+                               _2)) {
+}
+
 SysExDataBuffer::SysExDataBuffer(const SysExDataBuffer::OnSysEx& on_sysex)
-    : on_sysex_(std::move(on_sysex)) {
+    : midi_in_(nullptr),
+      filter_output_(std::bind(&SysExDataBuffer::OnFilteredData, this, _1,
+                               _2)) {
+  Subscribe(FunctionSet::All(), on_sysex);
 }
 
 SysExDataBuffer::~SysExDataBuffer() {
 }
 
+void SysExDataBuffer::Subscribe(const FunctionSet& functions,
+                                const OnSysEx& on_sysex) {
+  Subscriber subscriber = { functions, on_sysex };
+  subscribers_.push_back(subscriber);
+  functions_.Add(functions);
+}
+
 void SysExDataBuffer::Attach(const shared_ptr<MidiIn>& midi_in) {
+  midi_in_ = midi_in.get();
+  midi_in->set_input_filter(functions_);
   midi_in->set_ondataavailable(
       std::bind(&SysExDataBuffer::OnData, this, _1, _2));
 }
 
 void SysExDataBuffer::OnData(const uint8_t* data, size_t size) {
+  // The MidiIn has usually filtered the data already, but this also takes
+  // care of implementations and data from before we attached.
+  if (functions_.all()) {
+    OnFilteredData(data, size);
+  } else {
+    filter_.Filter(data, size, functions_, filter_output_);
+  }
+}
+
+void SysExDataBuffer::OnFilteredData(const uint8_t* data, size_t size) {
+  bool stats = midi_in_ && midi_in_->stats();
+  std::chrono::steady_clock::time_point arrival;
+  if (stats)
+    arrival = midi_in_->arrival_time();
+
   size_t i = 0u;
   size_t pos_begin = 0u;
   for (; i < size; ++i) {
     if (data[i] == kSysExEnd) {
+      if (stats && buffer_.empty())
+        frame_arrival_ = arrival;
       buffer_.insert(buffer_.end(), &data[pos_begin], &data[i + 1u]);
       ASSERT(buffer_[buffer_.size() - 1u] == kSysExEnd);
       if (buffer_[0] != kSysExStart) {
@@ -101,7 +298,7 @@ void SysExDataBuffer::OnData(const uint8_t* data, size_t size) {
 #endif
       if (!buffer_.empty()) {
         ASSERT(buffer_[0] == kSysExStart);
-        on_sysex_(&buffer_);
+        Dispatch();
       }
       buffer_.clear();
       pos_begin = i + 1u;
@@ -109,8 +306,24 @@ void SysExDataBuffer::OnData(const uint8_t* data, size_t size) {
     }
   }
 
-  if (pos_begin < size)
+  if (pos_begin < size) {
+    if (stats && buffer_.empty())
+      frame_arrival_ = arrival;
     buffer_.insert(buffer_.end(), &data[pos_begin], &data[size]);
+  }
+}
+
+void SysExDataBuffer::Dispatch() {
+  MidiStats* stats = midi_in_ ? midi_in_->stats() : nullptr;
+  if (stats)
+    stats->OnFrameDispatched(&buffer_[0], buffer_.size(), frame_arrival_);
+
+  for (auto& subscriber : subscribers_) {
+    if (buffer_.empty())
+      break;
+    if (subscriber.functions.ContainsFrame(&buffer_[0], buffer_.size()))
+      subscriber.on_sysex(&buffer_);
+  }
 }
 
 }  // namespace midi
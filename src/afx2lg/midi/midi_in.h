@@ -6,11 +6,21 @@
 #define MIDI_MIDI_IN_H_
 
 #include "common/common_types.h"
+#include "common/byte_ring.h"
 #include "common/thread_loop.h"
 #include "midi/midi_out.h"  // for MidiDeviceInfo.
+#include "midi/sysex_filter.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
 
 namespace midi {
 
+class MidiCapture;
+class MidiStats;
+
 typedef std::function<void(const uint8_t*, size_t)> DataAvailable;
 
 // Interface class for a midi-in connection + device enumeration.
@@ -26,6 +36,11 @@ class MidiIn {
   static shared_ptr<MidiIn> OpenAxeFx(
       const shared_ptr<base::ThreadLoop>& worker_thread);
 
+  // Opens a device by name or index.  See DeviceInfos::Find.
+  static shared_ptr<MidiIn> Open(
+      const std::string& device,
+      const shared_ptr<base::ThreadLoop>& worker_thread);
+
   // Enumerate all midi output devices.
   static bool EnumerateDevices(DeviceInfos* devices);
 
@@ -36,18 +51,106 @@ class MidiIn {
     data_available_ = data_available;
   }
 
+  // Records incoming data to |capture|, in the chunks that the driver
+  // delivers it in.  NULL stops recording.  See MidiCapture::RecordMidiIn.
+  void set_capture(MidiCapture* capture) { capture_ = capture; }
+
+  // Records the timing of incoming data to |stats|.  NULL stops recording.
+  // See MidiStats::RecordMidiIn.
+  void set_stats(MidiStats* stats) { stats_ = stats; }
+  MidiStats* stats() const { return stats_; }
+
+  // While stats are recorded, the time that the driver delivered the data
+  // that's being passed to the DataAvailable callback.  Only valid during
+  // the callback.
+  std::chrono::steady_clock::time_point arrival_time() const {
+    return arrival_time_;
+  }
+
+  // Drops sysex frames that aren't in |functions| on the driver's thread,
+  // before they're queued for the worker.  Frames that are already being
+  // received are finished as they started.  The default is to pass
+  // everything through.  Can be called from any thread.
+  void set_input_filter(const FunctionSet& functions);
+
  protected:
+  // Size of the ring that incoming data is queued in.  Enough for a few
+  // seconds of a dense bank dump in case the worker is busy.
+  static const size_t kInputRingSize = 256 * 1024;
+
   MidiIn(const shared_ptr<MidiDeviceInfo>& device,
          const shared_ptr<base::ThreadLoop>& worker_thread);
 
+  // Called by implementations on the driver's thread when data arrives.
+  // Copies |data| to the input ring without locking or allocating memory and
+  // makes sure that the worker drains it, in batches, to the
+  // |data_available_| callback.  Returns the number of bytes that fit.  If
+  // that's fewer than |size|, the implementation can either wait for the
+  // worker and try again, or drop the rest.  |me| must refer to this object.
+  // When an input filter is set, data is either filtered and queued as a
+  // whole or not at all.
+  size_t QueueData(const std::weak_ptr<MidiIn>& me,
+                   const uint8_t* data,
+                   size_t size);
+
+  // Number of bytes that QueueData() can take right now.  Only exact on the
+  // driver's thread, where it can only be too low.
+  size_t input_space() const { return input_.space(); }
+
   shared_ptr<MidiDeviceInfo> device_;
   std::weak_ptr<base::ThreadLoop> worker_;
   DataAvailable data_available_;
+
+ private:
+  // Number of driver callbacks whose arrival times can be queued.
+  static const size_t kMaxArrivals = 1024;
+
+  // When the driver delivered the data up to a position in the stream of
+  // queued bytes.
+  struct Arrival {
+    uint64_t end;
+    std::chrono::steady_clock::rep time;
+  };
+
+  // Runs on the worker thread.
+  static void DrainInput(const std::weak_ptr<MidiIn>& me);
+  // Sets |arrival_time_| for the next |size| bytes to be drained and
+  // returns how many of them arrived at that time.
+  size_t UpdateArrivalTime(size_t size);
+  // Returns a consistent copy of the input filter without locking.
+  FunctionSet LoadInputFilter() const;
+
+  base::ByteRing input_;
+  // True while a DrainInput task is queued but hasn't started.
+  std::atomic<bool> drain_pending_;
+  // The input filter, split up so that the driver's thread can read it
+  // without locking.  |filter_sequence_| is odd while the filter is being
+  // changed and the reader retries if it changed while it was reading, so
+  // it never sees half of an old and half of a new set.  Writers are
+  // serialized by |filter_lock_|.
+  std::mutex filter_lock_;
+  std::atomic<uint32_t> filter_sequence_;
+  std::atomic<uint64_t> filter_bits_[2];
+  std::atomic<bool> filter_other_;
+  // Only used on the driver's thread.
+  SysExFilter filter_;
+  SysExFilter::Output filter_output_;
+  size_t filtered_size_;
+  std::atomic<MidiCapture*> capture_;
+  std::atomic<MidiStats*> stats_;
+  // Arrival records, while stats are recorded.  The producer side is the
+  // driver's thread, like |input_|.
+  base::ByteRing arrivals_;
+  // Bytes written to and read from |input_|, on the driver's and the
+  // worker's thread respectively.
+  uint64_t bytes_queued_;
+  uint64_t bytes_drained_;
+  std::chrono::steady_clock::time_point arrival_time_;
 };
 
 // This is an in-between class that receives callbacks from a MidiIn
 // implementation and watches for an end-of-sysex byte and forwards whole
-// sysex buffers over to a supplied callback.
+// sysex buffers over to subscribed callbacks.
 // The callback of this class is slightly different from the |DataAvailable|
 // callback so that the caller can swap the Message buffer over to another
 // container without having to allocate more memory.
@@ -55,16 +158,43 @@ class SysExDataBuffer {
  public:
   typedef std::function<void(Message*)> OnSysEx;
 
-  SysExDataBuffer(const OnSysEx& on_sysex);
+  SysExDataBuffer();
+  // Subscribes |on_sysex| to everything.
+  explicit SysExDataBuffer(const OnSysEx& on_sysex);
   ~SysExDataBuffer();
 
+  // Calls |on_sysex| for frames in |functions|.  Frames that nobody has
+  // subscribed to are dropped before they're buffered.  A frame goes to
+  // subscribers in the order they subscribed, until one of them swaps the
+  // message out.  Subscribe before attaching.
+  void Subscribe(const FunctionSet& functions, const OnSysEx& on_sysex);
+
+  // Everything that's been subscribed to.
+  const FunctionSet& functions() const { return functions_; }
+
+  // Also sets the input filter of |midi_in| to functions().
   void Attach(const shared_ptr<MidiIn>& midi_in);
 
  private:
-  void OnData(const uint8_t* data, size_t size);
+  struct Subscriber {
+    FunctionSet functions;
+    OnSysEx on_sysex;
+  };
 
-  OnSysEx on_sysex_;
+  void OnData(const uint8_t* data, size_t size);
+  void OnFilteredData(const uint8_t* data, size_t size);
+  void Dispatch();
+
+  // The MidiIn that we're attached to, for recording stats.  Data only
+  // comes from its worker, so it's alive when we use it.
+  MidiIn* midi_in_;
+  std::vector<Subscriber> subscribers_;
+  FunctionSet functions_;
+  SysExFilter filter_;
+  SysExFilter::Output filter_output_;
   Message buffer_;
+  // When the driver delivered the start of |buffer_|.
+  std::chrono::steady_clock::time_point frame_arrival_;
 };
 
 // Convenience class to attach a SysExDataBuffer to a MidiIn object
@@ -79,6 +209,7 @@ class ScopedBufferAttach {
   }
   ~ScopedBufferAttach() {
     midi_in_->set_ondataavailable(nullptr);
+    midi_in_->set_input_filter(FunctionSet::All());
   }
  private:
   shared_ptr<MidiIn> midi_in_;
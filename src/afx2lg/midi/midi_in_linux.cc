@@ -0,0 +1,150 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "midi/midi_in.h"
+
+#include "midi/midi_linux.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sound/asound.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <thread>
+
+namespace midi {
+
+class MidiInLinux : public MidiIn {
+ public:
+  MidiInLinux(int fd,
+              const shared_ptr<MidiDeviceInfo>& device,
+              const shared_ptr<base::ThreadLoop>& worker_thread)
+      : MidiIn(device, worker_thread),
+        fd_(fd) {
+    wake_[0] = wake_[1] = -1;
+  }
+
+  virtual ~MidiInLinux() {
+    Close();
+  }
+
+  bool Init(const shared_ptr<MidiInLinux>& shared_this) {
+    weak_this_ = shared_this;
+    ASSERT(shared_this.get() == this);
+
+    if (fd_ < 0 || pipe(wake_) != 0)
+      return false;
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+
+    reader_ = std::thread(&MidiInLinux::ReadLoop, this);
+    return true;
+  }
+
+  void Close() {
+    if (reader_.joinable()) {
+      char c = 0;
+      ssize_t written = write(wake_[1], &c, 1);
+      (void)written;
+      reader_.join();
+    }
+
+    for (size_t i = 0; i < arraysize(wake_); ++i) {
+      if (wake_[i] != -1) {
+        close(wake_[i]);
+        wake_[i] = -1;
+      }
+    }
+
+    if (fd_ != -1) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+ protected:
+  // Waits for |timeout_ms| or until Close() is called.  Returns false if
+  // the reader should quit.
+  bool Wait(int timeout_ms) {
+    pollfd fds[1] = { { wake_[0], POLLIN, 0 } };
+    int ret = poll(fds, arraysize(fds), timeout_ms);
+    if (ret < 0)
+      return errno == EINTR;
+    return ret == 0;
+  }
+
+  // Runs on the reader thread.  Everything that's available is read in one
+  // go and copied to the input ring.  If the worker falls behind and the
+  // ring fills up, the reader waits for it, the same as the device would.
+  void ReadLoop() {
+    uint8_t buffer[kBufferSize];
+    bool eof = false;
+    while (!eof) {
+      pollfd fds[2] = { { fd_, POLLIN, 0 }, { wake_[0], POLLIN, 0 } };
+      int ret = poll(fds, arraysize(fds), -1);
+      if (ret < 0 && errno == EINTR)
+        continue;
+      if (ret < 0 || fds[1].revents)
+        break;
+
+      size_t size = 0;
+      while (size < kBufferSize) {
+        ssize_t bytes = read(fd_, buffer + size, kBufferSize - size);
+        if (bytes > 0) {
+          size += bytes;
+        } else if (bytes < 0 && errno == EINTR) {
+          continue;
+        } else {
+          // EAGAIN means that we've read all there is for now.  Anything
+          // else means that the device is gone.
+          eof = bytes == 0 || errno != EAGAIN;
+          break;
+        }
+      }
+
+      size_t queued = QueueData(weak_this_, buffer, size);
+      while (queued < size) {
+        if (!Wait(1))
+          return;
+        queued += QueueData(weak_this_, buffer + queued, size - queued);
+      }
+    }
+  }
+
+  static const size_t kBufferSize = 16 * 1024;
+
+  int fd_;
+  int wake_[2];
+  std::thread reader_;
+  std::weak_ptr<MidiInLinux> weak_this_;
+};
+
+shared_ptr<MidiIn> CreateMidiInForFd(
+    int fd,
+    const shared_ptr<MidiDeviceInfo>& device,
+    const shared_ptr<base::ThreadLoop>& worker_thread) {
+  shared_ptr<MidiInLinux> ret(new MidiInLinux(fd, device, worker_thread));
+  if (!ret->Init(ret))
+    ret.reset();
+  return ret;
+}
+
+// static
+shared_ptr<MidiIn> MidiIn::Create(
+    const shared_ptr<MidiDeviceInfo>& device,
+    const shared_ptr<base::ThreadLoop>& worker_thread) {
+  int fd = OpenRawMidiDevice(*device.get(), SNDRV_RAWMIDI_STREAM_INPUT);
+  if (fd < 0) {
+    std::cerr << "Failed to open " << device->name() << " for input\n";
+    return nullptr;
+  }
+  return CreateMidiInForFd(fd, device, worker_thread);
+}
+
+// static
+bool MidiIn::EnumerateDevices(DeviceInfos* devices) {
+  return EnumerateRawMidiDevices(SNDRV_RAWMIDI_STREAM_INPUT, devices);
+}
+
+}  // namespace midi
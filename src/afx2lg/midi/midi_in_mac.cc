@@ -18,11 +18,14 @@ class MidiInMac : public MidiIn {
   MidiInMac(const shared_ptr<MidiDeviceInfo>& device,
             const shared_ptr<base::ThreadLoop>& worker_thread)
       : MidiIn(device, worker_thread),
-        midi_in_(NULL) {
+        midi_in_(NULL),
+        overflows_(0u) {
   }
 
   virtual ~MidiInMac() {
     Close();
+    if (overflows_)
+      std::cerr << "WRN: Dropped " << overflows_ << " midi packets.\n";
   }
 
   bool Init(const shared_ptr<MidiInMac>& shared_this) {
@@ -50,44 +53,22 @@ class MidiInMac : public MidiIn {
   }
 
  protected:
-  static void OnProcessBuffer(
-      const std::weak_ptr<MidiInMac>& me,
-      uint8_t* buffer,
-      size_t size) {
-    std::shared_ptr<MidiInMac> locked(me.lock());
-    if (locked) {
-      if (locked->data_available_ != nullptr) {
-        locked->data_available_(buffer, size);
-      }
-    }
-    delete [] buffer;
-  }
-
+  // Runs on CoreMIDI's high priority thread, so the packets are only copied
+  // to the input ring.  If the worker has fallen so far behind that a
+  // packet doesn't fit, there's no choice but to drop it.  Packets are
+  // dropped as a whole, so that the parser never sees half of one.
   void OnCallback(const MIDIPacketList* packets) {
-    shared_ptr<base::ThreadLoop> worker(worker_.lock());
-    if (!worker)
-      return;
-
     size_t count = packets->numPackets;
     const MIDIPacket* packet = &packets->packet[0];
-    size_t total_size = 0;
     while (count--) {
-      total_size += packet->length;
-      packet = MIDIPacketNext(packet);
-    }
-
-    uint8_t* buffer = new uint8_t[total_size];
-    uint8_t* pos = buffer;
-    count = packets->numPackets;
-    packet = &packets->packet[0];
-    while (count--) {
-      memcpy(pos, &packet->data[0], packet->length);
-      pos += packet->length;
+      size_t length = packet->length;
+      // With an input filter set, QueueData() queues all or nothing.
+      if (input_space() < length ||
+          QueueData(weak_this_, &packet->data[0], length) < length) {
+        ++overflows_;
+      }
       packet = MIDIPacketNext(packet);
     }
-
-    worker->QueueTask(
-        std::bind(&MidiInMac::OnProcessBuffer, weak_this_, buffer, total_size));
   }
 
   static void MidiInCallback(
@@ -98,6 +79,8 @@ class MidiInMac : public MidiIn {
 
   MIDIPortRef midi_in_;
   std::weak_ptr<MidiInMac> weak_this_;
+  // Number of packets that didn't fit in the input ring.
+  std::atomic<size_t> overflows_;
 };
 
 // static
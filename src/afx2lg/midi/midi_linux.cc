@@ -0,0 +1,115 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "midi/midi_linux.h"
+
+#include <fcntl.h>
+#include <sound/asound.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace midi {
+
+namespace {
+
+// The kernel supports up to 32 cards.
+const int kMaxCards = 32;
+
+// MidiDeviceInfo ids pack the card, device and subdevice numbers.
+int MakeDeviceId(int card, int device, int subdevice) {
+  return (card << 16) | ((device & 0xFF) << 8) | (subdevice & 0xFF);
+}
+
+int CardFromId(int id) { return id >> 16; }
+int DeviceFromId(int id) { return (id >> 8) & 0xFF; }
+int SubdeviceFromId(int id) { return id & 0xFF; }
+
+int OpenControl(int card) {
+  std::string path("/dev/snd/controlC" + std::to_string(card));
+  return open(path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+void AddSubdevices(int control, int stream, int device,
+                   DeviceInfos* devices) {
+  snd_rawmidi_info info;
+  memset(&info, 0, sizeof(info));
+  info.device = device;
+  info.subdevice = 0;
+  info.stream = stream;
+  if (ioctl(control, SNDRV_CTL_IOCTL_RAWMIDI_INFO, &info) < 0)
+    return;  // The device doesn't support this direction.
+
+  unsigned int count = info.subdevices_count;
+  for (unsigned int sub = 0; sub < count; ++sub) {
+    info.subdevice = sub;
+    if (sub && ioctl(control, SNDRV_CTL_IOCTL_RAWMIDI_INFO, &info) < 0)
+      continue;
+    // Use the subdevice names when there's more than one, since that's how
+    // the ports of multi port interfaces are told apart.
+    const unsigned char* name = info.name;
+    if (count > 1 && info.subname[0])
+      name = info.subname;
+    devices->push_back(shared_ptr<MidiDeviceInfo>(new MidiDeviceInfo(
+        MakeDeviceId(info.card, device, sub),
+        reinterpret_cast<const char*>(name))));
+  }
+}
+
+}  // namespace
+
+bool EnumerateRawMidiDevices(int stream, DeviceInfos* devices) {
+  for (int card = 0; card < kMaxCards; ++card) {
+    int control = OpenControl(card);
+    if (control < 0)
+      continue;
+
+    int device = -1;
+    while (ioctl(control, SNDRV_CTL_IOCTL_RAWMIDI_NEXT_DEVICE, &device) >= 0 &&
+           device >= 0) {
+      AddSubdevices(control, stream, device, devices);
+    }
+
+    close(control);
+  }
+
+  // Having no MIDI devices isn't an error.
+  return true;
+}
+
+int OpenRawMidiDevice(const MidiDeviceInfo& device, int stream) {
+  int card = CardFromId(device.id());
+  int control = OpenControl(card);
+  if (control < 0)
+    return -1;
+
+  // The preferred subdevice applies to the next open() from this process
+  // while the control device is open.
+  int subdevice = SubdeviceFromId(device.id());
+  ioctl(control, SNDRV_CTL_IOCTL_RAWMIDI_PREFER_SUBDEVICE, &subdevice);
+
+  std::string path("/dev/snd/midiC" + std::to_string(card) + "D" +
+                   std::to_string(DeviceFromId(device.id())));
+  int flags = O_CLOEXEC;
+  flags |= stream == SNDRV_RAWMIDI_STREAM_INPUT ? O_RDONLY | O_NONBLOCK
+                                                : O_WRONLY;
+  int fd = open(path.c_str(), flags);
+  close(control);
+
+  if (fd >= 0) {
+    // Sysex dumps arrive faster than the default 4K buffer is guaranteed
+    // to be drained, so ask for more room.
+    snd_rawmidi_params params;
+    memset(&params, 0, sizeof(params));
+    params.stream = stream;
+    params.buffer_size = 64 * 1024;
+    params.avail_min = 1;
+    params.no_active_sensing = 1;
+    ioctl(fd, SNDRV_RAWMIDI_IOCTL_PARAMS, &params);
+  }
+
+  return fd;
+}
+
+}  // namespace midi
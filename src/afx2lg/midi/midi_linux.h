@@ -0,0 +1,40 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef MIDI_MIDI_LINUX_H_
+#define MIDI_MIDI_LINUX_H_
+
+#include "common/common_types.h"
+#include "common/thread_loop.h"
+#include "midi/midi_in.h"
+#include "midi/midi_out.h"
+
+namespace midi {
+
+// The Linux implementation talks to the ALSA rawmidi devices in /dev/snd
+// directly via the kernel interface, so there's no dependency on libasound.
+// Every rawmidi subdevice is a separate MidiDeviceInfo.  Virtual ports
+// (snd-virmidi) show up the same way as hardware ports, which makes it
+// possible to test with a sequencer client on the other end.
+
+// |stream| is SNDRV_RAWMIDI_STREAM_INPUT or SNDRV_RAWMIDI_STREAM_OUTPUT.
+bool EnumerateRawMidiDevices(int stream, DeviceInfos* devices);
+
+// Opens the rawmidi subdevice that |device| refers to and returns the file
+// descriptor, or -1 on failure.  Input is opened in non-blocking mode.
+int OpenRawMidiDevice(const MidiDeviceInfo& device, int stream);
+
+// These take ownership of |fd| and work with any file descriptor, which is
+// how the tests exercise them with pipes instead of devices.
+shared_ptr<MidiIn> CreateMidiInForFd(
+    int fd,
+    const shared_ptr<MidiDeviceInfo>& device,
+    const shared_ptr<base::ThreadLoop>& worker_thread);
+unique_ptr<MidiOut> CreateMidiOutForFd(
+    int fd,
+    const shared_ptr<MidiDeviceInfo>& device);
+
+}  // namespace midi
+
+#endif  // MIDI_MIDI_LINUX_H_
@@ -3,11 +3,16 @@
 
 #include "midi/midi_out.h"
 
+#include "midi/message_pool.h"
+
 #include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <mutex>
 
 namespace midi {
 
-#if !defined(OS_WIN) && !defined(OS_MACOSX)
+#if !defined(OS_WIN) && !defined(OS_MACOSX) && !defined(OS_LINUX)
 // static
 unique_ptr<MidiOut> MidiOut::Create(const shared_ptr<MidiDeviceInfo>& device) {
   return nullptr;
@@ -31,11 +36,34 @@ DeviceInfos::const_iterator DeviceInfos::FindAxeFx() const {
   return end();
 }
 
-Message::Message() {}
+DeviceInfos::const_iterator DeviceInfos::Find(const std::string& device) const {
+  if (device.empty())
+    return end();
+
+  if (device.find_first_not_of("0123456789") == std::string::npos) {
+    size_t index = strtoul(device.c_str(), NULL, 10);
+    return index < size() ? begin() + index : end();
+  }
+
+  auto lower = [](const std::string& str) {
+    std::string ret(str);
+    std::transform(ret.begin(), ret.end(), ret.begin(), ::tolower);
+    return ret;
+  };
+  std::string name(lower(device));
+  for (auto it = begin(); it != end(); ++it) {
+    if (lower((*it)->name()).find(name) != std::string::npos)
+      return it;
+  }
+  return end();
+}
+
+Message::Message() : pooled_(false) {}
 
 Message::Message(const axefx::FractalSysExHeader* header, size_t size)
     : std::vector<uint8_t>(reinterpret_cast<const uint8_t*>(header),
-                           reinterpret_cast<const uint8_t*>(header) + size) {
+                           reinterpret_cast<const uint8_t*>(header) + size),
+      pooled_(false) {
 }
 
 bool Message::IsSysEx() const {
@@ -91,16 +119,61 @@ unique_ptr<MidiOut> MidiOut::OpenAxeFx() {
   return Create(*found);
 }
 
+// static
+unique_ptr<MidiOut> MidiOut::Open(const std::string& device) {
+  DeviceInfos devices;
+  EnumerateDevices(&devices);
+  DeviceInfos::const_iterator found = devices.Find(device);
+  if (found == devices.end())
+    return nullptr;
+
+  return Create(*found);
+}
+
 MessageBufferOwner::MessageBufferOwner(
     unique_ptr<Message>& message, const std::function<void()>& on_complete)
     : on_complete_(on_complete), message_(std::move(message)) {
 }
 
 MessageBufferOwner::~MessageBufferOwner() {
+  MessagePool::Get()->Recycle(std::move(message_));
   if (on_complete_ != nullptr)
     on_complete_();
 }
 
+namespace {
+// Free list for MessageBufferOwner instances.
+std::mutex owner_lock;
+std::vector<void*>* free_owners = new std::vector<void*>();
+const size_t kMaxFreeOwners = 64;
+}  // namespace
+
+// static
+void* MessageBufferOwner::operator new(size_t size) {
+  ASSERT(size == sizeof(MessageBufferOwner));
+  {
+    std::lock_guard<std::mutex> lock(owner_lock);
+    if (!free_owners->empty()) {
+      void* p = free_owners->back();
+      free_owners->pop_back();
+      return p;
+    }
+  }
+  return ::operator new(size);
+}
+
+// static
+void MessageBufferOwner::operator delete(void* p) {
+  {
+    std::lock_guard<std::mutex> lock(owner_lock);
+    if (free_owners->size() < kMaxFreeOwners) {
+      free_owners->push_back(p);
+      return;
+    }
+  }
+  ::operator delete(p);
+}
+
 void MessageBufferOwner::CancelCallback() {
   on_complete_ = nullptr;
 }
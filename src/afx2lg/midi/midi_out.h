@@ -34,6 +34,10 @@ class DeviceInfos : public std::vector<shared_ptr<MidiDeviceInfo> > {
   ~DeviceInfos();
 
   const_iterator FindAxeFx() const;
+
+  // Finds a device by its position in the list, if |device| is a number,
+  // or by a case insensitive match on part of its name.
+  const_iterator Find(const std::string& device) const;
 };
 
 // TODO: This needs to be moved out to its own header... not sure if it belongs
@@ -41,7 +45,8 @@ class DeviceInfos : public std::vector<shared_ptr<MidiDeviceInfo> > {
 class Message : public std::vector<uint8_t> {
  public:
   Message();
-  Message(const Message& other) : std::vector<uint8_t>(other) {}
+  Message(const Message& other)
+      : std::vector<uint8_t>(other), pooled_(false) {}
   Message(const axefx::FractalSysExHeader* header, size_t size);
 
   bool IsSysEx() const;
@@ -53,7 +58,12 @@ class Message : public std::vector<uint8_t> {
   iterator find(uint8_t i);
 
  private:
+  friend class MessagePool;
+
   Message& operator=(const Message&);
+
+  // True for messages that belong to the MessagePool.
+  bool pooled_;
 };
 
 // A bank-select CC message + PC.
@@ -70,6 +80,9 @@ class MidiOut {
 
   static unique_ptr<MidiOut> OpenAxeFx();
 
+  // Opens a device by name or index.  See DeviceInfos::Find.
+  static unique_ptr<MidiOut> Open(const std::string& device);
+
   // Create an instance of MidiOut.
   static unique_ptr<MidiOut> Create(const shared_ptr<MidiDeviceInfo>& device);
 
@@ -88,13 +101,17 @@ class MidiOut {
 };
 
 // Used for owning a message buffer and deliver a callback when
-// a message has been sent.
+// a message has been sent.  Pooled messages are returned to the pool.
 class MessageBufferOwner {
  public:
   MessageBufferOwner(unique_ptr<Message>& message,
                      const std::function<void()>& on_complete);
   ~MessageBufferOwner();
 
+  // One of these is created for every message sent, so they're recycled.
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
+
   void CancelCallback();
 
  private:
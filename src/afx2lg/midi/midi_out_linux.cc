@@ -0,0 +1,193 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "midi/midi_out.h"
+
+#include "midi/midi_linux.h"
+
+#include <errno.h>
+#include <sound/asound.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace midi {
+
+class MidiOutLinux : public MidiOut {
+ public:
+  MidiOutLinux(int fd, const shared_ptr<MidiDeviceInfo>& device)
+      : MidiOut(device),
+        fd_(fd),
+        quit_(false),
+        device_gone_(false) {
+  }
+
+  virtual ~MidiOutLinux() {
+    Close();
+  }
+
+  bool Init() {
+    if (fd_ < 0)
+      return false;
+    writer_ = std::thread(&MidiOutLinux::WriteLoop, this);
+    return true;
+  }
+
+  void Close() {
+    if (writer_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(lock_);
+        quit_ = true;
+      }
+      queued_.notify_one();
+      writer_.join();
+    }
+
+    // Messages that never made it out don't get a completion callback.
+    for (auto& pending : pending_) {
+      pending.owner->CancelCallback();
+      delete pending.owner;
+    }
+    pending_.clear();
+
+    if (fd_ != -1) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  // MidiOut implementation.
+
+  // Fails once the device is gone.
+  virtual bool Send(unique_ptr<Message> message,
+                    const std::function<void()>& on_complete) {
+    ASSERT(!message->empty());
+
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      if (device_gone_)
+        return false;
+      Pending pending;
+      pending.message = message.get();
+      pending.owner = new MessageBufferOwner(message, on_complete);
+      pending_.push_back(pending);
+    }
+    queued_.notify_one();
+
+    return true;
+  }
+
+ protected:
+  struct Pending {
+    const Message* message;
+    MessageBufferOwner* owner;
+  };
+
+  // Returns 0 or the errno of the write that failed.
+  int WriteAll(const uint8_t* data, size_t size) {
+    while (size) {
+      ssize_t bytes = write(fd_, data, size);
+      if (bytes < 0) {
+        if (errno == EINTR)
+          continue;
+        return errno;
+      }
+      data += bytes;
+      size -= bytes;
+    }
+    return 0;
+  }
+
+  // Runs on the writer thread.  Messages are written in the order they
+  // were sent and completion is signaled once the driver has transmitted
+  // the message, which matches when CoreMIDI signals it on the Mac.
+  // Messages that fail to be written don't get a completion callback.  If
+  // the device is gone, the writer stops and Send() fails from then on.
+  void WriteLoop() {
+    while (true) {
+      Pending pending;
+      {
+        std::unique_lock<std::mutex> lock(lock_);
+        while (pending_.empty() && !quit_)
+          queued_.wait(lock);
+        if (quit_)
+          break;
+        pending = pending_.front();
+        pending_.pop_front();
+      }
+
+      int error = WriteAll(&pending.message->at(0), pending.message->size());
+      if (error) {
+        std::cerr << "Failed to send a message to " << device_->name()
+                  << "\n";
+        pending.owner->CancelCallback();
+        delete pending.owner;
+        if (error == EBADF || error == ENODEV) {
+          OnDeviceGone();
+          return;
+        }
+        continue;
+      }
+
+      // Fails for anything but rawmidi devices, where write() is enough.
+      int stream = SNDRV_RAWMIDI_STREAM_OUTPUT;
+      ioctl(fd_, SNDRV_RAWMIDI_IOCTL_DRAIN, &stream);
+
+      delete pending.owner;
+    }
+  }
+
+  // Called on the writer thread before it quits because of an error.
+  void OnDeviceGone() {
+    std::deque<Pending> pending;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      device_gone_ = true;
+      pending.swap(pending_);
+    }
+    for (auto& p : pending) {
+      p.owner->CancelCallback();
+      delete p.owner;
+    }
+  }
+
+  int fd_;
+  std::thread writer_;
+  std::mutex lock_;
+  std::condition_variable queued_;
+  bool quit_;
+  // Set when the writer has stopped because the device is gone.
+  bool device_gone_;
+  std::deque<Pending> pending_;
+};
+
+unique_ptr<MidiOut> CreateMidiOutForFd(
+    int fd,
+    const shared_ptr<MidiDeviceInfo>& device) {
+  unique_ptr<MidiOutLinux> ret(new MidiOutLinux(fd, device));
+  if (!ret->Init())
+    ret.reset();
+  return std::move(ret);
+}
+
+// static
+unique_ptr<MidiOut> MidiOut::Create(const shared_ptr<MidiDeviceInfo>& device) {
+  int fd = OpenRawMidiDevice(*device.get(), SNDRV_RAWMIDI_STREAM_OUTPUT);
+  if (fd < 0) {
+    std::cerr << "Failed to open " << device->name() << " for output\n";
+    return nullptr;
+  }
+  return CreateMidiOutForFd(fd, device);
+}
+
+// static
+bool MidiOut::EnumerateDevices(DeviceInfos* devices) {
+  return EnumerateRawMidiDevices(SNDRV_RAWMIDI_STREAM_OUTPUT, devices);
+}
+
+}  // namespace midi
@@ -0,0 +1,195 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "midi/midi_stats.h"
+
+#include <iomanip>
+
+namespace midi {
+
+namespace {
+int64_t MicrosecondsBetween(MidiStats::Clock::time_point begin,
+                            MidiStats::Clock::time_point end) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      end - begin).count();
+}
+
+std::string FunctionName(size_t function) {
+  switch (function) {
+    case axefx::REQUEST_PRESET_DUMP: return "REQUEST_PRESET_DUMP";
+    case axefx::TUNER_DATA: return "TUNER_DATA";
+    case axefx::PRESET_NAME: return "PRESET_NAME";
+    case axefx::TEMPO_HEARTBEAT: return "TEMPO_HEARTBEAT";
+    case axefx::PRESET_CHANGE: return "PRESET_CHANGE";
+    case axefx::BANK_DUMP_REQUEST: return "BANK_DUMP_REQUEST";
+    case axefx::PARAMETER_CHANGED: return "PARAMETER_CHANGED";
+    case axefx::FIRMWARE_UPDATE: return "FIRMWARE_UPDATE";
+    case axefx::REPLY: return "REPLY";
+    case axefx::PRESET_ID: return "PRESET_ID";
+    case axefx::PRESET_PARAMETERS: return "PRESET_PARAMETERS";
+    case axefx::PRESET_CHECKSUM: return "PRESET_CHECKSUM";
+    case axefx::IR_BEGIN: return "IR_BEGIN";
+    case axefx::IR_DATA: return "IR_DATA";
+    case axefx::IR_END: return "IR_END";
+    case axefx::FIRMWARE_BEGIN: return "FIRMWARE_BEGIN";
+    case axefx::FIRMWARE_DATA: return "FIRMWARE_DATA";
+    case axefx::FIRMWARE_END: return "FIRMWARE_END";
+    case MidiStats::kOther: return "other";
+  }
+  return "function " + std::to_string(function);
+}
+
+void PrintHistograms(std::ostream* out, const char* title,
+                     const base::Histogram* histograms, size_t count) {
+  bool printed_title = false;
+  for (size_t i = 0; i < count; ++i) {
+    if (!histograms[i].count())
+      continue;
+    if (!printed_title) {
+      *out << title << ":\n";
+      printed_title = true;
+    }
+    *out << "  " << std::left << std::setw(20) << FunctionName(i);
+    histograms[i].Print(out);
+    *out << "\n";
+  }
+}
+}  // namespace
+
+class MidiStats::Out : public MidiOut {
+ public:
+  Out(unique_ptr<MidiOut> midi_out, MidiStats* stats)
+      : MidiOut(midi_out->device()),
+        midi_out_(std::move(midi_out)),
+        stats_(stats) {}
+  virtual ~Out() {}
+
+  virtual bool Send(unique_ptr<Message> message,
+                    const std::function<void()>& on_complete) {
+    Clock::time_point now = Clock::now();
+    size_t function = stats_->OnSend(*message, now);
+    MidiStats* stats = stats_;
+    // The completion callback is made when the driver releases the
+    // MessageBufferOwner.
+    return midi_out_->Send(std::move(message),
+        [stats, function, now, on_complete]() {
+          stats->OnSendComplete(function, now);
+          if (on_complete)
+            on_complete();
+        });
+  }
+
+ private:
+  unique_ptr<MidiOut> midi_out_;
+  MidiStats* stats_;
+};
+
+MidiStats::Traffic::Traffic(Clock::time_point start)
+    : bytes(0u), first(-1), last(-1), start(start) {}
+
+void MidiStats::Traffic::Add(size_t size) {
+  int64_t now = MicrosecondsBetween(start, Clock::now());
+  int64_t unset = -1;
+  first.compare_exchange_strong(unset, now);
+  last = now;
+  bytes += size;
+}
+
+double MidiStats::Traffic::rate() const {
+  int64_t elapsed = last - first;
+  if (first < 0 || elapsed <= 0)
+    return 0.0;
+  return bytes * 1000000.0 / elapsed;
+}
+
+MidiStats::MidiStats()
+    : sent_(Clock::now()),
+      received_(Clock::now()),
+      pending_function_(kOther),
+      pending_(false) {
+}
+
+MidiStats::~MidiStats() {}
+
+void MidiStats::RecordMidiIn(MidiIn* midi_in) {
+  midi_in->set_stats(this);
+}
+
+unique_ptr<MidiOut> MidiStats::RecordMidiOut(unique_ptr<MidiOut> midi_out) {
+  return unique_ptr<MidiOut>(new Out(std::move(midi_out), this));
+}
+
+void MidiStats::RecordLoop(base::ThreadLoop* loop) {
+  loop->set_queue_delay(&queue_delay_);
+}
+
+void MidiStats::OnDataReceived(size_t size) {
+  received_.Add(size);
+}
+
+void MidiStats::OnFrameDispatched(const uint8_t* frame, size_t size,
+                                  Clock::time_point arrival) {
+  Clock::time_point now = Clock::now();
+  size_t function = GetFunction(frame, size);
+  input_delay_[function].Add(
+      std::chrono::microseconds(MicrosecondsBetween(arrival, now)));
+
+  if (function == axefx::TEMPO_HEARTBEAT || function == axefx::TUNER_DATA)
+    return;
+
+  std::lock_guard<std::mutex> lock(lock_);
+  if (pending_) {
+    round_trip_[pending_function_].Add(
+        std::chrono::microseconds(MicrosecondsBetween(pending_sent_, now)));
+    pending_ = false;
+  }
+}
+
+size_t MidiStats::OnSend(const Message& message, Clock::time_point now) {
+  sent_.Add(message.size());
+  size_t function = message.empty() ? kOther :
+      GetFunction(&message[0], message.size());
+
+  std::lock_guard<std::mutex> lock(lock_);
+  pending_function_ = function;
+  pending_sent_ = now;
+  pending_ = true;
+  return function;
+}
+
+void MidiStats::OnSendComplete(size_t function, Clock::time_point sent) {
+  send_time_[function].Add(std::chrono::microseconds(
+      MicrosecondsBetween(sent, Clock::now())));
+}
+
+void MidiStats::Print(std::ostream* out) const {
+  *out << "Sent " << bytes_sent() << " bytes";
+  if (send_rate())
+    *out << " at " << static_cast<size_t>(send_rate()) << " bytes/s";
+  *out << ", received " << bytes_received() << " bytes";
+  if (receive_rate())
+    *out << " at " << static_cast<size_t>(receive_rate()) << " bytes/s";
+  *out << "\n";
+
+  PrintHistograms(out, "Round trip", round_trip_, kFunctions);
+  PrintHistograms(out, "Send time", send_time_, kFunctions);
+  PrintHistograms(out, "Input delay", input_delay_, kFunctions);
+  if (queue_delay_.count()) {
+    *out << "Task queue delay:\n  " << std::left << std::setw(20) << "all";
+    queue_delay_.Print(out);
+    *out << "\n";
+  }
+}
+
+// static
+size_t MidiStats::GetFunction(const uint8_t* frame, size_t size) {
+  const size_t kHeaderSize = sizeof(axefx::FractalSysExHeader);
+  if (size <= kHeaderSize || frame[0] != axefx::kSysExStart ||
+      memcmp(&frame[1], axefx::kFractalMidiId,
+             sizeof(axefx::kFractalMidiId)) != 0) {
+    return kOther;
+  }
+  return frame[kHeaderSize - 1] & 0x7F;
+}
+
+}  // namespace midi
@@ -0,0 +1,121 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef MIDI_MIDI_STATS_H_
+#define MIDI_MIDI_STATS_H_
+
+#include "common/common_types.h"
+#include "common/histogram.h"
+#include "common/thread_loop.h"
+#include "midi/midi_in.h"
+#include "midi/midi_out.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+
+namespace midi {
+
+// Timing of the MIDI traffic between the host and a unit, for tuning the
+// pacing of transfers.  For each Fractal function id, it keeps histograms
+// of:
+//  - send time: from when a message is handed to MidiOut::Send until the
+//    driver is done with it.
+//  - input delay: from when the driver delivers the first byte of a frame
+//    until the frame is dispatched by a SysExDataBuffer.
+//  - round trip: from when a message is sent until the next frame that
+//    isn't tempo or tuner data is dispatched, filed under the function of
+//    the sent message.  E.g. a preset dump request and its first reply.
+// Frames that aren't Fractal messages are filed under kOther.  It also
+// counts bytes in each direction and can record the queueing delay of the
+// worker's ThreadLoop.
+//
+// Thread safe.  The stats must outlive the objects that they're recording.
+class MidiStats {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // Index of frames that aren't Fractal messages.
+  static const size_t kOther = 0x80;
+
+  MidiStats();
+  ~MidiStats();
+
+  void RecordMidiIn(MidiIn* midi_in);
+  // Returns a MidiOut that times messages and passes them on to |midi_out|.
+  unique_ptr<MidiOut> RecordMidiOut(unique_ptr<MidiOut> midi_out);
+  void RecordLoop(base::ThreadLoop* loop);
+
+  // Called by MidiIn on the driver's thread for all incoming data.
+  void OnDataReceived(size_t size);
+  // Called by SysExDataBuffer before a frame is dispatched.  |arrival| is
+  // when the driver delivered the start of the frame.
+  void OnFrameDispatched(const uint8_t* frame, size_t size,
+                         Clock::time_point arrival);
+
+  const base::Histogram& send_time(size_t function) const {
+    return send_time_[function];
+  }
+  const base::Histogram& input_delay(size_t function) const {
+    return input_delay_[function];
+  }
+  const base::Histogram& round_trip(size_t function) const {
+    return round_trip_[function];
+  }
+  const base::Histogram& queue_delay() const { return queue_delay_; }
+
+  size_t bytes_sent() const { return sent_.bytes; }
+  size_t bytes_received() const { return received_.bytes; }
+  // Average bytes per second in each direction, from the first byte to the
+  // last one.
+  double send_rate() const { return sent_.rate(); }
+  double receive_rate() const { return received_.rate(); }
+
+  // Prints the throughput and every histogram that has samples.
+  void Print(std::ostream* out) const;
+
+ private:
+  class Out;
+
+  static const size_t kFunctions = kOther + 1;
+
+  // Direction of the traffic, for the byte counts.
+  struct Traffic {
+    explicit Traffic(Clock::time_point start);
+    void Add(size_t size);
+    double rate() const;
+
+    std::atomic<size_t> bytes;
+    // Microseconds since the stats were created.  -1 until data arrives.
+    std::atomic<int64_t> first;
+    std::atomic<int64_t> last;
+    const Clock::time_point start;
+  };
+
+  // Called by Out.  OnSend returns the function of |message|.
+  size_t OnSend(const Message& message, Clock::time_point now);
+  void OnSendComplete(size_t function, Clock::time_point sent);
+
+  static size_t GetFunction(const uint8_t* frame, size_t size);
+
+  base::Histogram send_time_[kFunctions];
+  base::Histogram input_delay_[kFunctions];
+  base::Histogram round_trip_[kFunctions];
+  base::Histogram queue_delay_;
+  Traffic sent_;
+  Traffic received_;
+
+  // The message that's waiting for a reply.
+  std::mutex lock_;
+  size_t pending_function_;
+  Clock::time_point pending_sent_;
+  bool pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(MidiStats);
+};
+
+}  // namespace midi
+
+#endif  // MIDI_MIDI_STATS_H_
@@ -0,0 +1,627 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "midi/simulated_axefx.h"
+
+#include "axefx/preset.h"
+#include "common/file_utils.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace midi {
+
+namespace {
+
+const char kDeviceName[] = "AXE-FX II (simulated)";
+
+// Parses a serialized preset far enough to verify it and get to the name.
+unique_ptr<axefx::Preset> ParsePreset(
+    const std::vector<std::vector<uint8_t> >& messages) {
+  unique_ptr<axefx::Preset> preset(new axefx::Preset());
+  if (messages.size() < 2)
+    return nullptr;
+
+  for (size_t i = 0; i < messages.size(); ++i) {
+    const std::vector<uint8_t>& m = messages[i];
+    if (!axefx::IsFractalSysEx(&m[0], m.size()))
+      return nullptr;
+    auto header = reinterpret_cast<const axefx::FractalSysExHeader*>(&m[0]);
+    bool ok = false;
+    if (i == 0) {
+      ok = header->function() == axefx::PRESET_ID &&
+           preset->SetPresetId(
+               *static_cast<const axefx::PresetIdHeader*>(header), m.size());
+    } else if (i == messages.size() - 1) {
+      ok = header->function() == axefx::PRESET_CHECKSUM &&
+           preset->Finalize(
+               static_cast<const axefx::PresetChecksumHeader*>(header),
+               m.size(), true);
+    } else {
+      ok = header->function() == axefx::PRESET_PARAMETERS &&
+           preset->AddParameterData(
+               *static_cast<const axefx::ParameterBlockHeader*>(header),
+               m.size());
+    }
+    if (!ok)
+      return nullptr;
+  }
+
+  return preset;
+}
+
+// Builds a message from a header, optional payload and a checksum.
+std::vector<uint8_t> BuildMessage(axefx::FunctionId function,
+                                  const uint8_t* payload,
+                                  size_t size) {
+  std::vector<uint8_t> message;
+  message.resize(sizeof(axefx::FractalSysExHeader));
+  new (&message[0]) axefx::FractalSysExHeader(function);
+  message.insert(message.end(), payload, payload + size);
+  message.push_back(0);
+  message.push_back(axefx::kSysExEnd);
+  message[message.size() - 2] =
+      axefx::CalculateSysExChecksum(&message[0], message.size());
+  return message;
+}
+
+}  // namespace
+
+class SimulatedAxeFx::In : public MidiIn {
+ public:
+  In(const shared_ptr<MidiDeviceInfo>& device,
+     const shared_ptr<base::ThreadLoop>& worker_thread)
+      : MidiIn(device, worker_thread) {}
+  virtual ~In() {}
+
+  void set_weak_this(const std::weak_ptr<In>& me) { weak_this_ = me; }
+
+  // Called on the simulator thread.  Returns the number of bytes that fit
+  // in the input ring.
+  size_t Deliver(const uint8_t* data, size_t size) {
+    return QueueData(weak_this_, data, size);
+  }
+
+ private:
+  std::weak_ptr<In> weak_this_;
+};
+
+class SimulatedAxeFx::Out : public MidiOut {
+ public:
+  Out(const shared_ptr<MidiDeviceInfo>& device, SimulatedAxeFx* device_impl)
+      : MidiOut(device), device_impl_(device_impl) {}
+  virtual ~Out() {}
+
+  virtual bool Send(unique_ptr<Message> message,
+                    const std::function<void()>& on_complete) {
+    ASSERT(!message->empty());
+    device_impl_->Receive(std::move(message), on_complete);
+    return true;
+  }
+
+ private:
+  SimulatedAxeFx* device_impl_;
+};
+
+SimulatedAxeFx::Options::Options()
+    : bytes_per_second(kUsbBytesPerSecond),
+      latency(std::chrono::milliseconds(1)),
+      jitter(0),
+      tempo_interval(500),
+      tuner_interval(0),
+      store_time(0),
+      reject_presets(0u),
+      drop_rate(0.0),
+      seed(1) {
+}
+
+SimulatedAxeFx::SimulatedAxeFx(const Options& options)
+    : options_(options),
+      sequence_(0u),
+      quit_(false),
+      in_wire_free_(Clock::now()),
+      presets_received_(0u),
+      bytes_sent_(0u),
+      bytes_received_(0u),
+      bytes_dropped_(0u),
+      out_wire_free_(Clock::now()),
+      reply_start_(Clock::now()),
+      messages_in_transit_(0u),
+      random_(options.seed),
+      current_preset_(0),
+      bank_select_(0),
+      busy_until_(Clock::now()),
+      upload_rejected_(false),
+      presets_rejected_(0u) {
+  if (options_.tempo_interval.count())
+    Schedule(Clock::now(), std::bind(&SimulatedAxeFx::SendTempo, this));
+  if (options_.tuner_interval.count())
+    Schedule(Clock::now(), std::bind(&SimulatedAxeFx::SendTuner, this));
+  thread_ = std::thread(&SimulatedAxeFx::Run, this);
+}
+
+SimulatedAxeFx::~SimulatedAxeFx() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    quit_ = true;
+  }
+  signal_.notify_one();
+  thread_.join();
+
+  // Messages that never made it across don't get a completion callback.
+  for (auto& pending : in_flight_) {
+    pending.owner->CancelCallback();
+    delete pending.owner;
+  }
+}
+
+bool SimulatedAxeFx::LoadPresets(const std::string& path) {
+  base::MemoryMappedFile file;
+  if (!file.Open(path)) {
+    std::cerr << "Failed to open " << path << "\n";
+    return false;
+  }
+  return LoadPresets(file.data(), file.data() + file.size());
+}
+
+bool SimulatedAxeFx::LoadPresets(const uint8_t* begin, const uint8_t* end) {
+  // The messages are kept as they are in the file, so that dumps are
+  // byte for byte what was loaded.
+  SysExMessages messages;
+  size_t count = 0;
+  const uint8_t* pos = begin;
+  while (pos < end) {
+    const uint8_t* message_end = std::find(pos, end, axefx::kSysExEnd);
+    if (message_end == end || *pos != axefx::kSysExStart)
+      break;
+    ++message_end;
+
+    size_t size = message_end - pos;
+    if (axefx::IsFractalSysExNoChecksum(pos, size)) {
+      auto header = reinterpret_cast<const axefx::FractalSysExHeader*>(pos);
+      switch (header->function()) {
+        case axefx::PRESET_ID:
+          messages.clear();
+          // Fall through.
+        case axefx::PRESET_PARAMETERS:
+          messages.push_back(std::vector<uint8_t>(pos, message_end));
+          break;
+        case axefx::PRESET_CHECKSUM:
+          messages.push_back(std::vector<uint8_t>(pos, message_end));
+          if (!StorePreset(&messages))
+            return false;
+          ++count;
+          break;
+        default:
+          // IR data etc. isn't part of the library.
+          break;
+      }
+    }
+    pos = message_end;
+  }
+
+  if (!count)
+    std::cerr << "No presets found\n";
+
+  return count != 0;
+}
+
+shared_ptr<MidiIn> SimulatedAxeFx::OpenMidiIn(
+    const shared_ptr<base::ThreadLoop>& worker_thread) {
+  shared_ptr<MidiDeviceInfo> device(new MidiDeviceInfo(-1, kDeviceName));
+  shared_ptr<In> in(new In(device, worker_thread));
+  in->set_weak_this(in);
+  std::lock_guard<std::mutex> lock(lock_);
+  in_ = in;
+  return in;
+}
+
+unique_ptr<MidiOut> SimulatedAxeFx::OpenMidiOut() {
+  shared_ptr<MidiDeviceInfo> device(new MidiDeviceInfo(-1, kDeviceName));
+  return unique_ptr<MidiOut>(new Out(device, this));
+}
+
+std::vector<uint8_t> SimulatedAxeFx::GetPresetData(int id) const {
+  std::lock_guard<std::mutex> lock(lock_);
+  const SysExMessages* messages = &edit_buffer_;
+  if (id != axefx::kEditBufferId) {
+    auto it = presets_.find(id);
+    if (it == presets_.end())
+      return std::vector<uint8_t>();
+    messages = &it->second;
+  }
+
+  std::vector<uint8_t> ret;
+  for (const auto& m : *messages)
+    ret.insert(ret.end(), m.begin(), m.end());
+  return ret;
+}
+
+size_t SimulatedAxeFx::presets_received() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return presets_received_;
+}
+
+size_t SimulatedAxeFx::bytes_sent() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return bytes_sent_;
+}
+
+size_t SimulatedAxeFx::bytes_received() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return bytes_received_;
+}
+
+size_t SimulatedAxeFx::bytes_dropped() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return bytes_dropped_;
+}
+
+void SimulatedAxeFx::Receive(unique_ptr<Message> message,
+                             const std::function<void()>& on_complete) {
+  Clock::time_point arrival;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    // Messages go across the wire one after the other, so each one has to
+    // wait for the previous one.
+    arrival = std::max(Clock::now(), in_wire_free_) +
+              TransferTime(message->size());
+    in_wire_free_ = arrival;
+    bytes_received_ += message->size();
+    InFlight pending;
+    pending.message = message.get();
+    pending.owner = new MessageBufferOwner(message, on_complete);
+    in_flight_.push_back(pending);
+  }
+  Schedule(arrival, std::bind(&SimulatedAxeFx::OnReceived, this));
+}
+
+void SimulatedAxeFx::Run() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (!quit_) {
+    if (events_.empty()) {
+      signal_.wait(lock);
+      continue;
+    }
+
+    Clock::time_point time = events_.top().time;
+    if (Clock::now() < time) {
+      signal_.wait_until(lock, time);
+      continue;
+    }
+
+    Task task(events_.top().task);
+    events_.pop();
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
+void SimulatedAxeFx::Schedule(Clock::time_point time, const Task& task) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    Event event = { time, sequence_++, task };
+    events_.push(event);
+  }
+  signal_.notify_one();
+}
+
+void SimulatedAxeFx::OnReceived() {
+  InFlight pending;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    ASSERT(!in_flight_.empty());
+    pending = in_flight_.front();
+    in_flight_.pop_front();
+  }
+
+  reply_start_ = Clock::now() + options_.latency;
+
+  // The message may contain more than one MIDI message, e.g. the bank
+  // select CC and program change pair.
+  const Message& message = *pending.message;
+  size_t i = 0;
+  while (i < message.size()) {
+    uint8_t status = message[i];
+    if (status == axefx::kSysExStart) {
+      size_t end = i;
+      while (end < message.size() && message[end] != axefx::kSysExEnd)
+        ++end;
+      if (end == message.size())
+        break;
+      HandleSysEx(std::vector<uint8_t>(message.begin() + i,
+                                       message.begin() + end + 1));
+      i = end + 1;
+    } else if ((status & 0xF0) == 0xB0 && i + 2 < message.size()) {
+      HandleControlChange(message[i + 1], message[i + 2]);
+      i += 3;
+    } else if ((status & 0xF0) == 0xC0 && i + 1 < message.size()) {
+      current_preset_ = bank_select_ * 128 + message[i + 1];
+      {
+        std::lock_guard<std::mutex> lock(lock_);
+        auto it = presets_.find(current_preset_);
+        edit_buffer_ = it != presets_.end() ? it->second : SysExMessages();
+      }
+      SendPresetChange();
+      i += 2;
+    } else {
+      ++i;
+    }
+  }
+
+  // The message has now been transmitted.
+  delete pending.owner;
+}
+
+void SimulatedAxeFx::HandleSysEx(const std::vector<uint8_t>& message) {
+  if (!axefx::IsFractalSysExNoChecksum(&message[0], message.size()))
+    return;
+
+  auto header = reinterpret_cast<const axefx::FractalSysExHeader*>(
+      &message[0]);
+  switch (header->function()) {
+    case axefx::BANK_DUMP_REQUEST: {
+      auto request = static_cast<const axefx::BankDumpRequest*>(header);
+      if (message.size() >= sizeof(*request) &&
+          request->bank_id <= axefx::BankDumpRequest::SYSTEM_BANK) {
+        SendBank(request->bank_id);
+      }
+      break;
+    }
+
+    case axefx::REQUEST_PRESET_DUMP: {
+      auto request = static_cast<const axefx::PresetDumpRequest*>(header);
+      if (message.size() >= sizeof(*request)) {
+        int id = request->preset_id_.As16bit();
+        SendPreset(id, id);
+      }
+      break;
+    }
+
+    case axefx::PRESET_NAME:
+      SendPresetName();
+      break;
+
+    case axefx::PRESET_CHANGE: {
+      // With a preset id, this selects a preset.  Without, it's a query.
+      if (message.size() >= sizeof(*header) + sizeof(axefx::SeptetPair) +
+                                sizeof(axefx::FractalSysExEnd)) {
+        auto id = reinterpret_cast<const axefx::SeptetPair*>(header + 1);
+        current_preset_ = id->As16bit();
+        std::lock_guard<std::mutex> lock(lock_);
+        auto it = presets_.find(current_preset_);
+        edit_buffer_ = it != presets_.end() ? it->second : SysExMessages();
+      }
+      SendPresetChange();
+      break;
+    }
+
+    case axefx::FIRMWARE_UPDATE:
+      SendReply(axefx::FIRMWARE_UPDATE, 0);
+      break;
+
+    case axefx::PRESET_ID:
+    case axefx::PRESET_PARAMETERS:
+    case axefx::PRESET_CHECKSUM:
+      HandlePresetData(message);
+      break;
+
+    default:
+      // IR and firmware data are accepted but not stored.
+      break;
+  }
+}
+
+void SimulatedAxeFx::HandleControlChange(uint8_t controller, uint8_t value) {
+  // Only bank select is supported.
+  if (controller == 0)
+    bank_select_ = value;
+}
+
+void SimulatedAxeFx::HandlePresetData(const std::vector<uint8_t>& message) {
+  auto header = reinterpret_cast<const axefx::FractalSysExHeader*>(
+      &message[0]);
+  if (header->function() == axefx::PRESET_ID) {
+    upload_.clear();
+    upload_rejected_ = false;
+  }
+
+  // While a preset is being stored, incoming data is lost.
+  Clock::time_point now = Clock::now();
+  if (now < busy_until_)
+    upload_rejected_ = true;
+
+  upload_.push_back(message);
+  if (header->function() != axefx::PRESET_CHECKSUM)
+    return;
+
+  if (presets_rejected_ < options_.reject_presets) {
+    ++presets_rejected_;
+    upload_rejected_ = true;
+  }
+
+  if (upload_rejected_ || !StorePreset(&upload_)) {
+    std::cerr << "Simulator: received an invalid preset\n";
+    upload_.clear();
+    SendReply(axefx::PRESET_CHECKSUM, 1);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    ++presets_received_;
+  }
+
+  busy_until_ = now + options_.store_time;
+  const uint8_t payload[] = { axefx::PRESET_CHECKSUM, 0 };
+  Transmit(BuildMessage(axefx::REPLY, payload, sizeof(payload)),
+           std::max(reply_start_, busy_until_));
+}
+
+bool SimulatedAxeFx::StorePreset(SysExMessages* messages) {
+  unique_ptr<axefx::Preset> preset(ParsePreset(*messages));
+  if (!preset)
+    return false;
+
+  std::lock_guard<std::mutex> lock(lock_);
+  if (preset->from_edit_buffer()) {
+    edit_buffer_.swap(*messages);
+  } else {
+    // The simulator starts out with preset 0 selected.
+    if (preset->id() == 0 && edit_buffer_.empty())
+      edit_buffer_ = *messages;
+    presets_[preset->id()].swap(*messages);
+  }
+  messages->clear();
+
+  return true;
+}
+
+void SimulatedAxeFx::SendBank(int bank) {
+  for (int i = 0; i < 128; ++i)
+    SendPreset(bank * 128 + i, bank * 128 + i);
+}
+
+void SimulatedAxeFx::SendPreset(int id, int target_id) {
+  SysExMessages messages;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (id == axefx::kEditBufferId) {
+      messages = edit_buffer_;
+    } else {
+      auto it = presets_.find(id);
+      if (it == presets_.end())
+        it = presets_.begin();
+      messages = it != presets_.end() ? it->second : edit_buffer_;
+    }
+  }
+
+  if (messages.empty())
+    return;
+
+  // The first message holds the id, which isn't included in the preset
+  // checksum, so it's all that needs to change to move a preset.
+  messages[0].assign(sizeof(axefx::PresetIdHeader), 0u);
+  new (&messages[0][0]) axefx::PresetIdHeader(
+      static_cast<uint16_t>(target_id));
+
+  for (const auto& m : messages)
+    Transmit(m, reply_start_);
+}
+
+void SimulatedAxeFx::SendPresetName() {
+  SysExMessages messages;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    messages = edit_buffer_;
+  }
+
+  std::string name;
+  unique_ptr<axefx::Preset> preset(ParsePreset(messages));
+  if (preset)
+    name = preset->name();
+  Transmit(BuildMessage(axefx::PRESET_NAME,
+                        reinterpret_cast<const uint8_t*>(name.c_str()),
+                        name.length()),
+           reply_start_);
+}
+
+void SimulatedAxeFx::SendPresetChange() {
+  axefx::SeptetPair id(static_cast<uint16_t>(current_preset_));
+  Transmit(BuildMessage(axefx::PRESET_CHANGE,
+                        reinterpret_cast<const uint8_t*>(&id), sizeof(id)),
+           reply_start_);
+}
+
+void SimulatedAxeFx::SendReply(axefx::FunctionId function, uint8_t error) {
+  const uint8_t payload[] = { static_cast<uint8_t>(function), error };
+  Transmit(BuildMessage(axefx::REPLY, payload, sizeof(payload)),
+           reply_start_);
+}
+
+void SimulatedAxeFx::SendTempo() {
+  // The unit doesn't interrupt a dump with heartbeats.
+  Clock::time_point now = Clock::now();
+  if (!messages_in_transit_)
+    Transmit(BuildMessage(axefx::TEMPO_HEARTBEAT, nullptr, 0u), now);
+  Schedule(now + options_.tempo_interval,
+           std::bind(&SimulatedAxeFx::SendTempo, this));
+}
+
+void SimulatedAxeFx::SendTuner() {
+  Clock::time_point now = Clock::now();
+  if (!messages_in_transit_) {
+    // Note, string and cents.  A slightly flat A on the fifth string.
+    const uint8_t payload[] = { 9, 4, 60 };
+    Transmit(BuildMessage(axefx::TUNER_DATA, payload, sizeof(payload)), now);
+  }
+  Schedule(now + options_.tuner_interval,
+           std::bind(&SimulatedAxeFx::SendTuner, this));
+}
+
+void SimulatedAxeFx::Transmit(const std::vector<uint8_t>& message,
+                              Clock::time_point earliest) {
+  Clock::time_point start = std::max(earliest, out_wire_free_);
+  out_wire_free_ = start + TransferTime(message.size()) + Jitter();
+  ++messages_in_transit_;
+  Schedule(out_wire_free_,
+           std::bind(&SimulatedAxeFx::Deliver, this, message));
+}
+
+void SimulatedAxeFx::Deliver(const std::vector<uint8_t>& message) {
+  --messages_in_transit_;
+  const std::vector<uint8_t>* data = &message;
+  std::vector<uint8_t> kept;
+  if (options_.drop_rate > 0.0) {
+    std::bernoulli_distribution drop(options_.drop_rate);
+    kept.reserve(message.size());
+    for (auto b : message) {
+      if (!drop(random_))
+        kept.push_back(b);
+    }
+    data = &kept;
+  }
+
+  shared_ptr<In> in;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    bytes_sent_ += data->size();
+    bytes_dropped_ += message.size() - data->size();
+    in = in_.lock();
+  }
+
+  if (!in)
+    return;
+
+  size_t queued = 0u;
+  while (queued < data->size()) {
+    queued += in->Deliver(&data->at(queued), data->size() - queued);
+    if (queued < data->size()) {
+      // The host isn't keeping up.  A real unit would block too.
+      std::unique_lock<std::mutex> lock(lock_);
+      if (signal_.wait_for(lock, std::chrono::milliseconds(1),
+                           [this]() { return quit_; })) {
+        return;
+      }
+    }
+  }
+}
+
+SimulatedAxeFx::Clock::duration SimulatedAxeFx::TransferTime(
+    size_t bytes) const {
+  if (!options_.bytes_per_second)
+    return Clock::duration::zero();
+  return std::chrono::duration_cast<Clock::duration>(
+      std::chrono::microseconds(
+          bytes * 1000000ull / options_.bytes_per_second));
+}
+
+SimulatedAxeFx::Clock::duration SimulatedAxeFx::Jitter() {
+  if (!options_.jitter.count())
+    return Clock::duration::zero();
+  std::uniform_int_distribution<int64_t> jitter(0, options_.jitter.count());
+  return std::chrono::microseconds(jitter(random_));
+}
+
+}  // namespace midi
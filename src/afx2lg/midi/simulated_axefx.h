@@ -0,0 +1,187 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef MIDI_SIMULATED_AXEFX_H_
+#define MIDI_SIMULATED_AXEFX_H_
+
+#include "common/common_types.h"
+#include "common/thread_loop.h"
+#include "midi/midi_in.h"
+#include "midi/midi_out.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace midi {
+
+// An in-process stand-in for an AxeFx II that implements the MidiIn and
+// MidiOut interfaces.  It answers bank and preset dump requests from a
+// library of presets loaded from .syx files, accepts presets that are sent
+// to it (with a REPLY once each one has been stored), and paces everything
+// it sends and receives according to the configured bandwidth, latency and
+// jitter.  Tempo and tuner messages can be mixed in and bytes can be dropped
+// on the way to the host, so that the tools can be tested and benchmarked
+// end to end without a unit.
+//
+// The simulator runs on its own thread.  Completion callbacks for sent
+// messages and data for the MidiIn worker are delivered from that thread,
+// the same as with the real backends.  The simulator must outlive the
+// MidiIn and MidiOut objects it opens.
+class SimulatedAxeFx {
+ public:
+  // 31250 baud with a start and stop bit per byte.
+  static const size_t kMidiBytesPerSecond = 3125;
+  // Roughly what the AxeFx II manages over USB.
+  static const size_t kUsbBytesPerSecond = 100 * 1024;
+
+  struct Options {
+    // Constructor sets USB like defaults without any noise.
+    Options();
+
+    // Bandwidth in each direction.  0 means that transfers are instant.
+    size_t bytes_per_second;
+    // Time from when a request has been received until the reply starts.
+    std::chrono::microseconds latency;
+    // Random extra delay, up to this amount, added to each message.
+    std::chrono::microseconds jitter;
+    // Interval between tempo heartbeat messages.  0 disables them.  Note
+    // that axe_backup relies on these to detect the end of a bank dump.
+    std::chrono::milliseconds tempo_interval;
+    // Interval between tuner data messages.  0 disables them.
+    std::chrono::milliseconds tuner_interval;
+    // How long it takes to store a preset that's been received.  Presets
+    // that arrive during that time are rejected with an error reply.
+    std::chrono::milliseconds store_time;
+    // Number of presets sent to the simulator that are rejected with an
+    // error reply, starting with the first one, as if data had been lost on
+    // the way.
+    size_t reject_presets;
+    // Probability, per byte, that a byte sent to the host gets lost.
+    double drop_rate;
+    // Seed for the jitter and drop generator, so that runs are repeatable.
+    unsigned int seed;
+  };
+
+  explicit SimulatedAxeFx(const Options& options);
+  ~SimulatedAxeFx();
+
+  // Loads presets from a sysex file or buffer.  Can be called more than
+  // once to build a library from several files.  Presets from the edit
+  // buffer are loaded into the edit buffer.  Presets that aren't in the
+  // library are filled in with the first one, or the edit buffer.
+  bool LoadPresets(const std::string& path);
+  bool LoadPresets(const uint8_t* begin, const uint8_t* end);
+
+  // Only one MidiIn can be open at a time.  Opening a new one replaces the
+  // previous one.
+  shared_ptr<MidiIn> OpenMidiIn(
+      const shared_ptr<base::ThreadLoop>& worker_thread);
+  unique_ptr<MidiOut> OpenMidiOut();
+
+  // Returns the serialized preset stored under |id| or an empty buffer.
+  // Includes presets that have been sent to the simulator.
+  std::vector<uint8_t> GetPresetData(int id) const;
+
+  // Number of presets that have been sent to the simulator and passed
+  // verification.
+  size_t presets_received() const;
+  size_t bytes_sent() const;
+  size_t bytes_received() const;
+  size_t bytes_dropped() const;
+
+ private:
+  class In;
+  class Out;
+
+  typedef std::chrono::steady_clock Clock;
+  typedef std::function<void()> Task;
+  typedef std::vector<std::vector<uint8_t> > SysExMessages;
+
+  struct InFlight {
+    const Message* message;
+    MessageBufferOwner* owner;
+  };
+
+  struct Event {
+    Clock::time_point time;
+    uint64_t sequence;  // Keeps events with the same time in order.
+    Task task;
+    bool operator<(const Event& other) const {
+      return time == other.time ? sequence > other.sequence
+                                : time > other.time;
+    }
+  };
+
+  // Called by Out on the host's thread.
+  void Receive(unique_ptr<Message> message,
+               const std::function<void()>& on_complete);
+
+  // Except for StorePreset, these run on the simulator thread.
+  void Run();
+  void Schedule(Clock::time_point time, const Task& task);
+  void OnReceived();
+  void HandleSysEx(const std::vector<uint8_t>& message);
+  void HandleControlChange(uint8_t controller, uint8_t value);
+  void HandlePresetData(const std::vector<uint8_t>& message);
+  // Verifies a serialized preset and moves it to the library.
+  bool StorePreset(SysExMessages* messages);
+  void SendBank(int bank);
+  void SendPreset(int id, int target_id);
+  void SendPresetName();
+  void SendPresetChange();
+  void SendReply(axefx::FunctionId function, uint8_t error);
+  void SendTempo();
+  void SendTuner();
+  void Transmit(const std::vector<uint8_t>& message,
+                Clock::time_point earliest);
+  void Deliver(const std::vector<uint8_t>& message);
+  Clock::duration TransferTime(size_t bytes) const;
+  Clock::duration Jitter();
+
+  const Options options_;
+
+  mutable std::mutex lock_;
+  std::condition_variable signal_;
+  std::priority_queue<Event> events_;
+  uint64_t sequence_;
+  bool quit_;
+  std::thread thread_;
+
+  // Guarded by |lock_|.
+  std::map<int, SysExMessages> presets_;
+  SysExMessages edit_buffer_;
+  std::weak_ptr<In> in_;
+  std::deque<InFlight> in_flight_;
+  Clock::time_point in_wire_free_;
+  size_t presets_received_;
+  size_t bytes_sent_;
+  size_t bytes_received_;
+  size_t bytes_dropped_;
+
+  // Only accessed on the simulator thread.
+  Clock::time_point out_wire_free_;
+  Clock::time_point reply_start_;
+  size_t messages_in_transit_;
+  std::mt19937 random_;
+  int current_preset_;
+  int bank_select_;
+  SysExMessages upload_;
+  Clock::time_point busy_until_;
+  bool upload_rejected_;
+  size_t presets_rejected_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimulatedAxeFx);
+};
+
+}  // namespace midi
+
+#endif  // MIDI_SIMULATED_AXEFX_H_
@@ -0,0 +1,130 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "midi/sysex_filter.h"
+
+namespace midi {
+
+FunctionSet::FunctionSet() : other_(false) {
+  bits_[0] = bits_[1] = 0u;
+}
+
+FunctionSet::FunctionSet(std::initializer_list<axefx::FunctionId> functions,
+                         bool other)
+    : other_(other) {
+  bits_[0] = bits_[1] = 0u;
+  for (auto function : functions)
+    Add(function);
+}
+
+// static
+FunctionSet FunctionSet::All() {
+  FunctionSet ret;
+  ret.bits_[0] = ret.bits_[1] = ~0ull;
+  ret.other_ = true;
+  return ret;
+}
+
+void FunctionSet::Add(const FunctionSet& other) {
+  bits_[0] |= other.bits_[0];
+  bits_[1] |= other.bits_[1];
+  other_ |= other.other_;
+}
+
+bool FunctionSet::Contains(uint8_t function_id) const {
+  function_id &= 0x7F;
+  return (bits_[function_id / 64] & (1ull << (function_id % 64))) != 0;
+}
+
+bool FunctionSet::ContainsFrame(const uint8_t* frame, size_t size) const {
+  const size_t kHeaderSize = sizeof(axefx::FractalSysExHeader);
+  bool fractal = size > kHeaderSize && frame[0] == axefx::kSysExStart &&
+      memcmp(&frame[1], axefx::kFractalMidiId,
+             sizeof(axefx::kFractalMidiId)) == 0;
+  return fractal ? Contains(frame[kHeaderSize - 1]) : other_;
+}
+
+bool FunctionSet::all() const {
+  return other_ && bits_[0] == ~0ull && bits_[1] == ~0ull;
+}
+
+bool FunctionSet::operator==(const FunctionSet& other) const {
+  return bits_[0] == other.bits_[0] && bits_[1] == other.bits_[1] &&
+         other_ == other.other_;
+}
+
+void FunctionSet::Add(uint8_t function_id) {
+  function_id &= 0x7F;
+  bits_[function_id / 64] |= 1ull << (function_id % 64);
+}
+
+SysExFilter::SysExFilter() : state_(BETWEEN_FRAMES), header_size_(0u) {}
+
+SysExFilter::~SysExFilter() {}
+
+void SysExFilter::Filter(const uint8_t* data, size_t size,
+                         const FunctionSet& functions, const Output& output) {
+  // Start of the bytes in |data| that are being passed on, if any.
+  const uint8_t* run = state_ == BETWEEN_FRAMES || state_ == PASS ? data
+                                                                   : NULL;
+  const uint8_t* end = data + size;
+  for (const uint8_t* p = data; p < end; ++p) {
+    if (state_ == HEADER) {
+      if (*p == axefx::kSysExStart) {
+        // The frame ended before we could tell what it was.
+        Classify(functions, output);
+      } else {
+        // Frames that don't start with the Fractal id are classified as
+        // soon as that's clear.
+        size_t i = header_size_++;
+        header_[i] = *p;
+        bool fractal = i > sizeof(axefx::kFractalMidiId) ||
+                       *p == axefx::kFractalMidiId[i - 1];
+        if (header_size_ == kMaxHeldBytes || *p == axefx::kSysExEnd ||
+            !fractal) {
+          Classify(functions, output);
+          if (state_ != DROP)
+            run = p + 1;
+        }
+        continue;
+      }
+    }
+
+    if (*p == axefx::kSysExStart) {
+      if (run && p > run)
+        output(run, p - run);
+      run = NULL;
+      state_ = HEADER;
+      header_[0] = *p;
+      header_size_ = 1u;
+    } else if (*p == axefx::kSysExEnd) {
+      if (state_ == DROP)
+        run = p + 1;
+      state_ = BETWEEN_FRAMES;
+    }
+  }
+
+  if (run && end > run)
+    output(run, end - run);
+}
+
+void SysExFilter::Classify(const FunctionSet& functions,
+                           const Output& output) {
+  ASSERT(state_ == HEADER);
+  bool complete = header_[header_size_ - 1] == axefx::kSysExEnd;
+  bool fractal = header_size_ == kMaxHeldBytes &&
+      memcmp(&header_[1], axefx::kFractalMidiId,
+             sizeof(axefx::kFractalMidiId)) == 0 && !complete;
+  bool pass = fractal ? functions.Contains(header_[kMaxHeldBytes - 1])
+                      : functions.other();
+  if (pass)
+    output(header_, header_size_);
+
+  if (complete)
+    state_ = BETWEEN_FRAMES;
+  else
+    state_ = pass ? PASS : DROP;
+  header_size_ = 0u;
+}
+
+}  // namespace midi
@@ -0,0 +1,91 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#pragma once
+#ifndef MIDI_SYSEX_FILTER_H_
+#define MIDI_SYSEX_FILTER_H_
+
+#include "common/common_types.h"
+
+#include "axefx/sysex_types.h"
+
+#include <functional>
+#include <initializer_list>
+
+namespace midi {
+
+// A set of Fractal function ids, used to pick the sysex frames that a
+// receiver is interested in.  Frames that aren't Fractal messages, such as
+// data from other devices or partial frames, are grouped together as
+// "other".
+class FunctionSet {
+ public:
+  // An empty set.
+  FunctionSet();
+  FunctionSet(std::initializer_list<axefx::FunctionId> functions,
+              bool other);
+
+  // A set that contains every function and other data.
+  static FunctionSet All();
+
+  void Add(axefx::FunctionId function) { Add(static_cast<uint8_t>(function)); }
+  void Add(const FunctionSet& other);
+  void set_other(bool other) { other_ = other; }
+
+  bool Contains(uint8_t function_id) const;
+  // True if |frame| is a Fractal message with a function in the set, or
+  // another kind of frame and the set includes other data.
+  bool ContainsFrame(const uint8_t* frame, size_t size) const;
+  bool other() const { return other_; }
+  bool all() const;
+
+  bool operator==(const FunctionSet& other) const;
+
+ private:
+  friend class MidiIn;
+
+  void Add(uint8_t function_id);
+
+  // One bit per 7 bit function id.
+  uint64_t bits_[2];
+  bool other_;
+};
+
+// Classifies sysex frames by their function id as the bytes stream in, so
+// that frames nobody wants can be dropped before they're copied anywhere.
+// The first bytes of each frame are held back until the function id has
+// arrived and are then passed on, or not, along with the rest of the frame.
+// Data outside of frames always passes through.
+class SysExFilter {
+ public:
+  // Called for each run of bytes that passes the filter.
+  typedef std::function<void(const uint8_t*, size_t)> Output;
+
+  // The most bytes that are held back at a time.
+  static const size_t kMaxHeldBytes = sizeof(axefx::FractalSysExHeader);
+
+  SysExFilter();
+  ~SysExFilter();
+
+  void Filter(const uint8_t* data, size_t size, const FunctionSet& functions,
+              const Output& output);
+
+ private:
+  enum State {
+    BETWEEN_FRAMES,
+    HEADER,
+    PASS,
+    DROP,
+  };
+
+  // Decides what to do with the frame whose header is in |header_|.
+  void Classify(const FunctionSet& functions, const Output& output);
+
+  State state_;
+  uint8_t header_[kMaxHeldBytes];
+  size_t header_size_;
+};
+
+}  // namespace midi
+
+#endif  // MIDI_SYSEX_FILTER_H_
@@ -3,15 +3,23 @@
 
 #include "gtest/gtest.h"
 
+#include "axefx/axe_edit_xml_reader.h"
 #include "axefx/axe_fx_sysex_parser.h"
 #include "axefx/blocks.h"
 #include "axefx/ir_data.h"
+#include "axefx/param_units.h"
 #include "axefx/preset.h"
+#include "axefx/preset_archive.h"
+#include "axefx/preset_json_reader.h"
 #include "axefx/sysex_types.h"
+#include "common/json_writer.h"
+#include "common/thread_pool.h"
+#include "json/reader.h"
 #include "json/writer.h"
 #include "test/test_utils.h"
 
 #include <functional>
+#include <sstream>
 
 using std::placeholders::_1;
 
@@ -81,6 +89,8 @@ class ParserTestUtil {
     out->insert(out->end(), data.begin(), data.end());
   }
 
+  void set_executor(base::ThreadPool* pool) { parser_->set_executor(pool); }
+
   void Serialize(std::vector<uint8_t>* serialized) {
     parser_->Serialize(std::bind(&SerializeCallback, _1, serialized));
   }
@@ -165,6 +175,104 @@ TEST(FractalTypes, Fractal14bit) {
   }
 }
 
+TEST(FractalTypes, GeneratedLookups) {
+  EXPECT_EQ(BLOCK_TYPE_AMP, GetBlockType(BLOCK_AMP_2));
+  EXPECT_EQ(BLOCK_TYPE_INVALID, GetBlockType(BLOCK_INVALID));
+  EXPECT_EQ(BLOCK_TYPE_INVALID, GetBlockType(static_cast<AxeFxIIBlockID>(999)));
+  EXPECT_STREQ("Amp 2", GetBlockName(BLOCK_AMP_2));
+  EXPECT_STREQ("", GetBlockName(BLOCK_SHUNT_200));
+  EXPECT_STREQ("Amp", GetBlockTypeName(BLOCK_TYPE_AMP));
+  EXPECT_STREQ("", GetBlockTypeName(BLOCK_TYPE_INVALID));
+  EXPECT_EQ(DISTORT_BYPASS, GetBlockBypassParamID(BLOCK_TYPE_AMP));
+  EXPECT_EQ(-1, GetBlockBypassParamID(BLOCK_TYPE_CONTROLLERS));
+
+  size_t length = 42u;
+  EXPECT_STREQ("distort_type", GetParamName(BLOCK_TYPE_AMP, DISTORT_TYPE));
+  EXPECT_STREQ("distort_type",
+               GetParamName(BLOCK_TYPE_AMP, DISTORT_TYPE, &length));
+  EXPECT_EQ(strlen("distort_type"), length);
+  EXPECT_STREQ("", GetParamName(BLOCK_TYPE_AMP, -1, &length));
+  EXPECT_EQ(0u, length);
+  int count = GetParamCount(BLOCK_TYPE_AMP);
+  EXPECT_GT(count, DISTORT_BYPASS);
+  EXPECT_STREQ("", GetParamName(BLOCK_TYPE_AMP, count));
+  EXPECT_STREQ("amp_", GetParamPrefix(BLOCK_TYPE_AMP, &length));
+  EXPECT_EQ(4u, length);
+
+  EXPECT_STREQ("59 BASSGUY", GetAmpName(0));
+  EXPECT_STREQ("", GetAmpName(-1));
+  EXPECT_STREQ("", GetCabName(100000));
+}
+
+TEST(FractalTypes, VersionedTypeTables) {
+  const TypeTables* v7 = GetTypeTables(0x0202);
+  const TypeTables* latest = GetTypeTables(0x0204);
+  ASSERT_NE(v7, latest);
+  EXPECT_EQ(latest, GetLatestTypeTables());
+  EXPECT_EQ(latest, GetTypeTables(0x0310));
+  EXPECT_EQ(v7, GetTypeTables(0x0100));
+  EXPECT_STREQ("7", GetFirmwareVersion(v7));
+  EXPECT_STREQ("9.2", GetFirmwareVersion(latest));
+
+  // The output block's bypass parameter moved in 9.x.
+  EXPECT_EQ(12, GetBlockBypassParamID(v7, BLOCK_TYPE_OUTPUT));
+  EXPECT_EQ(OUTPUT_BYPASS, GetBlockBypassParamID(latest, BLOCK_TYPE_OUTPUT));
+  EXPECT_LT(GetParamCount(v7, BLOCK_TYPE_OUTPUT),
+            GetParamCount(latest, BLOCK_TYPE_OUTPUT));
+  EXPECT_STREQ("Output", GetBlockName(v7, BLOCK_OUTPUT));
+  EXPECT_EQ(0, GetParamCount(v7, BLOCK_TYPE_MODIFIER));
+
+  // The 7.x profile doesn't list amp models.
+  EXPECT_STREQ(GetAmpName(0), GetAmpName(v7, 0));
+}
+
+TEST(FractalTypes, ParamScaleTables) {
+  EXPECT_STREQ("7.0", GetParamScaleFirmwareVersion());
+  EXPECT_EQ(-1, GetVariantParamID(BLOCK_TYPE_OUTPUT));
+  EXPECT_EQ(DISTORT_TYPE, GetVariantParamID(BLOCK_TYPE_AMP));
+  EXPECT_GT(GetVariantCount(BLOCK_TYPE_AMP), 1);
+  EXPECT_TRUE(GetParamScaleTable(BLOCK_TYPE_AMP, 0) != NULL);
+  EXPECT_TRUE(GetParamScaleTable(BLOCK_TYPE_AMP, -1) == NULL);
+  EXPECT_TRUE(GetParamScaleTable(BLOCK_TYPE_INVALID, 0) == NULL);
+
+  // Compressor: threshold is linear from -80 to 0 dB, attack is logarithmic
+  // from 1 to 100 ms and knee type is a list.
+  const ParamScaleTable* table = GetParamScaleTable(BLOCK_TYPE_COMPRESSOR, 0);
+  ASSERT_TRUE(table != NULL);
+  // Threshold, ratio, attack, release, level and knee type.
+  const uint16_t raw[] = { 0, 0, 32767, 65534, 65534, 3 };
+  double out[arraysize(raw)];
+  RawToDisplay(*table, raw, arraysize(raw), out);
+  EXPECT_DOUBLE_EQ(-80.0, out[0]);
+  EXPECT_NEAR(10.0, out[2], 0.001);
+  EXPECT_NEAR(1000.0, out[3], 0.001);
+  EXPECT_DOUBLE_EQ(20.0, out[4]);
+  EXPECT_DOUBLE_EQ(3.0, out[5]);
+  EXPECT_EQ("-80.0 dB", FormatDisplayValue(table->info[0], out[0]));
+  EXPECT_EQ("10.000 ms", FormatDisplayValue(table->info[2], out[2]));
+  EXPECT_EQ("SOFTEST", FormatDisplayValue(table->info[5], out[5]));
+
+  double value = 0.0;
+  EXPECT_TRUE(ParseDisplayValue(table->info[5], "SOFT", &value));
+  EXPECT_EQ(1.0, value);
+  EXPECT_TRUE(ParseDisplayValue(table->info[3], " 1,800.5", &value));
+  EXPECT_EQ(1800.5, value);
+  EXPECT_TRUE(ParseDisplayValue(table->info[0], "   -12", &value));
+  EXPECT_EQ(-12.0, value);
+  EXPECT_FALSE(ParseDisplayValue(table->info[5], "LOUDEST", &value));
+  EXPECT_FALSE(ParseDisplayValue(table->info[0], "  ", &value));
+
+  const double values[] = { -40.0, 20.0, 10.0, 5000.0, -20.0, 7.0 };
+  uint16_t back[arraysize(values)];
+  DisplayToRaw(*table, values, arraysize(values), back);
+  EXPECT_EQ(32767, back[0]);
+  EXPECT_EQ(65534, back[1]);
+  EXPECT_EQ(raw[2], back[2]);
+  EXPECT_EQ(65534, back[3]);  // Clamped.
+  EXPECT_EQ(0, back[4]);
+  EXPECT_EQ(7, back[5]);
+}
+
 TEST(FractalTypes, BlockSceneState) {
   // The high order byte represents X/Y state, low order is bypassed flag.
   BlockSceneState state(0x66AA);
@@ -283,6 +391,123 @@ TEST_F(AxeFxII, ParsePresetFile) {
   EXPECT_EQ("Dynamic JCM800", front->second->name());
 }
 
+TEST_F(AxeFxII, OldPresetsUseMatchingTypeTables) {
+  ASSERT_TRUE(ParseFile("axefx2/V7_Bank_A.syx"));
+  const TypeTables* v7 = GetTypeTables(0x0202);
+  size_t outputs = 0u;
+  for (const auto& entry : parser_.presets()) {
+    Preset* preset = entry.second.get();
+    ASSERT_EQ(0x0202, preset->version());
+    EXPECT_EQ(v7, preset->type_tables());
+    BlockParameters* output = preset->LookupBlock(BLOCK_OUTPUT);
+    if (!output)
+      continue;
+    ++outputs;
+    EXPECT_EQ(v7, output->type_tables());
+    EXPECT_EQ(BlockSceneState(output->GetParamValue(12, true)).As16bit(),
+              output->GetBypassState().As16bit());
+  }
+  EXPECT_GT(outputs, 0u);
+
+  Preset preset;
+  EXPECT_EQ(GetLatestTypeTables(), preset.type_tables());
+  preset.set_version(0x0202);
+  EXPECT_EQ(v7, preset.type_tables());
+}
+
+TEST_F(AxeFxII, DisplayValuesRoundTrip) {
+  ASSERT_TRUE(ParseFile("axefx2/V7_Bank_A.syx"));
+  size_t blocks = 0u;
+  for (const auto& entry : parser_.presets()) {
+    Preset* preset = entry.second.get();
+    for (int id = BLOCK_COMPRESSOR_1; id <= BLOCK_OUTPUT; ++id) {
+      BlockParameters* block =
+          preset->LookupBlock(static_cast<AxeFxIIBlockID>(id));
+      if (!block || block->raw_values().empty())
+        continue;
+      // Models added after the profile was written don't have a table.
+      if (!GetParamScaleTable(*block, true) ||
+          (block->supports_xy() && !GetParamScaleTable(*block, false))) {
+        continue;
+      }
+      std::vector<double> values;
+      ASSERT_TRUE(GetDisplayValues(*block, &values))
+          << preset->name() << " " << GetBlockName(block->block());
+      std::vector<uint16_t> original(block->raw_values());
+      ASSERT_TRUE(SetDisplayValues(values, block));
+      for (size_t i = 0; i < original.size(); ++i) {
+        // Parameters with an empty range (e.g. min and max both 0 dB) all
+        // map to the same value.
+        const ParamScaleTable* table =
+            GetParamScaleTable(*block, !block->supports_xy() ||
+                                       i < original.size() / 2);
+        size_t index = block->supports_xy() ? i % (original.size() / 2) : i;
+        if (index < table->count && table->scales[index] == 0.0)
+          continue;
+        // Rounding can be off by one for logarithmic parameters.
+        EXPECT_LE(abs(original[i] - block->raw_values()[i]), 1)
+            << GetBlockName(block->block()) << " param " << i;
+      }
+      ++blocks;
+    }
+  }
+  EXPECT_GT(blocks, 100u);
+}
+
+TEST_F(AxeFxII, ImportAxeEditXml) {
+  unique_ptr<uint8_t[]> file;
+  int file_size = 0;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/Dynamic JCM800.xml", &file,
+                                     &file_size));
+  const char* xml = reinterpret_cast<const char*>(file.get());
+  shared_ptr<Preset> imported;
+  ASSERT_TRUE(ParseAxeEditXml(xml, xml + file_size, &imported));
+  EXPECT_EQ("Dynamic JCM800", imported->name());
+  EXPECT_EQ(0x0202, imported->version());
+
+  // The same preset, saved as sysex.
+  ASSERT_TRUE(ParseFile("axefx2/p000318_DynamicJCM800.syx"));
+  Preset* original = parser_.presets().begin()->second.get();
+  const AxeFxIIBlockID kBlocks[] = {
+    BLOCK_AMP_1, BLOCK_CABINET_1, BLOCK_REVERB_1, BLOCK_DELAY_1,
+    BLOCK_CHORUS_1, BLOCK_NOISEGATE, BLOCK_OUTPUT, BLOCK_CONTROLLERS,
+  };
+  // The export only has the values as displayed (e.g. "1,800.0") and comes
+  // from a later firmware where a few parameters are scaled differently, so
+  // only most values are expected to match exactly.
+  size_t total = 0, matching = 0;
+  for (size_t b = 0; b < arraysize(kBlocks); ++b) {
+    BlockParameters* block = imported->LookupBlock(kBlocks[b]);
+    BlockParameters* expected = original->LookupBlock(kBlocks[b]);
+    ASSERT_TRUE(block != NULL);
+    ASSERT_TRUE(expected != NULL);
+    size_t count = std::min(block->raw_values().size(),
+                            expected->raw_values().size());
+    if (block->supports_xy())
+      count /= 2;
+    int variant_param = GetVariantParamID(block->type());
+    if (variant_param != -1) {
+      EXPECT_EQ(expected->raw_values()[variant_param],
+                block->raw_values()[variant_param])
+          << GetBlockName(kBlocks[b]);
+    }
+    for (size_t i = 0; i < count; ++i) {
+      if (abs(block->raw_values()[i] - expected->raw_values()[i]) <= 1)
+        ++matching;
+    }
+    total += count;
+  }
+  EXPECT_GT(matching * 100, total * 85);
+
+  // The result can be serialized and read back.
+  std::vector<uint8_t> syx;
+  imported->Serialize(std::bind(&ParserTestUtil::SerializeCallback, _1, &syx));
+  SysExParser parser;
+  ASSERT_TRUE(parser.ParseSysExBuffer(&syx[0], &syx[0] + syx.size(), true));
+  ASSERT_EQ(1u, parser.presets().size());
+  EXPECT_EQ("Dynamic JCM800", parser.presets().begin()->second->name());
+}
+
 TEST_F(AxeFxII, ParseCompressedPresetFile) {
   ASSERT_TRUE(ParseFile("axefx2/tone_match_preset.syx"));
   EXPECT_EQ(SysExParser::PRESET, parser_.type());
@@ -331,6 +556,18 @@ TEST_F(AxeFxII, SerializeBankFile) {
   }
 }
 
+TEST_F(AxeFxII, SerializeBankFileInParallel) {
+  base::ThreadPool pool(4);
+  parser_.set_executor(&pool);
+  ASSERT_TRUE(ParseFile("axefx2/V7_Bank_A.syx"));
+  ASSERT_EQ(SysExParser::PRESET_ARCHIVE, parser_.type());
+  EXPECT_EQ(128u, parser_.preset_count());
+  std::vector<uint8_t> serialized;
+  parser_.Serialize(&serialized);
+  EXPECT_TRUE(parser_.MatchesFileContent(serialized, ' '));
+  parser_.Reset();
+}
+
 TEST_F(AxeFxII, ParseXyPresetFile) {
   ASSERT_TRUE(ParseFile("axefx2/xy_test2.syx"));
   EXPECT_EQ(SysExParser::PRESET, parser_.type());
@@ -511,6 +748,209 @@ TEST_F(AxeFxII, PresetToJson) {
 #endif
 }
 
+TEST_F(AxeFxII, PresetWriteJsonMatchesToJson) {
+  const char* test_files[] = {
+    "axefx2/tone_match_preset.syx",
+    "axefx2/one_amp_8scenes_xy_1.syx",
+    "axefx2/V7_Bank_A.syx",
+  };
+
+  for (size_t i = 0; i < arraysize(test_files); ++i) {
+    ASSERT_TRUE(ParseFile(test_files[i]));
+    for (const auto& entry : parser_.presets()) {
+      const Preset& p = *entry.second.get();
+      Json::Value dom;
+      p.ToJson(&dom);
+
+      std::ostringstream stream;
+      {
+        base::JsonWriter writer(&stream, base::JsonWriter::COMPACT);
+        p.WriteJson(&writer);
+      }
+
+      // Round trip the DOM through text as well so that both sides end up
+      // with the same integer types.
+      Json::Reader reader;
+      Json::Value expected, streamed;
+      ASSERT_TRUE(reader.parse(Json::FastWriter().write(dom), expected));
+      ASSERT_TRUE(reader.parse(stream.str(), streamed)) << stream.str();
+      EXPECT_EQ(expected, streamed) << p.name();
+    }
+    parser_.Reset();
+  }
+}
+
+TEST_F(AxeFxII, PresetJsonRoundTrip) {
+  const char* test_files[] = {
+    "axefx2/V7_Bank_A.syx",
+    "axefx2/9b_A.syx",
+    "axefx2/V12_Bank_A.syx",
+    "axefx2/one_amp_8scenes_xy_1.syx",
+    "axefx2/p000318_DynamicJCM800.syx",
+    "axefx2/xy_test2.syx",
+  };
+
+  for (size_t i = 0; i < arraysize(test_files); ++i) {
+    ASSERT_TRUE(ParseFile(test_files[i]));
+
+    std::vector<const Preset*> originals;
+    std::ostringstream stream;
+    {
+      base::JsonWriter writer(&stream, base::JsonWriter::STYLED);
+      writer.BeginObject();
+      writer.Key("bank");
+      writer.BeginArray();
+      for (const auto& entry : parser_.presets()) {
+        // Tone match IR data isn't a part of the JSON.
+        if (!entry.second->ir_data().empty())
+          continue;
+        entry.second->WriteJson(&writer);
+        originals.push_back(entry.second.get());
+      }
+      writer.EndArray();
+      writer.EndObject();
+    }
+    ASSERT_FALSE(originals.empty());
+
+    std::vector<shared_ptr<Preset> > imported;
+    PresetJsonReader reader([&imported](const shared_ptr<Preset>& preset) {
+      imported.push_back(preset);
+    });
+    std::string json(stream.str());
+    ASSERT_TRUE(reader.Parse(json.c_str(), json.c_str() + json.length()))
+        << test_files[i];
+    ASSERT_EQ(originals.size(), imported.size());
+
+    for (size_t p = 0; p < originals.size(); ++p) {
+      EXPECT_EQ(originals[p]->id(), imported[p]->id());
+      EXPECT_EQ(originals[p]->name(), imported[p]->name());
+      std::vector<uint8_t> expected, actual;
+      originals[p]->Serialize(
+          std::bind(&ParserTestUtil::SerializeCallback, _1, &expected));
+      imported[p]->Serialize(
+          std::bind(&ParserTestUtil::SerializeCallback, _1, &actual));
+      EXPECT_TRUE(expected == actual) << test_files[i] << " "
+                                      << originals[p]->name();
+    }
+    parser_.Reset();
+  }
+}
+
+TEST_F(AxeFxII, PresetJsonReaderRejectsBadInput) {
+  const char* bad_input[] = {
+    "",
+    "42",
+    "{\"name\":\"no id\",\"matrix\":{}}",
+    "{\"id\":1,\"name\":\"no matrix\"}",
+    "{\"id\":400,\"name\":\"global\",\"matrix\":{}}",
+    "{\"id\":1,\"matrix\":{},\"block_params\":"
+        "[{\"id\":100,\"values\":{\"no_such_param\":1}}]}",
+    "{\"id\":1,\"matrix\":{},\"block_params\":"
+        "[{\"id\":106,\"values\":{\"x\":{},\"y\":{\"distort_type\":1}}}]}",
+    "[{\"id\":1,\"matrix\":{}},]",
+  };
+
+  for (size_t i = 0; i < arraysize(bad_input); ++i) {
+    int count = 0;
+    PresetJsonReader reader([&count](const shared_ptr<Preset>&) { ++count; });
+    const char* json = bad_input[i];
+    EXPECT_FALSE(reader.Parse(json, json + strlen(json))) << json;
+    EXPECT_LE(count, 1);
+  }
+
+  // A minimal preset with an X/Y block and one unnamed parameter.
+  const char kMinimal[] =
+      "{\"id\":null,\"name\":\"Minimal\",\"matrix\":{\"row1\":"
+      "[{\"id\":106,\"input_rows\":[0,3]}]},\"block_params\":"
+      "[{\"id\":106,\"active_config\":\"y\",\"values\":"
+      "{\"x\":{\"distort_type\":7},\"y\":{\"distort_type\":9}}}]}";
+  shared_ptr<Preset> preset;
+  PresetJsonReader reader([&preset](const shared_ptr<Preset>& p) {
+    preset = p;
+  });
+  ASSERT_TRUE(reader.Parse(kMinimal, kMinimal + arraysize(kMinimal) - 1));
+  ASSERT_TRUE(preset.get() != NULL);
+  EXPECT_TRUE(preset->from_edit_buffer());
+  EXPECT_EQ("Minimal", preset->name());
+  EXPECT_EQ(BLOCK_AMP_1, preset->matrix()[0][1].block());
+  EXPECT_EQ(0x9, preset->matrix()[0][1].input_mask());
+  BlockParameters* amp = preset->LookupBlock(BLOCK_AMP_1);
+  ASSERT_TRUE(amp != NULL);
+  EXPECT_EQ(CONFIG_Y, amp->active_config());
+  EXPECT_EQ(7, amp->GetParamValue(DISTORT_TYPE, true));
+  EXPECT_EQ(9, amp->GetParamValue(DISTORT_TYPE, false));
+}
+
+TEST_F(AxeFxII, PresetArchiveRoundTrip) {
+  const struct {
+    const char* path;
+    bool parse_parameter_data;
+  } test_files[] = {
+    { "axefx2/V7_Bank_A.syx", true },
+    { "axefx2/9b_A.syx", true },
+    { "axefx2/tone_match_preset.syx", true },
+    { "axefx2/tone_match_preset.syx", false },
+    { "axefx2/system_backup.syx", true },
+  };
+
+  for (size_t i = 0; i < arraysize(test_files); ++i) {
+    unique_ptr<uint8_t[]> file;
+    int file_size = 0;
+    ASSERT_TRUE(ReadTestFileIntoBuffer(test_files[i].path, &file, &file_size));
+    SysExParser original;
+    ASSERT_TRUE(original.ParseSysExBuffer(file.get(), file.get() + file_size,
+                                          test_files[i].parse_parameter_data));
+    std::vector<uint8_t> expected;
+    original.Serialize(
+        std::bind(&ParserTestUtil::SerializeCallback, _1, &expected));
+
+    std::vector<uint8_t> archive;
+    ASSERT_TRUE(WritePresetArchive(original.presets(), &archive));
+    EXPECT_TRUE(IsPresetArchive(&archive[0], &archive[0] + archive.size()));
+    EXPECT_LT(archive.size(), static_cast<size_t>(file_size))
+        << test_files[i].path;
+
+    PresetArchiveReader reader;
+    ASSERT_TRUE(reader.Open(&archive[0], &archive[0] + archive.size()));
+    ASSERT_EQ(original.presets().size(), reader.preset_count());
+    size_t index = 0;
+    for (const auto& entry : original.presets()) {
+      EXPECT_EQ(entry.first, reader.preset_id(index));
+      EXPECT_EQ(entry.second->name(), reader.preset_name(index));
+      ++index;
+    }
+
+    SysExParser loaded;
+    ASSERT_TRUE(loaded.ParsePresetArchive(&archive[0],
+                                          &archive[0] + archive.size()));
+    EXPECT_EQ(original.type(), loaded.type());
+    std::vector<uint8_t> serialized;
+    loaded.Serialize(
+        std::bind(&ParserTestUtil::SerializeCallback, _1, &serialized));
+    EXPECT_TRUE(expected == serialized) << test_files[i].path;
+  }
+}
+
+TEST_F(AxeFxII, PresetArchiveRejectsCorruptData) {
+  ASSERT_TRUE(ParseFile("axefx2/V7_Bank_A.syx"));
+  std::vector<uint8_t> archive;
+  ASSERT_TRUE(WritePresetArchive(parser_.presets(), &archive));
+
+  PresetArchiveReader reader;
+  // Truncated table of contents and truncated preset data.
+  EXPECT_FALSE(reader.Open(&archive[0], &archive[0] + 20));
+  EXPECT_FALSE(reader.Open(&archive[0], &archive[0] + archive.size() - 2));
+  // Unknown format version.
+  std::vector<uint8_t> copy(archive);
+  copy[4] = 0xFF;
+  EXPECT_FALSE(reader.Open(&copy[0], &copy[0] + copy.size()));
+  // Not an archive at all.
+  copy = archive;
+  copy[0] = 0xF0;
+  EXPECT_FALSE(reader.Open(&copy[0], &copy[0] + copy.size()));
+  EXPECT_TRUE(reader.Open(&archive[0], &archive[0] + archive.size()));
+}
+
 TEST_F(AxeFxII, ParseIRFile) {
   ASSERT_TRUE(ParseFile("axefx2/FreakIR.syx"));
   EXPECT_EQ(SysExParser::IR, parser_.type());
@@ -0,0 +1,117 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "gtest/gtest.h"
+
+#include "common/byte_ring.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace base {
+
+namespace {
+// Reads everything that's in |ring| into |out|.
+void ReadAll(ByteRing* ring, std::vector<uint8_t>* out) {
+  const uint8_t* data;
+  size_t size;
+  while ((size = ring->Peek(&data)) != 0u) {
+    out->insert(out->end(), data, data + size);
+    ring->Consume(size);
+  }
+}
+}  // namespace
+
+TEST(ByteRing, RoundsUpCapacity) {
+  ByteRing ring(100);
+  EXPECT_EQ(128u, ring.capacity());
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST(ByteRing, WriteAndRead) {
+  ByteRing ring(16);
+  const uint8_t data[] = { 0xF0, 1, 2, 3, 0xF7 };
+  EXPECT_EQ(sizeof(data), ring.Write(data, sizeof(data)));
+  EXPECT_EQ(sizeof(data), ring.size());
+
+  const uint8_t* read;
+  ASSERT_EQ(sizeof(data), ring.Peek(&read));
+  EXPECT_EQ(0, memcmp(data, read, sizeof(data)));
+  ring.Consume(2u);
+  EXPECT_EQ(sizeof(data) - 2u, ring.size());
+  ASSERT_EQ(sizeof(data) - 2u, ring.Peek(&read));
+  EXPECT_EQ(2u, read[0]);
+  ring.Consume(sizeof(data) - 2u);
+  EXPECT_TRUE(ring.empty());
+  EXPECT_EQ(0u, ring.Peek(&read));
+}
+
+TEST(ByteRing, Full) {
+  ByteRing ring(8);
+  const uint8_t data[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+  EXPECT_EQ(8u, ring.Write(data, sizeof(data)));
+  EXPECT_EQ(0u, ring.Write(data, sizeof(data)));
+
+  std::vector<uint8_t> out;
+  ReadAll(&ring, &out);
+  EXPECT_EQ(std::vector<uint8_t>(data, data + 8), out);
+}
+
+TEST(ByteRing, WrapsAround) {
+  ByteRing ring(8);
+  const uint8_t data[] = { 1, 2, 3, 4, 5, 6 };
+  std::vector<uint8_t> out;
+  EXPECT_EQ(sizeof(data), ring.Write(data, sizeof(data)));
+  ReadAll(&ring, &out);
+  out.clear();
+
+  // This one is split over the end of the buffer.
+  EXPECT_EQ(sizeof(data), ring.Write(data, sizeof(data)));
+  const uint8_t* read;
+  EXPECT_EQ(2u, ring.Peek(&read));
+  ReadAll(&ring, &out);
+  EXPECT_EQ(std::vector<uint8_t>(data, data + sizeof(data)), out);
+}
+
+TEST(ByteRing, Threads) {
+  ByteRing ring(64);
+  const size_t kBytes = 1024 * 1024;
+  std::thread producer([&ring, kBytes]() {
+    uint8_t chunk[7];
+    size_t sent = 0u;
+    while (sent < kBytes) {
+      size_t size = std::min(sizeof(chunk), kBytes - sent);
+      for (size_t i = 0; i < size; ++i)
+        chunk[i] = static_cast<uint8_t>(sent + i);
+      size_t written = 0u;
+      while (written < size) {
+        written += ring.Write(chunk + written, size - written);
+        if (written < size)
+          std::this_thread::yield();
+      }
+      sent += size;
+    }
+  });
+
+  size_t received = 0u;
+  bool in_order = true;
+  while (received < kBytes) {
+    const uint8_t* data;
+    size_t size = ring.Peek(&data);
+    if (!size) {
+      std::this_thread::yield();
+      continue;
+    }
+    for (size_t i = 0; i < size; ++i)
+      in_order &= data[i] == static_cast<uint8_t>(received + i);
+    ring.Consume(size);
+    received += size;
+  }
+  producer.join();
+
+  EXPECT_TRUE(in_order);
+  EXPECT_TRUE(ring.empty());
+}
+
+}  // namespace base
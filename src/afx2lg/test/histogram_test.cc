@@ -0,0 +1,62 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "gtest/gtest.h"
+
+#include "common/histogram.h"
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace base {
+
+using std::chrono::microseconds;
+
+TEST(Histogram, Empty) {
+  Histogram histogram;
+  EXPECT_EQ(0u, histogram.count());
+  EXPECT_EQ(microseconds(0), histogram.min());
+  EXPECT_EQ(microseconds(0), histogram.mean());
+  EXPECT_EQ(microseconds(0), histogram.Percentile(50));
+}
+
+TEST(Histogram, Percentiles) {
+  Histogram histogram;
+  for (int i = 1; i <= 100; ++i)
+    histogram.Add(microseconds(i * 10));
+
+  EXPECT_EQ(100u, histogram.count());
+  EXPECT_EQ(microseconds(10), histogram.min());
+  EXPECT_EQ(microseconds(1000), histogram.max());
+  EXPECT_EQ(microseconds(505), histogram.mean());
+  // The median is 500us, which is in the bucket that ends at 512us.
+  EXPECT_EQ(microseconds(512), histogram.Percentile(50));
+  // Percentiles aren't reported as larger than the largest sample.
+  EXPECT_EQ(microseconds(1000), histogram.Percentile(99));
+  EXPECT_EQ(microseconds(16), histogram.Percentile(1));
+
+  std::ostringstream out;
+  histogram.Print(&out);
+  EXPECT_EQ("100 samples, min 10us, median 512us, 99% 1000us, max 1000us, "
+            "mean 505us", out.str());
+}
+
+TEST(Histogram, Threads) {
+  Histogram histogram;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(std::thread([&histogram, i]() {
+      for (int j = 0; j < 10000; ++j)
+        histogram.Add(microseconds(i));
+    }));
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(40000u, histogram.count());
+  EXPECT_EQ(microseconds(0), histogram.min());
+  EXPECT_EQ(microseconds(3), histogram.max());
+}
+
+}  // namespace base
@@ -0,0 +1,140 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "gtest/gtest.h"
+
+#include "common/json_reader.h"
+#include "common/json_writer.h"
+
+#include <sstream>
+
+namespace base {
+
+namespace {
+// |json| must outlive the returned reader.
+JsonReader* CreateReader(const std::string& json) {
+  return new JsonReader(json.c_str(), json.c_str() + json.length());
+}
+}  // namespace
+
+TEST(JsonReader, Tokens) {
+  std::string json(
+      " {\"id\" : -12, \"name\":\"a \\\"quoted\\\"\\\\name\\n\",\n"
+      "  \"list\": [true, false, null, 1.5e2, {}, []]}  ");
+  unique_ptr<JsonReader> r(CreateReader(json));
+  EXPECT_EQ(JsonReader::BEGIN_OBJECT, r->Next());
+  EXPECT_EQ(JsonReader::KEY, r->Next());
+  EXPECT_EQ("id", r->string());
+  EXPECT_EQ(JsonReader::NUMBER, r->Next());
+  EXPECT_TRUE(r->IsInteger(-12, -12));
+  EXPECT_FALSE(r->IsInteger(0, 100));
+  EXPECT_EQ(JsonReader::KEY, r->Next());
+  EXPECT_EQ("name", r->string());
+  EXPECT_EQ(JsonReader::STRING, r->Next());
+  EXPECT_EQ("a \"quoted\"\\name\n", r->string());
+  EXPECT_EQ(JsonReader::KEY, r->Next());
+  EXPECT_EQ(JsonReader::BEGIN_ARRAY, r->Next());
+  EXPECT_EQ(JsonReader::BOOLEAN, r->Next());
+  EXPECT_TRUE(r->boolean());
+  EXPECT_EQ(JsonReader::BOOLEAN, r->Next());
+  EXPECT_FALSE(r->boolean());
+  EXPECT_EQ(JsonReader::NULL_VALUE, r->Next());
+  EXPECT_EQ(JsonReader::NUMBER, r->Next());
+  EXPECT_EQ(150.0, r->number());
+  EXPECT_EQ(JsonReader::BEGIN_OBJECT, r->Next());
+  EXPECT_EQ(JsonReader::END_OBJECT, r->Next());
+  EXPECT_EQ(JsonReader::BEGIN_ARRAY, r->Next());
+  EXPECT_EQ(JsonReader::END_ARRAY, r->Next());
+  EXPECT_EQ(JsonReader::END_ARRAY, r->Next());
+  EXPECT_EQ(JsonReader::END_OBJECT, r->Next());
+  EXPECT_EQ(JsonReader::END_OF_INPUT, r->Next());
+}
+
+TEST(JsonReader, UnicodeEscapes) {
+  std::string json("\"\\u0041\\u00e9\\u20ac\\ud83c\\udfb8\\u0000\"");
+  unique_ptr<JsonReader> r(CreateReader(json));
+  EXPECT_EQ(JsonReader::STRING, r->Next());
+  EXPECT_EQ(std::string("A\xC3\xA9\xE2\x82\xAC\xF0\x9F\x8E\xB8\0", 11),
+            r->string());
+}
+
+TEST(JsonReader, SyntaxErrors) {
+  const char* bad_input[] = {
+    "",
+    "{",
+    "[1,]",
+    "[1 2]",
+    "{\"a\" 1}",
+    "{\"a\":1,}",
+    "{1:2}",
+    "[\"unterminated]",
+    "[tru]",
+    "[-]",
+    "[1]]",
+    "{]",
+    "1 2",
+    "\"\\x\"",
+    "\"\\ud800\"",
+  };
+
+  for (size_t i = 0; i < arraysize(bad_input); ++i) {
+    std::string json(bad_input[i]);
+    unique_ptr<JsonReader> r(CreateReader(json));
+    JsonReader::Token token;
+    do {
+      token = r->Next();
+    } while (token != JsonReader::INVALID && token != JsonReader::END_OF_INPUT);
+    EXPECT_EQ(JsonReader::INVALID, token) << bad_input[i];
+    // Once failed, the reader stays failed.
+    EXPECT_EQ(JsonReader::INVALID, r->Next());
+  }
+}
+
+TEST(JsonReader, Skip) {
+  std::string json(
+      "{\"skip\":{\"a\":[1,{\"b\":[]}],\"c\":\"]\"},\"keep\":2}");
+  unique_ptr<JsonReader> r(CreateReader(json));
+  EXPECT_EQ(JsonReader::BEGIN_OBJECT, r->Next());
+  EXPECT_EQ(JsonReader::KEY, r->Next());
+  EXPECT_TRUE(r->Skip(r->Next()));
+  EXPECT_EQ(JsonReader::KEY, r->Next());
+  EXPECT_EQ("keep", r->string());
+  EXPECT_EQ(JsonReader::NUMBER, r->Next());
+  EXPECT_EQ(JsonReader::END_OBJECT, r->Next());
+}
+
+TEST(JsonReader, ReadsJsonWriterOutput) {
+  std::ostringstream stream;
+  {
+    JsonWriter w(&stream, JsonWriter::STYLED);
+    w.BeginArray();
+    for (int i = 0; i < 1000; ++i) {
+      w.BeginObject();
+      w.Key("param_", 6, i);
+      w.Value(i * 65);
+      w.Key("text");
+      w.Value("\t\x01");
+      w.EndObject();
+    }
+    w.EndArray();
+  }
+
+  std::string json(stream.str());
+  unique_ptr<JsonReader> r(CreateReader(json));
+  EXPECT_EQ(JsonReader::BEGIN_ARRAY, r->Next());
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_EQ(JsonReader::BEGIN_OBJECT, r->Next());
+    ASSERT_EQ(JsonReader::KEY, r->Next());
+    EXPECT_EQ("param_" + std::to_string(i), r->string());
+    ASSERT_EQ(JsonReader::NUMBER, r->Next());
+    EXPECT_TRUE(r->IsInteger(i * 65, i * 65));
+    ASSERT_EQ(JsonReader::KEY, r->Next());
+    ASSERT_EQ(JsonReader::STRING, r->Next());
+    EXPECT_EQ("\t\x01", r->string());
+    ASSERT_EQ(JsonReader::END_OBJECT, r->Next());
+  }
+  EXPECT_EQ(JsonReader::END_ARRAY, r->Next());
+  EXPECT_EQ(JsonReader::END_OF_INPUT, r->Next());
+}
+
+}  // namespace base
@@ -0,0 +1,89 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "gtest/gtest.h"
+
+#include "common/json_writer.h"
+
+#include <sstream>
+
+namespace base {
+
+TEST(JsonWriter, Compact) {
+  std::ostringstream stream;
+  {
+    JsonWriter w(&stream, JsonWriter::COMPACT);
+    w.BeginObject();
+    w.Key("id");
+    w.Value(-12);
+    w.Key("name");
+    w.Value("a \"quoted\"\\name\n");
+    w.Key("list");
+    w.BeginArray();
+    w.Value(true);
+    w.Value(0u);
+    w.Null();
+    w.BeginObject();
+    w.EndObject();
+    w.EndArray();
+    w.Key("param_", 6, 42);
+    w.Value(65534);
+    w.EndObject();
+  }
+  EXPECT_EQ("{\"id\":-12,\"name\":\"a \\\"quoted\\\"\\\\name\\n\","
+            "\"list\":[true,0,null,{}],\"param_42\":65534}", stream.str());
+}
+
+TEST(JsonWriter, Styled) {
+  std::ostringstream stream;
+  {
+    JsonWriter w(&stream, JsonWriter::STYLED);
+    w.BeginObject();
+    w.Key("enabled");
+    w.BeginArray();
+    w.Value(true);
+    w.Value(false);
+    w.EndArray();
+    w.Key("rows");
+    w.BeginArray();
+    w.BeginObject();
+    w.Key("id");
+    w.Value(1);
+    w.EndObject();
+    w.EndArray();
+    w.Key("empty");
+    w.BeginArray();
+    w.EndArray();
+    w.EndObject();
+  }
+  EXPECT_EQ("{\n"
+            "   \"enabled\" : [ true, false ],\n"
+            "   \"rows\" : [\n"
+            "      {\n"
+            "         \"id\" : 1\n"
+            "      }\n"
+            "   ],\n"
+            "   \"empty\" : []\n"
+            "}\n", stream.str());
+}
+
+TEST(JsonWriter, LargeOutputIsFlushedInChunks) {
+  std::string out;
+  size_t flushes = 0u;
+  {
+    JsonWriter w([&](const char* data, size_t size) {
+                   out.append(data, size);
+                   ++flushes;
+                 },
+                 JsonWriter::COMPACT);
+    w.BeginArray();
+    for (int i = 0; i < 100000; ++i)
+      w.Value(i);
+    w.EndArray();
+  }
+  EXPECT_GT(flushes, 1u);
+  EXPECT_EQ('[', out[0]);
+  EXPECT_EQ("99998,99999]", out.substr(out.length() - 12));
+}
+
+}  // namespace base
@@ -6,8 +6,16 @@
 #include "common/common_types.h"
 #include "lg/lg_parser.h"
 #include "lg/lg_utils.h"
+#include "lg/setup_state.h"
+#include "lg/output_buffer.h"
 #include "test_utils.h"
 
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <regex>
+#include <sstream>
+
 namespace lg {
 
 class MockCallback : public LgParserCallback {
@@ -41,6 +49,460 @@ TEST(LittleGiant, BasicReadInputFile) {
   EXPECT_FALSE(callback.lines_.empty());
 }
 
+// Builds an LG export with |patch_count| patches, four to a bank, and a
+// single bank list that holds all of the banks.  Patch i is set up for
+// preset i + 256.
+std::string CreateSyntheticSetup(int patch_count) {
+  std::ostringstream setup;
+  setup << std::setfill('0')
+        << ";=====   PRESET DATA                                       =====\n";
+  for (int i = 0; i < patch_count; ++i) {
+    int id = i + 256;
+    setup << "* PATCH : PATCH " << i << "\n"
+          << "+ 01 CC    000 " << std::setw(3) << (id >> 7) << "\n"
+          << "+ 01 PC    " << std::setw(3) << (id & 0x7F) << "\n"
+          << ";---------------------------------------------------------\n";
+  }
+
+  setup << ";=====   BANK DATA                                         =====\n";
+  int bank_count = (patch_count + 3) / 4;
+  for (int b = 0; b < bank_count; ++b) {
+    setup << "* BANK : BANK " << b << "\n";
+    for (int i = b * 4; i < std::min(b * 4 + 4, patch_count); ++i) {
+      setup << "switch " << std::setw(2) << (i - b * 4 + 1)
+            << " : PA PATCH " << i << "\n";
+    }
+    setup << ";---------------------------------------------------------\n";
+  }
+
+  setup << ";=====   BANKLIST DATA                                     =====\n"
+        << "* BANKLIST : BANKLIST 001\n";
+  for (int b = 0; b < bank_count; ++b)
+    setup << "BANK " << b << "\n";
+  setup << ";---------------------------------------------------------\n";
+
+  return setup.str();
+}
+
+// Parses a synthetic setup with |patch_count| patches along with all 512
+// presets.  The upper half of the presets rename existing patches and the
+// lower half get added as new patches, all with the same name.
+// Returns the processor time it took in microseconds, which unlike the wall
+// clock doesn't depend on what else the machine is busy with.
+long long ParseSyntheticSetup(int patch_count, MockCallback* callback) {
+  std::string setup(CreateSyntheticSetup(patch_count));
+  for (int i = 0; i < 512; ++i) {
+    shared_ptr<axefx::Preset> preset(new axefx::Preset());
+    preset->set_id(i);
+    preset->set_name(i < 256 ? std::string("New") :
+                               "Renamed " + std::to_string(i));
+    callback->map_[i] = preset;
+  }
+
+  std::clock_t start = std::clock();
+  LgParser parser;
+  EXPECT_TRUE(parser.ParseBuffer(callback, setup.c_str(),
+                                 setup.c_str() + setup.length()));
+  return (std::clock() - start) * 1000000LL / CLOCKS_PER_SEC;
+}
+
+TEST(LittleGiant, ManyPatches) {
+  MockCallback large;
+  ParseSyntheticSetup(10000, &large);
+
+  size_t patches = 0, renamed = 0;
+  ReservedNames names;
+  for (size_t i = 0; i < large.lines_.size(); ++i) {
+    const std::string& line = large.lines_[i];
+    if (!IsPatchStart(line.c_str()))
+      continue;
+    ++patches;
+    std::string name;
+    ASSERT_TRUE(ParseEntryName(line, &name));
+    if (name.compare(0, 8, "Renamed ") == 0)
+      ++renamed;
+    EXPECT_TRUE(names.insert(name).second) << name;
+  }
+  EXPECT_EQ(10256u, patches);
+  EXPECT_EQ(256u, renamed);
+}
+
+TEST(LittleGiant, ManyPatchesScaleLinearly) {
+  // The fastest of a few runs, taken in turns so that both sizes see the
+  // same conditions.
+  long long small_time = 0, large_time = 0;
+  for (int i = 0; i < 3; ++i) {
+    MockCallback small, large;
+    long long time = ParseSyntheticSetup(1000, &small);
+    small_time = i ? std::min(small_time, time) : time;
+    time = ParseSyntheticSetup(10000, &large);
+    large_time = i ? std::min(large_time, time) : time;
+  }
+
+  // Ten times the patches should take roughly ten times as long, where the
+  // linear patch and bank lookups made it approach a hundred times.
+  EXPECT_LT(large_time, std::max(small_time, 1000LL) * 30);
+}
+
+// The regular expressions that lg_utils used before it got its own
+// scanners.  The scanners are expected to produce the same results.
+namespace regex_reference {
+
+bool ParseInts(const std::string& str, const char* reg_exp, int* ints[],
+               int size) {
+  if (str[0] != '+')
+    return false;
+  std::smatch match;
+  if (!std::regex_match(str, match, std::regex(reg_exp)))
+    return false;
+  for (int i = 0; i < size; ++i)
+    *ints[i] = atoi(match.str(i + 1).c_str());
+  return true;
+}
+
+bool ParseCC(const std::string& str, int* channel, int* cc, int* value) {
+  int* ints[] = { channel, cc, value };
+  return ParseInts(str, "\\+\\s+(\\d+)\\s+CC\\s+(\\d+)\\s+(\\d+).*\n", ints,
+                   arraysize(ints));
+}
+
+bool ParseProgramChange(const std::string& str, int* channel, int* preset) {
+  int* ints[] = { channel, preset };
+  return ParseInts(str, "\\+\\s+(\\d+)\\s+PC\\s+(\\d+).*\n", ints,
+                   arraysize(ints));
+}
+
+bool Match(const std::string& str, const char* reg_exp, std::smatch* match) {
+  return std::regex_match(str, *match, std::regex(reg_exp));
+}
+
+const char kEntryName[] = "\\*\\s+(\\w+)\\s+:\\s+([\\w ]+)\n";
+const char* const kLinePatterns[] = {
+  "switch \\d+\\s+\\:\\s+PA\\s+([\\w ]+)\n",  // PATCH_SWITCH
+  "DEFAULTPRESET\\s+([\\w ]+)\n",  // DEFAULT_PRESET
+};
+
+}  // namespace regex_reference
+
+// Compares the scanners with the regular expressions for |line|.
+void CompareWithRegex(const std::string& line) {
+  int channel = -1, cc = -1, value = -1;
+  int expected_channel = -1, expected_cc = -1, expected_value = -1;
+  EXPECT_EQ(regex_reference::ParseCC(line, &expected_channel, &expected_cc,
+                                     &expected_value),
+            ParseCC(line, &channel, &cc, &value)) << line;
+  EXPECT_EQ(expected_channel, channel) << line;
+  EXPECT_EQ(expected_cc, cc) << line;
+  EXPECT_EQ(expected_value, value) << line;
+
+  channel = value = expected_channel = expected_value = -1;
+  EXPECT_EQ(regex_reference::ParseProgramChange(line, &expected_channel,
+                                                &expected_value),
+            ParseProgramChange(line, &channel, &value)) << line;
+  EXPECT_EQ(expected_channel, channel) << line;
+  EXPECT_EQ(expected_value, value) << line;
+
+  std::smatch match;
+  bool matched = regex_reference::Match(line, regex_reference::kEntryName,
+                                        &match);
+  std::string name;
+  EXPECT_EQ(matched, ParseEntryName(line, &name)) << line;
+  std::string replaced(line);
+  EXPECT_EQ(matched, ReplaceEntryName(&replaced, "New Name")) << line;
+  if (matched) {
+    EXPECT_EQ(match.str(2), name);
+    std::string expected(line);
+    expected.replace(match.position(2), match.length(2), "New Name");
+    EXPECT_EQ(expected, replaced);
+  }
+
+  const LinePattern kPatterns[] = { PATCH_SWITCH, DEFAULT_PRESET };
+  for (size_t i = 0; i < arraysize(kPatterns); ++i) {
+    matched = regex_reference::Match(line, regex_reference::kLinePatterns[i],
+                                     &match);
+    std::string found;
+    EXPECT_EQ(matched, ExtractSubstring(line, kPatterns[i], &found)) << line;
+    replaced = line;
+    EXPECT_EQ(matched, ReplaceIfMatch(&replaced, kPatterns[i],
+                                      match.str(1).c_str(), "X")) << line;
+    EXPECT_FALSE(ReplaceIfMatch(&replaced, kPatterns[i], "no such name",
+                                "X"));
+    if (matched) {
+      EXPECT_EQ(match.str(1), found);
+      std::string expected(line);
+      expected.replace(match.position(1), match.length(1), "X");
+      EXPECT_EQ(expected, replaced);
+    }
+  }
+}
+
+void CompareFileWithRegex(const char* file) {
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer(file, &buffer, &file_size));
+  const char* pos = reinterpret_cast<const char*>(buffer.get());
+  const char* end = pos + file_size;
+  size_t lines = 0;
+  while (pos < end) {
+    const char* bol = pos;
+    if (!FindEol(&pos, end))
+      break;
+    ++pos;
+    std::string line(bol, pos);
+    CompareWithRegex(line);
+    // LgEntry trims trailing white space before parsing.
+    size_t last = line.find_last_not_of(" \t\r\n");
+    if (last != std::string::npos && last + 2 < line.length())
+      CompareWithRegex(line.substr(0, last + 1) + '\n');
+    ++lines;
+  }
+  EXPECT_GT(lines, 400u);
+}
+
+TEST(LittleGiant, ScannersMatchRegexOnInputFile) {
+  CompareFileWithRegex("lg2/input.txt");
+}
+
+TEST(LittleGiant, ScannersMatchRegexOnExampleSetup) {
+  CompareFileWithRegex("../../../distribution/example_setup.txt");
+}
+
+TEST(LittleGiant, ScannersMatchRegexOnEdgeCases) {
+  const char* const kLines[] = {
+    "", "\n", "+", "+\n", "+ 01 CC    000 000\n", "+ 01 CC    000 000",
+    "+ 01 CC 000 000\r\n", "+ 01 CC 000 000 x\n", "+ 01 CC 000 000x\n",
+    "+01 CC 000 000\n", "+ 01 CC 000\n", "+\t01\tCC\t7\t12\n",
+    "+ 01 PC    127    \n", "+ 01 PC 5\r\n", "+ 01 PC 5 \r \n",
+    "+ 01 PC\n", "+ 99999 PC 99999999\n", "+ 01 CC 034 000\n\n",
+    "* PATCH : PATCH 001\n", "* PATCH : PATCH 001", "* PATCH: X\n",
+    "*PATCH : X\n", "* PATCH : \n", "* PATCH :  \n", "* PATCH : \t\n",
+    "* PATCH :\t \n", "* PATCH :\n \n", "* PATCH :\nName\n",
+    "* PATCH : Name!\n", "* PATCH : Name \n", "* STOMP_BOX : a_b 9\n",
+    "* PATCH : Name\r\n", "*  BANK  :   BANK 001  \n",
+    "switch 01 : PA PATCH 001\n", "switch 1:PA x\n", "switch 01 : SB x\n",
+    "switch 01 : PA  \n", "switch 01 : PA \n", "switch 01 : PA\t\n",
+    "switch  01 : PA x\n", "switch 01 : PAx\n", "switch 01 :\tPA\tx y\n",
+    "DEFAULTPRESET PATCH 001\n", "DEFAULTPRESET\n", "DEFAULTPRESET  \n",
+    "DEFAULTPRESETX\n", "DEFAULTPRESET a-b\n",
+  };
+  for (size_t i = 0; i < arraysize(kLines); ++i)
+    CompareWithRegex(kLines[i]);
+}
+
+TEST(LittleGiant, LineArena) {
+  LineArena arena;
+  std::string text("* PATCH : Name\n");
+  Line copy(arena.Copy(text));
+  EXPECT_NE(text.data(), copy.data());
+  EXPECT_EQ(Line(text), copy);
+
+  Line replaced(arena.Replace(copy, 10, 4, "Longer name"));
+  EXPECT_EQ("* PATCH : Longer name\n", replaced.str());
+  EXPECT_EQ(text, copy.str());
+
+  EXPECT_EQ("* PATCH\n", arena.CopyWithNewline(copy, 7).str());
+  EXPECT_EQ("\n", arena.CopyWithNewline(Line(), 0).str());
+
+  // Lines that don't fit in a block and the ones after them.
+  std::string long_line(100000, 'x');
+  Line long_copy(arena.Copy(long_line));
+  Line after(arena.Copy(text));
+  EXPECT_EQ(long_line, long_copy.str());
+  EXPECT_EQ(text, after.str());
+  EXPECT_EQ("* PATCH : Longer name\n", replaced.str());
+}
+
+// Receives the buffered output in chunks instead of line by line.
+class ChunkCallback : public MockCallback {
+ public:
+  ChunkCallback() : writes_(0) {}
+  virtual ~ChunkCallback() {}
+
+  virtual void Write(const char* data, size_t length) {
+    output_.append(data, length);
+    ++writes_;
+  }
+
+  std::string output_;
+  int writes_;
+};
+
+TEST(LittleGiant, BufferedOutputMatchesLines) {
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("lg2/input.txt", &buffer,
+                                     &file_size));
+  const char* begin = reinterpret_cast<const char*>(buffer.get());
+
+  MockCallback lines;
+  LgParser line_parser;
+  ASSERT_TRUE(line_parser.ParseBuffer(&lines, begin, begin + file_size));
+  std::string expected;
+  for (const auto& line : lines.lines_) {
+    // The per-line adapter hands out one complete line per call.
+    ASSERT_FALSE(line.empty());
+    EXPECT_EQ('\n', line.back());
+    EXPECT_EQ(line.length() - 1, line.find('\n'));
+    expected += line;
+  }
+
+  ChunkCallback chunks;
+  LgParser chunk_parser;
+  ASSERT_TRUE(chunk_parser.ParseBuffer(&chunks, begin, begin + file_size));
+  EXPECT_TRUE(chunks.lines_.empty());
+  EXPECT_EQ(expected, chunks.output_);
+  // Chunks end on a line boundary, so they're not always completely full.
+  EXPECT_LT(0, chunks.writes_);
+  EXPECT_LE(static_cast<size_t>(chunks.writes_),
+            expected.length() / (OutputBuffer::kDefaultCapacity / 2) + 1);
+}
+
+TEST(LittleGiant, OutputBuffer) {
+  ChunkCallback callback;
+  {
+    OutputBuffer output(&callback, 16);
+    output.Append("first line\n");
+    EXPECT_EQ(0, callback.writes_);
+    // Doesn't fit, so the first line is flushed on its own.
+    output.Append("second\n");
+    EXPECT_EQ(1, callback.writes_);
+    EXPECT_EQ("first line\n", callback.output_);
+    output.Append(std::string(40, 'x') + "\n");
+    // Longer than the buffer, so it's passed straight through.
+    EXPECT_EQ(3, callback.writes_);
+    output.Append("last\n");
+  }
+  EXPECT_EQ(4, callback.writes_);
+  EXPECT_EQ("first line\nsecond\n" + std::string(40, 'x') + "\nlast\n",
+            callback.output_);
+}
+
+// Only updates patches for presets that have changed according to |state_|.
+class IncrementalCallback : public MockCallback {
+ public:
+  explicit IncrementalCallback(const SetupState* state) : state_(state) {}
+  virtual ~IncrementalCallback() {}
+
+  virtual bool ShouldUpdatePatch(const axefx::Preset& preset) {
+    return state_->HasChanged(preset);
+  }
+
+  std::string Output() const {
+    std::string output;
+    for (const auto& line : lines_)
+      output += line;
+    return output;
+  }
+
+  const SetupState* state_;
+};
+
+void AddPreset(int id, const std::string& name, axefx::PresetMap* presets) {
+  shared_ptr<axefx::Preset> preset(new axefx::Preset());
+  preset->set_id(id);
+  preset->set_name(name);
+  (*presets)[id] = preset;
+}
+
+TEST(LittleGiant, IncrementalUpdate) {
+  // Generate a setup from scratch, the way the first run would.
+  SetupState empty;
+  IncrementalCallback first(&empty);
+  for (int i = 0; i < 8; ++i)
+    AddPreset(i + 256, "Preset " + std::to_string(i), &first.map_);
+  std::string setup(CreateSyntheticSetup(8));
+  {
+    LgParser parser;
+    ASSERT_TRUE(parser.ParseBuffer(&first, setup.c_str(),
+                                   setup.c_str() + setup.length()));
+  }
+  std::string generated(first.Output());
+  EXPECT_NE(std::string::npos, generated.find("Preset 2\n"));
+
+  SetupState state;
+  for (const auto& p : first.map_)
+    state.Update(*p.second.get());
+
+  // Nothing has changed, so the setup is written back as is.
+  IncrementalCallback unchanged(&state);
+  unchanged.map_ = first.map_;
+  {
+    LgParser parser;
+    ASSERT_TRUE(parser.ParseBuffer(&unchanged, generated.c_str(),
+                                   generated.c_str() + generated.length()));
+  }
+  EXPECT_EQ(generated, unchanged.Output());
+
+  // Only the lines that refer to the renamed preset change.
+  IncrementalCallback renamed(&state);
+  renamed.map_ = first.map_;
+  AddPreset(258, "Changed", &renamed.map_);
+  EXPECT_TRUE(state.HasChanged(*renamed.map_[258].get()));
+  EXPECT_FALSE(state.HasChanged(*renamed.map_[259].get()));
+  {
+    LgParser parser;
+    ASSERT_TRUE(parser.ParseBuffer(&renamed, generated.c_str(),
+                                   generated.c_str() + generated.length()));
+  }
+  std::istringstream before(generated);
+  std::istringstream after(renamed.Output());
+  std::string old_line, new_line;
+  int changed = 0;
+  while (std::getline(before, old_line)) {
+    ASSERT_TRUE(std::getline(after, new_line));
+    if (old_line != new_line) {
+      EXPECT_NE(std::string::npos, old_line.find("Preset 2")) << old_line;
+      EXPECT_NE(std::string::npos, new_line.find("Changed")) << new_line;
+      ++changed;
+    }
+  }
+  EXPECT_FALSE(std::getline(after, new_line));
+  // The patch itself and its slot in the bank.
+  EXPECT_EQ(2, changed);
+}
+
+TEST(LittleGiant, SetupState) {
+  axefx::PresetMap presets;
+  AddPreset(0, "Clean", &presets);
+  AddPreset(100, "Lead with spaces ", &presets);
+
+  SetupState state;
+  for (const auto& p : presets)
+    EXPECT_TRUE(state.HasChanged(*p.second.get()));
+  for (const auto& p : presets)
+    state.Update(*p.second.get());
+  for (const auto& p : presets)
+    EXPECT_FALSE(state.HasChanged(*p.second.get()));
+
+  const char kPath[] = "lg_setup_state_test.txt";
+  ASSERT_TRUE(state.Save(kPath));
+  SetupState loaded;
+  EXPECT_TRUE(loaded.Load(kPath));
+  std::remove(kPath);
+  EXPECT_EQ(2u, loaded.size());
+  for (const auto& p : presets)
+    EXPECT_FALSE(loaded.HasChanged(*p.second.get()));
+
+  AddPreset(0, "Crunch", &presets);
+  EXPECT_TRUE(loaded.HasChanged(*presets[0].get()));
+  EXPECT_NE(SetupState::PresetChecksum(*presets[0].get()),
+            SetupState::PresetChecksum(*presets[100].get()));
+
+  // Renaming a preset without touching its data changes the checksum, even
+  // when the names only differ in trailing spaces.
+  axefx::PresetMap renamed;
+  AddPreset(100, "Lead with spaces", &renamed);
+  EXPECT_NE(SetupState::PresetChecksum(*presets[100].get()),
+            SetupState::PresetChecksum(*renamed[100].get()));
+  EXPECT_TRUE(loaded.HasChanged(*renamed[100].get()));
+  AddPreset(100, "Lead with spaces ", &renamed);
+  EXPECT_FALSE(loaded.HasChanged(*renamed[100].get()));
+
+  // A missing state file means that everything has changed.
+  EXPECT_TRUE(loaded.Load(kPath));
+  EXPECT_EQ(0u, loaded.size());
+}
+
 TEST(LittleGiant, UniqueName) {
   ReservedNames reserved;
   std::string name("MyName");
@@ -57,4 +519,24 @@ TEST(LittleGiant, UniqueName) {
   EXPECT_NE(reserved.find("myreallylongn128"), reserved.end());
 }
 
+TEST(LittleGiant, UniqueNamesScaleLinearly) {
+  // With a shared counter, each name takes one lookup in |reserved| no
+  // matter how many names have been generated before it.
+  ReservedNames reserved;
+  std::string name("New");
+  reserved.insert(name);
+  size_t counter = 0u;
+  for (size_t i = 1u; i <= 1000u; ++i) {
+    std::string unique(GenerateUniqueName(reserved, name, &counter));
+    EXPECT_EQ(i, counter);
+    EXPECT_TRUE(reserved.insert(unique).second) << unique;
+  }
+
+  // Suffixes that are taken are skipped.
+  reserved.insert("New1002");
+  EXPECT_EQ("New1001", GenerateUniqueName(reserved, name, &counter));
+  EXPECT_EQ("New1003", GenerateUniqueName(reserved, name, &counter));
+  EXPECT_EQ(1003u, counter);
+}
+
 }  // namespace lg
@@ -8,10 +8,29 @@
 #include "axefx/axe_fx_sysex_parser.h"
 #include "axefx/preset.h"
 #include "axefx/sysex_types.h"
+#include "midi/message_pool.h"
+#include "midi/midi_capture.h"
+#include "midi/message_sender.h"
 #include "midi/midi_in.h"
 #include "midi/midi_out.h"
+#include "midi/midi_stats.h"
+#include "midi/simulated_axefx.h"
+#include "midi/sysex_filter.h"
 #include "test_utils.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <thread>
+
+#if defined(OS_LINUX)
+#include "midi/midi_linux.h"
+
+#include <unistd.h>
+#endif
+
 using base::ThreadLoop;
 using base::SharedThreadLoop;
 
@@ -26,6 +45,25 @@ bool IsTempoOrTuner(Message* msg) {
          msg->IsFractalMessageType(axefx::TUNER_DATA);
 }
 
+TEST(DeviceInfos, Find) {
+  DeviceInfos devices;
+  devices.push_back(
+      shared_ptr<MidiDeviceInfo>(new MidiDeviceInfo(0, "USB MIDI Cable")));
+  devices.push_back(
+      shared_ptr<MidiDeviceInfo>(new MidiDeviceInfo(1, "AXE-FX II")));
+  devices.push_back(
+      shared_ptr<MidiDeviceInfo>(new MidiDeviceInfo(2, "AXE-FX II #2")));
+
+  EXPECT_EQ(devices.begin() + 1, devices.FindAxeFx());
+  EXPECT_EQ(devices.begin() + 1, devices.Find("axe-fx"));
+  EXPECT_EQ(devices.begin() + 2, devices.Find("#2"));
+  EXPECT_EQ(devices.begin() + 2, devices.Find("2"));
+  EXPECT_EQ(devices.begin(), devices.Find("0"));
+  EXPECT_EQ(devices.end(), devices.Find("3"));
+  EXPECT_EQ(devices.end(), devices.Find("Axe-Fx III"));
+  EXPECT_EQ(devices.end(), devices.Find(""));
+}
+
 TEST(MidiOut, EnumerateDevices) {
   DeviceInfos devices;
   EXPECT_TRUE(MidiOut::EnumerateDevices(&devices));
@@ -411,4 +449,890 @@ TEST(SysExDataBuffer, Basic) {
   }
 }
 
+namespace {
+void AppendFrame(std::vector<uint8_t>* stream, const uint8_t* frame,
+                 size_t size) {
+  stream->insert(stream->end(), frame, frame + size);
+}
+
+void AppendTo(std::vector<uint8_t>* out, const uint8_t* data, size_t size) {
+  out->insert(out->end(), data, data + size);
+}
+
+void AppendMessage(std::vector<uint8_t>* out, Message* msg) {
+  out->insert(out->end(), msg->begin(), msg->end());
+}
+
+// Runs |stream| through a filter in two chunks split at every offset and
+// checks that the output is always |expected|.
+void ExpectFiltered(const std::vector<uint8_t>& stream,
+                    const FunctionSet& functions,
+                    const std::vector<uint8_t>& expected) {
+  for (size_t split = 0; split <= stream.size(); ++split) {
+    SysExFilter filter;
+    std::vector<uint8_t> out;
+    SysExFilter::Output output(std::bind(&AppendTo, &out, _1, _2));
+    filter.Filter(&stream[0], split, functions, output);
+    filter.Filter(&stream[0] + split, stream.size() - split, functions,
+                  output);
+    EXPECT_EQ(expected, out) << "split at " << split;
+  }
+}
+
+const uint8_t kTunerFrame[] = { 0xF0, 0x00, 0x01, 0x74, 0x03, 0x0D, 0x01,
+                                0x02, 0xF7 };
+const uint8_t kTempoFrame[] = { 0xF0, 0x00, 0x01, 0x74, 0x03, 0x10, 0xF7 };
+const uint8_t kNameFrame[] = { 0xF0, 0x00, 0x01, 0x74, 0x03, 0x0F, 0x41,
+                               0x42, 0x43, 0x00, 0xF7 };
+const uint8_t kShortFrame[] = { 0xF0, 0x00, 0x01, 0xF7 };
+const uint8_t kOtherFrame[] = { 0xF0, 0x43, 0x10, 0x4C, 0x00, 0x00, 0x7E,
+                                0x00, 0xF7 };
+}  // namespace
+
+TEST(SysExFilter, DropsUnwantedFrames) {
+  std::vector<uint8_t> stream;
+  stream.push_back(0x01);  // Not part of a frame.
+  AppendFrame(&stream, kTunerFrame, sizeof(kTunerFrame));
+  AppendFrame(&stream, kNameFrame, sizeof(kNameFrame));
+  AppendFrame(&stream, kTempoFrame, sizeof(kTempoFrame));
+  AppendFrame(&stream, kShortFrame, sizeof(kShortFrame));
+  AppendFrame(&stream, kOtherFrame, sizeof(kOtherFrame));
+  AppendFrame(&stream, kTunerFrame, sizeof(kTunerFrame));
+  // A frame that's cut off by the next one.
+  AppendFrame(&stream, kTempoFrame, 4);
+  AppendFrame(&stream, kNameFrame, sizeof(kNameFrame));
+
+  std::vector<uint8_t> expected;
+  expected.push_back(0x01);
+  AppendFrame(&expected, kNameFrame, sizeof(kNameFrame));
+  AppendFrame(&expected, kShortFrame, sizeof(kShortFrame));
+  AppendFrame(&expected, kOtherFrame, sizeof(kOtherFrame));
+  AppendFrame(&expected, kTempoFrame, 4);
+  AppendFrame(&expected, kNameFrame, sizeof(kNameFrame));
+  ExpectFiltered(stream, FunctionSet({ axefx::PRESET_NAME }, true),
+                 expected);
+
+  expected.clear();
+  expected.push_back(0x01);
+  AppendFrame(&expected, kNameFrame, sizeof(kNameFrame));
+  AppendFrame(&expected, kTempoFrame, sizeof(kTempoFrame));
+  AppendFrame(&expected, kNameFrame, sizeof(kNameFrame));
+  ExpectFiltered(stream,
+                 FunctionSet({ axefx::PRESET_NAME, axefx::TEMPO_HEARTBEAT },
+                             false),
+                 expected);
+
+  ExpectFiltered(stream, FunctionSet::All(), stream);
+}
+
+TEST(SysExDataBuffer, Subscribers) {
+  shared_ptr<MockMidiIn> midi_in(new MockMidiIn());
+  std::vector<uint8_t> names, tempo, other;
+  SysExDataBuffer buffer;
+  buffer.Subscribe(FunctionSet({ axefx::PRESET_NAME }, false),
+                   std::bind(&AppendMessage, &names, _1));
+  buffer.Subscribe(FunctionSet({ axefx::TEMPO_HEARTBEAT }, true),
+                   std::bind(&AppendMessage, &tempo, _1));
+  buffer.Subscribe(FunctionSet({}, true),
+                   std::bind(&AppendMessage, &other, _1));
+  EXPECT_FALSE(buffer.functions().all());
+  EXPECT_FALSE(buffer.functions().Contains(axefx::TUNER_DATA));
+  buffer.Attach(midi_in);
+
+  midi_in->ReportBytes(kTunerFrame, sizeof(kTunerFrame));
+  midi_in->ReportBytes(kNameFrame, sizeof(kNameFrame));
+  midi_in->ReportBytes(kTempoFrame, sizeof(kTempoFrame));
+  midi_in->ReportBytes(kOtherFrame, sizeof(kOtherFrame));
+
+  EXPECT_EQ(std::vector<uint8_t>(kNameFrame,
+                                 kNameFrame + sizeof(kNameFrame)), names);
+  std::vector<uint8_t> expected(kTempoFrame,
+                                kTempoFrame + sizeof(kTempoFrame));
+  AppendFrame(&expected, kOtherFrame, sizeof(kOtherFrame));
+  EXPECT_EQ(expected, tempo);
+  // Every subscriber sees the frame unless one swaps it out.
+  EXPECT_EQ(std::vector<uint8_t>(kOtherFrame,
+                                 kOtherFrame + sizeof(kOtherFrame)), other);
+}
+
+namespace {
+// The simulator sends replies back to back, so messages are collected as
+// they arrive instead of via AssignToBufferAndQuit.  Since tempo messages
+// keep the loop from timing out, give up after a number of them.
+void AppendUntilTempo(Message* msg, std::vector<uint8_t>* received,
+                      int* tempo_count, const SharedThreadLoop& loop) {
+  if (IsTempoOrTuner(msg)) {
+    if (!received->empty() || ++(*tempo_count) == 50)
+      loop->Quit();
+  } else {
+    received->insert(received->end(), msg->begin(), msg->end());
+  }
+}
+
+// Sends |message| and returns everything other than tempo and tuner
+// messages that comes back, up until the next tempo message.
+std::vector<uint8_t> SendAndReceive(const shared_ptr<MidiIn>& midi_in,
+                                    MidiOut* midi_out,
+                                    const SharedThreadLoop& loop,
+                                    unique_ptr<Message> message) {
+  loop->set_timeout(std::chrono::milliseconds(2000));
+  std::vector<uint8_t> received;
+  int tempo_count = 0;
+  SysExDataBuffer buffer(
+      std::bind(&AppendUntilTempo, _1, &received, &tempo_count, loop));
+  ScopedBufferAttach attach(midi_in, &buffer);
+  EXPECT_TRUE(midi_out->Send(std::move(message), nullptr));
+  EXPECT_TRUE(loop->Run());
+
+  return received;
+}
+
+std::vector<uint8_t> SendToSimulator(SimulatedAxeFx* axefx,
+                                     unique_ptr<Message> message) {
+  SharedThreadLoop loop(new ThreadLoop());
+  shared_ptr<MidiIn> midi_in(axefx->OpenMidiIn(loop));
+  unique_ptr<MidiOut> midi_out(axefx->OpenMidiOut());
+  return SendAndReceive(midi_in, midi_out.get(), loop, std::move(message));
+}
+
+SimulatedAxeFx::Options FastOptions() {
+  SimulatedAxeFx::Options options;
+  options.bytes_per_second = 0u;
+  options.latency = std::chrono::microseconds(0);
+  options.tempo_interval = std::chrono::milliseconds(20);
+  return options;
+}
+}  // namespace
+
+TEST(SimulatedAxeFx, BankDump) {
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/9b_A.syx", &buffer, &file_size));
+
+  SimulatedAxeFx axefx(FastOptions());
+  ASSERT_TRUE(axefx.LoadPresets(buffer.get(), buffer.get() + file_size));
+
+  axefx::BankDumpRequest request(axefx::BankDumpRequest::BANK_A);
+  std::vector<uint8_t> received(SendToSimulator(&axefx,
+      unique_ptr<Message>(new Message(&request, sizeof(request)))));
+
+  ASSERT_EQ(static_cast<size_t>(file_size), received.size());
+  EXPECT_EQ(0, memcmp(buffer.get(), &received[0], file_size));
+  EXPECT_GE(axefx.bytes_sent(), received.size());
+}
+
+TEST(SimulatedAxeFx, BankDumpFillsInMissingPresets) {
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/one_amp.syx", &buffer,
+                                     &file_size));
+
+  SimulatedAxeFx axefx(FastOptions());
+  ASSERT_TRUE(axefx.LoadPresets(buffer.get(), buffer.get() + file_size));
+
+  axefx::BankDumpRequest request(axefx::BankDumpRequest::BANK_B);
+  std::vector<uint8_t> received(SendToSimulator(&axefx,
+      unique_ptr<Message>(new Message(&request, sizeof(request)))));
+  ASSERT_FALSE(received.empty());
+
+  axefx::SysExParser parser;
+  ASSERT_TRUE(parser.ParseSysExBuffer(&received[0],
+                                      &received[0] + received.size(), false));
+  ASSERT_EQ(128u, parser.presets().size());
+  EXPECT_EQ(128, parser.presets().begin()->first);
+  EXPECT_EQ(255, parser.presets().rbegin()->first);
+}
+
+TEST(SimulatedAxeFx, Requests) {
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/9b_A.syx", &buffer, &file_size));
+
+  SimulatedAxeFx axefx(FastOptions());
+  ASSERT_TRUE(axefx.LoadPresets(buffer.get(), buffer.get() + file_size));
+
+  axefx::GenericNoDataMessage fw_update(axefx::FIRMWARE_UPDATE);
+  std::vector<uint8_t> received(SendToSimulator(&axefx,
+      unique_ptr<Message>(new Message(&fw_update, sizeof(fw_update)))));
+  ASSERT_TRUE(axefx::IsFractalSysEx(&received[0], received.size()));
+  auto reply = reinterpret_cast<const axefx::ReplyMessage*>(&received[0]);
+  EXPECT_EQ(axefx::REPLY, reply->function());
+  EXPECT_EQ(axefx::FIRMWARE_UPDATE, reply->reply_to());
+  EXPECT_EQ(0u, reply->error_id);
+
+  // Selects preset 2.
+  received = SendToSimulator(&axefx,
+      unique_ptr<Message>(new ProgramChange(0, 0, 2)));
+  ASSERT_TRUE(axefx::IsFractalSysEx(&received[0], received.size()));
+  auto p = reinterpret_cast<const axefx::FractalSysExHeader*>(&received[0]);
+  ASSERT_EQ(axefx::PRESET_CHANGE, p->function());
+  EXPECT_EQ(2u, reinterpret_cast<const axefx::SeptetPair*>(p + 1)->As16bit());
+
+  axefx::GenericNoDataMessage name_request(axefx::PRESET_NAME);
+  received = SendToSimulator(&axefx,
+      unique_ptr<Message>(new Message(&name_request, sizeof(name_request))));
+  ASSERT_TRUE(axefx::IsFractalSysEx(&received[0], received.size()));
+  p = reinterpret_cast<const axefx::FractalSysExHeader*>(&received[0]);
+  ASSERT_EQ(axefx::PRESET_NAME, p->function());
+  std::string name(reinterpret_cast<const char*>(p + 1),
+                   reinterpret_cast<const char*>(&received.back() - 1));
+
+  axefx::PresetDumpRequest dump_request;
+  received = SendToSimulator(&axefx,
+      unique_ptr<Message>(new Message(&dump_request, sizeof(dump_request))));
+  axefx::SysExParser parser;
+  ASSERT_FALSE(received.empty());
+  ASSERT_TRUE(parser.ParseSysExBuffer(&received[0],
+                                      &received[0] + received.size(), true));
+  ASSERT_EQ(1u, parser.presets().size());
+  const axefx::Preset& preset = *parser.presets().begin()->second;
+  EXPECT_TRUE(preset.from_edit_buffer());
+  EXPECT_EQ(name, preset.name());
+}
+
+TEST(SimulatedAxeFx, ReceivePreset) {
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/one_amp.syx", &buffer,
+                                     &file_size));
+  axefx::SysExParser parser;
+  ASSERT_TRUE(parser.ParseSysExBuffer(buffer.get(), buffer.get() + file_size,
+                                      false));
+  ASSERT_EQ(1u, parser.presets().size());
+  int id = parser.presets().begin()->first;
+
+  SimulatedAxeFx axefx(FastOptions());
+  SharedThreadLoop loop(new ThreadLoop());
+  loop->set_timeout(std::chrono::milliseconds(2000));
+  unique_ptr<MidiOut> midi_out(axefx.OpenMidiOut());
+  std::vector<unique_ptr<Message> > messages;
+  parser.Serialize([&messages](const std::vector<uint8_t>& data) {
+    messages.push_back(unique_ptr<Message>(
+        new Message(static_cast<const Message&>(data))));
+  });
+  ASSERT_FALSE(messages.empty());
+  std::function<void()> quit(std::bind(&ThreadLoop::Quit, loop));
+  for (size_t i = 0; i < messages.size(); ++i) {
+    EXPECT_TRUE(midi_out->Send(std::move(messages[i]),
+                               i == messages.size() - 1 ? quit : nullptr));
+  }
+  EXPECT_TRUE(loop->Run());
+
+  EXPECT_EQ(1u, axefx.presets_received());
+  std::vector<uint8_t> stored(axefx.GetPresetData(id));
+  ASSERT_EQ(static_cast<size_t>(file_size), stored.size());
+  EXPECT_EQ(0, memcmp(buffer.get(), &stored[0], file_size));
+}
+
+TEST(SimulatedAxeFx, Bandwidth) {
+  SimulatedAxeFx::Options options;
+  options.bytes_per_second = 20000;
+  SimulatedAxeFx axefx(options);
+  unique_ptr<MidiOut> midi_out(axefx.OpenMidiOut());
+
+  // 2000 bytes at 20000 bytes per second take 100ms to transfer.
+  unique_ptr<Message> message(new Message());
+  message->assign(2000, 0);
+  message->front() = axefx::kSysExStart;
+  message->back() = axefx::kSysExEnd;
+
+  SharedThreadLoop loop(new ThreadLoop());
+  loop->set_timeout(std::chrono::milliseconds(2000));
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(midi_out->Send(std::move(message),
+                             std::bind(&ThreadLoop::Quit, loop)));
+  EXPECT_TRUE(loop->Run());
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_GE(elapsed, std::chrono::milliseconds(100));
+  EXPECT_EQ(2000u, axefx.bytes_received());
+}
+
+TEST(SimulatedAxeFx, DroppedBytes) {
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/9b_A.syx", &buffer, &file_size));
+
+  SimulatedAxeFx::Options options(FastOptions());
+  options.drop_rate = 0.0001;
+  SimulatedAxeFx axefx(options);
+  ASSERT_TRUE(axefx.LoadPresets(buffer.get(), buffer.get() + file_size));
+
+  axefx::BankDumpRequest request(axefx::BankDumpRequest::BANK_A);
+  std::vector<uint8_t> received(SendToSimulator(&axefx,
+      unique_ptr<Message>(new Message(&request, sizeof(request)))));
+
+  EXPECT_GT(axefx.bytes_dropped(), 0u);
+  EXPECT_LT(received.size(), static_cast<size_t>(file_size));
+}
+
+TEST(MidiIn, InputFilter) {
+  SimulatedAxeFx::Options options(FastOptions());
+  options.tempo_interval = std::chrono::milliseconds(10);
+  options.tuner_interval = std::chrono::milliseconds(1);
+  SimulatedAxeFx axefx(options);
+  SharedThreadLoop loop(new ThreadLoop());
+  shared_ptr<MidiIn> midi_in(axefx.OpenMidiIn(loop));
+  midi_in->set_input_filter(FunctionSet({ axefx::TEMPO_HEARTBEAT }, false));
+
+  const int kFrames = 10;
+  int frames = 0;
+  std::vector<uint8_t> received;
+  midi_in->set_ondataavailable([&](const uint8_t* data, size_t size) {
+    received.insert(received.end(), data, data + size);
+    frames += static_cast<int>(
+        std::count(data, data + size, axefx::kSysExEnd));
+    if (frames >= kFrames)
+      loop->Quit();
+  });
+  loop->set_timeout(std::chrono::milliseconds(2000));
+  EXPECT_TRUE(loop->Run());
+  midi_in->set_ondataavailable(nullptr);
+
+  // Only tempo messages got through, even though tuner data was sent ten
+  // times as often.
+  size_t begin = 0u;
+  for (size_t i = 0; i < received.size(); ++i) {
+    if (received[i] != axefx::kSysExEnd)
+      continue;
+    EXPECT_TRUE(axefx::IsFractalSysEx(&received[begin], i + 1 - begin));
+    EXPECT_EQ(axefx::TEMPO_HEARTBEAT, received[begin + 5]);
+    begin = i + 1;
+  }
+}
+
+TEST(MidiStats, BankDump) {
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/9b_A.syx", &buffer, &file_size));
+  SimulatedAxeFx axefx(FastOptions());
+  ASSERT_TRUE(axefx.LoadPresets(buffer.get(), buffer.get() + file_size));
+
+  MidiStats stats;
+  SharedThreadLoop loop(new ThreadLoop());
+  stats.RecordLoop(loop.get());
+  shared_ptr<MidiIn> midi_in(axefx.OpenMidiIn(loop));
+  stats.RecordMidiIn(midi_in.get());
+  unique_ptr<MidiOut> midi_out(stats.RecordMidiOut(axefx.OpenMidiOut()));
+
+  axefx::BankDumpRequest request(axefx::BankDumpRequest::BANK_A);
+  std::vector<uint8_t> received(SendAndReceive(midi_in, midi_out.get(), loop,
+      unique_ptr<Message>(new Message(&request, sizeof(request)))));
+  loop->set_queue_delay(nullptr);
+  ASSERT_EQ(static_cast<size_t>(file_size), received.size());
+
+  EXPECT_EQ(sizeof(request), stats.bytes_sent());
+  EXPECT_GE(stats.bytes_received(), received.size());
+  EXPECT_GT(stats.receive_rate(), 0.0);
+  EXPECT_EQ(1u, stats.send_time(axefx::BANK_DUMP_REQUEST).count());
+  EXPECT_EQ(1u, stats.round_trip(axefx::BANK_DUMP_REQUEST).count());
+  EXPECT_EQ(128u, stats.input_delay(axefx::PRESET_ID).count());
+  EXPECT_EQ(128u, stats.input_delay(axefx::PRESET_CHECKSUM).count());
+  EXPECT_GT(stats.input_delay(axefx::TEMPO_HEARTBEAT).count(), 0u);
+  EXPECT_GT(stats.queue_delay().count(), 0u);
+
+  std::ostringstream out;
+  stats.Print(&out);
+  EXPECT_NE(std::string::npos, out.str().find("BANK_DUMP_REQUEST"));
+}
+
+TEST(MessagePool, Recycles) {
+  MessagePool* pool = MessagePool::Get();
+  axefx::BankDumpRequest request(axefx::BankDumpRequest::BANK_A);
+  unique_ptr<Message> message(pool->New(&request, sizeof(request)));
+  EXPECT_EQ(sizeof(request), message->size());
+  EXPECT_EQ(0, memcmp(&request, &message->at(0), sizeof(request)));
+  unique_ptr<Message> frame(pool->New(kSmallMessageSize + 1));
+  EXPECT_GE(frame->capacity(), kMaxFrameSize);
+  const Message* small = message.get();
+  const Message* frame_ptr = frame.get();
+  pool->Recycle(std::move(message));
+  pool->Recycle(std::move(frame));
+
+  size_t allocations = pool->allocations();
+  message = pool->New(kSmallMessageSize);
+  EXPECT_EQ(small, message.get());
+  EXPECT_TRUE(message->empty());
+  frame = pool->New(kMaxFrameSize);
+  EXPECT_EQ(frame_ptr, frame.get());
+  EXPECT_EQ(allocations, pool->allocations());
+
+  // Messages that don't fit in a frame aren't pooled.
+  unique_ptr<Message> large(pool->New(kMaxFrameSize + 1));
+  EXPECT_EQ(allocations, pool->allocations());
+  large->resize(kMaxFrameSize + 1);
+  pool->Recycle(std::move(large));
+
+  // Messages are returned to the pool when the send completes.
+  SimulatedAxeFx axefx(FastOptions());
+  unique_ptr<MidiOut> midi_out(axefx.OpenMidiOut());
+  const Message* sent = frame.get();
+  pool->Recycle(std::move(message));
+  SharedThreadLoop loop(new ThreadLoop());
+  frame->assign(reinterpret_cast<const uint8_t*>(&request),
+                reinterpret_cast<const uint8_t*>(&request) + sizeof(request));
+  ASSERT_TRUE(midi_out->Send(std::move(frame),
+                             std::bind(&ThreadLoop::Quit, loop)));
+  loop->Run();
+  frame = pool->New(kMaxFrameSize);
+  EXPECT_EQ(sent, frame.get());
+  EXPECT_EQ(allocations, pool->allocations());
+}
+
+TEST(MidiCapture, SaveAndLoad) {
+  MidiCapture capture;
+  const uint8_t request[] = { 0xF0, 1, 2, 0xF7 };
+  const uint8_t reply[] = { 0xF0, 3 };
+  capture.Record(MidiCapture::TO_UNIT, request, sizeof(request));
+  capture.Record(MidiCapture::FROM_UNIT, reply, sizeof(reply));
+
+  const char kPath[] = "midi_capture_test.bin";
+  ASSERT_TRUE(capture.Save(kPath));
+  MidiCapture loaded;
+  EXPECT_TRUE(loaded.Load(kPath));
+  std::remove(kPath);
+
+  ASSERT_EQ(2u, loaded.chunks().size());
+  for (size_t i = 0; i < loaded.chunks().size(); ++i) {
+    const MidiCapture::Chunk& expected = capture.chunks()[i];
+    const MidiCapture::Chunk& chunk = loaded.chunks()[i];
+    EXPECT_EQ(expected.direction, chunk.direction);
+    EXPECT_EQ(expected.time.count(), chunk.time.count());
+    EXPECT_EQ(expected.data, chunk.data);
+  }
+  EXPECT_LE(loaded.chunks()[0].time, loaded.chunks()[1].time);
+
+  // Truncated files are rejected.
+  const uint8_t kTruncated[] = { 'a', 'f', 'x', '2', 'l', 'g', 'M', 'C', 1 };
+  EXPECT_FALSE(loaded.Load(kTruncated, kTruncated + sizeof(kTruncated)));
+}
+
+TEST(MidiCapture, RecordAndReplay) {
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/9b_A.syx", &buffer, &file_size));
+  SimulatedAxeFx axefx(FastOptions());
+  ASSERT_TRUE(axefx.LoadPresets(buffer.get(), buffer.get() + file_size));
+
+  axefx::BankDumpRequest request(axefx::BankDumpRequest::BANK_A);
+  MidiCapture capture;
+  std::vector<uint8_t> recorded;
+  {
+    SharedThreadLoop loop(new ThreadLoop());
+    shared_ptr<MidiIn> midi_in(axefx.OpenMidiIn(loop));
+    capture.RecordMidiIn(midi_in.get());
+    unique_ptr<MidiOut> midi_out(capture.RecordMidiOut(axefx.OpenMidiOut()));
+    recorded = SendAndReceive(midi_in, midi_out.get(), loop,
+        unique_ptr<Message>(new Message(&request, sizeof(request))));
+  }
+  ASSERT_EQ(static_cast<size_t>(file_size), recorded.size());
+
+  size_t sent = 0u;
+  for (const auto& chunk : capture.chunks()) {
+    if (chunk.direction == MidiCapture::TO_UNIT)
+      ++sent;
+  }
+  EXPECT_EQ(1u, sent);
+
+  // Going through the same steps against the replayer gets the same data.
+  MidiReplayer replayer(capture, MidiReplayer::FULL_SPEED);
+  SharedThreadLoop loop(new ThreadLoop());
+  shared_ptr<MidiIn> midi_in(replayer.OpenMidiIn(loop));
+  unique_ptr<MidiOut> midi_out(replayer.OpenMidiOut());
+  std::vector<uint8_t> replayed(SendAndReceive(midi_in, midi_out.get(), loop,
+      unique_ptr<Message>(new Message(&request, sizeof(request)))));
+  EXPECT_EQ(recorded, replayed);
+  EXPECT_EQ(0u, replayer.mismatches());
+
+  // Anything else is reported as a mismatch.
+  axefx::BankDumpRequest other(axefx::BankDumpRequest::BANK_B);
+  EXPECT_TRUE(midi_out->Send(
+      unique_ptr<Message>(new Message(&other, sizeof(other))), nullptr));
+  EXPECT_EQ(1u, replayer.mismatches());
+}
+
+TEST(MidiCapture, ReplayAtOriginalPace) {
+  MidiCapture capture;
+  const uint8_t request[] = { 0xF0, 1, 2, 0xF7 };
+  const uint8_t reply[] = { 0xF0, 3, 0xF7 };
+  capture.Record(MidiCapture::TO_UNIT, request, sizeof(request));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  capture.Record(MidiCapture::FROM_UNIT, reply, sizeof(reply));
+
+  MidiReplayer replayer(capture, MidiReplayer::ORIGINAL_PACE);
+  SharedThreadLoop loop(new ThreadLoop());
+  shared_ptr<MidiIn> midi_in(replayer.OpenMidiIn(loop));
+  unique_ptr<MidiOut> midi_out(replayer.OpenMidiOut());
+  std::vector<uint8_t> received;
+  midi_in->set_ondataavailable([&](const uint8_t* data, size_t size) {
+    received.insert(received.end(), data, data + size);
+    loop->Quit();
+  });
+
+  // Nothing is played back until the request has been sent.
+  loop->set_timeout(std::chrono::milliseconds(100));
+  EXPECT_FALSE(loop->Run());
+  EXPECT_TRUE(received.empty());
+
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(midi_out->Send(
+      MessagePool::Get()->New(&request[0], sizeof(request)), nullptr));
+  loop->set_timeout(std::chrono::milliseconds(2000));
+  EXPECT_TRUE(loop->Run());
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(45));
+  EXPECT_EQ(std::vector<uint8_t>(reply, reply + sizeof(reply)), received);
+  midi_in->set_ondataavailable(nullptr);
+}
+
+namespace {
+void Increment(size_t* count) {
+  ++(*count);
+}
+
+// Serializes bank A to |sender| and runs |loop| until it's been sent.
+void SendBankA(MessageSender* sender, const SharedThreadLoop& loop) {
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/9b_A.syx", &buffer, &file_size));
+  axefx::SysExParser parser;
+  ASSERT_TRUE(parser.ParseSysExBuffer(buffer.get(), buffer.get() + file_size,
+                                      false));
+  ASSERT_TRUE(parser.Serialize(std::bind(&MessageSender::Add, sender, _1)));
+
+  size_t progress = 0;
+  sender->Start(std::bind(&Increment, &progress),
+                std::bind(&ThreadLoop::Quit, loop));
+  loop->set_timeout(std::chrono::seconds(20));
+  ASSERT_TRUE(loop->Run());
+  EXPECT_EQ(progress, sender->messages_sent());
+  EXPECT_EQ(static_cast<size_t>(
+                std::count(buffer.get(), buffer.get() + file_size,
+                           axefx::kSysExStart)),
+            sender->messages_sent());
+}
+}  // namespace
+
+TEST(MessageSender, WaitsForReplies) {
+  SimulatedAxeFx::Options options(FastOptions());
+  options.store_time = std::chrono::milliseconds(2);
+  SimulatedAxeFx axefx(options);
+
+  SharedThreadLoop loop(new ThreadLoop());
+  shared_ptr<MidiIn> midi_in(axefx.OpenMidiIn(loop));
+  unique_ptr<MidiOut> midi_out(axefx.OpenMidiOut());
+  MessageSender::Options sender_options;
+  sender_options.window = 8;
+  MessageSender sender(midi_out.get(), midi_in, loop, sender_options);
+  size_t allocations = MessagePool::Get()->allocations();
+  SendBankA(&sender, loop);
+
+  EXPECT_EQ(0u, sender.error_replies());
+  EXPECT_EQ(128u, axefx.presets_received());
+  // Thousands of frames have been sent, but only the ones that were in
+  // flight at the same time needed buffers of their own.
+  EXPECT_LE(MessagePool::Get()->allocations() - allocations,
+            sender_options.window + 1u);
+}
+
+TEST(MessageSender, SlowsDownOnErrors) {
+  SimulatedAxeFx::Options options(FastOptions());
+  options.store_time = std::chrono::milliseconds(2);
+  SimulatedAxeFx axefx(options);
+
+  SharedThreadLoop loop(new ThreadLoop());
+  shared_ptr<MidiIn> midi_in(axefx.OpenMidiIn(loop));
+  unique_ptr<MidiOut> midi_out(axefx.OpenMidiOut());
+  // Without waiting for replies, the unit gets overrun while it's storing.
+  MessageSender::Options sender_options;
+  sender_options.window = 8;
+  sender_options.wait_for_reply.clear();
+  MessageSender sender(midi_out.get(), midi_in, loop, sender_options);
+  SendBankA(&sender, loop);
+
+  EXPECT_GT(sender.error_replies(), 0u);
+  EXPECT_TRUE(sender.failed());
+  EXPECT_LT(axefx.presets_received(), 128u);
+}
+
+TEST(MessageSender, ResendsRejectedPresets) {
+  SimulatedAxeFx::Options options(FastOptions());
+  options.reject_presets = 3;
+  SimulatedAxeFx axefx(options);
+
+  SharedThreadLoop loop(new ThreadLoop());
+  shared_ptr<MidiIn> midi_in(axefx.OpenMidiIn(loop));
+  unique_ptr<MidiOut> midi_out(axefx.OpenMidiOut());
+  MessageSender sender(midi_out.get(), midi_in, loop,
+                       MessageSender::Options());
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/9b_A.syx", &buffer, &file_size));
+  std::vector<uint8_t> bank(buffer.get(), buffer.get() + file_size);
+  axefx::SysExParser parser;
+  ASSERT_TRUE(parser.ParseSysExBuffer(buffer.get(), buffer.get() + file_size,
+                                      false));
+  ASSERT_TRUE(parser.Serialize(std::bind(&MessageSender::Add, &sender, _1)));
+  sender.Start(nullptr, std::bind(&ThreadLoop::Quit, loop));
+  loop->set_timeout(std::chrono::seconds(20));
+  ASSERT_TRUE(loop->Run());
+
+  // The first preset is rejected three times and then stored.
+  EXPECT_EQ(3u, sender.error_replies());
+  EXPECT_EQ(3u, sender.retries());
+  EXPECT_FALSE(sender.failed());
+  EXPECT_EQ(128u, axefx.presets_received());
+  std::vector<uint8_t> first(axefx.GetPresetData(0));
+  ASSERT_FALSE(first.empty());
+  EXPECT_TRUE(std::equal(first.begin(), first.end(), bank.begin()));
+}
+
+TEST(MessageSender, GivesUpAfterRetries) {
+  SimulatedAxeFx::Options options(FastOptions());
+  options.reject_presets = 10;
+  SimulatedAxeFx axefx(options);
+
+  SharedThreadLoop loop(new ThreadLoop());
+  shared_ptr<MidiIn> midi_in(axefx.OpenMidiIn(loop));
+  unique_ptr<MidiOut> midi_out(axefx.OpenMidiOut());
+  MessageSender::Options sender_options;
+  sender_options.max_retries = 2;
+  MessageSender sender(midi_out.get(), midi_in, loop, sender_options);
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/9b_A.syx", &buffer, &file_size));
+  axefx::SysExParser parser;
+  ASSERT_TRUE(parser.ParseSysExBuffer(buffer.get(), buffer.get() + file_size,
+                                      false));
+  ASSERT_TRUE(parser.Serialize(std::bind(&MessageSender::Add, &sender, _1)));
+  sender.Start(nullptr, std::bind(&ThreadLoop::Quit, loop));
+  loop->set_timeout(std::chrono::seconds(20));
+  ASSERT_TRUE(loop->Run());
+
+  EXPECT_TRUE(sender.failed());
+  EXPECT_EQ(3u, sender.error_replies());
+  EXPECT_EQ(0u, axefx.presets_received());
+}
+
+// Passes the first |count| messages on to |midi_out| and then fails, like a
+// device that has been unplugged.
+class FailingMidiOut : public MidiOut {
+ public:
+  FailingMidiOut(MidiOut* midi_out, size_t count)
+      : MidiOut(midi_out->device()), midi_out_(midi_out), count_(count) {}
+  virtual ~FailingMidiOut() {}
+
+  virtual bool Send(unique_ptr<Message> message,
+                    const std::function<void()>& on_complete) {
+    if (!count_)
+      return false;
+    --count_;
+    return midi_out_->Send(std::move(message), on_complete);
+  }
+
+ private:
+  MidiOut* midi_out_;
+  size_t count_;
+};
+
+void SetResultAndQuit(bool* result, const SharedThreadLoop& loop,
+                      bool succeeded) {
+  *result = succeeded;
+  loop->Quit();
+}
+
+TEST(MessageSender, FailsWhenSendFails) {
+  SimulatedAxeFx axefx(FastOptions());
+
+  SharedThreadLoop loop(new ThreadLoop());
+  shared_ptr<MidiIn> midi_in(axefx.OpenMidiIn(loop));
+  unique_ptr<MidiOut> midi_out(axefx.OpenMidiOut());
+  FailingMidiOut failing(midi_out.get(), 100u);
+  MessageSender sender(&failing, midi_in, loop, MessageSender::Options());
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/9b_A.syx", &buffer, &file_size));
+  axefx::SysExParser parser;
+  ASSERT_TRUE(parser.ParseSysExBuffer(buffer.get(), buffer.get() + file_size,
+                                      false));
+  ASSERT_TRUE(parser.Serialize(std::bind(&MessageSender::Add, &sender, _1)));
+  bool succeeded = true;
+  sender.Start(nullptr, std::bind(&SetResultAndQuit, &succeeded, loop, _1));
+  loop->set_timeout(std::chrono::seconds(20));
+  ASSERT_TRUE(loop->Run());
+
+  EXPECT_FALSE(succeeded);
+  EXPECT_TRUE(sender.failed());
+  EXPECT_LE(sender.messages_sent(), 100u);
+  EXPECT_LT(axefx.presets_received(), 128u);
+}
+
+TEST(MessageSender, DeletedWhileSending) {
+  // At MIDI speed, messages are still in flight when the sender goes away.
+  SimulatedAxeFx::Options options(FastOptions());
+  options.bytes_per_second = SimulatedAxeFx::kMidiBytesPerSecond;
+  // Tempo messages would keep the loop from timing out.
+  options.tempo_interval = std::chrono::milliseconds(0);
+  SimulatedAxeFx axefx(options);
+
+  SharedThreadLoop loop(new ThreadLoop());
+  shared_ptr<MidiIn> midi_in(axefx.OpenMidiIn(loop));
+  unique_ptr<MidiOut> midi_out(axefx.OpenMidiOut());
+  unique_ptr<MessageSender> sender(new MessageSender(
+      midi_out.get(), midi_in, loop, MessageSender::Options()));
+  std::vector<uint8_t> message(300u, 0x00);
+  message.front() = axefx::kSysExStart;
+  message.back() = axefx::kSysExEnd;
+  for (int i = 0; i < 8; ++i)
+    sender->Add(message);
+  sender->Start(nullptr, nullptr);
+  loop->set_timeout(std::chrono::milliseconds(20));
+  EXPECT_FALSE(loop->Run());
+  sender.reset();
+
+  // The completions that come in now are dropped.
+  loop->set_timeout(std::chrono::milliseconds(500));
+  EXPECT_FALSE(loop->Run());
+}
+
+TEST(MessageSender, NoReplies) {
+  SimulatedAxeFx receiver(FastOptions());
+  // Nothing is sent to this one, so it only sends tempo messages.
+  SimulatedAxeFx silent(FastOptions());
+
+  SharedThreadLoop loop(new ThreadLoop());
+  shared_ptr<MidiIn> midi_in(silent.OpenMidiIn(loop));
+  unique_ptr<MidiOut> midi_out(receiver.OpenMidiOut());
+  MessageSender::Options sender_options;
+  sender_options.reply_timeout = std::chrono::milliseconds(50);
+  MessageSender sender(midi_out.get(), midi_in, loop, sender_options);
+  SendBankA(&sender, loop);
+
+  EXPECT_FALSE(sender.waiting_for_reply());
+  EXPECT_EQ(128u, receiver.presets_received());
+}
+
+#if defined(OS_LINUX)
+// The Linux implementation works on any file descriptor, so these tests use
+// pipes to run it without a device attached.
+
+void AppendAndQuitWhenDone(Message* msg, std::vector<uint8_t>* received,
+                           size_t expected_size, SharedThreadLoop loop) {
+  received->insert(received->end(), msg->begin(), msg->end());
+  if (received->size() >= expected_size)
+    loop->Quit();
+}
+
+TEST(MidiLinux, ReceiveSysExFromPipe) {
+  std::unique_ptr<uint8_t[]> buffer;
+  int file_size;
+  ASSERT_TRUE(ReadTestFileIntoBuffer("axefx2/9b_A.syx", &buffer, &file_size));
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  SharedThreadLoop loop(new ThreadLoop());
+  loop->set_timeout(std::chrono::milliseconds(5000));
+  shared_ptr<MidiDeviceInfo> info(new MidiDeviceInfo(0, "pipe"));
+  shared_ptr<MidiIn> in(CreateMidiInForFd(fds[0], info, loop));
+  ASSERT_TRUE(in.get() != NULL);
+
+  std::vector<uint8_t> received;
+  SysExDataBuffer sysex(std::bind(&AppendAndQuitWhenDone, _1, &received,
+                                  static_cast<size_t>(file_size), loop));
+  ScopedBufferAttach attach(in, &sysex);
+
+  // Larger than what fits in the pipe and in the read buffers, so the
+  // reader has to recycle its buffers while the writer is blocked.
+  std::thread writer([&]() {
+    const uint8_t* pos = buffer.get();
+    const uint8_t* end = pos + file_size;
+    while (pos < end) {
+      ssize_t written = write(fds[1], pos, std::min<ptrdiff_t>(777, end - pos));
+      if (written <= 0)
+        break;
+      pos += written;
+    }
+  });
+
+  EXPECT_TRUE(loop->Run());
+  writer.join();
+  close(fds[1]);
+
+  ASSERT_EQ(static_cast<size_t>(file_size), received.size());
+  EXPECT_EQ(0, memcmp(buffer.get(), &received[0], file_size));
+}
+
+TEST(MidiLinux, SendToPipe) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  shared_ptr<MidiDeviceInfo> info(new MidiDeviceInfo(0, "pipe"));
+  unique_ptr<MidiOut> out(CreateMidiOutForFd(fds[1], info));
+  ASSERT_TRUE(out.get() != NULL);
+
+  SharedThreadLoop loop(new ThreadLoop());
+  loop->set_timeout(std::chrono::milliseconds(5000));
+  std::vector<int> completed;
+  const int kMessageCount = 3;
+  for (int i = 0; i < kMessageCount; ++i) {
+    unique_ptr<Message> message(new ProgramChange(0, 0, i));
+    // Completion is signaled on the writer thread.
+    EXPECT_TRUE(out->Send(std::move(message), [&completed, i, loop]() {
+      loop->QueueTask([&completed, i, loop]() {
+        completed.push_back(i);
+        if (completed.size() == kMessageCount)
+          loop->Quit();
+      });
+    }));
+  }
+
+  EXPECT_TRUE(loop->Run());
+  ASSERT_EQ(kMessageCount, static_cast<int>(completed.size()));
+  for (int i = 0; i < kMessageCount; ++i)
+    EXPECT_EQ(i, completed[i]);
+
+  uint8_t data[5 * kMessageCount];
+  size_t size = 0;
+  while (size < sizeof(data)) {
+    ssize_t bytes = read(fds[0], data + size, sizeof(data) - size);
+    ASSERT_LT(0, bytes);
+    size += bytes;
+  }
+  for (int i = 0; i < kMessageCount; ++i) {
+    ProgramChange expected(0, 0, i);
+    EXPECT_EQ(0, memcmp(&expected[0], &data[i * 5], 5));
+  }
+
+  out.reset();
+  close(fds[0]);
+}
+
+TEST(MidiLinux, SendFailsWhenDeviceIsGone) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  shared_ptr<MidiDeviceInfo> info(new MidiDeviceInfo(0, "pipe"));
+  // Writing to the read end fails with EBADF, as if the device was gone.
+  unique_ptr<MidiOut> out(CreateMidiOutForFd(fds[0], info));
+  ASSERT_TRUE(out.get() != NULL);
+
+  std::atomic<int> completed(0);
+  auto on_complete = [&completed]() { ++completed; };
+  EXPECT_TRUE(out->Send(unique_ptr<Message>(new ProgramChange(0, 0, 1)),
+                        on_complete));
+
+  // Once the writer has given up, Send() fails right away.
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  bool sent = true;
+  while (sent && std::chrono::steady_clock::now() < deadline) {
+    sent = out->Send(unique_ptr<Message>(new ProgramChange(0, 0, 2)),
+                     on_complete);
+    if (sent)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_FALSE(sent);
+
+  out.reset();
+  EXPECT_EQ(0, completed.load());
+  close(fds[1]);
+}
+#endif  // OS_LINUX
+
 }  // namespace midi
@@ -0,0 +1,68 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "gtest/gtest.h"
+
+#include "common/small_task.h"
+
+#include <functional>
+#include <memory>
+
+namespace base {
+
+TEST(SmallTask, Empty) {
+  SmallTask task;
+  EXPECT_TRUE(task.empty());
+  task.Reset();
+  EXPECT_TRUE(task.empty());
+}
+
+TEST(SmallTask, Inline) {
+  int calls = 0;
+  std::shared_ptr<int> shared(new int(1));
+  std::weak_ptr<int> weak(shared);
+  SmallTask task([&calls, shared, weak]() { calls += *shared; });
+  EXPECT_FALSE(task.empty());
+  EXPECT_EQ(2, shared.use_count());
+
+  task();
+  EXPECT_EQ(1, calls);
+
+  // Moving relocates the closure.
+  SmallTask moved(std::move(task));
+  EXPECT_TRUE(task.empty());
+  EXPECT_EQ(2, shared.use_count());
+  moved();
+  EXPECT_EQ(2, calls);
+
+  moved.Reset();
+  EXPECT_EQ(1, shared.use_count());
+}
+
+TEST(SmallTask, StdFunction) {
+  int calls = 0;
+  std::function<void()> function([&calls]() { ++calls; });
+  SmallTask task(function);
+  task();
+  EXPECT_EQ(1, calls);
+}
+
+TEST(SmallTask, Large) {
+  // Too big to be stored inline.
+  struct {
+    char data[SmallTask::kInlineSize * 2];
+  } large = {};
+  large.data[sizeof(large.data) - 1] = 42;
+  std::shared_ptr<int> shared(new int(0));
+  SmallTask task([large, shared]() {
+    *shared = large.data[sizeof(large.data) - 1];
+  });
+  SmallTask moved;
+  moved = std::move(task);
+  moved();
+  EXPECT_EQ(42, *shared);
+  moved.Reset();
+  EXPECT_EQ(1, shared.use_count());
+}
+
+}  // namespace base
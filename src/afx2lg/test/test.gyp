@@ -25,12 +25,18 @@
       ],
       'sources': [
         'axefx_test.cc',
+        'byte_ring_test.cc',
+        'histogram_test.cc',
+        'json_reader_test.cc',
+        'json_writer_test.cc',
         'lg_test.cc',
         'main.cc',
         'midi_test.cc',
+        'small_task_test.cc',
         'test_utils.cc',
         'test_utils.h',
         'thread_loop_test.cc',
+        'thread_pool_test.cc',
       ],
     },
   ],
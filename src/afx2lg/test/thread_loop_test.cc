@@ -5,10 +5,139 @@
 
 #include "common/thread_loop.h"
 
+#include "common/histogram.h"
+
+#include <atomic>
+#include <iostream>
+#include <queue>
+#include <vector>
+
 namespace base {
 namespace {
 template<typename T>
 void Assign(T* t, const T& val) { *t = val; }
+
+// The previous ThreadLoop implementation, a std::queue under a mutex, to
+// compare with.
+class MutexThreadLoop {
+ public:
+  typedef std::function<void()> Task;
+
+  MutexThreadLoop() : is_running_(false) {}
+
+  bool Run() {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      is_running_ = true;
+    }
+    Task task;
+    while (PopTask(&task)) {
+      task();
+      std::lock_guard<std::mutex> lock(lock_);
+      if (!is_running_)
+        return true;
+    }
+    return false;
+  }
+
+  void Quit() {
+    QueueTask([this]() {
+      std::lock_guard<std::mutex> lock(lock_);
+      is_running_ = false;
+    });
+  }
+
+  void QueueTask(const Task& task) {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      queue_.push(task);
+    }
+    signal_.notify_one();
+  }
+
+ private:
+  bool PopTask(Task* task) {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (queue_.empty()) {
+      if (signal_.wait_for(lock, std::chrono::seconds(10)) ==
+          std::cv_status::timeout) {
+        return false;
+      }
+    }
+    *task = std::move(queue_.front());
+    queue_.pop();
+    return true;
+  }
+
+  std::condition_variable signal_;
+  std::mutex lock_;
+  std::queue<Task> queue_;
+  bool is_running_;
+};
+
+// Each task queues the next one, until |count| tasks have run.
+template<typename Loop>
+void QueueChain(Loop* loop, const std::shared_ptr<size_t>& done,
+                size_t count) {
+  if (++(*done) == count) {
+    loop->Quit();
+  } else {
+    loop->QueueTask([loop, done, count]() { QueueChain(loop, done, count); });
+  }
+}
+
+// Runs |count| tasks that capture a shared_ptr, like most tasks in the midi
+// code do, and returns nanoseconds per task.  The tasks are queued from
+// |threads| threads while the loop runs them, or by the tasks themselves
+// if |threads| is 0.
+template<typename Loop>
+double MeasureThroughput(size_t threads, size_t count) {
+  if (!threads) {
+    Loop loop;
+    std::shared_ptr<size_t> done(new size_t(0u));
+    auto start = std::chrono::steady_clock::now();
+    loop.QueueTask([&loop, done, count]() { QueueChain(&loop, done, count); });
+    EXPECT_TRUE(loop.Run());
+    EXPECT_EQ(count, *done);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count() /
+        static_cast<double>(count);
+  }
+
+  Loop loop;
+  std::shared_ptr<std::atomic<size_t> > done(new std::atomic<size_t>(0u));
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> producers;
+  for (size_t i = 0; i < threads; ++i) {
+    producers.push_back(std::thread([&loop, done, threads, count]() {
+      for (size_t j = 0; j < count / threads; ++j) {
+        loop.QueueTask([&loop, done, count]() {
+          if (++(*done) == count)
+            loop.Quit();
+        });
+      }
+    }));
+  }
+  EXPECT_TRUE(loop.Run());
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  for (auto& producer : producers)
+    producer.join();
+  EXPECT_EQ(count, done->load());
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      elapsed).count() / static_cast<double>(count);
+}
+
+void CompareThroughput(size_t threads) {
+  const size_t kTasks = 200000;
+  double mutex_loop = MeasureThroughput<MutexThreadLoop>(threads, kTasks);
+  double loop = MeasureThroughput<ThreadLoop>(threads, kTasks);
+  if (threads) {
+    std::cout << threads << " producer thread(s): ";
+  } else {
+    std::cout << "Queued by tasks: ";
+  }
+  std::cout << loop << "ns per task, was " << mutex_loop << "ns\n";
+}
 }  // namespace
 
 TEST(ThreadLoop, Simple) {
@@ -45,4 +174,135 @@ TEST(ThreadLoop, QueueTaskFromTask) {
   EXPECT_TRUE(loop.Run());
 }
 
+TEST(ThreadLoop, Order) {
+  // More tasks than fit in the ring, so that some go to the overflow list.
+  const int kThreads = 4;
+  const int kTasks = 5000;
+  ThreadLoop loop;
+  std::vector<int> last(kThreads, -1);
+  bool in_order = true;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.push_back(std::thread([&, i]() {
+      for (int j = 0; j < kTasks; ++j) {
+        loop.QueueTask([&, i, j]() {
+          in_order &= last[i] == j - 1;
+          last[i] = j;
+        });
+      }
+    }));
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_FALSE(loop.empty());
+  loop.Quit();
+  EXPECT_TRUE(loop.Run());
+
+  EXPECT_TRUE(in_order);
+  for (int i = 0; i < kThreads; ++i)
+    EXPECT_EQ(kTasks - 1, last[i]);
+  EXPECT_TRUE(loop.empty());
+}
+
+TEST(ThreadLoop, QueueWhileRunning) {
+  const int kTasks = 10000;
+  ThreadLoop loop;
+  int count = 0;
+  std::thread producer([&]() {
+    for (int i = 0; i < kTasks; ++i)
+      loop.QueueTask([&]() { ++count; });
+    loop.Quit();
+  });
+  EXPECT_TRUE(loop.Run());
+  producer.join();
+  EXPECT_EQ(kTasks, count);
+}
+
+TEST(ThreadLoop, Throughput) {
+  CompareThroughput(0);
+  CompareThroughput(1);
+  CompareThroughput(4);
+}
+
+TEST(ThreadLoop, QueueDelay) {
+  Histogram histogram;
+  ThreadLoop loop;
+  loop.set_queue_delay(&histogram);
+  loop.QueueTask([]() {});
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  loop.Quit();
+  EXPECT_TRUE(loop.Run());
+  loop.set_queue_delay(nullptr);
+
+  ASSERT_EQ(2u, histogram.count());
+  EXPECT_GE(histogram.max(), std::chrono::milliseconds(10));
+}
+
+TEST(ThreadLoop, DelayedTask) {
+  ThreadLoop loop;
+  std::vector<int> order;
+  auto start = std::chrono::steady_clock::now();
+  loop.QueueDelayedTask(std::chrono::milliseconds(30), [&]() {
+    order.push_back(3);
+    loop.Quit();
+  });
+  loop.QueueDelayedTask(std::chrono::milliseconds(20),
+                        [&]() { order.push_back(2); });
+  loop.QueueDelayedTask(std::chrono::milliseconds(10),
+                        [&]() { order.push_back(0); });
+  loop.QueueDelayedTask(std::chrono::milliseconds(10),
+                        [&]() { order.push_back(1); });
+  EXPECT_TRUE(loop.Run());
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(30));
+  EXPECT_EQ(std::vector<int>({ 0, 1, 2, 3 }), order);
+}
+
+TEST(ThreadLoop, CancelTask) {
+  ThreadLoop loop;
+  bool canceled_ran = false;
+  ThreadLoop::TimerId canceled = loop.QueueDelayedTask(
+      std::chrono::milliseconds(10), [&]() { canceled_ran = true; });
+  ThreadLoop::TimerId quit = loop.QueueDelayedTask(
+      std::chrono::milliseconds(20), [&]() { loop.Quit(); });
+  EXPECT_NE(canceled, quit);
+  EXPECT_TRUE(loop.CancelTask(canceled));
+  EXPECT_FALSE(loop.CancelTask(canceled));
+  EXPECT_TRUE(loop.Run());
+  EXPECT_FALSE(canceled_ran);
+  // Already run.
+  EXPECT_FALSE(loop.CancelTask(quit));
+}
+
+TEST(ThreadLoop, DelayedTaskFromThread) {
+  // The worker is waiting when the task is queued and has to wake up
+  // earlier than it planned to.
+  ThreadLoop loop;
+  loop.set_timeout(std::chrono::seconds(10));
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    loop.QueueDelayedTask(std::chrono::milliseconds(10),
+                          [&]() { loop.Quit(); });
+  });
+  EXPECT_TRUE(loop.Run());
+  producer.join();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+  EXPECT_LT(elapsed, std::chrono::seconds(5));
+}
+
+TEST(ThreadLoop, TimeoutWithDelayedTask) {
+  // A task that isn't due yet doesn't keep the loop from timing out.
+  ThreadLoop loop;
+  loop.set_timeout(std::chrono::milliseconds(10));
+  bool task_ran = false;
+  loop.QueueDelayedTask(std::chrono::seconds(10),
+                        [&]() { task_ran = true; });
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(loop.Run());
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+  EXPECT_FALSE(task_ran);
+}
+
 }  // namespace base
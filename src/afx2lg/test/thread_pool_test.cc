@@ -0,0 +1,129 @@
+// Copyright (c) 2013, Tomas Gunnarsson
+// All rights reserved.
+
+#include "gtest/gtest.h"
+
+#include "common/thread_pool.h"
+
+#include <atomic>
+#include <vector>
+
+namespace base {
+
+TEST(ThreadPool, PostTask) {
+  ThreadPool pool(2);
+  EXPECT_EQ(2u, pool.size());
+  std::atomic<int> count(0);
+  {
+    TaskGroup group(&pool);
+    for (int i = 0; i < 100; ++i)
+      group.Run([&count]() { ++count; });
+  }
+  EXPECT_EQ(100, count);
+}
+
+TEST(ThreadPool, RunsQueuedTasksBeforeQuitting) {
+  std::atomic<int> count(0);
+  {
+    ThreadPool pool(1);
+    for (int i = 0; i < 100; ++i)
+      pool.PostTask([&count]() { ++count; });
+  }
+  EXPECT_EQ(100, count);
+}
+
+TEST(ThreadPool, ParallelFor) {
+  const size_t kCount = 10000;
+  ThreadPool pool(4);
+  std::vector<int> visits(kCount, 0);
+  ParallelFor(&pool, 0u, kCount, 16u, [&](size_t i) { ++visits[i]; });
+  EXPECT_EQ(std::vector<int>(kCount, 1), visits);
+
+  // Without a pool, everything runs on the calling thread.
+  std::thread::id caller = std::this_thread::get_id();
+  bool on_caller = true;
+  ParallelFor(nullptr, 0u, 100u, 1u, [&](size_t i) {
+    on_caller &= std::this_thread::get_id() == caller;
+  });
+  EXPECT_TRUE(on_caller);
+}
+
+TEST(ThreadPool, NestedParallelFor) {
+  // More nested waits than workers.  The waiting threads run the inner
+  // loops themselves.
+  ThreadPool pool(2);
+  std::atomic<int> count(0);
+  ParallelFor(&pool, 0u, 8u, 1u, [&](size_t) {
+    ParallelFor(&pool, 0u, 100u, 1u, [&](size_t) { ++count; });
+  });
+  EXPECT_EQ(800, count);
+}
+
+TEST(ThreadPool, PostTaskAndReply) {
+  ThreadPool pool(2);
+  SharedThreadLoop loop(new ThreadLoop());
+  loop->set_timeout(std::chrono::seconds(10));
+  std::thread::id loop_thread = std::this_thread::get_id();
+  std::thread::id task_thread;
+  std::thread::id reply_thread;
+  pool.PostTaskAndReply(
+      [&]() { task_thread = std::this_thread::get_id(); },
+      loop,
+      [&]() {
+        reply_thread = std::this_thread::get_id();
+        loop->Quit();
+      });
+  EXPECT_TRUE(loop->Run());
+  EXPECT_NE(loop_thread, task_thread);
+  EXPECT_EQ(loop_thread, reply_thread);
+}
+
+TEST(TaskGraph, Dependencies) {
+  ThreadPool pool(4);
+  // a -> (b, c) -> d
+  std::atomic<int> step(0);
+  int a = -1, b = -1, c = -1, d = -1;
+  TaskGraph graph(&pool);
+  TaskGraph::Node node_a = graph.Add([&]() { a = step++; });
+  TaskGraph::Node node_b = graph.Add([&]() { b = step++; }, { node_a });
+  TaskGraph::Node node_c = graph.Add([&]() { c = step++; }, { node_a });
+  graph.Add([&]() { d = step++; }, { node_b, node_c });
+  graph.Run();
+  EXPECT_EQ(0, a);
+  EXPECT_GT(b, a);
+  EXPECT_GT(c, a);
+  EXPECT_EQ(3, d);
+}
+
+TEST(TaskGraph, RunWithoutPool) {
+  std::vector<int> order;
+  TaskGraph graph(nullptr);
+  TaskGraph::Node first = graph.Add([&]() { order.push_back(0); });
+  graph.Add([&]() { order.push_back(1); }, { first });
+  graph.Run();
+  EXPECT_EQ(std::vector<int>({ 0, 1 }), order);
+}
+
+TEST(TaskGraph, ReplyOnLoop) {
+  ThreadPool pool(2);
+  SharedThreadLoop loop(new ThreadLoop());
+  loop->set_timeout(std::chrono::seconds(10));
+  std::atomic<int> count(0);
+  TaskGraph graph(&pool);
+  TaskGraph::Node first = graph.Add([&]() { ++count; });
+  for (int i = 0; i < 10; ++i)
+    graph.Add([&]() { ++count; }, { first });
+  int count_when_done = 0;
+  std::thread::id loop_thread = std::this_thread::get_id();
+  std::thread::id done_thread;
+  graph.Run(loop, [&]() {
+    count_when_done = count;
+    done_thread = std::this_thread::get_id();
+    loop->Quit();
+  });
+  EXPECT_TRUE(loop->Run());
+  EXPECT_EQ(11, count_when_done);
+  EXPECT_EQ(loop_thread, done_thread);
+}
+
+}  // namespace base